@@ -0,0 +1,39 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "base/crc32.h"
+
+#include <array>
+
+namespace base {
+namespace {
+
+constexpr std::uint32_t k_polynomial = 0xedb88320;
+
+constexpr std::array<std::uint32_t, 256> make_crc_table() {
+    std::array<std::uint32_t, 256> table{};
+    for (std::uint32_t i = 0; i < table.size(); ++i) {
+        std::uint32_t crc = i;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc & 1) != 0 ? (crc >> 1) ^ k_polynomial : crc >> 1;
+        }
+        table[i] = crc;
+    }
+    return table;
+}
+
+constexpr auto k_crc_table = make_crc_table();
+
+} // namespace
+
+std::uint32_t crc32(const void* data, std::size_t len, std::uint32_t crc) noexcept {
+    const auto* bytes = static_cast<const std::uint8_t*>(data);
+    crc = ~crc;
+    for (std::size_t i = 0; i < len; ++i) {
+        crc = k_crc_table[(crc ^ bytes[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+} // namespace base
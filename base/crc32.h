@@ -0,0 +1,26 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#pragma once
+
+#ifndef BASE_CRC32_H_
+#define BASE_CRC32_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace base {
+
+// CRC-32 (IEEE 802.3) as used by zlib and gzip, to detect torn or corrupted records.
+// `crc` is the value of preceding data when computed incrementally.
+std::uint32_t crc32(const void* data, std::size_t len, std::uint32_t crc = 0) noexcept;
+
+inline std::uint32_t crc32(std::string_view data, std::uint32_t crc = 0) noexcept {
+    return crc32(data.data(), data.size(), crc);
+}
+
+} // namespace base
+
+#endif // BASE_CRC32_H_
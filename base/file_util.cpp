@@ -4,9 +4,224 @@
 
 #include "base/file_util.h"
 
+#include <atomic>
+#include <condition_variable>
 #include <fstream>
+#include <mutex>
+#include <string>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "esl/scope_guard.h"
+#include "esl/unique_handle.h"
+
+#include "base/thread_pool.h"
 
 namespace base {
+namespace {
+
+[[noreturn]] void throw_fs_error(const char* what, const std::filesystem::path& path) {
+    throw std::filesystem::filesystem_error(what, path,
+                                            std::error_code(errno, std::system_category()));
+}
+
+// Returns false if copy_file_range(2) is not usable between the files, and nothing was copied.
+bool copy_in_kernel(int src_fd, int dst_fd, std::size_t size, const std::filesystem::path& dst) {
+    std::size_t copied = 0;
+    while (copied < size) {
+        auto n = ::copy_file_range(src_fd, nullptr, dst_fd, nullptr, size - copied, 0);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (copied == 0 && (errno == ENOSYS || errno == EXDEV || errno == EINVAL ||
+                                errno == EOPNOTSUPP)) {
+                return false;
+            }
+            throw_fs_error("cannot copy file data", dst);
+        }
+        if (n == 0) {
+            // File shrunk in the meantime.
+            break;
+        }
+        copied += static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+void copy_with_sendfile(int src_fd, int dst_fd, std::size_t size, const std::filesystem::path& dst) {
+    std::size_t copied = 0;
+    while (copied < size) {
+        auto n = ::sendfile(dst_fd, src_fd, nullptr, size - copied);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n == -1) {
+            throw_fs_error("cannot copy file data", dst);
+        }
+        if (n == 0) {
+            break;
+        }
+        copied += static_cast<std::size_t>(n);
+    }
+}
+
+constexpr std::uint64_t k_sector_size = 512;
+
+// nftw(3) passes no user data to callbacks.
+thread_local std::uint64_t removed_bytes = 0;
+
+int remove_entry(const char* path, const struct stat* st, int /*type_flag*/, struct FTW* /*ftw*/) {
+    if (::remove(path) != 0) {
+        return -1;
+    }
+
+    // Links visited before have been removed, thus the last one sees the count dropped to 1.
+    if (S_ISDIR(st->st_mode) || st->st_nlink == 1) {
+        removed_bytes += static_cast<std::uint64_t>(st->st_blocks) * k_sector_size;
+    }
+
+    return 0;
+}
+
+// Directories are listed concurrently, each in a task of its own; files are unlinked by the task
+// listing them, and a directory is removed by whichever task finishes its last pending child.
+class parallel_tree_remover {
+public:
+    explicit parallel_tree_remover(thread_pool& pool)
+        : pool_(pool) {}
+
+    std::uint64_t run(const std::filesystem::path& root) {
+        auto* node = new dir_node{root.native(), nullptr};
+        remove_dir(node);
+
+        std::unique_lock lock(mtx_);
+        done_cv_.wait(lock, [this] { return done_; });
+        if (error_) {
+            throw std::filesystem::filesystem_error("cannot remove tree", error_path_, error_);
+        }
+        return freed_.load();
+    }
+
+private:
+    struct dir_node {
+        std::string path;
+        dir_node* parent;
+        // Subdirectories being removed, plus one for listing the directory itself.
+        std::atomic<std::size_t> pending{1};
+        std::uint64_t blocks{0};
+    };
+
+    void record_error(int err, const std::string& path) {
+        std::lock_guard lock(mtx_);
+        if (!error_) {
+            error_ = std::error_code(err, std::system_category());
+            error_path_ = path;
+        }
+    }
+
+    void remove_dir(dir_node* node) noexcept {
+        int fd = ::open(node->path.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        DIR* dir = fd == -1 ? nullptr : ::fdopendir(fd);
+        if (dir == nullptr) {
+            record_error(errno, node->path);
+            if (fd != -1) {
+                ::close(fd);
+            }
+            finish(node);
+            return;
+        }
+
+        struct stat st {};
+        if (::fstat(fd, &st) == 0) {
+            node->blocks = static_cast<std::uint64_t>(st.st_blocks);
+        }
+
+        while (auto* ent = ::readdir(dir)) {
+            std::string_view name(ent->d_name);
+            if (name == "." || name == "..") {
+                continue;
+            }
+
+            if (::fstatat(fd, ent->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+                record_error(errno, node->path + "/" + ent->d_name);
+                continue;
+            }
+
+            if (S_ISDIR(st.st_mode)) {
+                spawn_child(node, node->path + "/" + ent->d_name);
+                continue;
+            }
+
+            if (::unlinkat(fd, ent->d_name, 0) != 0) {
+                record_error(errno, node->path + "/" + ent->d_name);
+                continue;
+            }
+
+            // Counted as not freed if linked elsewhere, which is racy against links being
+            // removed concurrently, thus may undercount.
+            if (st.st_nlink == 1) {
+                freed_.fetch_add(static_cast<std::uint64_t>(st.st_blocks) * k_sector_size);
+            }
+        }
+
+        ::closedir(dir);
+        finish(node);
+    }
+
+    void spawn_child(dir_node* node, std::string path) noexcept {
+        dir_node* child = nullptr;
+        try {
+            child = new dir_node{std::move(path), node};
+            node->pending.fetch_add(1);
+            pool_.submit([this, child] { remove_dir(child); });
+        } catch (const std::exception&) {
+            // Failure of submit leaves the child to be removed by the caller.
+            if (child != nullptr) {
+                remove_dir(child);
+            } else {
+                record_error(ENOMEM, node->path);
+            }
+        }
+    }
+
+    // Removes the directory once nothing in it is pending, and so forth for its parents.
+    void finish(dir_node* node) noexcept {
+        while (node != nullptr && node->pending.fetch_sub(1) == 1) {
+            if (::rmdir(node->path.c_str()) != 0) {
+                record_error(errno, node->path);
+            } else {
+                freed_.fetch_add(node->blocks * k_sector_size);
+            }
+
+            auto* parent = node->parent;
+            delete node;
+            node = parent;
+            if (node == nullptr) {
+                std::lock_guard lock(mtx_);
+                done_ = true;
+                done_cv_.notify_one();
+            }
+        }
+    }
+
+    thread_pool& pool_;
+    std::atomic<std::uint64_t> freed_{0};
+    std::mutex mtx_;
+    std::condition_variable done_cv_;
+    bool done_{false};
+    std::error_code error_;
+    std::string error_path_;
+};
+
+} // namespace
 
 void write_to_file(const std::filesystem::path& filepath, std::string_view data) {
     std::ofstream out(filepath);
@@ -42,4 +257,81 @@ std::string read_file_to_string(const std::filesystem::path& filepath) {
     }
 }
 
+bool clone_file(const std::filesystem::path& src, const std::filesystem::path& dst) {
+    esl::unique_fd src_fd(::open(src.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW));
+    if (!src_fd) {
+        throw_fs_error("cannot open file to clone", src);
+    }
+
+    struct stat st {};
+    if (::fstat(src_fd.get(), &st) != 0) {
+        throw_fs_error("cannot stat file to clone", src);
+    }
+
+    constexpr mode_t perm_mask = 07777;
+    esl::unique_fd dst_fd(::open(dst.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+                                 st.st_mode & perm_mask));
+    if (!dst_fd) {
+        throw_fs_error("cannot create file to clone into", dst);
+    }
+
+    ESL_ON_SCOPE_FAIL {
+        ::unlink(dst.c_str());
+    };
+
+    // open(2) applies umask.
+    if (::fchmod(dst_fd.get(), st.st_mode & perm_mask) != 0) {
+        throw_fs_error("cannot set file permission", dst);
+    }
+
+    if (::ioctl(dst_fd.get(), FICLONE, src_fd.get()) == 0) {
+        return true;
+    }
+
+    auto size = static_cast<std::size_t>(st.st_size);
+    if (!copy_in_kernel(src_fd.get(), dst_fd.get(), size, dst)) {
+        copy_with_sendfile(src_fd.get(), dst_fd.get(), size, dst);
+    }
+
+    return false;
+}
+
+std::uint64_t remove_tree(const std::filesystem::path& path) {
+    // Max number of directory fds held open during the walk.
+    constexpr int max_open_fds = 64;
+    removed_bytes = 0;
+    if (::nftw(path.c_str(), remove_entry, max_open_fds, FTW_DEPTH | FTW_PHYS) != 0) {
+        auto err = errno;
+        if (err == ENOENT && !std::filesystem::exists(std::filesystem::symlink_status(path))) {
+            return 0;
+        }
+        throw std::filesystem::filesystem_error("cannot remove tree", path,
+                                                std::error_code(err, std::system_category()));
+    }
+    return removed_bytes;
+}
+
+std::uint64_t remove_tree(const std::filesystem::path& path, thread_pool& pool) {
+    struct stat st {};
+    if (::lstat(path.c_str(), &st) != 0) {
+        if (errno == ENOENT) {
+            return 0;
+        }
+        throw_fs_error("cannot stat tree to remove", path);
+    }
+
+    if (!S_ISDIR(st.st_mode)) {
+        return remove_tree(path);
+    }
+
+    return parallel_tree_remover(pool).run(path);
+}
+
+void sync_filesystem(const std::filesystem::path& path) {
+    esl::unique_fd fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (!fd || ::syncfs(fd.get()) != 0) {
+        throw_fs_error("cannot sync filesystem", path);
+    }
+}
+
 } // namespace base
@@ -7,17 +7,44 @@
 #ifndef BASE_FILE_UTIL_H_
 #define BASE_FILE_UTIL_H_
 
+#include <cstdint>
 #include <filesystem>
 #include <string_view>
 
 namespace base {
 
+class thread_pool;
+
 // Throws `std::filesystem::filesystem_error` when failed.
 void write_to_file(const std::filesystem::path& filepath, std::string_view data);
 
 // Throws `std::filesystem::filesystem_error` when failed.
 std::string read_file_to_string(const std::filesystem::path& filepath);
 
+// Creates `dst` with content and permission bits of regular file `src`; `dst` must not exist.
+// Data is shared with FICLONE on filesystems supporting reflinks, e.g. btrfs and XFS, otherwise
+// copied in kernel with copy_file_range(2).
+// Returns true if reflinked.
+// Throws `std::filesystem::filesystem_error` when failed.
+bool clone_file(const std::filesystem::path& src, const std::filesystem::path& dst);
+
+// Removes `path` and, if it is a directory, all its contents, without following symlinks.
+// Returns disk space freed in bytes, counting files having links outside of `path` as not freed;
+// returns 0 if `path` doesn't exist.
+// Throws `std::filesystem::filesystem_error` when failed.
+std::uint64_t remove_tree(const std::filesystem::path& path);
+
+// Same as above, while directories are removed concurrently on `pool`, which pays off for large
+// trees as unlinking is bound by metadata latency rather than bandwidth.
+// Must not be called from a task of `pool`.
+// Throws `std::filesystem::filesystem_error` when failed.
+std::uint64_t remove_tree(const std::filesystem::path& path, thread_pool& pool);
+
+// Flushes the whole filesystem containing `path` once, which is much cheaper than fsync-ing
+// every file written into it.
+// Throws `std::filesystem::filesystem_error` when failed.
+void sync_filesystem(const std::filesystem::path& path);
+
 } // namespace base
 
 #endif // BASE_FILE_UTIL_H_
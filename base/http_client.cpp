@@ -0,0 +1,387 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "base/http_client.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstddef>
+#include <cstring>
+#include <system_error>
+#include <vector>
+
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "esl/unique_handle.h"
+#include "fmt/format.h"
+
+namespace base {
+namespace {
+
+constexpr std::size_t k_recv_buf_size = 256 * 1024;
+constexpr std::size_t k_max_header_size = 64 * 1024;
+constexpr std::size_t k_max_error_body_size = 64 * 1024;
+constexpr int k_max_redirects = 5;
+constexpr int k_io_timeout_sec = 60;
+
+std::string to_lower(std::string_view str) {
+    std::string out(str);
+    std::transform(out.begin(), out.end(), out.begin(), [](unsigned char ch) {
+        return static_cast<char>(std::tolower(ch));
+    });
+    return out;
+}
+
+std::string_view trim(std::string_view str) {
+    while (!str.empty() && (str.front() == ' ' || str.front() == '\t')) {
+        str.remove_prefix(1);
+    }
+    while (!str.empty() && (str.back() == ' ' || str.back() == '\t' || str.back() == '\r')) {
+        str.remove_suffix(1);
+    }
+    return str;
+}
+
+esl::unique_fd connect_to(const http_url& url) {
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* result = nullptr;
+    if (int rc = ::getaddrinfo(url.host.c_str(), url.port.c_str(), &hints, &result); rc != 0) {
+        throw http_error(fmt::format("cannot resolve {}: {}", url.host, ::gai_strerror(rc)));
+    }
+
+    int last_errno = 0;
+    esl::unique_fd sock;
+    for (auto ai = result; ai != nullptr; ai = ai->ai_next) {
+        esl::unique_fd fd(::socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol));
+        if (!fd) {
+            last_errno = errno;
+            continue;
+        }
+
+        timeval tv{k_io_timeout_sec, 0};
+        ::setsockopt(fd.get(), SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        ::setsockopt(fd.get(), SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+        int rc = 0;
+        do {
+            rc = ::connect(fd.get(), ai->ai_addr, ai->ai_addrlen);
+        } while (rc == -1 && errno == EINTR);
+
+        if (rc == 0) {
+            sock = std::move(fd);
+            break;
+        }
+        last_errno = errno;
+    }
+    ::freeaddrinfo(result);
+
+    if (!sock) {
+        throw std::system_error(last_errno, std::system_category(),
+                                "cannot connect to " + url.authority());
+    }
+
+    return sock;
+}
+
+void send_all(int fd, std::string_view data) {
+    while (!data.empty()) {
+        auto sent = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+        if (sent == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::system_error(errno, std::system_category(), "failed to send request");
+        }
+        data.remove_prefix(static_cast<std::size_t>(sent));
+    }
+}
+
+// Buffered reader over a connected socket.
+class conn_reader {
+public:
+    explicit conn_reader(int fd)
+        : fd_(fd),
+          buf_(k_recv_buf_size) {}
+
+    // Returns false if peer closed the connection.
+    bool fill() {
+        if (begin_ == end_) {
+            begin_ = end_ = 0;
+        }
+
+        if (end_ == buf_.size()) {
+            std::memmove(buf_.data(), buf_.data() + begin_, end_ - begin_);
+            end_ -= begin_;
+            begin_ = 0;
+        }
+
+        ssize_t n = 0;
+        do {
+            n = ::recv(fd_, buf_.data() + end_, buf_.size() - end_, 0);
+        } while (n == -1 && errno == EINTR);
+
+        if (n == -1) {
+            throw std::system_error(errno, std::system_category(), "failed to receive response");
+        }
+
+        end_ += static_cast<std::size_t>(n);
+        return n > 0;
+    }
+
+    // Reads a line ending with CRLF and returns it without the line break.
+    std::string read_line() {
+        while (true) {
+            std::string_view avail(buf_.data() + begin_, end_ - begin_);
+            if (auto pos = avail.find("\r\n"); pos != std::string_view::npos) {
+                std::string line(avail.substr(0, pos));
+                begin_ += pos + 2;
+                return line;
+            }
+
+            if (avail.size() > k_max_header_size) {
+                throw http_error("response line is too long");
+            }
+
+            if (!fill()) {
+                throw http_error("connection closed before receiving a line");
+            }
+        }
+    }
+
+    // Calls `consume` for `length` bytes of body.
+    template<typename Consumer>
+    void read_exact(std::size_t length, Consumer&& consume) {
+        while (length > 0) {
+            if (begin_ == end_ && !fill()) {
+                throw http_error("connection closed before body completes");
+            }
+            auto n = std::min(length, end_ - begin_);
+            consume(std::string_view(buf_.data() + begin_, n));
+            begin_ += n;
+            length -= n;
+        }
+    }
+
+    template<typename Consumer>
+    void read_until_eof(Consumer&& consume) {
+        do {
+            if (begin_ != end_) {
+                consume(std::string_view(buf_.data() + begin_, end_ - begin_));
+                begin_ = end_;
+            }
+        } while (fill());
+    }
+
+private:
+    int fd_;
+    std::vector<char> buf_;
+    std::size_t begin_{0};
+    std::size_t end_{0};
+};
+
+std::size_t parse_size(std::string_view str, int base) {
+    std::size_t value = 0;
+    str = trim(str);
+    auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), value, base);
+    if (ec != std::errc{} || ptr == str.data()) {
+        throw http_error(fmt::format("invalid size value: {}", str));
+    }
+    return value;
+}
+
+template<typename Consumer>
+void read_chunked_body(conn_reader& reader, Consumer&& consume) {
+    constexpr int hex_base = 16;
+    while (true) {
+        auto size_line = reader.read_line();
+        // Ignore chunk extensions.
+        auto chunk_size = parse_size(std::string_view(size_line).substr(0, size_line.find(';')),
+                                     hex_base);
+        if (chunk_size == 0) {
+            // Skip trailers.
+            while (!reader.read_line().empty()) {}
+            return;
+        }
+
+        reader.read_exact(chunk_size, consume);
+        if (!reader.read_line().empty()) {
+            throw http_error("malformed chunk terminator");
+        }
+    }
+}
+
+http_response parse_response_head(conn_reader& reader) {
+    http_response resp;
+
+    // HTTP/1.1 200 OK
+    auto status_line = reader.read_line();
+    auto sp = status_line.find(' ');
+    if (status_line.compare(0, 5, "HTTP/") != 0 || sp == std::string::npos) {
+        throw http_error("malformed status line: " + status_line);
+    }
+    constexpr int dec_base = 10;
+    resp.status = static_cast<int>(
+            parse_size(std::string_view(status_line).substr(sp + 1, 3), dec_base));
+
+    std::size_t head_size = status_line.size();
+    for (auto line = reader.read_line(); !line.empty(); line = reader.read_line()) {
+        head_size += line.size();
+        if (head_size > k_max_header_size) {
+            throw http_error("response headers too large");
+        }
+
+        auto colon = line.find(':');
+        if (colon == std::string::npos) {
+            throw http_error("malformed header line: " + line);
+        }
+        std::string_view view(line);
+        resp.headers.emplace_back(to_lower(view.substr(0, colon)),
+                                  std::string(trim(view.substr(colon + 1))));
+    }
+
+    return resp;
+}
+
+std::string resolve_location(const http_url& base_url, const std::string& location) {
+    if (location.compare(0, 1, "/") == 0) {
+        return fmt::format("http://{}{}", base_url.authority(), location);
+    }
+    return location;
+}
+
+std::string build_request(const http_url& url, const http_headers& headers) {
+    auto req = fmt::format("GET {} HTTP/1.1\r\n"
+                           "Host: {}\r\n"
+                           "User-Agent: lumper\r\n"
+                           "Connection: close\r\n",
+                           url.target, url.authority());
+    for (const auto& [name, value] : headers) {
+        req.append(name).append(": ").append(value).append("\r\n");
+    }
+    req.append("\r\n");
+    return req;
+}
+
+bool is_redirect(int status) {
+    return status == 301 || status == 302 || status == 303 || status == 307 || status == 308;
+}
+
+} // namespace
+
+// static
+http_url http_url::parse(std::string_view url) {
+    constexpr std::string_view scheme = "http://";
+    if (url.substr(0, scheme.size()) != scheme) {
+        throw std::invalid_argument(fmt::format("unsupported url scheme: {}", url));
+    }
+    url.remove_prefix(scheme.size());
+
+    auto slash = url.find('/');
+    auto authority = url.substr(0, slash);
+    if (authority.empty()) {
+        throw std::invalid_argument("url has no host");
+    }
+
+    http_url result;
+    result.target = slash == std::string_view::npos ? "/" : std::string(url.substr(slash));
+
+    // IPv6 literal looks like [::1]:5000.
+    auto host_end = authority.front() == '[' ? authority.find(']') + 1 : 0;
+    auto colon = authority.find(':', host_end);
+    if (colon == std::string_view::npos) {
+        result.host = std::string(authority);
+        result.port = "80";
+    } else {
+        result.host = std::string(authority.substr(0, colon));
+        result.port = std::string(authority.substr(colon + 1));
+    }
+
+    if (result.host.size() > 2 && result.host.front() == '[') {
+        result.host = result.host.substr(1, result.host.size() - 2);
+    }
+
+    if (result.host.empty() || result.port.empty()) {
+        throw std::invalid_argument(fmt::format("malformed url authority: {}", authority));
+    }
+
+    return result;
+}
+
+std::string http_url::authority() const {
+    auto h = host.find(':') == std::string::npos ? host : "[" + host + "]";
+    return port == "80" ? h : h + ":" + port;
+}
+
+std::string http_url::to_string() const {
+    return fmt::format("http://{}{}", authority(), target);
+}
+
+const std::string* http_response::find_header(std::string_view name) const {
+    auto it = std::find_if(headers.begin(), headers.end(), [name](const auto& header) {
+        return header.first == name;
+    });
+    return it == headers.end() ? nullptr : &it->second;
+}
+
+http_response http_get(std::string_view url, const http_headers& headers,
+                       const http_body_sink& sink) {
+    std::string current_url(url);
+    for (int redirects = 0; redirects <= k_max_redirects; ++redirects) {
+        auto parsed = http_url::parse(current_url);
+        auto sock = connect_to(parsed);
+        send_all(sock.get(), build_request(parsed, headers));
+
+        conn_reader reader(sock.get());
+        auto resp = parse_response_head(reader);
+        while (resp.status == 100) {
+            resp = parse_response_head(reader);
+        }
+
+        if (is_redirect(resp.status)) {
+            const auto* location = resp.find_header("location");
+            if (!location) {
+                throw http_error("redirect without location");
+            }
+            current_url = resolve_location(parsed, *location);
+            continue;
+        }
+
+        bool stream = sink && resp.ok();
+        auto consume = [&](std::string_view chunk) {
+            if (stream) {
+                sink(resp, chunk);
+            } else if (resp.body.size() < k_max_error_body_size || resp.ok()) {
+                resp.body.append(chunk);
+            }
+        };
+
+        if (resp.status == 204 || resp.status == 304) {
+            return resp;
+        }
+
+        const auto* te = resp.find_header("transfer-encoding");
+        const auto* cl = resp.find_header("content-length");
+        if (te && to_lower(*te).find("chunked") != std::string::npos) {
+            read_chunked_body(reader, consume);
+        } else if (cl) {
+            constexpr int dec_base = 10;
+            reader.read_exact(parse_size(*cl, dec_base), consume);
+        } else {
+            reader.read_until_eof(consume);
+        }
+
+        return resp;
+    }
+
+    throw http_error(fmt::format("too many redirects for {}", url));
+}
+
+} // namespace base
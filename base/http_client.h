@@ -0,0 +1,75 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#pragma once
+
+#ifndef BASE_HTTP_CLIENT_H_
+#define BASE_HTTP_CLIENT_H_
+
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace base {
+
+class http_error : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+struct http_url {
+    std::string host;
+    std::string port;
+    // Path with query, always starts with '/'.
+    std::string target;
+
+    // Only plain `http://` is supported.
+    // Throws `std::invalid_argument` for malformed or unsupported urls.
+    static http_url parse(std::string_view url);
+
+    // Returns `host[:port]` suitable for the Host header.
+    std::string authority() const;
+
+    std::string to_string() const;
+};
+
+using http_headers = std::vector<std::pair<std::string, std::string>>;
+
+struct http_response {
+    int status{0};
+    // Header names are lower-cased.
+    http_headers headers;
+    // Filled only if the body was not streamed to a sink.
+    std::string body;
+
+    // Returns nullptr if no such header.
+    const std::string* find_header(std::string_view name) const;
+
+    bool ok() const noexcept {
+        return status >= 200 && status < 300;
+    }
+};
+
+// Receives body chunks of a successful (2xx) response in order, along with the response head,
+// so that e.g. a 206 can be told from a 200 before consuming the first chunk.
+// Throwing from the sink aborts the transfer and the exception propagates to the caller.
+using http_body_sink = std::function<void(const http_response& head, std::string_view chunk)>;
+
+// Sends a GET request with one connection per request, and follows redirects.
+// If `sink` is given, body of a 2xx response is streamed into it instead of being buffered,
+// which keeps memory flat for large blobs; bodies of other responses are always buffered.
+// Throws:
+//  - `std::invalid_argument` for malformed url.
+//  - `std::system_error` for socket failures.
+//  - `http_error` for malformed responses or too many redirects.
+http_response http_get(std::string_view url,
+                       const http_headers& headers,
+                       const http_body_sink& sink = {});
+
+} // namespace base
+
+#endif // BASE_HTTP_CLIENT_H_
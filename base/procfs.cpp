@@ -0,0 +1,401 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "base/procfs.h"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <system_error>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "fmt/format.h"
+
+namespace base {
+namespace {
+
+constexpr std::string_view k_spaces = " \t\n";
+
+[[noreturn]] void throw_malformed(const char* path) {
+    throw std::system_error(std::make_error_code(std::errc::illegal_byte_sequence),
+                            fmt::format("malformed {}", path));
+}
+
+ssize_t read_eintr(int fd, char* buf, std::size_t size) noexcept {
+    ssize_t len = 0;
+    do {
+        len = ::read(fd, buf, size);
+    } while (len == -1 && errno == EINTR);
+    return len;
+}
+
+// Returns the next space-separated field of `sv`, and removes it along with spaces following;
+// empty at the end.
+std::string_view next_field(std::string_view& sv) noexcept {
+    auto begin = sv.find_first_not_of(k_spaces);
+    if (begin == std::string_view::npos) {
+        sv = {};
+        return {};
+    }
+    auto end = sv.find_first_of(k_spaces, begin);
+    auto field = sv.substr(begin, end == std::string_view::npos ? std::string_view::npos
+                                                                 : end - begin);
+    sv.remove_prefix(end == std::string_view::npos ? sv.size() : end);
+    return field;
+}
+
+template<typename T>
+bool parse_int(std::string_view sv, T& value) noexcept {
+    auto [ptr, ec] = std::from_chars(sv.data(), sv.data() + sv.size(), value);
+    return ec == std::errc{} && ptr == sv.data() + sv.size();
+}
+
+} // namespace
+
+namespace detail {
+
+bool parse_u64(std::string_view sv, std::uint64_t& value) noexcept {
+    return std::from_chars(sv.data(), sv.data() + sv.size(), value).ec == std::errc{};
+}
+
+} // namespace detail
+
+std::string_view read_proc_file(const char* path, char* buf, std::size_t size) {
+    esl::unique_fd fd(::open(path, O_RDONLY | O_CLOEXEC));
+    if (!fd) {
+        throw std::system_error(errno, std::system_category(),
+                                fmt::format("failed to open {}", path));
+    }
+
+    // Pseudo files may be generated in pieces, thus read till the end.
+    std::size_t len = 0;
+    for (;;) {
+        if (len == size) {
+            // One more byte tells a file filling the buffer exactly.
+            char extra = 0;
+            auto rv = read_eintr(fd.get(), &extra, 1);
+            if (rv == 0) {
+                break;
+            }
+            throw std::system_error(
+                    rv < 0 ? std::error_code(errno, std::system_category())
+                           : std::make_error_code(std::errc::value_too_large),
+                    fmt::format("failed to read {}", path));
+        }
+
+        auto rv = read_eintr(fd.get(), buf + len, size - len);
+        if (rv < 0) {
+            throw std::system_error(errno, std::system_category(),
+                                    fmt::format("failed to read {}", path));
+        }
+        if (rv == 0) {
+            break;
+        }
+        len += static_cast<std::size_t>(rv);
+    }
+
+    return {buf, len};
+}
+
+line_reader::line_reader(const char* path)
+    : fd_(::open(path, O_RDONLY | O_CLOEXEC)),
+      path_(path) {
+    if (!fd_) {
+        throw std::system_error(errno, std::system_category(),
+                                fmt::format("failed to open {}", path));
+    }
+}
+
+bool line_reader::fill() {
+    if (eof_) {
+        return false;
+    }
+
+    // Moves the partial line to the front, thus the rest of the buffer takes the remaining.
+    if (begin_ > 0) {
+        std::memmove(buf_, buf_ + begin_, end_ - begin_);
+        end_ -= begin_;
+        begin_ = 0;
+    }
+
+    auto rv = read_eintr(fd_.get(), buf_ + end_, sizeof(buf_) - end_);
+    if (rv < 0) {
+        throw std::system_error(errno, std::system_category(),
+                                fmt::format("failed to read {}", path_));
+    }
+    if (rv == 0) {
+        eof_ = true;
+        return false;
+    }
+    end_ += static_cast<std::size_t>(rv);
+    return true;
+}
+
+bool line_reader::next(std::string_view& line) {
+    bool skipping = false;
+    for (;;) {
+        std::string_view pending(buf_ + begin_, end_ - begin_);
+        if (auto eol = pending.find('\n'); eol != std::string_view::npos) {
+            begin_ += eol + 1;
+            if (skipping) {
+                skipping = false;
+                continue;
+            }
+            line = pending.substr(0, eol);
+            return true;
+        }
+
+        // A line filling the buffer is dropped until its end is found.
+        if (begin_ == 0 && end_ == sizeof(buf_)) {
+            skipping = true;
+            begin_ = end_ = 0;
+        }
+
+        if (!fill()) {
+            // The last line may have no newline.
+            if (begin_ == end_ || skipping) {
+                return false;
+            }
+            line = std::string_view(buf_ + begin_, end_ - begin_);
+            begin_ = end_;
+            return true;
+        }
+    }
+}
+
+std::optional<mountinfo_entry> parse_mountinfo_line(std::string_view line) noexcept {
+    // mount-id parent-id major:minor root mount-point options [optional...] - type source super
+    mountinfo_entry entry;
+    std::array<std::string_view, 6> fields;
+    for (auto& field : fields) {
+        field = next_field(line);
+    }
+    if (fields[5].empty()) {
+        return std::nullopt;
+    }
+    entry.root = fields[3];
+    entry.mount_point = fields[4];
+
+    // Optional fields end with a separator.
+    for (auto field = next_field(line);; field = next_field(line)) {
+        if (field.empty()) {
+            return std::nullopt;
+        }
+        if (field == "-") {
+            break;
+        }
+    }
+
+    entry.fs_type = next_field(line);
+    entry.source = next_field(line);
+    entry.super_options = next_field(line);
+    if (entry.super_options.empty()) {
+        return std::nullopt;
+    }
+    return entry;
+}
+
+memory_stat parse_memory_stat(std::string_view content) noexcept {
+    memory_stat stat;
+    parse_flat_keyed_file(content, [&stat](std::string_view key, std::uint64_t value) {
+        if (key == "anon" || key == "rss") {
+            stat.anon = value;
+        } else if (key == "file" || key == "cache") {
+            stat.file = value;
+        } else if (key == "shmem") {
+            stat.shmem = value;
+        } else if (key == "pgfault") {
+            stat.pgfault = value;
+        } else if (key == "pgmajfault") {
+            stat.pgmajfault = value;
+        }
+    });
+    return stat;
+}
+
+cpu_stat parse_cpu_stat(std::string_view content) noexcept {
+    constexpr std::uint64_t k_ns_per_us = 1000;
+    cpu_stat stat;
+    parse_flat_keyed_file(content, [&stat](std::string_view key, std::uint64_t value) {
+        if (key == "usage_usec") {
+            stat.usage_usec = value;
+        } else if (key == "user_usec") {
+            stat.user_usec = value;
+        } else if (key == "system_usec") {
+            stat.system_usec = value;
+        } else if (key == "nr_periods") {
+            stat.nr_periods = value;
+        } else if (key == "nr_throttled") {
+            stat.nr_throttled = value;
+        } else if (key == "throttled_usec") {
+            stat.throttled_usec = value;
+        } else if (key == "throttled_time") {
+            stat.throttled_usec = value / k_ns_per_us;
+        }
+    });
+    return stat;
+}
+
+std::optional<io_stat> parse_io_stat_line(std::string_view line) noexcept {
+    io_stat stat;
+    auto dev = next_field(line);
+    auto colon = dev.find(':');
+    if (colon == std::string_view::npos || !parse_int(dev.substr(0, colon), stat.major) ||
+        !parse_int(dev.substr(colon + 1), stat.minor)) {
+        return std::nullopt;
+    }
+
+    for (auto field = next_field(line); !field.empty(); field = next_field(line)) {
+        auto eq = field.find('=');
+        std::uint64_t value = 0;
+        if (eq == std::string_view::npos || !parse_int(field.substr(eq + 1), value)) {
+            return std::nullopt;
+        }
+        auto key = field.substr(0, eq);
+        if (key == "rbytes") {
+            stat.rbytes = value;
+        } else if (key == "wbytes") {
+            stat.wbytes = value;
+        } else if (key == "rios") {
+            stat.rios = value;
+        } else if (key == "wios") {
+            stat.wios = value;
+        } else if (key == "dbytes") {
+            stat.dbytes = value;
+        } else if (key == "dios") {
+            stat.dios = value;
+        }
+    }
+    return stat;
+}
+
+io_stat parse_io_stat(std::string_view content) noexcept {
+    io_stat total;
+    while (!content.empty()) {
+        auto eol = content.find('\n');
+        auto line = content.substr(0, eol);
+        content.remove_prefix(eol == std::string_view::npos ? content.size() : eol + 1);
+        if (auto stat = parse_io_stat_line(line); stat) {
+            total.rbytes += stat->rbytes;
+            total.wbytes += stat->wbytes;
+            total.rios += stat->rios;
+            total.wios += stat->wios;
+            total.dbytes += stat->dbytes;
+            total.dios += stat->dios;
+        }
+    }
+    return total;
+}
+
+std::optional<process_stat> parse_process_stat(std::string_view content) noexcept {
+    // comm may contain spaces and parentheses, thus fields are located after the last ')'.
+    auto comm_end = content.rfind(')');
+    if (comm_end == std::string_view::npos) {
+        return std::nullopt;
+    }
+    content.remove_prefix(comm_end + 1);
+
+    // Fields are numbered from 1 as in proc(5), state being the 3rd and rss the 24th.
+    constexpr std::size_t k_first_field = 3;
+    constexpr std::size_t k_last_field = 24;
+    std::array<std::string_view, k_last_field + 1> fields;
+    for (auto i = k_first_field; i <= k_last_field; ++i) {
+        fields[i] = next_field(content);
+        if (fields[i].empty()) {
+            return std::nullopt;
+        }
+    }
+
+    process_stat stat{};
+    if (fields[3].size() != 1) {
+        return std::nullopt;
+    }
+    stat.state = fields[3].front();
+    if (!parse_int(fields[4], stat.ppid) || !parse_int(fields[14], stat.utime) ||
+        !parse_int(fields[15], stat.stime) || !parse_int(fields[20], stat.num_threads) ||
+        !parse_int(fields[22], stat.start_time) || !parse_int(fields[23], stat.vsize) ||
+        !parse_int(fields[24], stat.rss)) {
+        return std::nullopt;
+    }
+    return stat;
+}
+
+std::optional<process_stat> read_process_stat(pid_t pid) {
+    // Enough for all fields, whose count and width are bounded.
+    constexpr std::size_t k_buf_size = 1024;
+    char path[32];
+    *fmt::format_to_n(path, sizeof(path) - 1, "/proc/{}/stat", pid).out = '\0';
+
+    esl::unique_fd fd(::open(path, O_RDONLY | O_CLOEXEC));
+    if (!fd) {
+        if (errno == ENOENT || errno == ESRCH) {
+            return std::nullopt;
+        }
+        throw std::system_error(errno, std::system_category(),
+                                fmt::format("failed to open {}", path));
+    }
+
+    char buf[k_buf_size];
+    auto len = read_eintr(fd.get(), buf, sizeof(buf));
+    if (len < 0) {
+        // The process has exited after opened.
+        if (errno == ESRCH) {
+            return std::nullopt;
+        }
+        throw std::system_error(errno, std::system_category(),
+                                fmt::format("failed to read {}", path));
+    }
+
+    auto stat = parse_process_stat({buf, static_cast<std::size_t>(len)});
+    if (!stat) {
+        throw_malformed(path);
+    }
+    return stat;
+}
+
+// static
+const mount_table& mount_table::get() {
+    static mount_table table("/proc/self/mountinfo");
+    return table;
+}
+
+mount_table::mount_table(const char* mountinfo_path) {
+    line_reader reader(mountinfo_path);
+    for (std::string_view line; reader.next(line);) {
+        if (auto entry = parse_mountinfo_line(line); entry) {
+            mounts_.push_back({std::string(entry->mount_point), std::string(entry->fs_type),
+                               std::string(entry->super_options)});
+        }
+    }
+}
+
+std::string_view mount_table::find_cgroup_mount_point(std::string_view subsystem) const noexcept {
+    for (const auto& m : mounts_) {
+        if (m.fs_type != "cgroup") {
+            continue;
+        }
+        // Subsystems are among super options, e.g. rw,cpu,cpuacct.
+        std::string_view options(m.super_options);
+        while (!options.empty()) {
+            auto comma = options.find(',');
+            if (options.substr(0, comma) == subsystem) {
+                return m.mount_point;
+            }
+            options.remove_prefix(comma == std::string_view::npos ? options.size() : comma + 1);
+        }
+    }
+    return {};
+}
+
+std::string_view mount_table::find_cgroup2_mount_point() const noexcept {
+    auto it = std::find_if(mounts_.begin(), mounts_.end(),
+                           [](const mount& m) { return m.fs_type == "cgroup2"; });
+    return it == mounts_.end() ? std::string_view{} : std::string_view(it->mount_point);
+}
+
+} // namespace base
@@ -0,0 +1,201 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#pragma once
+
+#ifndef BASE_PROCFS_H_
+#define BASE_PROCFS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "esl/unique_handle.h"
+
+// Parsers of procfs and cgroupfs files, which read through fixed buffers and return views or
+// plain structs, thus allocate nothing; they are called on every poll of stats.
+
+namespace base {
+
+// Reads the whole file into `buf`, as pseudo files of procfs and cgroupfs are small and generated
+// on each read; returns the content, which refers to `buf`.
+// Throws `std::system_error` when failed, or with `std::errc::value_too_large` if the file
+// doesn't fit.
+std::string_view read_proc_file(const char* path, char* buf, std::size_t size);
+
+// Reads a file line by line through a fixed buffer, e.g. mountinfo, which is too large to be read
+// at once on hosts with many mounts.
+class line_reader {
+public:
+    static constexpr std::size_t k_buf_size = 16 * 1024;
+
+    // Throws `std::system_error` when failed to open the file.
+    explicit line_reader(const char* path);
+
+    line_reader(const line_reader&) = delete;
+
+    line_reader& operator=(const line_reader&) = delete;
+
+    // Returns false at the end of the file. Lines longer than the buffer are skipped, e.g.
+    // overlay mounts with lots of layers in options.
+    // `line` refers to the buffer, thus is valid until the next call.
+    // Throws `std::system_error` when failed to read.
+    bool next(std::string_view& line);
+
+private:
+    // Returns false at the end of the file.
+    bool fill();
+
+    esl::unique_fd fd_;
+    const char* path_;
+    std::size_t begin_{0};
+    std::size_t end_{0};
+    bool eof_{false};
+    char buf_[k_buf_size];
+};
+
+// A line of /proc/<pid>/mountinfo, see proc(5); octal escapes, e.g. \040 for spaces, are kept.
+struct mountinfo_entry {
+    std::string_view root;
+    std::string_view mount_point;
+    std::string_view fs_type;
+    std::string_view source;
+    std::string_view super_options;
+};
+
+// Returns `std::nullopt` if `line` is malformed. Fields refer to `line`.
+std::optional<mountinfo_entry> parse_mountinfo_line(std::string_view line) noexcept;
+
+// Calls `fn(key, value)` for each line of `key value`, as in `memory.stat`, `cpu.stat` and
+// `memory.events`; lines whose value is not a number are skipped.
+template<typename Fn>
+void parse_flat_keyed_file(std::string_view content, Fn&& fn);
+
+// Bytes of v1, i.e. rss and cache, and v2, i.e. anon and file, are reported alike.
+struct memory_stat {
+    std::uint64_t anon{0};
+    std::uint64_t file{0};
+    std::uint64_t shmem{0};
+    std::uint64_t pgfault{0};
+    std::uint64_t pgmajfault{0};
+};
+
+memory_stat parse_memory_stat(std::string_view content) noexcept;
+
+// Usages are v2 only, and throttled time of v1 in nanoseconds is converted.
+struct cpu_stat {
+    std::uint64_t usage_usec{0};
+    std::uint64_t user_usec{0};
+    std::uint64_t system_usec{0};
+    std::uint64_t nr_periods{0};
+    std::uint64_t nr_throttled{0};
+    std::uint64_t throttled_usec{0};
+};
+
+cpu_stat parse_cpu_stat(std::string_view content) noexcept;
+
+// A line of `io.stat` of v2, e.g. `8:16 rbytes=1459200 wbytes=314773504 rios=192 wios=353`.
+struct io_stat {
+    unsigned int major{0};
+    unsigned int minor{0};
+    std::uint64_t rbytes{0};
+    std::uint64_t wbytes{0};
+    std::uint64_t rios{0};
+    std::uint64_t wios{0};
+    std::uint64_t dbytes{0};
+    std::uint64_t dios{0};
+};
+
+// Returns `std::nullopt` if `line` is malformed; unknown keys are skipped.
+std::optional<io_stat> parse_io_stat_line(std::string_view line) noexcept;
+
+// Sums stats of all devices, whose major and minor are left 0.
+io_stat parse_io_stat(std::string_view content) noexcept;
+
+// Fields of /proc/<pid>/stat.
+struct process_stat {
+    // One of "RSDZTtWXxKWP", see proc(5).
+    char state;
+    pid_t ppid;
+    // Times in user and kernel mode, in clock ticks.
+    std::uint64_t utime;
+    std::uint64_t stime;
+    std::int64_t num_threads;
+    // Time the process started after boot, in clock ticks; together with pid it identifies a
+    // process, as pids are recycled.
+    std::uint64_t start_time;
+    std::uint64_t vsize;
+    // In pages.
+    std::int64_t rss;
+};
+
+// Returns `std::nullopt` if `content` is malformed.
+std::optional<process_stat> parse_process_stat(std::string_view content) noexcept;
+
+// Returns `std::nullopt` if the process doesn't exist.
+// Throws `std::system_error` when failed to read.
+std::optional<process_stat> read_process_stat(pid_t pid);
+
+// Mounts of the process, parsed once; later mounts are not seen, which suits looking up
+// hierarchies mounted at boot, e.g. of cgroups.
+class mount_table {
+public:
+    struct mount {
+        std::string mount_point;
+        std::string fs_type;
+        std::string super_options;
+    };
+
+    // The table of /proc/self/mountinfo, parsed on the first call.
+    // Throws `std::system_error` when failed.
+    static const mount_table& get();
+
+    // Throws `std::system_error` when failed.
+    explicit mount_table(const char* mountinfo_path);
+
+    const std::vector<mount>& mounts() const noexcept {
+        return mounts_;
+    }
+
+    // Returns the mount point of the cgroup v1 hierarchy `subsystem` is bound to, or empty if
+    // not found.
+    std::string_view find_cgroup_mount_point(std::string_view subsystem) const noexcept;
+
+    // Returns the mount point of cgroup2, or empty if not mounted.
+    std::string_view find_cgroup2_mount_point() const noexcept;
+
+private:
+    std::vector<mount> mounts_;
+};
+
+namespace detail {
+
+// Returns false if `sv` doesn't begin with a decimal number.
+bool parse_u64(std::string_view sv, std::uint64_t& value) noexcept;
+
+} // namespace detail
+
+template<typename Fn>
+void parse_flat_keyed_file(std::string_view content, Fn&& fn) {
+    while (!content.empty()) {
+        auto eol = content.find('\n');
+        auto line = content.substr(0, eol);
+        content.remove_prefix(eol == std::string_view::npos ? content.size() : eol + 1);
+
+        auto sep = line.find(' ');
+        std::uint64_t value = 0;
+        if (sep != std::string_view::npos && detail::parse_u64(line.substr(sep + 1), value)) {
+            fn(line.substr(0, sep), value);
+        }
+    }
+}
+
+} // namespace base
+
+#endif // BASE_PROCFS_H_
@@ -0,0 +1,344 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "base/sha256.h"
+
+#include <algorithm>
+#include <cstring>
+#include <future>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+#include "esl/scope_guard.h"
+#include "esl/unique_handle.h"
+
+#include "base/thread_pool.h"
+
+namespace base {
+namespace {
+
+// Mapped file is hashed window by window, with readahead of the next window issued ahead.
+constexpr std::size_t k_map_window_size = 8 * 1024 * 1024;
+
+constexpr std::array<std::uint32_t, 8> k_initial_state{
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+alignas(16) constexpr std::uint32_t k_round_constants[64]{
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4,
+        0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe,
+        0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f,
+        0x4a7484aa, 0x5cb0a9dc, 0x76f988da, 0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+        0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc,
+        0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+        0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070, 0x19a4c116,
+        0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7,
+        0xc67178f2};
+
+constexpr std::uint32_t rotr(std::uint32_t x, int n) noexcept {
+    return (x >> n) | (x << (32 - n));
+}
+
+inline std::uint32_t load_be32(const std::uint8_t* p) noexcept {
+    return (std::uint32_t{p[0]} << 24) | (std::uint32_t{p[1]} << 16) |
+           (std::uint32_t{p[2]} << 8) | std::uint32_t{p[3]};
+}
+
+void compress_portable(std::uint32_t* state, const std::uint8_t* blocks, std::size_t num_blocks) {
+    std::uint32_t w[64];
+    for (std::size_t blk = 0; blk < num_blocks; ++blk, blocks += sha256::k_block_size) {
+        for (int i = 0; i < 16; ++i) {
+            w[i] = load_be32(blocks + 4 * i);
+        }
+        for (int i = 16; i < 64; ++i) {
+            auto s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            auto s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        auto a = state[0];
+        auto b = state[1];
+        auto c = state[2];
+        auto d = state[3];
+        auto e = state[4];
+        auto f = state[5];
+        auto g = state[6];
+        auto h = state[7];
+        for (int i = 0; i < 64; ++i) {
+            auto s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+            auto ch = (e & f) ^ (~e & g);
+            auto t1 = h + s1 + ch + k_round_constants[i] + w[i];
+            auto s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+            auto maj = (a & b) ^ (a & c) ^ (b & c);
+            auto t2 = s0 + maj;
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+}
+
+#if defined(__x86_64__)
+
+// Requires SHA, SSSE3 and SSE4.1; the instructions are enabled for this function only, so the
+// rest of the program still runs on CPUs without them.
+// Each iteration of the round loop performs 4 rounds with message words `msg[i % 4]`, while
+// computing message schedule for the following rounds.
+// NOLINTBEGIN(cppcoreguidelines-pro-type-reinterpret-cast)
+__attribute__((target("sha,ssse3,sse4.1"))) void compress_shani(std::uint32_t* state,
+                                                                const std::uint8_t* blocks,
+                                                                std::size_t num_blocks) {
+    const __m128i byteswap_mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    // Rearrange state into ABEF/CDGH, the layout sha256rnds2 works on.
+    auto tmp = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[0]));
+    auto state1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[4]));
+    tmp = _mm_shuffle_epi32(tmp, 0xb1);
+    state1 = _mm_shuffle_epi32(state1, 0x1b);
+    auto state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xf0);
+
+    for (std::size_t blk = 0; blk < num_blocks; ++blk, blocks += sha256::k_block_size) {
+        auto abef_save = state0;
+        auto cdgh_save = state1;
+        __m128i msg[4];
+
+#pragma GCC unroll 16
+        for (int i = 0; i < 16; ++i) {
+            auto& cur = msg[i % 4];
+            if (i < 4) {
+                cur = _mm_loadu_si128(reinterpret_cast<const __m128i*>(blocks + 16 * i));
+                cur = _mm_shuffle_epi8(cur, byteswap_mask);
+            }
+
+            auto wk = _mm_add_epi32(
+                    cur, _mm_load_si128(reinterpret_cast<const __m128i*>(&k_round_constants[4 * i])));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, wk);
+
+            if (i >= 3 && i <= 14) {
+                auto& next = msg[(i + 1) % 4];
+                next = _mm_add_epi32(next, _mm_alignr_epi8(cur, msg[(i + 3) % 4], 4));
+                next = _mm_sha256msg2_epu32(next, cur);
+            }
+
+            wk = _mm_shuffle_epi32(wk, 0x0e);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, wk);
+
+            if (i >= 1 && i <= 12) {
+                auto& prev = msg[(i + 3) % 4];
+                prev = _mm_sha256msg1_epu32(prev, cur);
+            }
+        }
+
+        state0 = _mm_add_epi32(state0, abef_save);
+        state1 = _mm_add_epi32(state1, cdgh_save);
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1b);
+    state1 = _mm_shuffle_epi32(state1, 0xb1);
+    state0 = _mm_blend_epi16(tmp, state1, 0xf0);
+    state1 = _mm_alignr_epi8(state1, tmp, 8);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[0]), state0);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[4]), state1);
+}
+// NOLINTEND(cppcoreguidelines-pro-type-reinterpret-cast)
+
+bool cpu_has_sha_extensions() noexcept {
+    unsigned int eax = 0;
+    unsigned int ebx = 0;
+    unsigned int ecx = 0;
+    unsigned int edx = 0;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_SSSE3) || !(ecx & bit_SSE4_1)) {
+        return false;
+    }
+
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        return false;
+    }
+
+    constexpr unsigned int bit_sha = 1U << 29;
+    return (ebx & bit_sha) != 0;
+}
+
+#endif
+
+sha256::compress_fn best_compress_fn() noexcept {
+#if defined(__x86_64__)
+    static const sha256::compress_fn fn =
+            cpu_has_sha_extensions() ? &compress_shani : &compress_portable;
+    return fn;
+#else
+    return &compress_portable;
+#endif
+}
+
+[[noreturn]] void throw_fs_error(const char* what, const std::filesystem::path& path) {
+    throw std::filesystem::filesystem_error(what, path,
+                                            std::error_code(errno, std::system_category()));
+}
+
+} // namespace
+
+sha256::sha256(engine eng) noexcept
+    : compress_(eng == engine::best ? best_compress_fn() : &compress_portable),
+      state_(k_initial_state) {}
+
+void sha256::update(const void* data, std::size_t len) noexcept {
+    const auto* p = static_cast<const std::uint8_t*>(data);
+    total_len_ += len;
+
+    if (buf_len_ > 0) {
+        auto n = std::min(len, k_block_size - buf_len_);
+        std::memcpy(buf_.data() + buf_len_, p, n);
+        buf_len_ += n;
+        p += n;
+        len -= n;
+        if (buf_len_ < k_block_size) {
+            return;
+        }
+        compress_(state_.data(), buf_.data(), 1);
+        buf_len_ = 0;
+    }
+
+    // Compress whole blocks directly from the input.
+    if (auto num_blocks = len / k_block_size; num_blocks > 0) {
+        compress_(state_.data(), p, num_blocks);
+        p += num_blocks * k_block_size;
+        len -= num_blocks * k_block_size;
+    }
+
+    std::memcpy(buf_.data(), p, len);
+    buf_len_ = len;
+}
+
+sha256::digest sha256::finalize() noexcept {
+    auto bit_len = total_len_ * 8;
+
+    buf_[buf_len_++] = 0x80;
+    if (buf_len_ > k_block_size - 8) {
+        std::memset(buf_.data() + buf_len_, 0, k_block_size - buf_len_);
+        compress_(state_.data(), buf_.data(), 1);
+        buf_len_ = 0;
+    }
+
+    std::memset(buf_.data() + buf_len_, 0, k_block_size - 8 - buf_len_);
+    for (int i = 0; i < 8; ++i) {
+        buf_[k_block_size - 1 - i] = static_cast<std::uint8_t>(bit_len >> (8 * i));
+    }
+    compress_(state_.data(), buf_.data(), 1);
+
+    digest result;
+    for (std::size_t i = 0; i < state_.size(); ++i) {
+        result[4 * i] = static_cast<std::uint8_t>(state_[i] >> 24);
+        result[4 * i + 1] = static_cast<std::uint8_t>(state_[i] >> 16);
+        result[4 * i + 2] = static_cast<std::uint8_t>(state_[i] >> 8);
+        result[4 * i + 3] = static_cast<std::uint8_t>(state_[i]);
+    }
+
+    return result;
+}
+
+std::string sha256::hex_finalize() {
+    return to_hex(finalize());
+}
+
+// static
+std::string sha256::to_hex(const digest& d) {
+    constexpr char digits[] = "0123456789abcdef";
+    std::string hex(d.size() * 2, '\0');
+    for (std::size_t i = 0; i < d.size(); ++i) {
+        hex[2 * i] = digits[d[i] >> 4];
+        hex[2 * i + 1] = digits[d[i] & 0xf];
+    }
+    return hex;
+}
+
+// static
+bool sha256::accelerated() noexcept {
+    return best_compress_fn() != &compress_portable;
+}
+
+std::string sha256_file(const std::filesystem::path& path, sha256::engine eng) {
+    esl::unique_fd fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (!fd) {
+        throw_fs_error("cannot open file to hash", path);
+    }
+
+    struct stat st {};
+    if (::fstat(fd.get(), &st) != 0) {
+        throw_fs_error("cannot stat file to hash", path);
+    }
+
+    sha256 hasher(eng);
+    auto size = static_cast<std::size_t>(st.st_size);
+    if (size == 0) {
+        return hasher.hex_finalize();
+    }
+
+    void* addr = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd.get(), 0);
+    if (addr == MAP_FAILED) {
+        throw_fs_error("cannot map file to hash", path);
+    }
+
+    ESL_ON_SCOPE_EXIT {
+        ::munmap(addr, size);
+    };
+
+    ::madvise(addr, size, MADV_SEQUENTIAL);
+
+    const auto* data = static_cast<const std::uint8_t*>(addr);
+    for (std::size_t offset = 0; offset < size; offset += k_map_window_size) {
+        auto len = std::min(k_map_window_size, size - offset);
+        // Kick off readahead of the next window while hashing this one.
+        if (offset + len < size) {
+            ::madvise(const_cast<std::uint8_t*>(data + offset + len),
+                      std::min(k_map_window_size, size - offset - len), MADV_WILLNEED);
+        }
+        hasher.update(data + offset, len);
+    }
+
+    return hasher.hex_finalize();
+}
+
+std::vector<std::string> sha256_files(const std::vector<std::filesystem::path>& paths,
+                                      thread_pool& pool) {
+    std::vector<std::string> digests(paths.size());
+    std::vector<std::future<void>> results;
+    results.reserve(paths.size());
+    for (std::size_t i = 0; i < paths.size(); ++i) {
+        results.push_back(pool.submit([&paths, &digests, i] {
+            digests[i] = sha256_file(paths[i]);
+        }));
+    }
+
+    wait_all(results);
+
+    return digests;
+}
+
+} // namespace base
@@ -0,0 +1,80 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#pragma once
+
+#ifndef BASE_SHA256_H_
+#define BASE_SHA256_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace base {
+
+class thread_pool;
+
+// Incremental SHA-256.
+// Uses SHA extensions of x86 CPUs when available, which is several times faster than the
+// portable implementation.
+class sha256 {
+public:
+    static constexpr std::size_t k_block_size = 64;
+    static constexpr std::size_t k_digest_size = 32;
+
+    using digest = std::array<std::uint8_t, k_digest_size>;
+
+    using compress_fn = void (*)(std::uint32_t* state, const std::uint8_t* blocks,
+                                 std::size_t num_blocks);
+
+    enum class engine {
+        best,
+        portable,
+    };
+
+    explicit sha256(engine eng = engine::best) noexcept;
+
+    void update(const void* data, std::size_t len) noexcept;
+
+    void update(std::string_view data) noexcept {
+        update(data.data(), data.size());
+    }
+
+    // The object must not be updated again after finalized.
+    digest finalize() noexcept;
+
+    // Returns lowercase hex of finalized digest.
+    std::string hex_finalize();
+
+    static std::string to_hex(const digest& d);
+
+    // Returns true if hardware acceleration is used for `engine::best`.
+    static bool accelerated() noexcept;
+
+private:
+    compress_fn compress_;
+    std::array<std::uint32_t, 8> state_;
+    std::array<std::uint8_t, k_block_size> buf_{};
+    std::size_t buf_len_{0};
+    std::uint64_t total_len_{0};
+};
+
+// Returns lowercase hex of SHA-256 of the file content.
+// The file is mapped rather than read, to avoid copying it through a userspace buffer.
+// Throws `std::filesystem::filesystem_error` when failed.
+std::string sha256_file(const std::filesystem::path& path,
+                        sha256::engine eng = sha256::engine::best);
+
+// Hashes files concurrently on the pool; results are in the same order as `paths`.
+// Throws the first failure of `sha256_file()` after all files are done.
+std::vector<std::string> sha256_files(const std::vector<std::filesystem::path>& paths,
+                                      thread_pool& pool);
+
+} // namespace base
+
+#endif // BASE_SHA256_H_
@@ -5,12 +5,16 @@
 #include "base/subprocess.h"
 
 #include <cassert>
+#include <cerrno>
 #include <cstddef>
+#include <cstdint>
 #include <cstdlib>
 #include <stdexcept>
 #include <system_error>
+#include <tuple>
 #include <utility>
 
+#include <signal.h>
 #include <sys/syscall.h>
 #include <sys/wait.h>
 #include <unistd.h>
@@ -55,6 +59,49 @@ void check_system_error(int ret, const char* what) {
     }
 }
 
+// Missing from headers older than the kernels having them.
+#ifndef SYS_clone3
+#define SYS_clone3 435
+#endif
+#ifndef CLONE_INTO_CGROUP
+#define CLONE_INTO_CGROUP 0x200000000ULL
+#endif
+
+// Same as `struct clone_args` of Linux 5.7, which has `cgroup` appended.
+struct clone3_args {
+    std::uint64_t flags;
+    std::uint64_t pidfd;
+    std::uint64_t child_tid;
+    std::uint64_t parent_tid;
+    std::uint64_t exit_signal;
+    std::uint64_t stack;
+    std::uint64_t stack_size;
+    std::uint64_t tls;
+    std::uint64_t set_tid;
+    std::uint64_t set_tid_size;
+    std::uint64_t cgroup;
+};
+
+static_assert(sizeof(clone3_args) == 88);
+
+// Forks with `flags` like clone(2) without a new stack; into the cgroup of `cgroup_fd` if it's
+// valid and the kernel supports, otherwise in the cgroup of the caller.
+// Safe to call in a forked child, as it makes syscalls only.
+pid_t clone_process(std::uint64_t flags, int cgroup_fd) noexcept {
+    if (cgroup_fd >= 0) {
+        clone3_args args{};
+        args.flags = flags | CLONE_INTO_CGROUP;
+        args.exit_signal = SIGCHLD;
+        args.cgroup = static_cast<std::uint64_t>(cgroup_fd);
+        auto pid = static_cast<pid_t>(::syscall(SYS_clone3, &args, sizeof(args)));
+        // ENOSYS before 5.3 that has no clone3(), E2BIG before 5.7 that takes shorter args.
+        if (pid != -1 || (errno != ENOSYS && errno != E2BIG)) {
+            return pid;
+        }
+    }
+    return static_cast<pid_t>(::syscall(SYS_clone, flags | SIGCHLD, 0, nullptr, nullptr));
+}
+
 std::pair<esl::unique_fd, esl::unique_fd> make_pipe() {
     int fds[2]{};
     auto rv = ::pipe2(fds, O_CLOEXEC);
@@ -142,6 +189,7 @@ subprocess& subprocess::operator=(subprocess&& rhs) noexcept {
 
     child_state_ = std::exchange(rhs.child_state_, state::not_started);
     pid_ = std::exchange(rhs.pid_, -1);
+    detached_pid_ = std::exchange(rhs.detached_pid_, -1);
     for (auto i = 0; i < std::size(stdio_pipes_); ++i) {
         stdio_pipes_[i] = std::move(rhs.stdio_pipes_[i]);
         rhs.stdio_pipes_[i].reset();
@@ -179,23 +227,47 @@ void subprocess::spawn(std::unique_ptr<const char*[]> argvp, options& opts) {
 
     auto [err_pipe_rd, err_pipe_wr] = make_pipe();
 
-    spawn_impl(argvp.get(), opts, err_pipe_wr.get());
+    // The intermediate child process reports pid of the detached process via the pipe.
+    esl::unique_fd detach_pipe_rd;
+    esl::unique_fd detach_pipe_wr;
+    if (opts.detach_) {
+        std::tie(detach_pipe_rd, detach_pipe_wr) = make_pipe();
+    }
+
+    spawn_impl(argvp.get(), opts, err_pipe_wr.get(), detach_pipe_wr.get());
 
     // Child's error pipe write end will be closed on exec(), and we must close parent's
     // write end as well before read. Because if child process executed successfully, no
     // data will be sent, and read in parent will block.
     err_pipe_wr.reset();
+    detach_pipe_wr.reset();
     read_child_error_pipe(err_pipe_rd.get(), argvp[0]);
 
     if (opts.detach_) {
         base::ignore_unused(wait());
+
+        pid_t pid = -1;
+        ssize_t rc = 0;
+        do {
+            rc = ::read(detach_pipe_rd.get(), &pid, sizeof(pid));
+        } while (rc == -1 && errno == EINTR);
+
+        if (rc != sizeof(pid)) {
+            SPDLOG_ERROR("Failed to read pid of detached process; rc={} errno={}", rc, errno);
+        } else {
+            detached_pid_ = pid;
+        }
     }
 }
 
-void subprocess::spawn_impl(const char* argvp[], const options& opts, int err_fd) {
-    // Make sure send signal to the parent when child terminates.
-    auto clone_flags = opts.clone_flags_ | SIGCHLD;
-    auto pid = static_cast<pid_t>(::syscall(SYS_clone, clone_flags, 0, nullptr, nullptr));
+void subprocess::spawn_impl(const char* argvp[], const options& opts, int err_fd,
+                            int detach_fd) {
+    // Children are cloned with SIGCHLD, which is sent to the parent when they terminate.
+    // The intermediate child process of detach-mode is created without new namespaces; otherwise
+    // it would be the init of a new pid namespace, whose exit kills the detached process, and
+    // pid of the detached process would be of no use for the parent.
+    auto pid = opts.detach_ ? clone_process(0, -1)
+                            : clone_process(opts.clone_flags_, opts.cgroup_fd_);
     check_system_error(pid, "failed to clone");
 
     // Within child process.
@@ -206,11 +278,17 @@ void subprocess::spawn_impl(const char* argvp[], const options& opts, int err_fd
         if (opts.detach_) {
             // Clone twice if detach was requested; and exit intermediate child process
             // immediately after success of clone.
-            // The grand-parent process still has the pid of the intermediate child process.
-            pid = static_cast<pid_t>(::syscall(SYS_clone, clone_flags, 0, nullptr, nullptr));
+            // The grand-parent process still has the pid of the intermediate child process, and
+            // receives pid of the detached process via `detach_fd`.
+            pid = clone_process(opts.clone_flags_, opts.cgroup_fd_);
             if (pid == -1) {
                 notify_child_error(err_fd, child_errc::detach_clone_failure, errno);
             } else if (pid != 0) {
+                // Writes to a pipe of no more than PIPE_BUF bytes are atomic.
+                ssize_t wc = 0;
+                do {
+                    wc = ::write(detach_fd, &pid, sizeof(pid));
+                } while (wc == -1 && errno == EINTR);
                 _exit(0);
             }
         }
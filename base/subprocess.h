@@ -137,6 +137,17 @@ public:
             return *this;
         }
 
+        // The process is created in the cgroup v2 directory of `cgroup_fd` with clone3(2)
+        // `CLONE_INTO_CGROUP`, thus never runs outside of it, even before exec; in detach-mode
+        // the detached process is, while the intermediate one is not.
+        // Kernels before 5.7 lack `CLONE_INTO_CGROUP`, on which the process is created in the
+        // cgroup of the caller, and the caller has to move it afterwards.
+        // `cgroup_fd` must stay open until spawned.
+        options& clone_into_cgroup(int cgroup_fd) noexcept {
+            cgroup_fd_ = cgroup_fd;
+            return *this;
+        }
+
         options& detach() noexcept {
             detach_ = true;
             return *this;
@@ -195,6 +206,7 @@ public:
     private:
         using stdio_action = std::variant<use_null_t, use_pipe_t, use_fd_t>;
         std::uint64_t clone_flags_{};
+        int cgroup_fd_{-1};
         bool detach_{false};
         // TODO(KC): can replace with flatmap or ordered vector.
         std::map<int, stdio_action> action_table_;
@@ -219,7 +231,8 @@ public:
     // After this call, `rhs` will be set to a default constructed state.
     subprocess(subprocess&& other) noexcept
         : child_state_(std::exchange(other.child_state_, state::not_started)),
-          pid_(std::exchange(other.pid_, -1)) {
+          pid_(std::exchange(other.pid_, -1)),
+          detached_pid_(std::exchange(other.detached_pid_, -1)) {
         using std::swap;
         swap(stdio_pipes_, other.stdio_pipes_);
     }
@@ -245,6 +258,12 @@ public:
         return pid_;
     }
 
+    // Returns pid of the detached process, which is not a child of the caller thus not waitable,
+    // or -1 if not spawned in detach-mode.
+    pid_t detached_pid() const noexcept {
+        return detached_pid_;
+    }
+
     // Returns -1 i.e. invalid fd if no corresponding pipe was set.
 
     int stdin_pipe() const {
@@ -276,7 +295,7 @@ public:
 private:
     void spawn(std::unique_ptr<const char*[]> argvp, options& opts);
 
-    void spawn_impl(const char* argvp[], const options& opts, int err_fd);
+    void spawn_impl(const char* argvp[], const options& opts, int err_fd, int detach_fd);
 
     void read_child_error_pipe(int err_fd, const char* executable);
 
@@ -291,6 +310,7 @@ private:
 private:
     state child_state_{state::not_started};
     pid_t pid_{-1};
+    pid_t detached_pid_{-1};
     esl::unique_fd stdio_pipes_[3]{};
 };
 
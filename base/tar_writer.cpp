@@ -0,0 +1,531 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "base/tar_writer.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <sys/sysmacros.h>
+#include <sys/xattr.h>
+#include <unistd.h>
+
+#include "esl/unique_handle.h"
+#include "fmt/format.h"
+
+namespace base {
+namespace {
+
+constexpr std::size_t k_block_size = 512;
+constexpr std::size_t k_copy_buf_size = 1024 * 1024;
+// Max bytes per sendfile(2) call is a bit less than 2GiB.
+constexpr std::size_t k_max_sendfile_size = 1U << 30;
+
+constexpr std::string_view k_xattr_pax_prefix = "SCHILY.xattr.";
+// ACLs are in system.* namespace and need dedicated pax records, which we don't support.
+constexpr std::string_view k_system_xattr_prefix = "system.";
+
+struct field {
+    std::size_t offset;
+    std::size_t len;
+};
+
+constexpr field k_name_field{0, 100};
+constexpr field k_mode_field{100, 8};
+constexpr field k_uid_field{108, 8};
+constexpr field k_gid_field{116, 8};
+constexpr field k_size_field{124, 12};
+constexpr field k_mtime_field{136, 12};
+constexpr field k_chksum_field{148, 8};
+constexpr field k_typeflag_field{156, 1};
+constexpr field k_linkname_field{157, 100};
+constexpr field k_magic_field{257, 6};
+constexpr field k_version_field{263, 2};
+constexpr field k_devmajor_field{329, 8};
+constexpr field k_devminor_field{337, 8};
+constexpr field k_prefix_field{345, 155};
+
+constexpr char k_type_regular = '0';
+constexpr char k_type_hardlink = '1';
+constexpr char k_type_symlink = '2';
+constexpr char k_type_char_dev = '3';
+constexpr char k_type_block_dev = '4';
+constexpr char k_type_directory = '5';
+constexpr char k_type_fifo = '6';
+constexpr char k_type_pax = 'x';
+
+using header_block = std::array<char, k_block_size>;
+
+[[noreturn]] void throw_fs_error(const char* what, const std::filesystem::path& path) {
+    throw std::filesystem::filesystem_error(what, path,
+                                            std::error_code(errno, std::system_category()));
+}
+
+// Octal fields hold `len - 1` digits and a terminating NUL.
+bool fits_octal(std::uint64_t value, field f) noexcept {
+    return value < (std::uint64_t{1} << (3 * (f.len - 1)));
+}
+
+void put_octal(header_block& block, field f, std::uint64_t value) noexcept {
+    for (std::size_t i = f.len - 1; i-- > 0;) {
+        block[f.offset + i] = static_cast<char>('0' + (value & 7));
+        value >>= 3;
+    }
+    block[f.offset + f.len - 1] = '\0';
+}
+
+void put_string(header_block& block, field f, std::string_view str) noexcept {
+    std::memcpy(block.data() + f.offset, str.data(), std::min(str.size(), f.len));
+}
+
+void put_checksum(header_block& block) noexcept {
+    std::memset(block.data() + k_chksum_field.offset, ' ', k_chksum_field.len);
+    std::uint32_t sum = 0;
+    for (auto ch : block) {
+        sum += static_cast<unsigned char>(ch);
+    }
+    // 6 digits, NUL and space, as most tar implementations do.
+    for (std::size_t i = 6; i-- > 0;) {
+        block[k_chksum_field.offset + i] = static_cast<char>('0' + (sum & 7));
+        sum >>= 3;
+    }
+    block[k_chksum_field.offset + 6] = '\0';
+}
+
+std::uint64_t padding_of(std::uint64_t size) noexcept {
+    return (k_block_size - size % k_block_size) % k_block_size;
+}
+
+// A record is "<len> <key>=<value>\n", where <len> counts the whole record including itself.
+void append_pax_record(std::string& out, std::string_view key, std::string_view value) {
+    auto payload = key.size() + value.size() + 3;
+    auto len = payload + 1;
+    while (true) {
+        auto total = payload + fmt::formatted_size("{}", len);
+        if (total == len) {
+            break;
+        }
+        len = total;
+    }
+    fmt::format_to(std::back_inserter(out), "{} {}={}\n", len, key, value);
+}
+
+// Splits `name` into ustar prefix and name fields; returns false if impossible.
+bool split_name(std::string_view name, std::string_view& prefix, std::string_view& base) {
+    if (name.size() <= k_name_field.len) {
+        prefix = {};
+        base = name;
+        return true;
+    }
+
+    for (auto pos = name.find('/'); pos != std::string_view::npos; pos = name.find('/', pos + 1)) {
+        if (pos > k_prefix_field.len) {
+            break;
+        }
+        auto rest = name.substr(pos + 1);
+        if (!rest.empty() && rest.size() <= k_name_field.len) {
+            prefix = name.substr(0, pos);
+            base = rest;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+struct header_fields {
+    std::string_view name;
+    std::uint32_t mode;
+    std::uint64_t uid;
+    std::uint64_t gid;
+    std::uint64_t size;
+    std::int64_t mtime;
+    char type_flag;
+    std::string_view link_name;
+    std::uint32_t dev_major;
+    std::uint32_t dev_minor;
+};
+
+header_block make_header(const header_fields& fields) {
+    header_block block{};
+    std::string_view prefix;
+    std::string_view base;
+    if (!split_name(fields.name, prefix, base)) {
+        // Real name is in pax records.
+        base = fields.name.substr(0, k_name_field.len);
+    }
+    put_string(block, k_name_field, base);
+    put_string(block, k_prefix_field, prefix);
+    put_octal(block, k_mode_field, fields.mode);
+    put_octal(block, k_uid_field, fits_octal(fields.uid, k_uid_field) ? fields.uid : 0);
+    put_octal(block, k_gid_field, fits_octal(fields.gid, k_gid_field) ? fields.gid : 0);
+    put_octal(block, k_size_field, fits_octal(fields.size, k_size_field) ? fields.size : 0);
+    put_octal(block, k_mtime_field, fields.mtime > 0 ? static_cast<std::uint64_t>(fields.mtime) : 0);
+    block[k_typeflag_field.offset] = fields.type_flag;
+    put_string(block, k_linkname_field, fields.link_name);
+    put_string(block, k_magic_field, std::string_view("ustar", 6));
+    put_string(block, k_version_field, "00");
+    put_octal(block, k_devmajor_field, fields.dev_major);
+    put_octal(block, k_devminor_field, fields.dev_minor);
+    put_checksum(block);
+    return block;
+}
+
+void collect_xattrs(const std::filesystem::path& path, std::vector<std::pair<std::string, std::string>>& pax) {
+    auto list_len = ::llistxattr(path.c_str(), nullptr, 0);
+    if (list_len == -1) {
+        if (errno == ENOTSUP) {
+            return;
+        }
+        throw_fs_error("cannot list xattrs", path);
+    }
+
+    if (list_len == 0) {
+        return;
+    }
+
+    std::string names(static_cast<std::size_t>(list_len), '\0');
+    list_len = ::llistxattr(path.c_str(), names.data(), names.size());
+    if (list_len == -1) {
+        throw_fs_error("cannot list xattrs", path);
+    }
+    names.resize(static_cast<std::size_t>(list_len));
+
+    for (std::size_t pos = 0; pos < names.size();) {
+        std::string_view name(names.c_str() + pos);
+        pos += name.size() + 1;
+        if (name.substr(0, k_system_xattr_prefix.size()) == k_system_xattr_prefix) {
+            continue;
+        }
+
+        auto value_len = ::lgetxattr(path.c_str(), name.data(), nullptr, 0);
+        if (value_len == -1) {
+            throw_fs_error("cannot read xattr", path);
+        }
+        std::string value(static_cast<std::size_t>(value_len), '\0');
+        value_len = ::lgetxattr(path.c_str(), name.data(), value.data(), value.size());
+        if (value_len == -1) {
+            throw_fs_error("cannot read xattr", path);
+        }
+        value.resize(static_cast<std::size_t>(value_len));
+        pax.emplace_back(fmt::format("{}{}", k_xattr_pax_prefix, name), std::move(value));
+    }
+}
+
+// Returns data regions of the file as (offset, length) pairs, or a single region covering the
+// whole file if it has no hole.
+std::vector<std::pair<off_t, off_t>> data_regions(int fd, const struct stat& st) {
+    constexpr blkcnt_t sector_size = 512;
+    if (st.st_blocks * sector_size >= st.st_size) {
+        return {{0, st.st_size}};
+    }
+
+    std::vector<std::pair<off_t, off_t>> regions;
+    for (off_t pos = 0; pos < st.st_size;) {
+        auto data = ::lseek(fd, pos, SEEK_DATA);
+        if (data == -1) {
+            if (errno == ENXIO) {
+                // Trailing hole.
+                break;
+            }
+            // SEEK_DATA is not supported by the filesystem.
+            return {{0, st.st_size}};
+        }
+
+        auto hole = ::lseek(fd, data, SEEK_HOLE);
+        if (hole == -1 || hole > st.st_size) {
+            hole = st.st_size;
+        }
+        regions.emplace_back(data, hole - data);
+        pos = hole;
+    }
+
+    return regions;
+}
+
+} // namespace
+
+tar_writer::tar_writer(int out_fd) noexcept
+    : out_fd_(out_fd) {}
+
+void tar_writer::add(const std::filesystem::path& path, std::string_view name) {
+    struct stat st {};
+    if (::lstat(path.c_str(), &st) != 0) {
+        throw_fs_error("cannot stat entry to archive", path);
+    }
+
+    pax_records pax;
+    collect_xattrs(path, pax);
+
+    std::string entry_name(name);
+    switch (st.st_mode & S_IFMT) {
+    case S_IFREG:
+        if (st.st_nlink > 1) {
+            auto [it, inserted] = links_.try_emplace({st.st_dev, st.st_ino}, entry_name);
+            if (!inserted) {
+                write_header(std::move(entry_name), st, k_type_hardlink, 0, it->second, pax);
+                break;
+            }
+        }
+        add_regular_file(path, std::move(entry_name), st, pax);
+        break;
+
+    case S_IFDIR:
+        if (entry_name.empty() || entry_name.back() != '/') {
+            entry_name.push_back('/');
+        }
+        write_header(std::move(entry_name), st, k_type_directory, 0, {}, pax);
+        break;
+
+    case S_IFLNK: {
+        std::string target(static_cast<std::size_t>(st.st_size) + 1, '\0');
+        auto len = ::readlink(path.c_str(), target.data(), target.size());
+        if (len == -1) {
+            throw_fs_error("cannot read symlink", path);
+        }
+        target.resize(static_cast<std::size_t>(len));
+        write_header(std::move(entry_name), st, k_type_symlink, 0, target, pax);
+        break;
+    }
+
+    case S_IFCHR:
+        write_header(std::move(entry_name), st, k_type_char_dev, 0, {}, pax);
+        break;
+
+    case S_IFBLK:
+        write_header(std::move(entry_name), st, k_type_block_dev, 0, {}, pax);
+        break;
+
+    case S_IFIFO:
+        write_header(std::move(entry_name), st, k_type_fifo, 0, {}, pax);
+        break;
+
+    default:
+        // Sockets can't be archived.
+        return;
+    }
+
+    ++stats_.entries;
+}
+
+void tar_writer::add_tree(const std::filesystem::path& root) {
+    for (const auto& entry : std::filesystem::recursive_directory_iterator(root)) {
+        add(entry.path(), entry.path().lexically_relative(root).native());
+    }
+}
+
+void tar_writer::finish() {
+    constexpr std::array<char, k_block_size * 2> end_marker{};
+    write_data(std::string_view(end_marker.data(), end_marker.size()));
+}
+
+void tar_writer::add_regular_file(const std::filesystem::path& path,
+                                  std::string name,
+                                  const struct stat& st,
+                                  pax_records& pax) {
+    esl::unique_fd fd(::open(path.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC));
+    if (!fd) {
+        throw_fs_error("cannot open file to archive", path);
+    }
+
+    ::posix_fadvise(fd.get(), 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    auto regions = data_regions(fd.get(), st);
+    auto real_size = static_cast<std::uint64_t>(st.st_size);
+    if (regions.size() == 1 && regions[0].first == 0 &&
+        static_cast<std::uint64_t>(regions[0].second) == real_size) {
+        write_header(std::move(name), st, k_type_regular, real_size, {}, pax);
+        send_file_range(fd.get(), path, 0, real_size);
+        write_padding(real_size);
+        return;
+    }
+
+    // GNU sparse format 1.0: data is prefixed by the sparse map, and the real name is in pax
+    // records so that tars unaware of the format extract the raw data under a distinct name.
+    // A trailing hole is denoted by an empty region at the end.
+    if (regions.empty() || static_cast<std::uint64_t>(regions.back().first + regions.back().second) <
+                                   real_size) {
+        regions.emplace_back(st.st_size, 0);
+    }
+
+    std::string sparse_map = fmt::format("{}\n", regions.size());
+    std::uint64_t data_size = 0;
+    for (const auto& [offset, length] : regions) {
+        fmt::format_to(std::back_inserter(sparse_map), "{}\n{}\n", offset, length);
+        data_size += static_cast<std::uint64_t>(length);
+    }
+    sparse_map.resize(sparse_map.size() + padding_of(sparse_map.size()), '\0');
+
+    auto fs_name = std::filesystem::path(name);
+    auto stored_name = (fs_name.parent_path() / "GNUSparseFile.0" / fs_name.filename()).native();
+    pax.emplace_back("GNU.sparse.major", "1");
+    pax.emplace_back("GNU.sparse.minor", "0");
+    pax.emplace_back("GNU.sparse.name", std::move(name));
+    pax.emplace_back("GNU.sparse.realsize", std::to_string(real_size));
+
+    write_header(std::move(stored_name), st, k_type_regular, sparse_map.size() + data_size, {},
+                 pax);
+    write_data(sparse_map);
+    for (const auto& [offset, length] : regions) {
+        send_file_range(fd.get(), path, offset, static_cast<std::uint64_t>(length));
+    }
+    write_padding(data_size);
+
+    ++stats_.sparse_files;
+}
+
+void tar_writer::write_header(std::string name,
+                              const struct stat& st,
+                              char type_flag,
+                              std::uint64_t size,
+                              std::string_view link_name,
+                              pax_records& pax) {
+    header_fields fields{name,
+                         st.st_mode & 07777,
+                         st.st_uid,
+                         st.st_gid,
+                         size,
+                         st.st_mtim.tv_sec,
+                         type_flag,
+                         link_name,
+                         0,
+                         0};
+    if (S_ISCHR(st.st_mode) || S_ISBLK(st.st_mode)) {
+        fields.dev_major = ::major(st.st_rdev);
+        fields.dev_minor = ::minor(st.st_rdev);
+    }
+
+    std::string_view prefix;
+    std::string_view base;
+    if (!split_name(name, prefix, base)) {
+        pax.emplace_back("path", name);
+    }
+    if (link_name.size() > k_linkname_field.len) {
+        pax.emplace_back("linkpath", link_name);
+    }
+    if (!fits_octal(size, k_size_field)) {
+        pax.emplace_back("size", std::to_string(size));
+    }
+    if (!fits_octal(fields.uid, k_uid_field)) {
+        pax.emplace_back("uid", std::to_string(fields.uid));
+    }
+    if (!fits_octal(fields.gid, k_gid_field)) {
+        pax.emplace_back("gid", std::to_string(fields.gid));
+    }
+    if (fields.mtime < 0) {
+        pax.emplace_back("mtime", std::to_string(fields.mtime));
+    }
+
+    if (!pax.empty()) {
+        std::string records;
+        for (const auto& [key, value] : pax) {
+            append_pax_record(records, key, value);
+        }
+
+        auto pax_name = fmt::format("PaxHeaders/{}", std::filesystem::path(name).filename().native());
+        header_fields pax_fields{pax_name, 0644, 0, 0, records.size(), fields.mtime,
+                                 k_type_pax, {}, 0, 0};
+        auto pax_block = make_header(pax_fields);
+        write_data(std::string_view(pax_block.data(), pax_block.size()));
+        write_data(records);
+        write_padding(records.size());
+    }
+
+    auto block = make_header(fields);
+    write_data(std::string_view(block.data(), block.size()));
+}
+
+void tar_writer::write_data(std::string_view data) {
+    while (!data.empty()) {
+        auto n = ::write(out_fd_, data.data(), data.size());
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::system_error(errno, std::system_category(), "failed to write tar stream");
+        }
+        data.remove_prefix(static_cast<std::size_t>(n));
+        stats_.archive_bytes += static_cast<std::uint64_t>(n);
+    }
+}
+
+void tar_writer::write_padding(std::uint64_t size) {
+    write_zeros(padding_of(size));
+}
+
+void tar_writer::send_file_range(int fd,
+                                 const std::filesystem::path& path,
+                                 off_t offset,
+                                 std::uint64_t length) {
+    while (length > 0) {
+        auto n = ::sendfile(out_fd_, fd, &offset,
+                            static_cast<std::size_t>(std::min<std::uint64_t>(length,
+                                                                             k_max_sendfile_size)));
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EINVAL || errno == ENOSYS) {
+                // E.g. the output is opened with O_APPEND.
+                copy_file_range_by_read(fd, path, offset, length);
+                return;
+            }
+            throw std::system_error(errno, std::system_category(),
+                                    fmt::format("failed to archive {}", path.native()));
+        }
+
+        if (n == 0) {
+            // The file shrunk after being stat-ed.
+            write_zeros(length);
+            return;
+        }
+
+        length -= static_cast<std::uint64_t>(n);
+        stats_.archive_bytes += static_cast<std::uint64_t>(n);
+    }
+}
+
+void tar_writer::copy_file_range_by_read(int fd,
+                                         const std::filesystem::path& path,
+                                         off_t offset,
+                                         std::uint64_t length) {
+    std::vector<char> buf(static_cast<std::size_t>(std::min<std::uint64_t>(length,
+                                                                           k_copy_buf_size)));
+    while (length > 0) {
+        auto n = ::pread(fd, buf.data(),
+                         static_cast<std::size_t>(std::min<std::uint64_t>(length, buf.size())),
+                         offset);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw_fs_error("cannot read file to archive", path);
+        }
+
+        if (n == 0) {
+            write_zeros(length);
+            return;
+        }
+
+        write_data(std::string_view(buf.data(), static_cast<std::size_t>(n)));
+        offset += n;
+        length -= static_cast<std::uint64_t>(n);
+    }
+}
+
+// Keeps the archive well-formed, as the header has claimed the size.
+void tar_writer::write_zeros(std::uint64_t length) {
+    constexpr std::array<char, k_block_size> zeros{};
+    while (length > 0) {
+        auto len = std::min<std::uint64_t>(length, zeros.size());
+        write_data(std::string_view(zeros.data(), static_cast<std::size_t>(len)));
+        length -= len;
+    }
+}
+
+} // namespace base
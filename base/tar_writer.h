@@ -0,0 +1,96 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#pragma once
+
+#ifndef BASE_TAR_WRITER_H_
+#define BASE_TAR_WRITER_H_
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <sys/stat.h>
+
+namespace base {
+
+struct tar_stats {
+    std::uint64_t entries{0};
+    std::uint64_t sparse_files{0};
+    // Bytes written into the archive, including headers and padding.
+    std::uint64_t archive_bytes{0};
+};
+
+// Writes a POSIX (pax) tar stream into `out_fd`, which may be a file, pipe or socket.
+// File bodies are sent with sendfile(2), thus never copied through userspace, and holes of
+// sparse files are skipped, using GNU sparse format 1.0 understood by GNU tar and bsdtar.
+class tar_writer {
+public:
+    explicit tar_writer(int out_fd) noexcept;
+
+    ~tar_writer() = default;
+
+    tar_writer(const tar_writer&) = delete;
+
+    tar_writer(tar_writer&&) = delete;
+
+    tar_writer& operator=(const tar_writer&) = delete;
+
+    tar_writer& operator=(tar_writer&&) = delete;
+
+    // Appends the filesystem entry at `path` as `name`, without recursing into directories.
+    // Symlinks are not followed; hardlinked files are archived as links to their first
+    // occurrence.
+    // Throws:
+    //  - `std::filesystem::filesystem_error` if failed to read the entry.
+    //  - `std::system_error` if failed to write the archive.
+    void add(const std::filesystem::path& path, std::string_view name);
+
+    // Appends the directory tree rooted at `root`, named relative to `root`; `root` itself is
+    // not included.
+    // Throws the same as `add()`.
+    void add_tree(const std::filesystem::path& root);
+
+    // Writes the end-of-archive marker.
+    // Throws `std::system_error` when failed.
+    void finish();
+
+    const tar_stats& stats() const noexcept {
+        return stats_;
+    }
+
+private:
+    using pax_records = std::vector<std::pair<std::string, std::string>>;
+
+    void add_regular_file(const std::filesystem::path& path, std::string name,
+                          const struct stat& st, pax_records& pax);
+
+    void write_header(std::string name, const struct stat& st, char type_flag,
+                      std::uint64_t size, std::string_view link_name, pax_records& pax);
+
+    void write_data(std::string_view data);
+
+    void write_padding(std::uint64_t size);
+
+    void send_file_range(int fd, const std::filesystem::path& path, off_t offset,
+                         std::uint64_t length);
+
+    void copy_file_range_by_read(int fd, const std::filesystem::path& path, off_t offset,
+                                 std::uint64_t length);
+
+    void write_zeros(std::uint64_t length);
+
+private:
+    int out_fd_;
+    tar_stats stats_;
+    std::map<std::pair<dev_t, ino_t>, std::string> links_;
+};
+
+} // namespace base
+
+#endif // BASE_TAR_WRITER_H_
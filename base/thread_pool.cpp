@@ -0,0 +1,79 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "base/thread_pool.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace base {
+
+thread_pool::thread_pool(std::size_t num_threads) {
+    if (num_threads == 0) {
+        throw std::invalid_argument("thread_pool requires at least one thread");
+    }
+
+    workers_.reserve(num_threads);
+    try {
+        for (std::size_t i = 0; i < num_threads; ++i) {
+            workers_.emplace_back([this] { run_worker(); });
+        }
+    } catch (...) {
+        // Destroying joinable threads would terminate the process.
+        stop();
+        throw;
+    }
+}
+
+thread_pool::~thread_pool() {
+    stop();
+}
+
+void thread_pool::stop() noexcept {
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        stopping_ = true;
+    }
+    not_empty_.notify_all();
+
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+// static
+std::size_t thread_pool::default_size() noexcept {
+    constexpr std::size_t max_io_threads = 8;
+    auto hw = static_cast<std::size_t>(std::thread::hardware_concurrency());
+    return std::clamp<std::size_t>(hw, 1, max_io_threads);
+}
+
+void thread_pool::enqueue(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        tasks_.push_back(std::move(task));
+    }
+    not_empty_.notify_one();
+}
+
+void thread_pool::run_worker() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            not_empty_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+            // Drain pending tasks before quitting.
+            if (tasks_.empty()) {
+                return;
+            }
+            task = std::move(tasks_.front());
+            tasks_.pop_front();
+        }
+
+        // Tasks are wrapped by packaged_task, which never lets exception escape.
+        task();
+    }
+}
+
+} // namespace base
@@ -0,0 +1,97 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#pragma once
+
+#ifndef BASE_THREAD_POOL_H_
+#define BASE_THREAD_POOL_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace base {
+
+// A fixed-size pool of worker threads running tasks in FIFO order.
+// Destruction waits for all queued tasks to complete.
+class thread_pool {
+public:
+    // Throws `std::invalid_argument` if `num_threads` is 0, and `std::system_error` if any thread
+    // cannot be started, in which case threads already started are joined.
+    explicit thread_pool(std::size_t num_threads);
+
+    ~thread_pool();
+
+    thread_pool(const thread_pool&) = delete;
+
+    thread_pool(thread_pool&&) = delete;
+
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    thread_pool& operator=(thread_pool&&) = delete;
+
+    // Exception thrown by `fn` is propagated via the returned future.
+    template<typename F>
+    auto submit(F&& fn) -> std::future<std::invoke_result_t<std::decay_t<F>>> {
+        using result_type = std::invoke_result_t<std::decay_t<F>>;
+        auto task = std::make_shared<std::packaged_task<result_type()>>(std::forward<F>(fn));
+        auto result = task->get_future();
+        enqueue([task] { (*task)(); });
+        return result;
+    }
+
+    std::size_t size() const noexcept {
+        return workers_.size();
+    }
+
+    // Returns a sensible pool size for I/O bound jobs when caller has no preference.
+    static std::size_t default_size() noexcept;
+
+private:
+    void enqueue(std::function<void()> task);
+
+    void run_worker();
+
+    // Joins all workers after they drain pending tasks.
+    void stop() noexcept;
+
+private:
+    std::mutex mtx_;
+    std::condition_variable not_empty_;
+    std::deque<std::function<void()>> tasks_;
+    bool stopping_{false};
+    std::vector<std::thread> workers_;
+};
+
+// Waits for all futures and rethrows the first exception encountered, if any.
+// All futures are waited even if some of them failed.
+template<typename T>
+void wait_all(std::vector<std::future<T>>& futures) {
+    std::exception_ptr first_error;
+    for (auto& fut : futures) {
+        try {
+            fut.get();
+        } catch (...) {
+            if (!first_error) {
+                first_error = std::current_exception();
+            }
+        }
+    }
+
+    if (first_error) {
+        std::rethrow_exception(first_error);
+    }
+}
+
+} // namespace base
+
+#endif // BASE_THREAD_POOL_H_
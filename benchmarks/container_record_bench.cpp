@@ -0,0 +1,143 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+// Compares container info formats on records alike those of `lumper run`:
+//  - encoding into json, as infos were saved, and into binary records.
+//  - decoding json, and records into `container_info`.
+//  - reading the status of records in place, as listing running containers does.
+//  - loading info files, read and parsed for json, mapped for records.
+// Usage: container_record_bench [num-records]
+
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "fmt/format.h"
+#include "nlohmann/json.hpp"
+
+#include "base/file_util.h"
+#include "lumper/container_info.h"
+#include "lumper/container_record.h"
+
+namespace {
+
+std::vector<lumper::container_info> make_infos(std::size_t count) {
+    std::vector<lumper::container_info> infos;
+    infos.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        infos.push_back({fmt::format("{:012x}", 0x5eed0000 + i),
+                         "ubuntu:22.04",
+                         "/bin/sh -c while true; do sleep 1; done",
+                         "2022-05-01 12:34:56",
+                         i % 2 == 0 ? lumper::k_container_status_running
+                                    : lumper::k_container_status_stopped,
+                         static_cast<int>(1000 + i),
+                         "",
+                         {std::string(64, 'a'), std::string(64, 'b'), std::string(64, 'c')},
+                         123456789 + i});
+    }
+    return infos;
+}
+
+void run_case(const char* name, std::size_t count, const std::function<std::size_t()>& fn) {
+    fn();
+    auto start = std::chrono::steady_clock::now();
+    auto checksum = fn();
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+    fmt::print("{:<28} {:>9.2f} ms {:>9.0f} ns/record (checksum {})\n",
+               name, elapsed.count() * 1000, elapsed.count() * 1e9 / static_cast<double>(count),
+               checksum);
+}
+
+} // namespace
+
+int main(int argc, const char* argv[]) {
+    std::size_t count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+    auto infos = make_infos(count);
+
+    std::vector<std::string> jsons;
+    std::vector<std::string> records;
+    for (const auto& info : infos) {
+        jsons.push_back(nlohmann::json(info).dump());
+        records.push_back(lumper::encode_container_record(info));
+    }
+    fmt::print("{} records, json {} bytes, binary {} bytes each\n",
+               count, jsons.front().size(), records.front().size());
+
+    run_case("encode json", count, [&infos] {
+        std::size_t n = 0;
+        for (const auto& info : infos) {
+            n += nlohmann::json(info).dump().size();
+        }
+        return n;
+    });
+    run_case("encode record", count, [&infos] {
+        std::size_t n = 0;
+        for (const auto& info : infos) {
+            n += lumper::encode_container_record(info).size();
+        }
+        return n;
+    });
+    run_case("decode json", count, [&jsons] {
+        std::size_t n = 0;
+        for (const auto& json : jsons) {
+            n += nlohmann::json::parse(json).get<lumper::container_info>().layers.size();
+        }
+        return n;
+    });
+    run_case("decode record", count, [&records] {
+        std::size_t n = 0;
+        for (const auto& record : records) {
+            n += lumper::container_record_view::parse(record)->to_container_info().layers.size();
+        }
+        return n;
+    });
+    run_case("read status of record", count, [&records] {
+        std::size_t n = 0;
+        for (const auto& record : records) {
+            auto view = lumper::container_record_view::parse(record);
+            n += view->status() == lumper::k_container_status_running ? 1 : 0;
+        }
+        return n;
+    });
+
+    // Files are freshly written, thus page-cached.
+    auto dir = std::filesystem::path(fmt::format("/tmp/lumper_container_record_bench_{}",
+                                                 ::getpid()));
+    std::filesystem::create_directories(dir);
+    std::vector<std::filesystem::path> json_files;
+    std::vector<std::filesystem::path> record_files;
+    for (std::size_t i = 0; i < count; ++i) {
+        json_files.push_back(dir / fmt::format("{}.json", i));
+        base::write_to_file(json_files.back(), jsons[i]);
+        record_files.push_back(dir / fmt::format("{}.rec", i));
+        base::write_to_file(record_files.back(), records[i]);
+    }
+
+    run_case("load json file", count, [&json_files] {
+        std::size_t n = 0;
+        for (const auto& path : json_files) {
+            n += nlohmann::json::parse(base::read_file_to_string(path))
+                         .get<lumper::container_info>()
+                         .layers.size();
+        }
+        return n;
+    });
+    run_case("load record file", count, [&record_files] {
+        std::size_t n = 0;
+        for (const auto& path : record_files) {
+            n += lumper::mapped_container_record(path).view().to_container_info().layers.size();
+        }
+        return n;
+    });
+
+    std::filesystem::remove_all(dir);
+
+    return 0;
+}
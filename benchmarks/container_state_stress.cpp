@@ -0,0 +1,187 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+// Runs many processes against container state at once, as parallel lumper invocations do, then
+// checks the state is consistent. Each process, in rounds:
+//  - creates containers as `lumper run` does: directory, lock, and info saved as running.
+//  - removes some of them, and of others', as `lumper rm` does.
+//  - lists all containers and reconciles their status as `lumper ps -a` does; containers are
+//    recorded with pids of the processes, which exit at the end, thus are marked stopped by
+//    processes left.
+// Consistent state means that indexed containers are exactly those having a directory, each with
+// a readable info.
+// Must run as root, on a host without real containers, as it works on /var/lib/lumper.
+// Usage: container_state_stress [num-processes] [rounds]
+
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "fmt/format.h"
+
+#include "base/thread_pool.h"
+#include "lumper/container_info.h"
+#include "lumper/container_status.h"
+#include "lumper/container_trash.h"
+#include "lumper/path_constants.h"
+#include "lumper/state_index.h"
+#include "lumper/state_root.h"
+
+namespace {
+
+constexpr char k_id_prefix[] = "stress";
+
+std::string make_id(std::size_t worker, std::size_t round) {
+    return fmt::format("{}{:04}{:04}", k_id_prefix, worker, round);
+}
+
+void create_container(const std::string& id) {
+    const auto& root = lumper::state_root::get();
+    if (!root.create_container_dir(id)) {
+        throw std::runtime_error("container-id in use: " + id);
+    }
+    auto lock = root.lock_container(id, lumper::container_lock_mode::exclusive);
+    if (!lock) {
+        throw std::runtime_error("container removed while being created: " + id);
+    }
+    root.create_container_subdir(id, "cow_rw");
+    lumper::save_container_info({id,
+                                 "stress",
+                                 "true",
+                                 lumper::format_create_time(std::chrono::system_clock::now()),
+                                 lumper::k_container_status_running,
+                                 ::getpid(),
+                                 "",
+                                 {},
+                                 lumper::get_process_start_time(::getpid())});
+}
+
+// Returns true if removed by this call.
+bool remove_container(const std::string& id, base::thread_pool& pool) {
+    auto lock = lumper::state_root::get().lock_container(id, lumper::container_lock_mode::exclusive);
+    if (!lock) {
+        return false;
+    }
+    auto entry = lumper::move_container_to_trash(id);
+    lumper::unindex_container(id);
+    lock.reset();
+    if (entry) {
+        lumper::empty_container_trash({*entry}, pool);
+    }
+    return true;
+}
+
+int run_worker(std::size_t worker, std::size_t workers, std::size_t rounds) {
+    base::thread_pool pool(1);
+    for (std::size_t round = 0; round < rounds; ++round) {
+        create_container(make_id(worker, round));
+
+        // Every third round removes a container of the next worker, which may not exist yet.
+        if (round % 3 == 2) {
+            remove_container(make_id((worker + 1) % workers, round - 1), pool);
+        }
+
+        auto infos = lumper::query_container_infos(false);
+        lumper::reconcile_container_status(infos, pool);
+    }
+    return EXIT_SUCCESS;
+}
+
+std::set<std::string> list_container_dirs() {
+    std::set<std::string> ids;
+    for (const auto& entry : std::filesystem::directory_iterator(lumper::k_container_dir)) {
+        auto id = entry.path().filename().native();
+        if (id.rfind(k_id_prefix, 0) == 0) {
+            ids.insert(id);
+        }
+    }
+    return ids;
+}
+
+std::set<std::string> list_indexed() {
+    std::set<std::string> ids;
+    for (const auto& info : lumper::query_container_infos(false)) {
+        if (info.id.rfind(k_id_prefix, 0) == 0) {
+            ids.insert(info.id);
+        }
+    }
+    return ids;
+}
+
+} // namespace
+
+int main(int argc, const char* argv[]) {
+    std::size_t workers = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 200;
+    std::size_t rounds = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 10;
+
+    // Leftovers of an earlier run would be taken as inconsistencies.
+    base::thread_pool pool(1);
+    for (const auto& id : list_container_dirs()) {
+        remove_container(id, pool);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<pid_t> pids;
+    for (std::size_t worker = 0; worker < workers; ++worker) {
+        auto pid = ::fork();
+        if (pid < 0) {
+            std::perror("fork");
+            return EXIT_FAILURE;
+        }
+        if (pid == 0) {
+            int rv = EXIT_FAILURE;
+            try {
+                rv = run_worker(worker, workers, rounds);
+            } catch (const std::exception& ex) {
+                fmt::print(stderr, "worker {} failed: {}\n", worker, ex.what());
+            }
+            std::_Exit(rv);
+        }
+        pids.push_back(pid);
+    }
+
+    std::size_t failed = 0;
+    for (auto pid : pids) {
+        int status = 0;
+        ::waitpid(pid, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+            ++failed;
+        }
+    }
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+
+    auto dirs = list_container_dirs();
+    auto indexed = list_indexed();
+    std::size_t broken = 0;
+    for (const auto& id : dirs) {
+        try {
+            lumper::load_container_info(id);
+        } catch (const std::exception& ex) {
+            fmt::print(stderr, "broken container {}: {}\n", id, ex.what());
+            ++broken;
+        }
+    }
+
+    auto ops = workers * rounds * 2 + workers * (rounds / 3);
+    fmt::print("{} processes x {} rounds: {:.2f}s, {:.0f} ops/s\n",
+               workers, rounds, elapsed.count(), static_cast<double>(ops) / elapsed.count());
+    fmt::print("failed processes {}, containers {}, indexed {}, broken {}\n",
+               failed, dirs.size(), indexed.size(), broken);
+
+    bool consistent = failed == 0 && broken == 0 && dirs == indexed;
+    fmt::print("{}\n", consistent ? "consistent" : "INCONSISTENT");
+
+    for (const auto& id : dirs) {
+        remove_container(id, pool);
+    }
+
+    return consistent ? EXIT_SUCCESS : EXIT_FAILURE;
+}
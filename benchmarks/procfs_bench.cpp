@@ -0,0 +1,187 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+// Compares reading procfs and cgroupfs files as lumper did, with streams and splitting into
+// vectors, against the fixed-buffer parsers of base/procfs:
+//  - looking up mount points of cgroup subsystems in /proc/self/mountinfo.
+//  - reading a small cgroup file, e.g. cpu.cfs_period_us.
+//  - parsing memory.stat, cpu.stat and io.stat alike those of a busy cgroup.
+//  - reading /proc/<pid>/stat.
+// Allocations are counted by replacing the global operator new.
+// Usage: procfs_bench [iterations]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <new>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <unistd.h>
+
+#include "esl/strings.h"
+#include "fmt/format.h"
+
+#include "base/file_util.h"
+#include "base/procfs.h"
+
+namespace {
+
+std::atomic<std::size_t> g_allocations{0};
+
+} // namespace
+
+void* operator new(std::size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size == 0 ? 1 : size); p) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+namespace {
+
+constexpr char k_mountinfo_path[] = "/proc/self/mountinfo";
+
+constexpr std::string_view k_memory_stat =
+        "anon 1073741824\nfile 536870912\nkernel 16777216\nkernel_stack 1048576\n"
+        "pagetables 4194304\nsec_pagetables 0\npercpu 65536\nsock 0\nvmalloc 0\nshmem 8388608\n"
+        "zswap 0\nzswapped 0\nfile_mapped 134217728\nfile_dirty 4096\nfile_writeback 0\n"
+        "swapcached 0\nanon_thp 0\nfile_thp 0\nshmem_thp 0\ninactive_anon 268435456\n"
+        "active_anon 805306368\ninactive_file 268435456\nactive_file 268435456\n"
+        "unevictable 0\nslab_reclaimable 8388608\nslab_unreclaimable 4194304\nslab 12582912\n"
+        "workingset_refault_anon 0\nworkingset_refault_file 1024\nworkingset_activate_anon 0\n"
+        "workingset_activate_file 512\nworkingset_restore_anon 0\nworkingset_restore_file 256\n"
+        "workingset_nodereclaim 0\npgscan 4096\npgsteal 4096\npgscan_kswapd 4096\n"
+        "pgscan_direct 0\npgsteal_kswapd 4096\npgsteal_direct 0\npgfault 12345678\n"
+        "pgmajfault 1234\npgrefill 0\npgactivate 2048\npgdeactivate 0\npglazyfree 0\n"
+        "pglazyfreed 0\nthp_fault_alloc 0\nthp_collapse_alloc 0\n";
+
+constexpr std::string_view k_cpu_stat =
+        "usage_usec 987654321\nuser_usec 654321000\nsystem_usec 333333321\n"
+        "core_sched.force_idle_usec 0\nnr_periods 123456\nnr_throttled 789\n"
+        "throttled_usec 4567890\nnr_bursts 0\nburst_usec 0\n";
+
+constexpr std::string_view k_io_stat =
+        "8:16 rbytes=1459200 wbytes=314773504 rios=192 wios=353 dbytes=0 dios=0\n"
+        "8:0 rbytes=90430464 wbytes=299008000 rios=8950 wios=1252 dbytes=50331648 dios=3021\n"
+        "253:0 rbytes=1024 wbytes=2048 rios=1 wios=2 dbytes=0 dios=0\n";
+
+// As `cgroups::find_mount_point()` did.
+std::string find_mount_point_by_stream(std::string_view subsystem) {
+    std::ifstream in(k_mountinfo_path);
+    for (std::string line; std::getline(in, line);) {
+        auto fields = esl::strings::split(line, ' ', esl::strings::skip_empty{})
+                              .to<std::vector<std::string_view>>();
+        auto toks = esl::strings::split(fields.back(), ',');
+        if (std::find(toks.begin(), toks.end(), subsystem) != toks.end()) {
+            return std::string(fields[4]);
+        }
+    }
+    return {};
+}
+
+std::string find_mount_point_by_line_reader(std::string_view subsystem) {
+    base::line_reader reader(k_mountinfo_path);
+    for (std::string_view line; reader.next(line);) {
+        auto entry = base::parse_mountinfo_line(line);
+        if (!entry || entry->fs_type != "cgroup") {
+            continue;
+        }
+        for (auto toks = entry->super_options; !toks.empty();) {
+            auto comma = toks.find(',');
+            if (toks.substr(0, comma) == subsystem) {
+                return std::string(entry->mount_point);
+            }
+            toks.remove_prefix(comma == std::string_view::npos ? toks.size() : comma + 1);
+        }
+    }
+    return {};
+}
+
+// Keyed files parsed into maps, as a straightforward reader would.
+std::map<std::string, std::uint64_t> parse_keyed_by_stream(std::string_view content) {
+    std::map<std::string, std::uint64_t> values;
+    std::istringstream in{std::string(content)};
+    std::string key;
+    std::uint64_t value = 0;
+    while (in >> key >> value) {
+        values.emplace(key, value);
+    }
+    return values;
+}
+
+void run_case(const char* name, std::size_t iterations, const std::function<std::size_t()>& fn) {
+    fn();
+    auto allocations = g_allocations.load(std::memory_order_relaxed);
+    auto start = std::chrono::steady_clock::now();
+    std::size_t checksum = 0;
+    for (std::size_t i = 0; i < iterations; ++i) {
+        checksum += fn();
+    }
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+    auto allocs = g_allocations.load(std::memory_order_relaxed) - allocations;
+    fmt::print("{:<36} {:>9.0f} ns/op {:>7.1f} allocs/op (checksum {})\n",
+               name, elapsed.count() * 1e9 / static_cast<double>(iterations),
+               static_cast<double>(allocs) / static_cast<double>(iterations), checksum);
+}
+
+} // namespace
+
+int main(int argc, const char* argv[]) {
+    std::size_t iterations = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 10000;
+
+    const auto& table = base::mount_table::get();
+    fmt::print("{} mounts, {} iterations\n", table.mounts().size(), iterations);
+
+    run_case("mount point: stream + split", iterations,
+             [] { return find_mount_point_by_stream("memory").size(); });
+    run_case("mount point: line_reader", iterations,
+             [] { return find_mount_point_by_line_reader("memory").size(); });
+    run_case("mount point: mount_table", iterations,
+             [&table] { return table.find_cgroup_mount_point("memory").size(); });
+
+    // A small knob, which exists on any host.
+    std::string knob = fmt::format("{}/cpu.cfs_period_us", table.find_cgroup_mount_point("cpu"));
+    if (table.find_cgroup_mount_point("cpu").empty()) {
+        knob = "/proc/loadavg";
+    }
+    run_case("small file: read_file_to_string", iterations,
+             [&knob] { return base::read_file_to_string(knob).size(); });
+    run_case("small file: read_proc_file", iterations, [&knob] {
+        char buf[64];
+        return base::read_proc_file(knob.c_str(), buf, sizeof(buf)).size();
+    });
+
+    run_case("memory.stat: stream + map", iterations,
+             [] { return parse_keyed_by_stream(k_memory_stat).at("anon") > 0 ? 1 : 0; });
+    run_case("memory.stat: parse_memory_stat", iterations,
+             [] { return base::parse_memory_stat(k_memory_stat).anon > 0 ? 1 : 0; });
+    run_case("cpu.stat: stream + map", iterations,
+             [] { return parse_keyed_by_stream(k_cpu_stat).at("nr_throttled") > 0 ? 1 : 0; });
+    run_case("cpu.stat: parse_cpu_stat", iterations,
+             [] { return base::parse_cpu_stat(k_cpu_stat).nr_throttled > 0 ? 1 : 0; });
+    run_case("io.stat: parse_io_stat", iterations,
+             [] { return base::parse_io_stat(k_io_stat).rios > 0 ? 1 : 0; });
+
+    auto pid = ::getpid();
+    run_case("/proc/<pid>/stat: read_process_stat", iterations,
+             [pid] { return base::read_process_stat(pid)->num_threads > 0 ? 1 : 0; });
+
+    return EXIT_SUCCESS;
+}
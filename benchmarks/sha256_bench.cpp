@@ -0,0 +1,115 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+// Compares layer hashing strategies on freshly written (thus page-cached) files:
+//  - naive: read(2) into a small buffer with portable SHA-256, one file at a time.
+//  - read(2) with the accelerated engine.
+//  - mmap with the accelerated engine, i.e. `base::sha256_file()`.
+//  - `base::sha256_files()` on a thread pool.
+// Usage: sha256_bench [file-size-in-MiB] [num-files]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "esl/unique_handle.h"
+#include "fmt/format.h"
+
+#include "base/file_util.h"
+#include "base/sha256.h"
+#include "base/thread_pool.h"
+
+namespace {
+
+constexpr std::size_t k_mib = 1024 * 1024;
+constexpr std::size_t k_naive_buf_size = 64 * 1024;
+
+std::string read_and_hash(const std::filesystem::path& path, base::sha256::engine eng) {
+    esl::unique_fd fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (!fd) {
+        std::perror("open");
+        std::exit(1);
+    }
+
+    base::sha256 hasher(eng);
+    std::vector<char> buf(k_naive_buf_size);
+    while (true) {
+        auto n = ::read(fd.get(), buf.data(), buf.size());
+        if (n <= 0) {
+            break;
+        }
+        hasher.update(buf.data(), static_cast<std::size_t>(n));
+    }
+    return hasher.hex_finalize();
+}
+
+void run_case(const char* name, std::size_t total_bytes, const std::function<void()>& fn) {
+    // Warm up once so that all cases see the same page cache state.
+    fn();
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+    fmt::print("{:<28} {:>8.1f} ms {:>10.1f} MiB/s\n",
+               name, elapsed.count() * 1000,
+               static_cast<double>(total_bytes) / k_mib / elapsed.count());
+}
+
+} // namespace
+
+int main(int argc, const char* argv[]) {
+    std::size_t file_mib = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 256;
+    std::size_t num_files = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 4;
+
+    std::mt19937_64 gen(42);
+    std::string data(file_mib * k_mib, '\0');
+    for (std::size_t i = 0; i + 8 <= data.size(); i += 8) {
+        auto v = gen();
+        std::memcpy(data.data() + i, &v, sizeof(v));
+    }
+
+    std::vector<std::filesystem::path> paths;
+    for (std::size_t i = 0; i < num_files; ++i) {
+        paths.emplace_back(fmt::format("/tmp/lumper_sha256_bench_{}_{}", ::getpid(), i));
+        base::write_to_file(paths.back(), data);
+    }
+
+    fmt::print("{} files x {} MiB, sha extensions: {}\n",
+               num_files, file_mib, base::sha256::accelerated() ? "yes" : "no");
+
+    auto total = num_files * file_mib * k_mib;
+    run_case("read + portable (naive)", total, [&paths] {
+        for (const auto& path : paths) {
+            read_and_hash(path, base::sha256::engine::portable);
+        }
+    });
+    run_case("read + accelerated", total, [&paths] {
+        for (const auto& path : paths) {
+            read_and_hash(path, base::sha256::engine::best);
+        }
+    });
+    run_case("mmap + accelerated", total, [&paths] {
+        for (const auto& path : paths) {
+            base::sha256_file(path);
+        }
+    });
+
+    base::thread_pool pool(base::thread_pool::default_size());
+    run_case(fmt::format("mmap + accelerated, {} threads", pool.size()).c_str(), total,
+             [&paths, &pool] { base::sha256_files(paths, pool); });
+
+    for (const auto& path : paths) {
+        std::filesystem::remove(path);
+    }
+
+    return 0;
+}
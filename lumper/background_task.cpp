@@ -0,0 +1,53 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "lumper/background_task.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "spdlog/spdlog.h"
+
+namespace lumper {
+
+void lower_io_priority() noexcept {
+    constexpr int ioprio_who_process = 1;
+    constexpr int ioprio_class_idle = 3;
+    constexpr int ioprio_class_shift = 13;
+    if (::syscall(SYS_ioprio_set, ioprio_who_process, 0,
+                  ioprio_class_idle << ioprio_class_shift) != 0) {
+        SPDLOG_WARN("Failed to lower I/O priority; errno={}", errno);
+    }
+}
+
+pid_t fork_into_background() {
+    // Or buffered output would be written twice.
+    std::fflush(nullptr);
+    auto pid = ::fork();
+    if (pid == -1) {
+        throw std::system_error(errno, std::system_category(), "failed to fork");
+    }
+
+    if (pid > 0) {
+        return pid;
+    }
+
+    ::setsid();
+    int null_fd = ::open("/dev/null", O_RDWR | O_CLOEXEC);
+    if (null_fd != -1) {
+        ::dup2(null_fd, STDIN_FILENO);
+        ::dup2(null_fd, STDOUT_FILENO);
+        ::dup2(null_fd, STDERR_FILENO);
+        ::close(null_fd);
+    }
+
+    return 0;
+}
+
+} // namespace lumper
@@ -0,0 +1,25 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#pragma once
+
+#ifndef LUMPER_BACKGROUND_TASK_H_
+#define LUMPER_BACKGROUND_TASK_H_
+
+#include <sys/types.h>
+
+namespace lumper {
+
+// Lowers I/O priority to idle, to let container starts on the same disk go first.
+// ioprio applies to the calling thread and is inherited by threads created afterwards.
+void lower_io_priority() noexcept;
+
+// Forks a process detached from the terminal, with stdio redirected to /dev/null.
+// Returns pid of the background process in the parent, and 0 in the background process.
+// Throws `std::system_error` if failed to fork.
+pid_t fork_into_background();
+
+} // namespace lumper
+
+#endif // LUMPER_BACKGROUND_TASK_H_
@@ -4,32 +4,152 @@
 
 #include "lumper/cgroups/cgroup_manager.h"
 
+#include <cerrno>
+#include <exception>
+#include <filesystem>
+#include <string_view>
+#include <vector>
+
+#include <unistd.h>
+
+#include "fmt/format.h"
 #include "spdlog/spdlog.h"
 
 #include "lumper/cgroups/subsystems.h"
+#include "lumper/cgroups/unified_cgroup.h"
+#include "lumper/cgroups/util.h"
 
 namespace lumper::cgroups {
+namespace {
+
+constexpr std::string_view k_memory = "memory";
+constexpr std::string_view k_cpu = "cpu";
+constexpr std::string_view k_cpuset = "cpuset";
+
+bool has_limits(const resource_config& cfg) noexcept {
+    return !cfg.memory_limit().empty() || cfg.cpus() >= 0 || !cfg.cpuset_cpus().empty();
+}
+
+// Returns the mount point of cgroup2 if it has all controllers lumper limits with, along with
+// cpuset if `cfg` has one, otherwise empty string, and v1 hierarchies are used.
+std::string find_unified_root(const resource_config& cfg) {
+    auto root = find_cgroup2_mount_point();
+    if (root.empty()) {
+        return {};
+    }
+    std::vector<std::string_view> controllers{k_memory, k_cpu};
+    if (!cfg.cpuset_cpus().empty()) {
+        controllers.push_back(k_cpuset);
+    }
+    return has_cgroup2_controllers(root, controllers) ? root : std::string{};
+}
+
+} // namespace
+
+std::string container_cgroup_name(std::string_view container_id) {
+    return fmt::format("{}/{}", k_parent_cgroup, container_id);
+}
 
 cgroup_manager::cgroup_manager(std::string name, const resource_config& cfg)
     : name_(std::move(name)) {
-    if (!cfg.memory_limit().empty()) {
-        subsystems_.push_back(std::make_unique<memory_subsystem>(name_, cfg.memory_limit()));
+    if (has_limits(cfg)) {
+        create(cfg);
+        return;
     }
 
-    if (cfg.cpus() > 0) {
-        subsystems_.push_back(std::make_unique<cpu_subsystem>(name_, cfg.cpus()));
+    try {
+        create(cfg);
+    } catch (const std::exception& ex) {
+        SPDLOG_WARN("Failed to create cgroup without limits; name={} ex={}", name_, ex.what());
+        unified_.reset();
+        subsystems_.clear();
+        memory_ = nullptr;
     }
-
-    SPDLOG_INFO("Enabled cgroup subsystems count={}", subsystems_.size());
 }
 
 cgroup_manager::~cgroup_manager() = default;
 
+void cgroup_manager::create(const resource_config& cfg) {
+    if (auto root = find_unified_root(cfg); !root.empty()) {
+        unified_ = std::make_unique<unified_cgroup>(root, name_, cfg);
+        SPDLOG_INFO("Created cgroup v2; root={} name={}", root, name_);
+        return;
+    }
+
+    // Subsystems without limits are for limits of ancestors, thus skipped if not mounted.
+    if (!cfg.memory_limit().empty() || !find_mount_point(k_memory).empty()) {
+        auto memory = std::make_unique<memory_subsystem>(name_, cfg.memory_limit());
+        memory_ = memory.get();
+        subsystems_.push_back(std::move(memory));
+    }
+
+    if (cfg.cpus() >= 0 || !find_mount_point(k_cpu).empty()) {
+        subsystems_.push_back(std::make_unique<cpu_subsystem>(name_, cfg.cpus()));
+    }
+
+    // Unlike others, a cgroup of cpuset is unusable until given cpus, thus created only for one.
+    if (!cfg.cpuset_cpus().empty()) {
+        subsystems_.push_back(
+                std::make_unique<cpuset_subsystem>(name_, cfg.cpuset_cpus(), cfg.cpuset_mems()));
+    }
+
+    SPDLOG_INFO("Enabled cgroup subsystems; name={} count={}", name_, subsystems_.size());
+}
+
 void cgroup_manager::apply(int pid) {
+    if (unified_) {
+        unified_->apply(pid);
+        return;
+    }
+
     // TODO(KC): Be tolerant for failure of one subsystem?
     for (auto& subsys : subsystems_) {
         subsys->apply(pid);
     }
 }
 
+void cgroup_manager::keep() noexcept {
+    if (unified_) {
+        unified_->keep();
+    }
+    for (auto& subsys : subsystems_) {
+        subsys->keep();
+    }
+}
+
+int cgroup_manager::cgroup_fd() const noexcept {
+    return unified_ ? unified_->fd() : -1;
+}
+
+std::uint64_t cgroup_manager::oom_kills() const {
+    if (unified_) {
+        return unified_->oom_kills();
+    }
+    return memory_ ? memory_->oom_kills() : 0;
+}
+
+void remove_cgroup(std::string_view name) noexcept {
+    try {
+        // The cgroup was created in either, which may have changed since, e.g. after a reboot.
+        std::vector<std::string> roots{find_cgroup2_mount_point(), find_mount_point(k_memory),
+                                       find_mount_point(k_cpu), find_mount_point(k_cpuset)};
+        for (const auto& root : roots) {
+            if (root.empty()) {
+                continue;
+            }
+            auto path = std::filesystem::path(root) / name;
+            if (::rmdir(path.c_str()) != 0 && errno != ENOENT) {
+                SPDLOG_WARN("Failed to remove cgroup; errno={} path={}", errno, path.native());
+            }
+        }
+    } catch (const std::exception& ex) {
+        SPDLOG_WARN("Failed to remove cgroup; name={} ex={}", name, ex.what());
+    }
+}
+
+void limit_parent_cgroup(const resource_config& cfg) {
+    cgroup_manager parent(k_parent_cgroup, cfg);
+    parent.keep();
+}
+
 } // namespace lumper::cgroups
@@ -7,6 +7,7 @@
 #ifndef LUMPER_CGROUPS_CGROUP_MANAGER_H_
 #define LUMPER_CGROUPS_CGROUP_MANAGER_H_
 
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <string_view>
@@ -15,19 +16,37 @@
 namespace lumper::cgroups {
 
 class subsystem;
+class memory_subsystem;
+class unified_cgroup;
+
+// Parent of all containers' cgroups, thus its limits apply to containers as a whole.
+constexpr char k_parent_cgroup[] = "lumper";
+
+// Returns the cgroup of the container, i.e. lumper/<container-id>.
+std::string container_cgroup_name(std::string_view container_id);
 
 class resource_config {
 public:
+    // "max" lifts the limit, e.g. of the parent cgroup.
     resource_config& set_memory_limit(std::string_view limit) {
         memory_limit_ = limit;
         return *this;
     }
 
+    // 0 lifts the limit, e.g. of the parent cgroup.
     resource_config& set_cpus(int cpus) {
         cpus_ = cpus;
         return *this;
     }
 
+    // Cpu list, e.g. 0-3, which processes run on, and memory nodes they allocate from; both are
+    // given or neither.
+    resource_config& set_cpuset(std::string_view cpus, std::string_view mems) {
+        cpuset_cpus_ = cpus;
+        cpuset_mems_ = mems;
+        return *this;
+    }
+
     const std::string& memory_limit() const noexcept {
         return memory_limit_;
     }
@@ -36,15 +55,30 @@ public:
         return cpus_;
     }
 
+    const std::string& cpuset_cpus() const noexcept {
+        return cpuset_cpus_;
+    }
+
+    const std::string& cpuset_mems() const noexcept {
+        return cpuset_mems_;
+    }
+
 private:
     std::string memory_limit_;
     int cpus_{-1};
+    std::string cpuset_cpus_;
+    std::string cpuset_mems_;
 };
 
+// Limits are applied with the unified hierarchy, i.e. cgroup v2, if it has the controllers
+// lumper limits with; otherwise with v1 hierarchies, one for each subsystem.
+// Containers and their parent are thus always in the same hierarchies.
 class cgroup_manager {
 public:
+    // The cgroup is created even if `cfg` has no limits, thus limits of its ancestors apply; it is
+    // not worth failing a container then, and failures are only logged.
     // Throws
-    //  - `std::filesystem::filesystem_error` for filesystem related errors.
+    //  - `std::system_error`, e.g. `std::filesystem::filesystem_error`, for file related errors.
     //  - `std::runtime_error` if mount point of `subsystem` cannot be found.
     cgroup_manager(std::string name, const resource_config& cfg);
 
@@ -58,13 +92,49 @@ public:
 
     cgroup_manager& operator=(cgroup_manager&&) = delete;
 
+    // Returns false if failed to create the cgroup without limits.
+    bool has_cgroup() const noexcept {
+        return unified_ != nullptr || !subsystems_.empty();
+    }
+
+    const std::string& name() const noexcept {
+        return name_;
+    }
+
+    // Moves `pid` into the cgroup; a no-op for a process created in it with `cgroup_fd()`.
     void apply(int pid);
 
+    // Leaves the cgroup on destruction, e.g. for a detached container, whose cgroup is removed
+    // with `remove_cgroup()` along with the container.
+    void keep() noexcept;
+
+    // Returns the directory of the cgroup, which processes can be created in with
+    // `CLONE_INTO_CGROUP`; -1 if there is no cgroup or limits are applied with v1.
+    int cgroup_fd() const noexcept;
+
+    // Returns processes killed by the OOM killer in the cgroup so far; 0 if memory isn't limited.
+    // Throws `std::system_error` when failed.
+    std::uint64_t oom_kills() const;
+
+private:
+    void create(const resource_config& cfg);
+
 private:
     std::string name_;
     std::vector<std::unique_ptr<subsystem>> subsystems_;
+    memory_subsystem* memory_{nullptr};
+    std::unique_ptr<unified_cgroup> unified_;
 };
 
+// Removes the cgroup from all hierarchies it may be in; failures are logged, e.g. if processes
+// are still in it.
+void remove_cgroup(std::string_view name) noexcept;
+
+// Sets limits of `k_parent_cgroup`, creating it if not exists; it is kept afterwards, until the
+// host reboots.
+// Throws as `cgroup_manager`.
+void limit_parent_cgroup(const resource_config& cfg);
+
 } // namespace lumper::cgroups
 
 #endif // LUMPER_CGROUPS_CGROUP_MANAGER_H_
@@ -14,6 +14,7 @@
 #include "spdlog/spdlog.h"
 
 #include "base/file_util.h"
+#include "base/procfs.h"
 #include "lumper/cgroups/util.h"
 
 namespace lumper::cgroups {
@@ -27,20 +28,31 @@ constexpr char task_filename[] = "tasks";
 
 cpu_subsystem::cpu_subsystem(std::string_view cgroup_name, int cpus) {
     assert(!cgroup_name.empty());
-    assert(cpus > 0);
     cgroup_path_ = get_cgroup_path_for_subsystem(cpu_subsystem::name, cgroup_name, true);
     ESL_ON_SCOPE_FAIL {
         remove();
     };
 
-    auto period_path = cgroup_path_ / period_filename;
-    auto period = base::read_file_to_string(period_path);
+    if (cpus < 0) {
+        return;
+    }
+
     auto quota_path = cgroup_path_ / quota_filename;
-    base::write_to_file(quota_path, fmt::to_string(cpus * std::stoi(period)));
+    if (cpus == 0) {
+        base::write_to_file(quota_path, "-1");
+        return;
+    }
+
+    char buf[k_cgroup_file_buf_size];
+    auto period_path = cgroup_path_ / period_filename;
+    auto period = base::read_proc_file(period_path.c_str(), buf, sizeof(buf));
+    base::write_to_file(quota_path, fmt::to_string(cpus * std::stoi(std::string(period))));
 }
 
 cpu_subsystem::~cpu_subsystem() {
-    remove();
+    if (!keep_) {
+        remove();
+    }
 }
 
 void cpu_subsystem::apply(int pid) {
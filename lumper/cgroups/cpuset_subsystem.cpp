@@ -0,0 +1,88 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "lumper/cgroups/subsystems.h"
+
+#include <cassert>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "esl/scope_guard.h"
+#include "fmt/format.h"
+#include "spdlog/spdlog.h"
+
+#include "base/file_util.h"
+#include "base/procfs.h"
+#include "lumper/cgroups/util.h"
+
+namespace lumper::cgroups {
+namespace {
+
+constexpr char cpus_filename[] = "cpuset.cpus";
+constexpr char mems_filename[] = "cpuset.mems";
+constexpr char task_filename[] = "tasks";
+
+// A cgroup of v1 cpuset is created with empty cpus and mems, unless `cgroup.clone_children` of
+// its parent is set, and tasks cannot join it then; thus intermediate ones, e.g. lumper, are
+// given those of their parents.
+void inherit_cpuset(const std::filesystem::path& parent, const std::filesystem::path& dir) {
+    char buf[k_cgroup_file_buf_size];
+    for (const auto* filename : {mems_filename, cpus_filename}) {
+        auto path = dir / filename;
+        auto value = base::read_proc_file(path.c_str(), buf, sizeof(buf));
+        if (!value.empty() && value != "\n") {
+            continue;
+        }
+        auto parent_path = parent / filename;
+        std::string parent_value(base::read_proc_file(parent_path.c_str(), buf, sizeof(buf)));
+        base::write_to_file(path, parent_value);
+    }
+}
+
+} // namespace
+
+cpuset_subsystem::cpuset_subsystem(std::string_view cgroup_name,
+                                   std::string_view cpus,
+                                   std::string_view mems) {
+    assert(!cgroup_name.empty());
+    assert(!cpus.empty() && !mems.empty());
+    cgroup_path_ = get_cgroup_path_for_subsystem(cpuset_subsystem::name, cgroup_name, true);
+    ESL_ON_SCOPE_FAIL {
+        remove();
+    };
+
+    std::filesystem::path path(find_mount_point(cpuset_subsystem::name));
+    for (const auto& part : std::filesystem::path(cgroup_name).relative_path().parent_path()) {
+        auto parent = path;
+        path /= part;
+        inherit_cpuset(parent, path);
+    }
+
+    // Mems first, as a cgroup needs both before taking tasks.
+    base::write_to_file(cgroup_path_ / mems_filename, mems);
+    base::write_to_file(cgroup_path_ / cpus_filename, cpus);
+}
+
+cpuset_subsystem::~cpuset_subsystem() {
+    if (!keep_) {
+        remove();
+    }
+}
+
+void cpuset_subsystem::apply(int pid) {
+    auto task_path = cgroup_path_ / task_filename;
+    base::write_to_file(task_path, fmt::to_string(pid));
+}
+
+void cpuset_subsystem::remove() noexcept {
+    auto rc = ::rmdir(cgroup_path_.c_str());
+    if (rc != 0 && errno != ENOENT) {
+        SPDLOG_ERROR("Failed to cleanup cgroup cpuset subsystem; errno={} path={}",
+                     errno, cgroup_path_.native());
+    }
+}
+
+} // namespace lumper::cgroups
@@ -5,6 +5,7 @@
 #include "lumper/cgroups/subsystems.h"
 
 #include <cassert>
+#include <string>
 
 #include <unistd.h>
 
@@ -14,6 +15,7 @@
 #include "spdlog/spdlog.h"
 
 #include "base/file_util.h"
+#include "base/procfs.h"
 #include "lumper/cgroups/util.h"
 
 namespace lumper::cgroups {
@@ -21,23 +23,27 @@ namespace {
 
 constexpr char limit_filename[] = "memory.limit_in_bytes";
 constexpr char task_filename[] = "tasks";
+constexpr char oom_control_filename[] = "memory.oom_control";
 
 } // namespace
 
 memory_subsystem::memory_subsystem(std::string_view cgroup_name, std::string_view memory_limit) {
     assert(!cgroup_name.empty());
-    assert(!memory_limit.empty());
     cgroup_path_ = get_cgroup_path_for_subsystem(memory_subsystem::name, cgroup_name, true);
     ESL_ON_SCOPE_FAIL {
         remove();
     };
 
-    auto limit_path = cgroup_path_ / limit_filename;
-    base::write_to_file(limit_path, memory_limit);
+    if (!memory_limit.empty()) {
+        auto limit_path = cgroup_path_ / limit_filename;
+        base::write_to_file(limit_path, memory_limit == "max" ? "-1" : memory_limit);
+    }
 }
 
 memory_subsystem::~memory_subsystem() {
-    remove();
+    if (!keep_) {
+        remove();
+    }
 }
 
 void memory_subsystem::apply(int pid) {
@@ -45,6 +51,14 @@ void memory_subsystem::apply(int pid) {
     base::write_to_file(task_path, fmt::to_string(pid));
 }
 
+std::uint64_t memory_subsystem::oom_kills() const {
+    char buf[k_cgroup_file_buf_size];
+    auto path = cgroup_path_ / oom_control_filename;
+    auto content = base::read_proc_file(path.c_str(), buf, sizeof(buf));
+    auto value = find_cgroup_key_value(content, "oom_kill");
+    return value ? std::stoull(std::string(*value)) : 0;
+}
+
 void memory_subsystem::remove() noexcept {
     // See https://lists.linuxfoundation.org/pipermail/containers/2009-March/016518.html
     auto rc = ::rmdir(cgroup_path_.c_str());
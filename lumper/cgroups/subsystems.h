@@ -7,6 +7,7 @@
 #ifndef LUMPER_CGROUPS_SUBSYSTEMS_H_
 #define LUMPER_CGROUPS_SUBSYSTEMS_H_
 
+#include <cstdint>
 #include <filesystem>
 #include <string_view>
 
@@ -17,13 +18,22 @@ public:
     virtual ~subsystem() = default;
 
     virtual void apply(int pid) = 0;
+
+    // Leaves the cgroup on destruction, e.g. for a detached container.
+    void keep() noexcept {
+        keep_ = true;
+    }
+
+protected:
+    bool keep_{false};
 };
 
 class memory_subsystem : public subsystem {
 public:
-    // Caller must guarantee that `cgroup_name` and `memory_limit` both are not empty.
+    // Caller must guarantee that `cgroup_name` is not empty; the memory is not limited if
+    // `memory_limit` is empty, and "max" lifts the limit of an existing cgroup.
     // Throws
-    //  - `std::filesystem::filesystem_error` for filesystem related errors.
+    //  - `std::system_error`, e.g. `std::filesystem::filesystem_error`, for file related errors.
     //  - `std::runtime_error` if mount point of `subsystem` cannot be found.
     memory_subsystem(std::string_view cgroup_name, std::string_view memory_limit);
 
@@ -40,6 +50,11 @@ public:
     // Throws `std::filesystem::filesystem_error` when failed.
     void apply(int pid) override;
 
+    // Returns the number of processes killed by the OOM killer in the cgroup so far; 0 if the
+    // kernel doesn't count, i.e. before 4.13.
+    // Throws `std::system_error` when failed.
+    std::uint64_t oom_kills() const;
+
 private:
     void remove() noexcept;
 
@@ -50,9 +65,10 @@ private:
 
 class cpu_subsystem : public subsystem {
 public:
-    // Caller must guarantee that `cgroup_name` and `memory_limit` both are not empty.
+    // Caller must guarantee that `cgroup_name` is not empty; cpus are not limited if `cpus` is
+    // negative, and 0 lifts the limit of an existing cgroup.
     // Throws
-    //  - `std::filesystem::filesystem_error` for filesystem related errors.
+    //  - `std::system_error`, e.g. `std::filesystem::filesystem_error`, for file related errors.
     //  - `std::runtime_error` if mount point of `subsystem` cannot be found.
     cpu_subsystem(std::string_view cgroup_name, int cpus);
 
@@ -77,6 +93,37 @@ private:
     static constexpr char name[] = "cpu";
 };
 
+class cpuset_subsystem : public subsystem {
+public:
+    // Caller must guarantee that `cgroup_name`, `cpus` and `mems` are not empty; they are cpu
+    // lists, e.g. 0-3, of cpus and memory nodes, and must be within those of the parent.
+    // Ancestors created without cpus and mems are given those of their parents.
+    // Throws
+    //  - `std::system_error`, e.g. `std::filesystem::filesystem_error`, for file related errors.
+    //  - `std::runtime_error` if mount point of `subsystem` cannot be found.
+    cpuset_subsystem(std::string_view cgroup_name, std::string_view cpus, std::string_view mems);
+
+    ~cpuset_subsystem() override;
+
+    cpuset_subsystem(const cpuset_subsystem&) = delete;
+
+    cpuset_subsystem(cpuset_subsystem&&) = delete;
+
+    cpuset_subsystem& operator=(const cpuset_subsystem&) = delete;
+
+    cpuset_subsystem& operator=(cpuset_subsystem&&) = delete;
+
+    // Throws `std::filesystem::filesystem_error` when failed.
+    void apply(int pid) override;
+
+private:
+    void remove() noexcept;
+
+private:
+    std::filesystem::path cgroup_path_;
+    static constexpr char name[] = "cpuset";
+};
+
 } // namespace lumper::cgroups
 
 #endif // LUMPER_CGROUPS_SUBSYSTEMS_H_
@@ -0,0 +1,140 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "lumper/cgroups/unified_cgroup.h"
+
+#include <algorithm>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "esl/scope_guard.h"
+#include "fmt/format.h"
+#include "spdlog/spdlog.h"
+
+#include "base/file_util.h"
+#include "base/procfs.h"
+#include "lumper/cgroups/cgroup_manager.h"
+#include "lumper/cgroups/util.h"
+
+namespace lumper::cgroups {
+namespace {
+
+constexpr char subtree_control_filename[] = "cgroup.subtree_control";
+constexpr char procs_filename[] = "cgroup.procs";
+constexpr char memory_max_filename[] = "memory.max";
+constexpr char memory_events_filename[] = "memory.events";
+constexpr char cpu_max_filename[] = "cpu.max";
+constexpr char cpuset_cpus_filename[] = "cpuset.cpus";
+constexpr char cpuset_mems_filename[] = "cpuset.mems";
+
+// Same as the default of `cpu.max`.
+constexpr int cpu_period_us = 100000;
+
+// Controllers are enabled one by one, thus a failure tells which one is missing.
+void enable_controllers(const std::filesystem::path& dir,
+                        const std::vector<std::string_view>& controllers) {
+    char buf[k_cgroup_file_buf_size];
+    auto path = dir / subtree_control_filename;
+    auto content = base::read_proc_file(path.c_str(), buf, sizeof(buf));
+    auto enabled = parse_cgroup_controllers(content);
+    for (auto controller : controllers) {
+        if (std::find(enabled.begin(), enabled.end(), controller) == enabled.end()) {
+            base::write_to_file(dir / subtree_control_filename, fmt::format("+{}", controller));
+        }
+    }
+}
+
+} // namespace
+
+unified_cgroup::unified_cgroup(const std::filesystem::path& root,
+                               std::string_view cgroup_name,
+                               const resource_config& cfg)
+    : cgroup_path_(root / cgroup_name) {
+    std::vector<std::string_view> controllers;
+    if (!cfg.memory_limit().empty()) {
+        controllers.push_back("memory");
+    }
+    if (cfg.cpus() >= 0) {
+        controllers.push_back("cpu");
+    }
+    if (!cfg.cpuset_cpus().empty()) {
+        controllers.push_back("cpuset");
+    }
+
+    // A controller is available to a cgroup only if enabled by each ancestor for its children.
+    constexpr mode_t perm = 0755;
+    auto path = root;
+    for (const auto& part : std::filesystem::path(cgroup_name).relative_path()) {
+        enable_controllers(path, controllers);
+        path /= part;
+        if (::mkdir(path.c_str(), perm) != 0 && errno != EEXIST) {
+            throw std::filesystem::filesystem_error("cannot mkdir for cgroup path", path,
+                                                    std::error_code(errno, std::system_category()));
+        }
+    }
+    ESL_ON_SCOPE_FAIL {
+        remove();
+    };
+
+    if (!cfg.memory_limit().empty()) {
+        memory_limited_ = true;
+        // Takes suffixes as `memory.limit_in_bytes` of v1, e.g. 512m, and "max".
+        base::write_to_file(cgroup_path_ / memory_max_filename, cfg.memory_limit());
+    }
+    if (cfg.cpus() == 0) {
+        base::write_to_file(cgroup_path_ / cpu_max_filename, fmt::format("max {}", cpu_period_us));
+    } else if (cfg.cpus() > 0) {
+        base::write_to_file(cgroup_path_ / cpu_max_filename,
+                            fmt::format("{} {}", cfg.cpus() * cpu_period_us, cpu_period_us));
+    }
+    // Ancestors left empty use cpus and mems of their parents, unlike v1.
+    if (!cfg.cpuset_cpus().empty()) {
+        base::write_to_file(cgroup_path_ / cpuset_cpus_filename, cfg.cpuset_cpus());
+        base::write_to_file(cgroup_path_ / cpuset_mems_filename, cfg.cpuset_mems());
+    }
+
+    fd_.reset(::open(cgroup_path_.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    if (!fd_) {
+        throw std::filesystem::filesystem_error("cannot open cgroup", cgroup_path_,
+                                                std::error_code(errno, std::system_category()));
+    }
+}
+
+unified_cgroup::~unified_cgroup() {
+    if (!keep_) {
+        remove();
+    }
+}
+
+void unified_cgroup::apply(int pid) {
+    base::write_to_file(cgroup_path_ / procs_filename, fmt::to_string(pid));
+}
+
+std::uint64_t unified_cgroup::oom_kills() const {
+    if (!memory_limited_) {
+        return 0;
+    }
+
+    char buf[k_cgroup_file_buf_size];
+    auto path = cgroup_path_ / memory_events_filename;
+    auto content = base::read_proc_file(path.c_str(), buf, sizeof(buf));
+    auto value = find_cgroup_key_value(content, "oom_kill");
+    return value ? std::stoull(std::string(*value)) : 0;
+}
+
+void unified_cgroup::remove() noexcept {
+    fd_.reset();
+    auto rc = ::rmdir(cgroup_path_.c_str());
+    if (rc != 0 && errno != ENOENT) {
+        SPDLOG_ERROR("Failed to cleanup unified cgroup; errno={} path={}",
+                     errno, cgroup_path_.native());
+    }
+}
+
+} // namespace lumper::cgroups
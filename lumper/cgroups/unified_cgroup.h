@@ -0,0 +1,71 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#pragma once
+
+#ifndef LUMPER_CGROUPS_UNIFIED_CGROUP_H_
+#define LUMPER_CGROUPS_UNIFIED_CGROUP_H_
+
+#include <cstdint>
+#include <filesystem>
+#include <string_view>
+
+#include "esl/unique_handle.h"
+
+namespace lumper::cgroups {
+
+class resource_config;
+
+// A cgroup of the unified hierarchy, i.e. cgroup v2, where all controllers share one directory
+// and processes are moved via `cgroup.procs`.
+class unified_cgroup {
+public:
+    // Creates `cgroup_name` under `root`, the mount point of cgroup2, along with its ancestors,
+    // enables controllers needed by `cfg` down the way, and sets limits of `cfg`.
+    // Throws `std::system_error`, e.g. `std::filesystem::filesystem_error`, when failed.
+    unified_cgroup(const std::filesystem::path& root,
+                   std::string_view cgroup_name,
+                   const resource_config& cfg);
+
+    ~unified_cgroup();
+
+    unified_cgroup(const unified_cgroup&) = delete;
+
+    unified_cgroup(unified_cgroup&&) = delete;
+
+    unified_cgroup& operator=(const unified_cgroup&) = delete;
+
+    unified_cgroup& operator=(unified_cgroup&&) = delete;
+
+    // The directory of the cgroup, for `CLONE_INTO_CGROUP`.
+    int fd() const noexcept {
+        return fd_.get();
+    }
+
+    // Throws `std::filesystem::filesystem_error` when failed.
+    void apply(int pid);
+
+    // Leaves the cgroup on destruction, e.g. for a detached container.
+    void keep() noexcept {
+        keep_ = true;
+    }
+
+    // Returns the number of processes killed by the OOM killer in the cgroup so far; 0 if memory
+    // isn't limited.
+    // Throws `std::system_error` when failed.
+    std::uint64_t oom_kills() const;
+
+private:
+    void remove() noexcept;
+
+private:
+    std::filesystem::path cgroup_path_;
+    esl::unique_fd fd_;
+    bool memory_limited_{false};
+    bool keep_{false};
+};
+
+} // namespace lumper::cgroups
+
+#endif // LUMPER_CGROUPS_UNIFIED_CGROUP_H_
@@ -5,8 +5,6 @@
 #include "lumper/cgroups/util.h"
 
 #include <algorithm>
-#include <cassert>
-#include <fstream>
 #include <stdexcept>
 #include <system_error>
 #include <vector>
@@ -14,29 +12,52 @@
 #include <sys/stat.h>
 
 #include "fmt/format.h"
-#include "esl/strings.h"
+
+#include "base/procfs.h"
 
 namespace lumper::cgroups {
 
 std::string find_mount_point(std::string_view subsystem) {
-    std::ifstream in("/proc/self/mountinfo");
-    if (!in) {
-        throw std::filesystem::filesystem_error(
-                "cannot open '/proc/self/mountinfo' file",
-                std::error_code(errno, std::system_category()));
+    return std::string(base::mount_table::get().find_cgroup_mount_point(subsystem));
+}
+
+std::string find_cgroup2_mount_point() {
+    return std::string(base::mount_table::get().find_cgroup2_mount_point());
+}
+
+std::vector<std::string_view> parse_cgroup_controllers(std::string_view content) {
+    std::vector<std::string_view> controllers;
+    constexpr std::string_view spaces = " \t\n";
+    for (auto begin = content.find_first_not_of(spaces); begin != std::string_view::npos;) {
+        auto end = content.find_first_of(spaces, begin);
+        controllers.push_back(content.substr(begin, end - begin));
+        begin = content.find_first_not_of(spaces, end);
     }
+    return controllers;
+}
 
-    for (std::string line; std::getline(in, line);) {
-        auto fields = esl::strings::split(line, ' ', esl::strings::skip_empty{})
-                              .to<std::vector<std::string_view>>();
-        assert(fields.size() > 4);
-        auto toks = esl::strings::split(fields.back(), ',');
-        if (std::find(toks.begin(), toks.end(), subsystem) != toks.end()) {
-            return std::string(fields[4]);
+std::optional<std::string_view> find_cgroup_key_value(std::string_view content,
+                                                      std::string_view key) {
+    while (!content.empty()) {
+        auto eol = content.find('\n');
+        auto line = content.substr(0, eol);
+        if (line.size() > key.size() && line.compare(0, key.size(), key) == 0 &&
+            line[key.size()] == ' ') {
+            return line.substr(key.size() + 1);
         }
+        content.remove_prefix(eol == std::string_view::npos ? content.size() : eol + 1);
     }
+    return std::nullopt;
+}
 
-    return {};
+bool has_cgroup2_controllers(const std::filesystem::path& root,
+                             const std::vector<std::string_view>& controllers) {
+    char buf[k_cgroup_file_buf_size];
+    auto path = root / "cgroup.controllers";
+    auto available = parse_cgroup_controllers(base::read_proc_file(path.c_str(), buf, sizeof(buf)));
+    return std::all_of(controllers.begin(), controllers.end(), [&available](auto controller) {
+        return std::find(available.begin(), available.end(), controller) != available.end();
+    });
 }
 
 std::filesystem::path get_cgroup_path_for_subsystem(std::string_view subsystem,
@@ -57,13 +78,18 @@ std::filesystem::path get_cgroup_path_for_subsystem(std::string_view subsystem,
                     std::make_error_code(std::errc::no_such_file_or_directory));
         }
 
+        // Ancestors, e.g. the parent of all containers' cgroups, are created along.
         constexpr auto perm = S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH;
         static_assert(perm == 0755); // NOLINT(readability-magic-numbers)
-        if (int rc = ::mkdir(cgroup_path.c_str(), perm); rc != 0 && errno != EEXIST) {
-            throw std::filesystem::filesystem_error(
-                    "cannot mkdir for cgroup path",
-                    cgroup_path,
-                    std::error_code(errno, std::system_category()));
+        auto path = cgroup_root;
+        for (const auto& part : std::filesystem::path(cgroup_name).relative_path()) {
+            path /= part;
+            if (int rc = ::mkdir(path.c_str(), perm); rc != 0 && errno != EEXIST) {
+                throw std::filesystem::filesystem_error(
+                        "cannot mkdir for cgroup path",
+                        path,
+                        std::error_code(errno, std::system_category()));
+            }
         }
     }
 
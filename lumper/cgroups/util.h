@@ -7,19 +7,47 @@
 #ifndef LUMPER_CGROUPS_UTIL_H_
 #define LUMPER_CGROUPS_UTIL_H_
 
+#include <cstddef>
 #include <filesystem>
+#include <optional>
 #include <string>
 #include <string_view>
+#include <vector>
 
 namespace lumper::cgroups {
 
+// Cgroup files, e.g. `memory.stat` and `cgroup.controllers`, are read into buffers of this size.
+constexpr std::size_t k_cgroup_file_buf_size = 4096;
+
 // Returns mount point of the given subsystem, otherwise returns empty string if not found.
-// Throws `std::filesystem::filesystem_error` on file failure, but should rarely happend in
-// practice.
+// Mounts are looked up in `base::mount_table::get()`, parsed once per process.
+// Throws `std::system_error` on file failure, but should rarely happend in practice.
 std::string find_mount_point(std::string_view subsystem);
 
+// Returns mount point of the unified hierarchy, i.e. cgroup v2, otherwise returns empty string if
+// not mounted.
+// Throws `std::system_error` on file failure.
+std::string find_cgroup2_mount_point();
+
+// Parses a space-separated list of controllers, e.g. content of `cgroup.controllers`.
+// Returned views refer to `content`.
+std::vector<std::string_view> parse_cgroup_controllers(std::string_view content);
+
+// Returns the value of `key` in lines of `key value`, e.g. content of `memory.events`, or
+// `std::nullopt` if not found.
+// The returned view refers to `content`.
+std::optional<std::string_view> find_cgroup_key_value(std::string_view content,
+                                                      std::string_view key);
+
+// Returns true if all of `controllers` are available in the unified hierarchy mounted at `root`;
+// on hybrid hosts controllers are bound to v1 hierarchies, and the unified one has none.
+// Throws `std::system_error` on file failure.
+bool has_cgroup2_controllers(const std::filesystem::path& root,
+                             const std::vector<std::string_view>& controllers);
+
 // Returns the path to the desired cgroup.
-// If the path doesn't exist but `auto_create` is true then create it automatically.
+// If the path doesn't exist but `auto_create` is true then create it automatically, along with
+// ancestors of a nested `cgroup_name`, e.g. lumper/<container-id>.
 // Throws:
 //  - `std::filesystem::filesystem_error` if path doesn't exist and `auto_create` is false; in
 //    this particular case, error_code should correspond to `no_such_file_or_directory`.
@@ -11,14 +11,40 @@
 #include "fmt/printf.h"
 #include "fmt/ranges.h"
 
+#include "base/thread_pool.h"
+#include "lumper/container_filter.h"
+#include "lumper/cpu_topology.h"
+#include "lumper/cpuset_allocator.h"
+
 namespace lumper {
 namespace {
 
 constexpr char k_prog_cmd[] = "COMMAND";
+constexpr char k_opt_state_durability[] = "--state-durability";
+constexpr char k_cmd_clone[] = "clone";
+constexpr char k_cmd_commit[] = "commit";
+constexpr char k_cmd_events[] = "events";
+constexpr char k_cmd_export[] = "export";
+constexpr char k_cmd_image_pin[] = "image pin";
+constexpr char k_cmd_image_pins[] = "image pins";
+constexpr char k_cmd_image_prune[] = "image prune";
+constexpr char k_cmd_image_squash[] = "image squash";
+constexpr char k_cmd_image_unpin[] = "image unpin";
+constexpr char k_cmd_inspect[] = "inspect";
+constexpr char k_cmd_limit[] = "limit";
 constexpr char k_cmd_run[] = "run";
+constexpr char k_cmd_prune[] = "prune";
 constexpr char k_cmd_ps[] = "ps";
+constexpr char k_cmd_pull[] = "pull";
 constexpr char k_cmd_rm[] = "rm";
 
+// For commands running tasks on a thread pool, see `get_jobs()`.
+inline void validate_jobs(const argparse::ArgumentParser* parser) {
+    if (auto jobs = parser->present<int>("--jobs"); jobs && *jobs <= 0) {
+        throw std::invalid_argument("--jobs must be positive");
+    }
+}
+
 inline void validate(cli::cmd_run_t, const argparse::ArgumentParser* parser) {
     auto argv = parser->present<std::vector<std::string>>("CMD");
     if (!argv || argv->empty()) {
@@ -28,14 +54,121 @@ inline void validate(cli::cmd_run_t, const argparse::ArgumentParser* parser) {
     if (parser->get<bool>("--it") && parser->get<bool>("--detach")) {
         throw std::invalid_argument("--it and --detach cannot both be given");
     }
+
+    if (parser->get<int>("--prefetch-window") < 0) {
+        throw std::invalid_argument("--prefetch-window must not be negative");
+    }
+
+    if (auto cpuset = parser->present<std::string>("--cpuset"); cpuset) {
+        if (*cpuset == k_cpuset_auto) {
+            if (auto cpus = parser->present<int>("--cpus"); !cpus || *cpus <= 0) {
+                throw std::invalid_argument("--cpuset auto requires positive --cpus");
+            }
+        } else {
+            parse_cpu_list(*cpuset);
+        }
+    }
+
+    if (auto node = parser->present<int>("--numa"); node && *node < 0) {
+        throw std::invalid_argument("--numa must not be negative");
+    }
+}
+
+inline void validate(cli::cmd_clone_t, const argparse::ArgumentParser* parser) {
+    if (parser->get<int>("--count") <= 0) {
+        throw std::invalid_argument("--count must be positive");
+    }
+
+    validate_jobs(parser);
+}
+
+// Image name is used as a path component.
+inline void validate_image_name(const std::string& image) {
+    if (image.empty() || image == "." || image == ".." || image.find('/') != std::string::npos) {
+        throw std::invalid_argument("invalid image name: " + image);
+    }
+}
+
+inline void validate(cli::cmd_commit_t, const argparse::ArgumentParser* parser) {
+    validate_image_name(parser->get<std::string>("IMAGE"));
+}
+
+inline void validate(cli::cmd_events_t, const argparse::ArgumentParser* parser) {
+    if (auto since = parser->present<std::string>("--since"); since) {
+        parse_age(*since);
+    }
+}
+
+inline void validate(cli::cmd_export_t, const argparse::ArgumentParser* parser) {
+    if (parser->get<std::string>("--output").empty()) {
+        throw std::invalid_argument("--output must not be empty");
+    }
+}
+
+inline void validate(cli::cmd_image_pin_t, const argparse::ArgumentParser* parser) {}
+
+inline void validate(cli::cmd_image_pins_t, const argparse::ArgumentParser* parser) {}
+
+inline void validate(cli::cmd_image_prune_t, const argparse::ArgumentParser* parser) {
+    validate_jobs(parser);
+}
+
+inline void validate(cli::cmd_image_squash_t, const argparse::ArgumentParser* parser) {
+    if (parser->get<int>("--keep-top") < 0) {
+        throw std::invalid_argument("--keep-top must not be negative");
+    }
+}
+
+inline void validate(cli::cmd_image_unpin_t, const argparse::ArgumentParser* parser) {}
+
+inline void validate(cli::cmd_inspect_t, const argparse::ArgumentParser* parser) {}
+
+inline void validate(cli::cmd_limit_t, const argparse::ArgumentParser* parser) {
+    auto memory = parser->present<std::string>("--memory");
+    auto cpus = parser->present<int>("--cpus");
+    if (!memory && !cpus) {
+        throw std::invalid_argument("at least one of --memory and --cpus must be given");
+    }
+
+    if (memory && memory->empty()) {
+        throw std::invalid_argument("--memory must not be empty");
+    }
+
+    if (cpus && *cpus < 0) {
+        throw std::invalid_argument("--cpus must not be negative");
+    }
+}
+
+inline void validate(cli::cmd_prune_t, const argparse::ArgumentParser* parser) {
+    container_filter::parse(parser->present<std::string>("--until"),
+                            parser->present<std::string>("--filter"));
+
+    validate_jobs(parser);
 }
 
 inline void validate(cli::cmd_ps_t, const argparse::ArgumentParser* parser) {}
 
-inline void validate(cli::cmd_rm_t, const argparse::ArgumentParser* parser) {}
+inline void validate(cli::cmd_pull_t, const argparse::ArgumentParser* parser) {
+    if (auto name = parser->present<std::string>("--name"); name) {
+        validate_image_name(*name);
+    }
+
+    validate_jobs(parser);
+}
+
+inline void validate(cli::cmd_rm_t, const argparse::ArgumentParser* parser) {
+    validate_jobs(parser);
+}
 
 } // namespace
 
+std::size_t get_jobs(const argparse::ArgumentParser& parser) {
+    if (auto jobs = parser.present<int>("--jobs"); jobs) {
+        return static_cast<std::size_t>(*jobs);
+    }
+    return base::thread_pool::default_size();
+}
+
 // static
 void cli::init(int argc, const char* argv[]) {
     // Once ctor of `instance` is done, its lifetime will endure until after return from the
@@ -64,6 +197,15 @@ void cli::parse(int argc, const char* argv[]) {
             .help("run container in background")
             .default_value(false)
             .implicit_value(true);
+    parser_run.add_argument("--verify")
+            .help("verify digests of image layers before running")
+            .default_value(false)
+            .implicit_value(true);
+    parser_run.add_argument("--prefetch-window")
+            .help("seconds of startup reads recorded on first run of the image and prefetched "
+                  "on later runs, 0 to disable")
+            .scan<'i', int>()
+            .default_value(10);
     parser_run.add_argument("-i", "--image")
             .help("image name")
             .required();
@@ -72,6 +214,13 @@ void cli::parse(int argc, const char* argv[]) {
     parser_run.add_argument("--cpus")
             .scan<'i', int>()
             .help("enable cpu limit");
+    parser_run.add_argument("--cpuset")
+            .help("cpus to run on, e.g. 0-3,8, shared with other containers; or auto for --cpus "
+                  "cpus of its own on one NUMA node");
+    parser_run.add_argument("--numa")
+            .scan<'i', int>()
+            .help("NUMA node to allocate memory from, and to run on if --cpuset is auto or "
+                  "not given");
     parser_run.add_argument("-v", "--volume")
             .help("data volume")
             .action([](const std::string& value) {
@@ -86,20 +235,150 @@ void cli::parse(int argc, const char* argv[]) {
             .remaining();
     cmd_parser_table_.emplace(k_cmd_run, cmd_parser{cmd_run_t{}, std::move(parser_run)});
 
+    argparse::ArgumentParser parser_clone("lumper clone");
+    parser_clone.add_argument("-n", "--count")
+            .scan<'i', int>()
+            .default_value(1)
+            .help("number of containers to create");
+    parser_clone.add_argument("-j", "--jobs")
+            .scan<'i', int>()
+            .help("max number of files to copy concurrently when reflinks are not supported");
+    parser_clone.add_argument("CONTAINER_ID")
+            .help("container whose changes the new containers start with");
+    cmd_parser_table_.emplace(k_cmd_clone, cmd_parser{cmd_clone_t{}, std::move(parser_clone)});
+
+    argparse::ArgumentParser parser_commit("lumper commit");
+    parser_commit.add_argument("CONTAINER_ID")
+            .help("container whose changes are captured");
+    parser_commit.add_argument("IMAGE")
+            .help("name of the new image");
+    cmd_parser_table_.emplace(k_cmd_commit, cmd_parser{cmd_commit_t{}, std::move(parser_commit)});
+
+    argparse::ArgumentParser parser_events("lumper events");
+    parser_events.add_argument("--since")
+            .help("only events within this long ago, e.g. 90s, 30m, 24h or 7d; all kept otherwise");
+    parser_events.add_argument("-f", "--follow")
+            .help("keep running, and print events as they are recorded")
+            .nargs(0)
+            .default_value(false)
+            .implicit_value(true);
+    cmd_parser_table_.emplace(k_cmd_events, cmd_parser{cmd_events_t{}, std::move(parser_events)});
+
+    argparse::ArgumentParser parser_export("lumper export");
+    parser_export.add_argument("-o", "--output")
+            .help("file to write the tar archive to, - for stdout")
+            .default_value(std::string("-"));
+    parser_export.add_argument("CONTAINER_ID")
+            .help("container whose filesystem is exported");
+    cmd_parser_table_.emplace(k_cmd_export, cmd_parser{cmd_export_t{}, std::move(parser_export)});
+
+    argparse::ArgumentParser parser_image_pin("lumper image pin");
+    parser_image_pin.add_argument("IMAGE")
+            .help("image copied into memory, which its containers run on from then on");
+    cmd_parser_table_.emplace(k_cmd_image_pin,
+                              cmd_parser{cmd_image_pin_t{}, std::move(parser_image_pin)});
+
+    argparse::ArgumentParser parser_image_pins("lumper image pins");
+    cmd_parser_table_.emplace(k_cmd_image_pins,
+                              cmd_parser{cmd_image_pins_t{}, std::move(parser_image_pins)});
+
+    argparse::ArgumentParser parser_image_prune("lumper image prune");
+    parser_image_prune.add_argument("-a", "--all")
+            .help("remove all images not used by any container, not just unreferenced layers")
+            .default_value(false)
+            .implicit_value(true);
+    parser_image_prune.add_argument("-d", "--detach")
+            .help("delete in background once garbage is collected")
+            .default_value(false)
+            .implicit_value(true);
+    parser_image_prune.add_argument("-j", "--jobs")
+            .scan<'i', int>()
+            .help("max number of trees to delete concurrently");
+    cmd_parser_table_.emplace(k_cmd_image_prune,
+                              cmd_parser{cmd_image_prune_t{}, std::move(parser_image_prune)});
+
+    argparse::ArgumentParser parser_image_squash("lumper image squash");
+    parser_image_squash.add_argument("--keep-top")
+            .scan<'i', int>()
+            .default_value(0)
+            .help("number of top layers kept as is, e.g. those changing often");
+    parser_image_squash.add_argument("IMAGE")
+            .help("image whose layers are merged into one");
+    cmd_parser_table_.emplace(k_cmd_image_squash,
+                              cmd_parser{cmd_image_squash_t{}, std::move(parser_image_squash)});
+
+    argparse::ArgumentParser parser_image_unpin("lumper image unpin");
+    parser_image_unpin.add_argument("IMAGE")
+            .help("image whose in-memory copy is dropped, once running containers exit");
+    cmd_parser_table_.emplace(k_cmd_image_unpin,
+                              cmd_parser{cmd_image_unpin_t{}, std::move(parser_image_unpin)});
+
+    argparse::ArgumentParser parser_inspect("lumper inspect");
+    parser_inspect.add_argument("container_ids")
+            .help("a list of container id or unique prefix of it, at least one required")
+            .nargs(argparse::nargs_pattern::at_least_one);
+    cmd_parser_table_.emplace(k_cmd_inspect,
+                              cmd_parser{cmd_inspect_t{}, std::move(parser_inspect)});
+
+    argparse::ArgumentParser parser_limit("lumper limit");
+    parser_limit.add_argument("-m", "--memory")
+            .help("memory limit of all containers as a whole, e.g. 8g, or max to lift it");
+    parser_limit.add_argument("--cpus")
+            .scan<'i', int>()
+            .help("cpu limit of all containers as a whole, or 0 to lift it");
+    cmd_parser_table_.emplace(k_cmd_limit, cmd_parser{cmd_limit_t{}, std::move(parser_limit)});
+
+    argparse::ArgumentParser parser_prune("lumper prune");
+    parser_prune.add_argument("--until")
+            .help("only containers created before this long ago, e.g. 90s, 30m, 24h or 7d");
+    parser_prune.add_argument("--filter")
+            .help("only containers matching the filter, e.g. image=alpine");
+    parser_prune.add_argument("-j", "--jobs")
+            .scan<'i', int>()
+            .help("max number of containers to remove concurrently");
+    cmd_parser_table_.emplace(k_cmd_prune, cmd_parser{cmd_prune_t{}, std::move(parser_prune)});
+
     argparse::ArgumentParser parser_ps("lumper ps");
     parser_ps.add_argument("-a", "--all")
             .help("Show all containers")
             .nargs(0)
             .default_value(false)
             .implicit_value(true);
+    parser_ps.add_argument("-w", "--watch")
+            .help("Keep running after listing, and print changes of containers as json lines")
+            .nargs(0)
+            .default_value(false)
+            .implicit_value(true);
     cmd_parser_table_.emplace(k_cmd_ps, cmd_parser{cmd_ps_t{}, std::move(parser_ps)});
 
+    argparse::ArgumentParser parser_pull("lumper pull");
+    parser_pull.add_argument("-n", "--name")
+            .help("local image name; derived from the reference if not given");
+    parser_pull.add_argument("-j", "--jobs")
+            .scan<'i', int>()
+            .help("max number of layers to download concurrently");
+    parser_pull.add_argument("REFERENCE")
+            .help("image reference, e.g. localhost:5000/alpine:3.16");
+    cmd_parser_table_.emplace(k_cmd_pull, cmd_parser{cmd_pull_t{}, std::move(parser_pull)});
+
     argparse::ArgumentParser parser_rm("lumper rm");
     parser_rm.add_argument("container_ids")
-             .help("a list of container id, at least one required")
+             .help("a list of container id or unique prefix of it, at least one required")
              .nargs(argparse::nargs_pattern::at_least_one);
+    parser_rm.add_argument("--sync")
+             .help("wait until container trees are deleted, which is done in background otherwise")
+             .default_value(false)
+             .implicit_value(true);
+    parser_rm.add_argument("-j", "--jobs")
+             .scan<'i', int>()
+             .help("max number of directories to delete concurrently");
     cmd_parser_table_.emplace(k_cmd_rm, cmd_parser{cmd_rm_t{}, std::move(parser_rm)});
 
+    prog_.add_argument(k_opt_state_durability)
+            .default_value(std::string("sync"))
+            .help("how container state is flushed to disk: none, sync or batch; batch shares "
+                  "syncs among concurrent writers");
+
     prog_.add_argument(k_prog_cmd)
             .remaining()
             .help("Avaliable commands: \n  " +
@@ -111,11 +390,26 @@ void cli::parse(int argc, const char* argv[]) {
     argparse::ArgumentParser* cur_parser{&prog_};
     try {
         prog_.parse_args(argc, argv);
+        state_durability_ =
+                parse_state_durability(prog_.get<std::string>(k_opt_state_durability));
         prog_args = prog_.get<std::vector<std::string>>(k_prog_cmd);
-        const auto& cmd = prog_args[0];
-        cur_cmd_parser_ = cmd_parser_table_.find(cmd);
+        cur_cmd_parser_ = cmd_parser_table_.end();
+        if (prog_args.size() > 1) {
+            // Two-word commands, e.g. `image prune`, are parsed as a whole.
+            auto cmd = prog_args[0] + " " + prog_args[1];
+            cur_cmd_parser_ = cmd_parser_table_.find(cmd);
+            if (cur_cmd_parser_ != cmd_parser_table_.end()) {
+                prog_args.erase(prog_args.begin());
+                prog_args[0] = std::move(cmd);
+            }
+        }
+
         if (cur_cmd_parser_ == cmd_parser_table_.end()) {
-            throw std::runtime_error("Unknown command: " + cmd);
+            const auto& cmd = prog_args[0];
+            cur_cmd_parser_ = cmd_parser_table_.find(cmd);
+            if (cur_cmd_parser_ == cmd_parser_table_.end()) {
+                throw std::runtime_error("Unknown command: " + cmd);
+            }
         }
 
         cur_parser = &cur_cmd_parser_->second.parser;
@@ -7,6 +7,7 @@
 #ifndef LUMPER_CLI_H_
 #define LUMPER_CLI_H_
 
+#include <cstddef>
 #include <map>
 #include <string>
 #include <variant>
@@ -14,6 +15,7 @@
 #include "argparse/argparse.hpp"
 
 #include "base/test_util.h"
+#include "lumper/state_file.h"
 
 namespace lumper {
 
@@ -33,7 +35,20 @@ private:
 
 class cli {
 public:
+    struct cmd_clone_t {};
+    struct cmd_commit_t {};
+    struct cmd_events_t {};
+    struct cmd_export_t {};
+    struct cmd_image_pin_t {};
+    struct cmd_image_pins_t {};
+    struct cmd_image_prune_t {};
+    struct cmd_image_squash_t {};
+    struct cmd_image_unpin_t {};
+    struct cmd_inspect_t {};
+    struct cmd_limit_t {};
+    struct cmd_prune_t {};
     struct cmd_ps_t {};
+    struct cmd_pull_t {};
     struct cmd_rm_t {};
     struct cmd_run_t {};
 
@@ -50,6 +65,11 @@ public:
         return cur_cmd_parser_->second.parser;
     }
 
+    // Given by global option --state-durability.
+    state_durability state_durability_policy() const noexcept {
+        return state_durability_;
+    }
+
     template<typename Visitor>
     void process_command(Visitor&& vis) const {
         std::visit(std::forward<Visitor>(vis), cur_cmd_parser_->second.cmd);
@@ -62,7 +82,22 @@ private:
     void parse(int argc, const char* argv[]);
 
 private:
-    using cmd_type = std::variant<cmd_ps_t, cmd_rm_t, cmd_run_t>;
+    using cmd_type = std::variant<cmd_clone_t,
+                                  cmd_commit_t,
+                                  cmd_events_t,
+                                  cmd_export_t,
+                                  cmd_image_pin_t,
+                                  cmd_image_pins_t,
+                                  cmd_image_prune_t,
+                                  cmd_image_squash_t,
+                                  cmd_image_unpin_t,
+                                  cmd_inspect_t,
+                                  cmd_limit_t,
+                                  cmd_prune_t,
+                                  cmd_ps_t,
+                                  cmd_pull_t,
+                                  cmd_rm_t,
+                                  cmd_run_t>;
 
     struct cmd_parser {
         cmd_type cmd;
@@ -72,12 +107,16 @@ private:
     argparse::ArgumentParser prog_;
     std::map<std::string, cmd_parser> cmd_parser_table_;
     decltype(cmd_parser_table_)::iterator cur_cmd_parser_;
+    state_durability state_durability_{state_durability::sync};
     // NOLINTNEXTLINE(cppcoreguidelines-avoid-non-const-global-variables)
     static inline cli* current_{nullptr};
 
     FRIEND_TEST_SUBCLASS(cli_test_stub);
 };
 
+// Returns `--jobs` given to the command, or `base::thread_pool::default_size()` if not given.
+std::size_t get_jobs(const argparse::ArgumentParser& parser);
+
 } // namespace lumper
 
 #endif // LUMPER_CLI_H_
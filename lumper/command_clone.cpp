@@ -0,0 +1,200 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "lumper/commands.h"
+
+#include <chrono>
+#include <filesystem>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "esl/scope_guard.h"
+#include "esl/strings.h"
+#include "esl/unique_handle.h"
+#include "fmt/format.h"
+#include "spdlog/spdlog.h"
+
+#include "base/subprocess.h"
+#include "base/thread_pool.h"
+#include "lumper/cgroups/cgroup_manager.h"
+#include "lumper/container_cpuset.h"
+#include "lumper/container_info.h"
+#include "lumper/container_root.h"
+#include "lumper/container_status.h"
+#include "lumper/cpu_topology.h"
+#include "lumper/cpuset_allocator.h"
+#include "lumper/event_journal.h"
+#include "lumper/image_mount.h"
+#include "lumper/image_store.h"
+#include "lumper/layer_copy.h"
+#include "lumper/mount_container_before_exec.h"
+#include "lumper/path_constants.h"
+#include "lumper/state_index.h"
+#include "lumper/state_root.h"
+
+namespace lumper {
+namespace {
+
+// Removes the container of a failed clone.
+void discard_container(const container_root_info& root) {
+    try {
+        if (!root.image_mount_key.empty()) {
+            release_image_mount(root.image_mount_key, root.container_id);
+        }
+        std::filesystem::remove_all(get_container_path(root.container_id, ""));
+    } catch (const std::exception& ex) {
+        SPDLOG_ERROR("Failed to discard container of failed clone; container_id={} ex={}",
+                     root.container_id, ex.what());
+    }
+}
+
+// Clones run in detach-mode, as `lumper run --detach` does, in cgroups of their own.
+int start_container(container_root_info& root,
+                    const std::vector<std::string>& argv,
+                    cgroups::cgroup_manager& cgroup_mgr) {
+    constexpr mode_t perm = 0666;
+    auto logfile_fd = state_root::get().open_container_file(
+            root.container_id, k_container_log_filename, O_CREAT | O_WRONLY, perm);
+
+    base::subprocess::options opts;
+    opts.clone_with_flags(CLONE_NEWUTS | CLONE_NEWPID | CLONE_NEWNS | CLONE_NEWNET | CLONE_NEWIPC);
+    opts.set_stdout(base::subprocess::use_fd, logfile_fd.get());
+    opts.set_stderr(base::subprocess::use_fd, logfile_fd.get());
+    opts.detach();
+
+    mount_container_before_exec mount_container(root.container_id,
+                                                root.rootfs,
+                                                std::move(root.mount_data));
+    opts.set_evil_pre_exec_callback(&mount_container);
+    opts.clone_into_cgroup(cgroup_mgr.cgroup_fd());
+
+    try {
+        base::subprocess proc(argv, opts);
+        auto pid = proc.detached_pid();
+        cgroup_mgr.apply(pid);
+        cgroup_mgr.keep();
+        return pid;
+    } catch (const base::spawn_subprocess_error& ex) {
+        auto errc = mount_container.read_error();
+        if (errc != mount_errc::ok) {
+            SPDLOG_ERROR("Failed to run mount_proc_before_exec; reason={}", mount_errc_msg(errc));
+        }
+        throw;
+    }
+}
+
+} // namespace
+
+void process(cli::cmd_clone_t) {
+    const auto& parser = cli::for_current_process().command_parser();
+
+    auto source_id = resolve_container_id(parser.get<std::string>("CONTAINER_ID"));
+    auto count = parser.get<int>("--count");
+    auto jobs = get_jobs(parser);
+
+    // Keeps the source from being removed while copied.
+    auto source_lock = state_root::get().lock_container(source_id, container_lock_mode::shared);
+    esl::unique_fd source_upper_fd;
+    if (source_lock) {
+        source_upper_fd = state_root::get().open_container_file(source_id, "cow_rw",
+                                                                O_RDONLY | O_DIRECTORY);
+    }
+    if (!source_upper_fd) {
+        throw std::invalid_argument(fmt::format("container {} doesn't exist", source_id));
+    }
+    auto source_upper = get_fd_path(source_upper_fd.get());
+
+    auto source = load_container_info(source_id);
+    // Older versions recorded arguments joined by spaces only.
+    auto argv = !source.argv.empty()
+                        ? source.argv
+                        : esl::strings::split(source.command, ' ', esl::strings::skip_empty{})
+                                  .to<std::vector<std::string>>();
+
+    // Clones are limited as the source is, while exclusive cpus are handed out to each of them
+    // anew, as many as the source has.
+    cgroups::resource_config res_cfg;
+    if (!source.memory_limit.empty()) {
+        res_cfg.set_memory_limit(source.memory_limit);
+    }
+    if (source.cpus > 0) {
+        res_cfg.set_cpus(source.cpus);
+    }
+    int exclusive_cpu_count = 0;
+    if (source.cpuset_exclusive) {
+        exclusive_cpu_count = static_cast<int>(parse_cpu_list(source.cpuset_cpus).size());
+    } else if (!source.cpuset_cpus.empty()) {
+        res_cfg.set_cpuset(source.cpuset_cpus, source.cpuset_mems);
+    }
+
+    // Keeps the image from being pruned until the container info referencing it is saved.
+    auto store_lock = lock_image_store(image_store_lock_mode::shared);
+
+    base::thread_pool pool(jobs);
+    for (int i = 0; i < count; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        auto root = create_container_root(source);
+        ESL_ON_SCOPE_FAIL {
+            discard_container(root);
+        };
+
+        // The source may still be running, in which case files being written are copied as is
+        // at the moment.
+        std::filesystem::remove(root.upperdir);
+        auto stats = copy_layer_tree(source_upper, root.upperdir, overlay_xattrs::keep, pool);
+
+        // Held until the container info is saved, thus exclusive cpus are not handed out twice.
+        esl::unique_fd cpuset_lock;
+        auto clone_cfg = res_cfg;
+        if (exclusive_cpu_count > 0) {
+            cpuset_lock = lock_cpuset_allocator();
+            auto cpuset = assign_cpuset(cpu_topology::read(),
+                                        {k_cpuset_auto, exclusive_cpu_count, std::nullopt},
+                                        query_exclusive_cpus());
+            clone_cfg.set_cpuset(format_cpu_list(cpuset.cpus), format_cpu_list(cpuset.mems));
+        }
+
+        auto container_id = root.container_id;
+        cgroups::cgroup_manager cgroup_mgr(cgroups::container_cgroup_name(container_id),
+                                           clone_cfg);
+        auto pid = start_container(root, argv, cgroup_mgr);
+        container_info info{container_id,
+                            source.image,
+                            source.command,
+                            format_create_time(std::chrono::system_clock::now()),
+                            k_container_status_running,
+                            pid,
+                            root.image_mount_key,
+                            root.layers,
+                            get_process_start_time(pid),
+                            cgroup_mgr.has_cgroup() ? cgroup_mgr.name() : "",
+                            clone_cfg.cpuset_cpus(),
+                            clone_cfg.cpuset_mems(),
+                            exclusive_cpu_count > 0,
+                            argv,
+                            {root.lowerdirs.begin(), root.lowerdirs.end()},
+                            source.memory_limit,
+                            source.cpus};
+        save_container_info(info);
+        cpuset_lock.reset();
+        record_container_event(container_event_type::created, container_id);
+        record_container_event(container_event_type::started, container_id, pid);
+
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - start);
+        SPDLOG_INFO("Cloned container; source={} container_id={} pid={} files={} reflinked={} "
+                    "bytes={} elapsed={}ms",
+                    source_id, container_id, pid, stats.files, stats.reflinked_files,
+                    stats.file_bytes, elapsed.count());
+        fmt::print("{}\n", container_id);
+    }
+}
+
+} // namespace lumper
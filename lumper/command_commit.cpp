@@ -0,0 +1,113 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "lumper/commands.h"
+
+#include <chrono>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+#include <fcntl.h>
+
+#include "esl/scope_guard.h"
+#include "fmt/format.h"
+#include "spdlog/spdlog.h"
+
+#include "base/file_util.h"
+#include "lumper/container_info.h"
+#include "lumper/image_store.h"
+#include "lumper/layer_copy.h"
+#include "lumper/path_constants.h"
+#include "lumper/state_index.h"
+#include "lumper/state_root.h"
+
+namespace lumper {
+namespace {
+
+std::string make_local_layer_id(std::string_view container_id) {
+    auto ts = std::chrono::system_clock::now().time_since_epoch();
+    return fmt::format("{}{}-{:x}", k_local_layer_prefix, container_id,
+                       std::chrono::duration_cast<std::chrono::nanoseconds>(ts).count());
+}
+
+} // namespace
+
+void process(cli::cmd_commit_t) {
+    const auto& parser = cli::for_current_process().command_parser();
+
+    auto container_id = resolve_container_id(parser.get<std::string>("CONTAINER_ID"));
+    auto image_name = parser.get<std::string>("IMAGE");
+
+    // Keeps the base image and the new layer from being pruned until the manifest is saved.
+    auto store_lock = lock_image_store(image_store_lock_mode::shared);
+
+    // Keeps the container from being removed while copied.
+    auto container_lock =
+            state_root::get().lock_container(container_id, container_lock_mode::shared);
+    if (!container_lock) {
+        throw std::invalid_argument(fmt::format("container {} doesn't exist", container_id));
+    }
+
+    auto info = load_container_info(container_id);
+    if (info.status == k_container_status_running) {
+        SPDLOG_WARN("Committing a running container, files being written may be captured "
+                    "partially; container_id={}",
+                    container_id);
+    }
+
+    // The new image stacks on the layers of the container's image, or the image itself if it
+    // has no layers.
+    image_manifest image{image_name, fmt::format("commit:{}", container_id), {}, {}};
+    if (auto base = load_image_manifest(info.image); base) {
+        image.layers = std::move(base->layers);
+        image.base_image = std::move(base->base_image);
+    } else {
+        if (info.image == image_name) {
+            // The manifest would shadow the image it is based on.
+            throw std::invalid_argument(
+                    fmt::format("image {} has no layers and can't be committed onto", image_name));
+        }
+        image.base_image = info.image;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    auto layer_id = make_local_layer_id(container_id);
+    auto layer_path = get_layer_path(layer_id);
+    auto staging_path = layer_path;
+    staging_path += ".committing";
+    std::filesystem::create_directories(k_layers_dir);
+    ESL_ON_SCOPE_FAIL {
+        std::error_code ec;
+        std::filesystem::remove_all(staging_path, ec);
+    };
+
+    auto upper = state_root::get().open_container_file(container_id, "cow_rw",
+                                                       O_RDONLY | O_DIRECTORY);
+    if (!upper) {
+        throw std::invalid_argument(fmt::format("container {} doesn't exist", container_id));
+    }
+    auto stats = copy_layer_tree(get_fd_path(upper.get()), staging_path,
+                                 overlay_xattrs::to_layer);
+    base::sync_filesystem(staging_path);
+    std::filesystem::rename(staging_path, layer_path);
+
+    image.layers.push_back(layer_id);
+    save_image_manifest(image);
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start);
+    SPDLOG_INFO("Committed container; container_id={} image={} layer={} entries={} files={} "
+                "reflinked={} bytes={} whiteouts={}",
+                container_id, image_name, layer_id, stats.entries, stats.files,
+                stats.reflinked_files, stats.file_bytes, stats.whiteouts);
+    fmt::print("Image {} created from container {} in {}ms: {} files ({} bytes, {} reflinked)\n",
+               image_name, container_id, elapsed.count(), stats.files, stats.file_bytes,
+               stats.reflinked_files);
+}
+
+} // namespace lumper
@@ -0,0 +1,105 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "lumper/commands.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <optional>
+#include <string>
+
+#include "fmt/format.h"
+#include "nlohmann/json.hpp"
+
+#include "lumper/container_filter.h"
+#include "lumper/container_info.h"
+#include "lumper/event_journal.h"
+
+namespace lumper {
+namespace {
+
+// A writer killed between reserving a slot and committing it never commits; the slot is skipped
+// once pending this long.
+constexpr auto k_pending_timeout = std::chrono::seconds(1);
+
+// Followers sleep until a commit wakes them; the bound only guards against a missed wakeup.
+constexpr auto k_idle_timeout = std::chrono::hours(1);
+
+void print_event(const container_event& event) {
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                      event.time.time_since_epoch())
+                      .count() %
+              1000;
+    nlohmann::json j{{"seq", event.seq},
+                     {"time", fmt::format("{}.{:03}", format_create_time(event.time), ms)},
+                     {"event", to_string(event.type)},
+                     {"id", event.container_id}};
+    if (event.pid >= 0) {
+        j["pid"] = event.pid;
+    }
+    if (event.exit_code >= 0) {
+        j["exit_code"] = event.exit_code;
+    }
+    if (event.signal >= 0) {
+        j["signal"] = event.signal;
+    }
+    fmt::print("{}\n", j.dump());
+}
+
+} // namespace
+
+void process(cli::cmd_events_t) {
+    const auto& parser = cli::for_current_process().command_parser();
+
+    std::optional<std::chrono::system_clock::time_point> since;
+    if (auto age = parser.present<std::string>("--since"); age) {
+        since = std::chrono::system_clock::now() - parse_age(*age);
+    }
+    auto follow = parser.get<bool>("--follow");
+
+    const auto& journal = event_journal::get();
+    auto cursor = journal.oldest_seq();
+    std::optional<std::uint64_t> pending_seq;
+    auto pending_since = std::chrono::steady_clock::now();
+    for (;;) {
+        // Taken before reading, thus an event committed after reading ends the wait at once.
+        auto token = journal.wait_token();
+        auto result = journal.read(cursor);
+        if (result.lost > 0) {
+            fmt::print("{}\n", nlohmann::json{{"event", "lost"}, {"count", result.lost}}.dump());
+        }
+        for (const auto& event : result.events) {
+            if (!since || event.time >= *since) {
+                print_event(event);
+            }
+        }
+        std::fflush(stdout);
+
+        // Without following, a pending slot is still waited for, or skipped, thus events after
+        // one left by a killed writer are not hidden until the ring laps.
+        if (!result.pending) {
+            if (!follow) {
+                return;
+            }
+            pending_seq.reset();
+            journal.wait(token, k_idle_timeout);
+            continue;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (pending_seq != cursor) {
+            pending_seq = cursor;
+            pending_since = now;
+        } else if (now - pending_since >= k_pending_timeout) {
+            fmt::print("{}\n", nlohmann::json{{"event", "lost"}, {"count", 1}}.dump());
+            ++cursor;
+            pending_seq.reset();
+            continue;
+        }
+        journal.wait(token, k_pending_timeout);
+    }
+}
+
+} // namespace lumper
@@ -0,0 +1,129 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "lumper/commands.h"
+
+#include <chrono>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "esl/unique_handle.h"
+#include "fmt/format.h"
+#include "spdlog/spdlog.h"
+
+#include "base/tar_writer.h"
+#include "lumper/container_info.h"
+#include "lumper/image_mount.h"
+#include "lumper/image_store.h"
+#include "lumper/overlay_view.h"
+#include "lumper/state_index.h"
+#include "lumper/state_root.h"
+
+namespace lumper {
+namespace {
+
+constexpr char k_stdout_output[] = "-";
+
+// The filesystem the container sees is its upperdir on lowerdirs recorded for it, thus images
+// changed since don't matter; the upperdir is opened as `upper_fd`, which must outlive the overlay.
+std::vector<std::filesystem::path> merged_view_layers(const container_info& info, int upper_fd) {
+    std::vector<std::filesystem::path> lowerdirs(info.lowerdirs.begin(), info.lowerdirs.end());
+    if (!lowerdirs.empty()) {
+        // E.g. unmounted by a reboot.
+        if (!info.image_mount.empty()) {
+            restore_image_mount(info.image_mount, info.id);
+        }
+    } else {
+        // Older versions didn't record lowerdirs.
+        auto [image_dirs, image_file] = resolve_image(info.image);
+        lowerdirs = std::move(image_dirs);
+        if (image_file) {
+            // The container holds the reference already, acquiring again just makes sure it is
+            // mounted.
+            auto mount = acquire_image_mount(*image_file, info.id);
+            lowerdirs.push_back(std::move(mount.mountpoint));
+        }
+    }
+
+    lowerdirs.insert(lowerdirs.begin(), get_fd_path(upper_fd));
+    return lowerdirs;
+}
+
+esl::unique_fd open_output(const std::string& output) {
+    if (output == k_stdout_output) {
+        if (::isatty(STDOUT_FILENO)) {
+            throw std::invalid_argument(
+                    "refusing to write archive to a terminal, redirect stdout or use --output");
+        }
+        return esl::unique_fd(::dup(STDOUT_FILENO));
+    }
+
+    esl::unique_fd fd(::open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644));
+    if (!fd) {
+        throw std::filesystem::filesystem_error("cannot open output", output,
+                                                std::error_code(errno, std::system_category()));
+    }
+    return fd;
+}
+
+} // namespace
+
+void process(cli::cmd_export_t) {
+    const auto& parser = cli::for_current_process().command_parser();
+
+    auto container_id = resolve_container_id(parser.get<std::string>("CONTAINER_ID"));
+    auto output = parser.get<std::string>("--output");
+
+    // Keeps the container from being removed while archived.
+    auto container_lock =
+            state_root::get().lock_container(container_id, container_lock_mode::shared);
+    if (!container_lock) {
+        throw std::invalid_argument(fmt::format("container {} doesn't exist", container_id));
+    }
+
+    auto info = load_container_info(container_id);
+    if (info.status == k_container_status_running) {
+        SPDLOG_WARN("Exporting a running container, files being written may be captured "
+                    "partially; container_id={}",
+                    container_id);
+    }
+
+    auto out_fd = open_output(output);
+    if (!out_fd) {
+        throw std::system_error(errno, std::system_category(), "failed to dup stdout");
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    // Shared image mount must be made in the host namespace, while the view lives in a private
+    // one and goes away with us.
+    auto upper = state_root::get().open_container_file(container_id, "cow_rw",
+                                                       O_RDONLY | O_DIRECTORY);
+    if (!upper) {
+        throw std::invalid_argument(fmt::format("container {} doesn't exist", container_id));
+    }
+    auto layers = merged_view_layers(info, upper.get());
+    enter_private_mount_namespace();
+    readonly_overlay view(layers);
+
+    base::tar_writer writer(out_fd.get());
+    writer.add_tree(view.path());
+    writer.finish();
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start);
+    const auto& stats = writer.stats();
+    SPDLOG_INFO("Exported container; container_id={} output={} entries={} sparse_files={} "
+                "bytes={} elapsed={}ms",
+                container_id, output, stats.entries, stats.sparse_files, stats.archive_bytes,
+                elapsed.count());
+}
+
+} // namespace lumper
@@ -0,0 +1,55 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "lumper/commands.h"
+
+#include <cstdint>
+#include <string>
+
+#include "fmt/format.h"
+
+#include "lumper/image_pin.h"
+#include "lumper/image_store.h"
+
+namespace lumper {
+
+void process(cli::cmd_image_pin_t) {
+    const auto& parser = cli::for_current_process().command_parser();
+    auto image_name = parser.get<std::string>("IMAGE");
+
+    auto [pin, created] = pin_image(image_name);
+    auto usage = get_image_pin_usage(pin);
+    fmt::print("{} {}: {} bytes, {} inodes in memory\n",
+               created ? "Pinned" : "Already pinned", image_name, usage.bytes, usage.inodes);
+}
+
+void process(cli::cmd_image_pins_t) {
+    // Tmpfs pages are charged to the memory cgroup of the pinning process, not to containers.
+    std::uint64_t total_bytes = 0;
+    fmt::print("IMAGE\t"
+               "BYTES\t"
+               "INODES\t"
+               "MOUNTPOINT\t\n");
+    for (const auto& pin : list_image_pins()) {
+        auto usage = get_image_pin_usage(pin);
+        total_bytes += usage.bytes;
+        fmt::print("{}\t{}\t{}\t{}\t\n", pin.image, usage.bytes, usage.inodes,
+                   pin.mountpoint.native());
+    }
+    fmt::print("Total {} bytes pinned\n", total_bytes);
+}
+
+void process(cli::cmd_image_unpin_t) {
+    const auto& parser = cli::for_current_process().command_parser();
+    auto image_name = parser.get<std::string>("IMAGE");
+
+    auto store_lock = lock_image_store(image_store_lock_mode::exclusive);
+    if (!unpin_image(image_name)) {
+        fmt::print("{} is not pinned\n", image_name);
+        return;
+    }
+    fmt::print("Unpinned {}; memory is freed once its running containers exit\n", image_name);
+}
+
+} // namespace lumper
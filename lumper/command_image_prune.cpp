@@ -0,0 +1,57 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "lumper/commands.h"
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+
+#include "fmt/format.h"
+#include "spdlog/spdlog.h"
+
+#include "base/thread_pool.h"
+#include "lumper/background_task.h"
+#include "lumper/image_gc.h"
+
+namespace lumper {
+
+void process(cli::cmd_image_prune_t) {
+    const auto& parser = cli::for_current_process().command_parser();
+
+    auto all_unused = parser.get<bool>("--all");
+    auto detach = parser.get<bool>("--detach");
+    auto jobs = get_jobs(parser);
+
+    auto garbage = collect_image_garbage(all_unused);
+    fmt::print("Pruning {} images, {} layers and {} blobs\n",
+               garbage.images.size(), garbage.layers.size(), garbage.blobs);
+    if (garbage.trash.empty()) {
+        return;
+    }
+
+    // Garbage is in trash already and the image store is unlocked, deleting needs no more
+    // coordination.
+    if (detach) {
+        if (auto pid = fork_into_background(); pid > 0) {
+            fmt::print("Deleting in background; pid={}\n", pid);
+            return;
+        }
+    }
+
+    lower_io_priority();
+
+    auto start = std::chrono::steady_clock::now();
+    base::thread_pool pool(std::clamp<std::size_t>(jobs, 1, garbage.trash.size()));
+    auto freed = empty_trash(garbage.trash, pool);
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start);
+
+    SPDLOG_INFO("Pruned images; images={} layers={} blobs={} freed_bytes={} elapsed={}ms",
+                garbage.images.size(), garbage.layers.size(), garbage.blobs, freed,
+                elapsed.count());
+    fmt::print("Reclaimed {} bytes in {}ms\n", freed, elapsed.count());
+}
+
+} // namespace lumper
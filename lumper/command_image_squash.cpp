@@ -0,0 +1,185 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "lumper/commands.h"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "esl/scope_guard.h"
+#include "esl/unique_handle.h"
+#include "fmt/format.h"
+#include "spdlog/spdlog.h"
+
+#include "base/file_util.h"
+#include "lumper/image_store.h"
+#include "lumper/layer_copy.h"
+#include "lumper/overlay_view.h"
+#include "lumper/path_constants.h"
+
+namespace lumper {
+namespace {
+
+constexpr std::size_t k_max_sample_paths = 4096;
+constexpr std::size_t k_lookup_rounds = 3;
+// Probing for files that don't exist, e.g. Python searching modules along sys.path, is the
+// worst case, as the lookup goes through all layers.
+constexpr std::string_view k_missing_suffix = ".lumper-missing";
+
+struct lookup_latency {
+    double hit_us;
+    double miss_us;
+};
+
+std::string make_squashed_layer_id() {
+    auto ts = std::chrono::system_clock::now().time_since_epoch();
+    return fmt::format("{}squash-{:x}", k_local_layer_prefix,
+                       std::chrono::duration_cast<std::chrono::nanoseconds>(ts).count());
+}
+
+std::vector<std::string> sample_paths(const std::filesystem::path& root) {
+    std::vector<std::string> paths;
+    for (const auto& entry : std::filesystem::recursive_directory_iterator(root)) {
+        if (paths.size() == k_max_sample_paths) {
+            break;
+        }
+        paths.push_back(entry.path().lexically_relative(root).native());
+    }
+    return paths;
+}
+
+// Measures first lookups on freshly mounted overlays, whose dentries are not cached yet, as
+// seen by a starting container; the best of a few rounds is taken to cut noise.
+lookup_latency measure_lookup_latency(const std::vector<std::filesystem::path>& lowerdirs,
+                                      const std::vector<std::string>& paths) {
+    auto time_lookups = [&paths](int root_fd, std::string_view suffix) {
+        std::string path;
+        struct stat st {};
+        auto start = std::chrono::steady_clock::now();
+        for (const auto& sample : paths) {
+            path.assign(sample).append(suffix);
+            ::fstatat(root_fd, path.c_str(), &st, AT_SYMLINK_NOFOLLOW);
+        }
+        auto elapsed = std::chrono::duration<double, std::micro>(
+                std::chrono::steady_clock::now() - start);
+        return elapsed.count() / static_cast<double>(paths.size());
+    };
+
+    lookup_latency best{1e9, 1e9};
+    for (std::size_t round = 0; round < k_lookup_rounds; ++round) {
+        readonly_overlay view(lowerdirs);
+        esl::unique_fd root_fd(::open(view.path().c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC));
+        if (!root_fd) {
+            throw std::filesystem::filesystem_error(
+                    "cannot open overlay root", view.path(),
+                    std::error_code(errno, std::system_category()));
+        }
+        best.hit_us = std::min(best.hit_us, time_lookups(root_fd.get(), ""));
+        best.miss_us = std::min(best.miss_us, time_lookups(root_fd.get(), k_missing_suffix));
+    }
+    return best;
+}
+
+} // namespace
+
+void process(cli::cmd_image_squash_t) {
+    const auto& parser = cli::for_current_process().command_parser();
+
+    auto image_name = parser.get<std::string>("IMAGE");
+    auto keep_top = static_cast<std::size_t>(parser.get<int>("--keep-top"));
+
+    // Keeps layers being squashed from being pruned.
+    auto store_lock = lock_image_store(image_store_lock_mode::shared);
+
+    auto manifest = load_image_manifest(image_name);
+    if (!manifest) {
+        throw std::invalid_argument(fmt::format("image {} has no layers to squash", image_name));
+    }
+
+    if (keep_top > manifest->layers.size()) {
+        throw std::invalid_argument(fmt::format("image {} has only {} layers to keep",
+                                                image_name, manifest->layers.size()));
+    }
+
+    // Layers of base images are squashed as well, except a single-file image at the bottom,
+    // which becomes the base image then.
+    auto [lowerdirs, image_file] = resolve_image(image_name);
+    if (lowerdirs.size() < keep_top + 2) {
+        throw std::invalid_argument(fmt::format("image {} has nothing to squash", image_name));
+    }
+
+    std::vector<std::filesystem::path> sources(lowerdirs.begin() + static_cast<long>(keep_top),
+                                               lowerdirs.end());
+
+    auto start = std::chrono::steady_clock::now();
+
+    auto layer_id = make_squashed_layer_id();
+    auto layer_path = get_layer_path(layer_id);
+    auto staging_path = layer_path;
+    staging_path += ".squashing";
+    std::filesystem::create_directories(k_layers_dir);
+    ESL_ON_SCOPE_FAIL {
+        std::error_code ec;
+        std::filesystem::remove_all(staging_path, ec);
+    };
+
+    auto stats = squash_layer_trees(sources, staging_path, image_file.has_value());
+    base::sync_filesystem(staging_path);
+    auto samples = sample_paths(staging_path);
+    std::filesystem::rename(staging_path, layer_path);
+
+    image_manifest squashed{image_name, manifest->reference, {layer_id}, {}};
+    squashed.layers.insert(squashed.layers.end(),
+                           manifest->layers.end() - static_cast<long>(keep_top),
+                           manifest->layers.end());
+    if (image_file) {
+        squashed.base_image = image_file->path.stem().native();
+    }
+    save_image_manifest(squashed);
+    store_lock.reset();
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start);
+    SPDLOG_INFO("Squashed image; image={} layers={} kept={} new_layer={} entries={} files={} "
+                "hardlinked={} reflinked={} whiteouts={}",
+                image_name, sources.size(), keep_top, layer_id, stats.entries, stats.files,
+                stats.hardlinked_files, stats.reflinked_files, stats.whiteouts);
+    fmt::print("Squashed {} layers of {} into {} in {}ms: {} files ({} hardlinked, {} reflinked)\n",
+               sources.size(), image_name, layer_id, elapsed.count(), stats.files,
+               stats.hardlinked_files, stats.reflinked_files);
+
+    if (samples.empty()) {
+        return;
+    }
+
+    // Old layers are left for `lumper image prune`, thus both stacks can be compared.
+    std::vector<std::filesystem::path> squashed_dirs(lowerdirs.begin(),
+                                                     lowerdirs.begin() + static_cast<long>(keep_top));
+    squashed_dirs.push_back(layer_path);
+    try {
+        enter_private_mount_namespace();
+        auto before = measure_lookup_latency(lowerdirs, samples);
+        auto after = measure_lookup_latency(squashed_dirs, samples);
+        fmt::print("Lookup latency over {} paths ({} -> {} lowerdirs):\n"
+                   "  existing: {:.2f}us -> {:.2f}us\n"
+                   "  missing:  {:.2f}us -> {:.2f}us\n",
+                   samples.size(), lowerdirs.size(), squashed_dirs.size(),
+                   before.hit_us, after.hit_us, before.miss_us, after.miss_us);
+    } catch (const std::exception& ex) {
+        SPDLOG_WARN("Failed to measure lookup latency; ex={}", ex.what());
+        fmt::print("Lookup latency not measured: {}\n", ex.what());
+    }
+}
+
+} // namespace lumper
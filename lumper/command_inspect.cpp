@@ -0,0 +1,31 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "lumper/commands.h"
+
+#include <string>
+#include <vector>
+
+#include "fmt/format.h"
+#include "nlohmann/json.hpp"
+
+#include "lumper/container_info.h"
+#include "lumper/state_index.h"
+
+namespace lumper {
+
+void process(cli::cmd_inspect_t) {
+    const auto& parser = cli::for_current_process().command_parser();
+
+    // All are resolved before anything is printed, thus output is either complete or none.
+    auto json = nlohmann::json::array();
+    for (const auto& id : parser.get<std::vector<std::string>>("container_ids")) {
+        json.push_back(load_container_info(resolve_container_id(id)));
+    }
+
+    constexpr int indent = 4;
+    fmt::print("{}\n", json.dump(indent));
+}
+
+} // namespace lumper
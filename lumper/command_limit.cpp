@@ -0,0 +1,34 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "lumper/commands.h"
+
+#include <string>
+
+#include "fmt/format.h"
+
+#include "lumper/cgroups/cgroup_manager.h"
+
+namespace lumper {
+
+void process(cli::cmd_limit_t) {
+    const auto& parser = cli::for_current_process().command_parser();
+
+    // Limits given only are changed, others stay as set earlier.
+    cgroups::resource_config res_cfg;
+    if (auto memory = parser.present<std::string>("--memory"); memory) {
+        res_cfg.set_memory_limit(*memory);
+    }
+    if (auto cpus = parser.present<int>("--cpus"); cpus) {
+        res_cfg.set_cpus(*cpus);
+    }
+
+    cgroups::limit_parent_cgroup(res_cfg);
+    fmt::print("Limited containers as a whole; cgroup={} memory={} cpus={}\n",
+               cgroups::k_parent_cgroup,
+               res_cfg.memory_limit().empty() ? "unchanged" : res_cfg.memory_limit(),
+               res_cfg.cpus() < 0 ? "unchanged" : fmt::to_string(res_cfg.cpus()));
+}
+
+} // namespace lumper
@@ -0,0 +1,143 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "lumper/commands.h"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <future>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "fmt/format.h"
+#include "spdlog/spdlog.h"
+
+#include "base/thread_pool.h"
+#include "lumper/background_task.h"
+#include "lumper/container_filter.h"
+#include "lumper/container_info.h"
+#include "lumper/container_status.h"
+#include "lumper/container_trash.h"
+#include "lumper/event_journal.h"
+#include "lumper/state_index.h"
+#include "lumper/state_root.h"
+
+namespace lumper {
+namespace {
+
+struct prune_result {
+    bool removed{false};
+    std::optional<std::filesystem::path> trash_entry;
+};
+
+// Moves the container into trash if it's still stopped, as the index may be stale by now.
+prune_result prune_container(const std::string& container_id) {
+    // Containers being used, e.g. exported, are left for next time rather than waited for.
+    auto lock = state_root::get().lock_container(container_id, container_lock_mode::exclusive,
+                                                 false);
+    if (!lock) {
+        return {};
+    }
+
+    if (has_container_info(container_id)) {
+        auto info = load_container_info(container_id);
+        if (info.status == k_container_status_running) {
+            return {};
+        }
+        release_container_resources(info);
+    }
+
+    // The lock goes into trash along with the directory, and is released here, before the trash
+    // is emptied.
+    return {true, move_container_to_trash(container_id)};
+}
+
+} // namespace
+
+void process(cli::cmd_prune_t) {
+    const auto& parser = cli::for_current_process().command_parser();
+
+    auto filter = container_filter::parse(parser.present<std::string>("--until"),
+                                          parser.present<std::string>("--filter"));
+    auto jobs = get_jobs(parser);
+
+    auto start = std::chrono::steady_clock::now();
+    base::thread_pool pool(jobs);
+
+    // Containers whose processes are gone are stopped, even if not marked yet.
+    auto infos = query_container_infos(false);
+    reconcile_container_status(infos, pool);
+
+    auto now = std::chrono::system_clock::now();
+    std::vector<std::string> candidates;
+    for (const auto& info : infos) {
+        if (info.status != k_container_status_running && filter.matches(info, now)) {
+            candidates.push_back(info.id);
+        }
+    }
+    if (candidates.empty()) {
+        fmt::print("Pruned 0 containers\n");
+        return;
+    }
+
+    state_index_intent intent(candidates);
+
+    // A removal takes only a few syscalls, thus containers are removed in chunks rather than a
+    // task for each.
+    std::vector<prune_result> results(candidates.size());
+    auto num_chunks = std::min(pool.size(), candidates.size());
+    auto chunk_size = (candidates.size() + num_chunks - 1) / num_chunks;
+    std::vector<std::future<void>> futures;
+    futures.reserve(num_chunks);
+    for (std::size_t begin = 0; begin < candidates.size(); begin += chunk_size) {
+        auto end = std::min(begin + chunk_size, candidates.size());
+        futures.push_back(pool.submit([&candidates, &results, begin, end] {
+            for (auto i = begin; i < end; ++i) {
+                try {
+                    results[i] = prune_container(candidates[i]);
+                } catch (const std::exception& ex) {
+                    SPDLOG_ERROR("Failed to prune container; container_id={} ex={}",
+                                 candidates[i], ex.what());
+                }
+            }
+        }));
+    }
+    base::wait_all(futures);
+
+    std::vector<std::string> removed;
+    std::vector<std::filesystem::path> trash;
+    for (std::size_t i = 0; i < candidates.size(); ++i) {
+        if (!results[i].removed) {
+            continue;
+        }
+        removed.push_back(candidates[i]);
+        if (results[i].trash_entry) {
+            trash.push_back(std::move(*results[i].trash_entry));
+        }
+    }
+
+    // Unindexed at once, as a record for each is a lock and an append for each.
+    unindex_containers(removed);
+    intent.commit();
+    for (const auto& id : removed) {
+        record_container_event(container_event_type::removed, id);
+    }
+
+    // Containers are gone once in trash; deleting their trees only frees disk space, which is done
+    // by threads created after lowering I/O priority, as it's inherited on creation.
+    lower_io_priority();
+    base::thread_pool delete_pool(jobs);
+    auto freed = empty_container_trash(trash, delete_pool);
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start);
+
+    SPDLOG_INFO("Pruned containers; candidates={} removed={} freed_bytes={} elapsed={}ms",
+                candidates.size(), removed.size(), freed, elapsed.count());
+    fmt::print("Pruned {} containers, reclaimed {} bytes in {}ms\n",
+               removed.size(), freed, elapsed.count());
+}
+
+} // namespace lumper
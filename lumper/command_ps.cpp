@@ -4,22 +4,40 @@
 
 #include "lumper/commands.h"
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
 #include <filesystem>
-#include <fstream>
+#include <map>
+#include <set>
 #include <string>
-#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
 
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "esl/unique_handle.h"
 #include "fmt/format.h"
 #include "nlohmann/json.hpp"
-#include "spdlog/spdlog.h"
 
+#include "base/thread_pool.h"
 #include "lumper/container_info.h"
+#include "lumper/container_status.h"
 #include "lumper/path_constants.h"
+#include "lumper/state_index.h"
 
 namespace lumper {
 namespace {
 
-constexpr char k_missing_value[] = "N/A";
+// Checks are cheap syscalls, thus a few threads are enough even for thousands of containers.
+constexpr std::size_t k_max_check_threads = 4;
+
+// Processes without a pidfd, i.e. on kernels before 5.3, are checked this often when watching.
+constexpr int k_unpinned_check_interval_ms = 1000;
 
 void print_headline() {
     fmt::print("CONTAINER ID\t"
@@ -29,38 +47,243 @@ void print_headline() {
                "STATUS\t\n");
 }
 
-nlohmann::json load_container_info_json(std::string_view container_id) {
-    auto json_path = std::filesystem::path(k_container_dir) / container_id / k_info_filename;
-    std::ifstream in(json_path);
-    try {
-        return nlohmann::json::parse(in);
-    } catch (const nlohmann::json::parse_error& ex) {
-        SPDLOG_ERROR("Failed to parse container-info file into json; ex={} container_id={}",
-                     ex.what(), container_id);
+void print_containers(const std::vector<container_info>& infos, bool list_all) {
+    print_headline();
+
+    for (const auto& info : infos) {
+        if (!list_all && info.status != k_container_status_running) {
+            continue;
+        }
+        fmt::print("{}\t{}\t{}\t{}\t{}\t\n",
+                   info.id, info.image, info.command, info.create_time, info.status);
     }
-    return nlohmann::json::object();
 }
 
+// Changes of containers are read from records appended to the state index, which is watched with
+// inotify, thus nothing is read until something is recorded, and only new records are read then.
+// Exits of container processes are watched with pidfds; an exited container is marked stopped as
+// `lumper ps` does, which in turn is read back from the index, as is any other change.
+class container_watcher {
+public:
+    explicit container_watcher(base::thread_pool& pool)
+        : pool_(pool) {
+        inotify_fd_.reset(::inotify_init1(IN_NONBLOCK | IN_CLOEXEC));
+        if (!inotify_fd_) {
+            throw std::system_error(errno, std::system_category(), "failed to init inotify");
+        }
+
+        // The index is watched through its directory, as compaction replaces it.
+        std::filesystem::path index_path(k_state_index_file);
+        index_name_ = index_path.filename().native();
+        auto dir = index_path.parent_path();
+        std::filesystem::create_directories(dir);
+        if (::inotify_add_watch(inotify_fd_.get(), dir.c_str(), IN_MODIFY | IN_MOVED_TO) < 0) {
+            throw std::system_error(errno, std::system_category(),
+                                    "failed to watch " + dir.native());
+        }
+    }
+
+    ~container_watcher() = default;
+
+    container_watcher(const container_watcher&) = delete;
+
+    container_watcher& operator=(const container_watcher&) = delete;
+
+    // Returns all containers, with status reconciled.
+    // Must be called once before `run()`.
+    std::vector<container_info> list() {
+        auto changes = read_state_index_changes(cursor_);
+        reconcile_container_status(changes.puts, pool_);
+        for (const auto& info : changes.puts) {
+            known_.emplace(info.id, info);
+            if (info.status == k_container_status_running) {
+                watch_process(info);
+            }
+        }
+        return std::move(changes.puts);
+    }
+
+    [[noreturn]] void run() {
+        std::vector<pollfd> pollfds;
+        std::vector<std::string> pollfd_ids;
+        while (true) {
+            check_unpinned();
+
+            pollfds.clear();
+            pollfd_ids.clear();
+            pollfds.push_back({inotify_fd_.get(), POLLIN, 0});
+            for (const auto& [id, pidfd] : pidfds_) {
+                pollfds.push_back({pidfd.get(), POLLIN, 0});
+                pollfd_ids.push_back(id);
+            }
+
+            int timeout = unpinned_.empty() ? -1 : k_unpinned_check_interval_ms;
+            int rv = ::poll(pollfds.data(), pollfds.size(), timeout);
+            if (rv < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::system_error(errno, std::system_category(), "failed to poll");
+            }
+
+            std::vector<container_info> exited;
+            for (std::size_t i = 1; i < pollfds.size(); ++i) {
+                if (pollfds[i].revents != 0) {
+                    pidfds_.erase(pollfd_ids[i - 1]);
+                    exited.push_back(known_.at(pollfd_ids[i - 1]));
+                }
+            }
+            // Containers locked by others are checked again later, until their exits are saved,
+            // unless their owners change them first.
+            std::vector<std::string> unsaved;
+            reconcile_container_status(exited, pool_, &unsaved);
+            unpinned_.insert(unsaved.begin(), unsaved.end());
+
+            if (pollfds[0].revents != 0 && drain_index_events()) {
+                apply(read_state_index_changes(cursor_));
+            }
+        }
+    }
+
+private:
+    void watch_process(const container_info& info) {
+        auto pidfd = open_container_pidfd(info);
+        if (pidfd) {
+            pidfds_.insert_or_assign(info.id, std::move(pidfd));
+        } else {
+            // Either the process has exited just now, or pidfd is not supported.
+            unpinned_.insert(info.id);
+        }
+    }
+
+    void unwatch_process(const std::string& id) {
+        pidfds_.erase(id);
+        unpinned_.erase(id);
+    }
+
+    void check_unpinned() {
+        if (unpinned_.empty()) {
+            return;
+        }
+
+        std::vector<container_info> infos;
+        for (const auto& id : unpinned_) {
+            infos.push_back(known_.at(id));
+        }
+        std::vector<std::string> unsaved;
+        reconcile_container_status(infos, pool_, &unsaved);
+        for (const auto& info : infos) {
+            if (info.status != k_container_status_running &&
+                std::find(unsaved.begin(), unsaved.end(), info.id) == unsaved.end()) {
+                unpinned_.erase(info.id);
+            }
+        }
+    }
+
+    // Returns true if the index is changed.
+    bool drain_index_events() {
+        alignas(inotify_event) char buf[4096];
+        bool changed = false;
+        while (true) {
+            auto len = ::read(inotify_fd_.get(), buf, sizeof(buf));
+            if (len <= 0) {
+                if (len < 0 && errno == EINTR) {
+                    continue;
+                }
+                break;
+            }
+
+            for (ssize_t offset = 0; offset < len;) {
+                inotify_event event{};
+                std::memcpy(&event, buf + offset, sizeof(event));
+                if (event.len > 0 && index_name_ == buf + offset + sizeof(event)) {
+                    changed = true;
+                }
+                offset += static_cast<ssize_t>(sizeof(event) + event.len);
+            }
+        }
+        return changed;
+    }
+
+    void apply(state_index_changes changes) {
+        if (changes.full) {
+            // The index is replaced, thus those not present are removed.
+            std::set<std::string> present;
+            for (const auto& info : changes.puts) {
+                present.insert(info.id);
+            }
+            for (const auto& [id, info] : known_) {
+                if (present.count(id) == 0) {
+                    changes.removes.push_back(id);
+                }
+            }
+        }
+
+        for (auto& info : changes.puts) {
+            auto it = known_.find(info.id);
+            if (it == known_.end()) {
+                print_event({{"event", "created"}, {"container", info}});
+            } else if (it->second.status != info.status) {
+                print_event({{"event", "status"}, {"id", info.id}, {"status", info.status}});
+            }
+
+            if (info.status == k_container_status_running) {
+                if (pidfds_.count(info.id) == 0 && unpinned_.count(info.id) == 0) {
+                    watch_process(info);
+                }
+            } else {
+                unwatch_process(info.id);
+            }
+            known_.insert_or_assign(info.id, std::move(info));
+        }
+
+        for (const auto& id : changes.removes) {
+            if (known_.erase(id) != 0) {
+                unwatch_process(id);
+                print_event({{"event", "removed"}, {"id", id}});
+            }
+        }
+
+        std::fflush(stdout);
+    }
+
+    static void print_event(const nlohmann::json& event) {
+        fmt::print("{}\n", event.dump());
+    }
+
+    base::thread_pool& pool_;
+    esl::unique_fd inotify_fd_;
+    std::string index_name_;
+    state_index_cursor cursor_;
+    std::map<std::string, container_info> known_;
+    // Pidfds of running containers' processes.
+    std::map<std::string, esl::unique_fd> pidfds_;
+    // Running containers whose processes can't be pinned with pidfds, or exited ones whose exits
+    // are not saved yet; checked periodically.
+    std::set<std::string> unpinned_;
+};
+
 } // namespace
 
 void process(cli::cmd_ps_t) {
     const auto& parser = cli::for_current_process().command_parser();
-
     bool list_all = parser.get<bool>("--all");
+    bool watch = parser.get<bool>("--watch");
 
-    print_headline();
-    for (const auto& dir_entry : std::filesystem::directory_iterator{k_container_dir}) {
-        auto container_id = dir_entry.path().filename().native();
-        auto info_json = load_container_info_json(container_id);
-        auto status = info_json.value("status", k_missing_value);
-        if (!list_all && status != k_container_status_running) {
-            continue;
-        }
-        auto image = info_json.value("image", k_missing_value);
-        auto command = info_json.value("command", k_missing_value);
-        auto created_time = info_json.value("create_time", k_missing_value);
-        fmt::print("{}\t{}\t{}\t{}\t{}\t\n", container_id, image, command, created_time, status);
+    base::thread_pool pool(std::min(base::thread_pool::default_size(), k_max_check_threads));
+
+    if (watch) {
+        // Watches before listing, thus no change is missed in between.
+        container_watcher watcher(pool);
+        print_containers(watcher.list(), list_all);
+        std::fflush(stdout);
+        watcher.run();
     }
+
+    // Reads only records of running containers unless all are listed.
+    auto infos = query_container_infos(!list_all);
+    reconcile_container_status(infos, pool);
+    print_containers(infos, list_all);
 }
 
 } // namespace lumper
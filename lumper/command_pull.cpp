@@ -0,0 +1,86 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "lumper/commands.h"
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <filesystem>
+#include <future>
+#include <string>
+#include <vector>
+
+#include "fmt/format.h"
+#include "spdlog/spdlog.h"
+
+#include "base/thread_pool.h"
+#include "lumper/image_reference.h"
+#include "lumper/image_store.h"
+#include "lumper/registry_client.h"
+
+namespace lumper {
+
+void process(cli::cmd_pull_t) {
+    const auto& parser = cli::for_current_process().command_parser();
+
+    auto ref = image_reference::parse(parser.get<std::string>("REFERENCE"));
+    auto image_name = parser.present<std::string>("--name").value_or(ref.local_name());
+    auto jobs = get_jobs(parser);
+
+    // Writing into the pipe of a prematurely exited extractor must fail with EPIPE rather than
+    // killing us.
+    std::signal(SIGPIPE, SIG_IGN);
+
+    auto start = std::chrono::steady_clock::now();
+
+    // Layers fetched are not referenced by any manifest until the end.
+    auto store_lock = lock_image_store(image_store_lock_mode::shared);
+
+    registry_client client(ref);
+    auto manifest = client.fetch_manifest();
+    SPDLOG_INFO("Fetched manifest; ref={} digest={} layers={}",
+                ref.to_string(), manifest.digest, manifest.layers.size());
+
+    image_manifest image{image_name, ref.to_string(), {}};
+    std::vector<const oci_descriptor*> missing;
+    std::uint64_t missing_bytes = 0;
+    for (const auto& layer : manifest.layers) {
+        auto layer_id = layer_id_from_digest(layer.digest);
+        if (!std::filesystem::exists(get_layer_path(layer_id))) {
+            missing.push_back(&layer);
+            missing_bytes += layer.size;
+        }
+        image.layers.push_back(std::move(layer_id));
+    }
+
+    fmt::print("Pulling {}: {} layers, {} to fetch ({} bytes)\n",
+               ref.to_string(), manifest.layers.size(), missing.size(), missing_bytes);
+
+    if (!missing.empty()) {
+        // Start the largest layers first, as they dominate the completion time.
+        std::sort(missing.begin(), missing.end(), [](const auto* lhs, const auto* rhs) {
+            return lhs->size > rhs->size;
+        });
+
+        base::thread_pool pool(std::clamp<std::size_t>(jobs, 1, missing.size()));
+        std::vector<std::future<void>> results;
+        results.reserve(missing.size());
+        for (const auto* layer : missing) {
+            results.push_back(pool.submit([&client, layer] {
+                client.fetch_layer(*layer);
+                fmt::print("  {} done\n", layer->digest);
+            }));
+        }
+        base::wait_all(results);
+    }
+
+    save_image_manifest(image);
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start);
+    fmt::print("Image {} is ready in {}ms\n", image_name, elapsed.count());
+}
+
+} // namespace lumper
@@ -4,29 +4,124 @@
 
 #include "lumper/commands.h"
 
+#include <algorithm>
+#include <chrono>
 #include <filesystem>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
 #include "fmt/format.h"
+#include "spdlog/spdlog.h"
 
-#include "lumper/path_constants.h"
+#include "base/thread_pool.h"
+#include "lumper/background_task.h"
+#include "lumper/container_info.h"
+#include "lumper/container_trash.h"
+#include "lumper/event_journal.h"
+#include "lumper/state_index.h"
+#include "lumper/state_root.h"
 
 namespace lumper {
+namespace {
+
+void empty_trash(const std::vector<std::filesystem::path>& entries, std::size_t jobs) {
+    lower_io_priority();
+
+    auto start = std::chrono::steady_clock::now();
+    base::thread_pool pool(jobs);
+    auto freed = empty_container_trash(entries, pool);
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start);
+    SPDLOG_INFO("Emptied container trash; entries={} freed_bytes={} elapsed={}ms",
+                entries.size(), freed, elapsed.count());
+}
+
+} // namespace
 
 void process(cli::cmd_rm_t) {
     const auto& parser = cli::for_current_process().command_parser();
 
     auto ids = parser.get<std::vector<std::string>>("container_ids");
-    for (const auto& id : ids) {
-        auto container_path = std::filesystem::path(k_container_dir) / id;
-        auto rm_cnt = std::filesystem::remove_all(container_path);
-        if (rm_cnt > 0) {
-            fmt::print("Container {} is deleted\n", id);
-        } else {
-            fmt::print("Contaienr {} not found\n", id);
+    auto sync = parser.get<bool>("--sync");
+    auto jobs = get_jobs(parser);
+
+    std::vector<std::filesystem::path> trash;
+    for (const auto& id_arg : ids) {
+        std::string id;
+        try {
+            id = resolve_container_id(id_arg);
+        } catch (const std::invalid_argument& ex) {
+            // Containers left unindexed, e.g. having broken info, are removed by complete ids.
+            if (!state_root::get().has_container(id_arg)) {
+                fmt::print("{}\n", ex.what());
+                continue;
+            }
+            id = id_arg;
+        }
+
+        // Waits for those using the container, e.g. a run saving its info; the lock goes into
+        // trash along with the directory, and is released before the trash is emptied.
+        auto lock = state_root::get().lock_container(id, container_lock_mode::exclusive);
+        if (!lock) {
+            fmt::print("no such container: {}\n", id);
+            continue;
+        }
+
+        state_index_intent intent({id});
+        if (has_container_info(id)) {
+            try {
+                release_container_resources(load_container_info(id));
+            } catch (const std::exception& ex) {
+                SPDLOG_WARN("Failed to load container info; container_id={} ex={}", id, ex.what());
+            }
+        }
+        if (auto entry = move_container_to_trash(id); entry) {
+            trash.push_back(std::move(*entry));
         }
+        unindex_container(id);
+        intent.commit();
+        record_container_event(container_event_type::removed, id);
+        fmt::print("Container {} is deleted\n", id);
     }
+
+    auto is_ours = [&trash](const auto& entry) {
+        return std::find(trash.begin(), trash.end(), entry) != trash.end();
+    };
+
+    // `--sync` waits for entries of this process only; those left by interrupted deletions are
+    // deleted in background as usual, and entries failed to delete are kept for next time.
+    std::vector<std::filesystem::path> leftovers;
+    if (sync) {
+        if (!trash.empty()) {
+            empty_trash(trash, jobs);
+        }
+        leftovers = list_container_trash();
+        leftovers.erase(std::remove_if(leftovers.begin(), leftovers.end(), is_ours),
+                        leftovers.end());
+        if (leftovers.empty()) {
+            return;
+        }
+    } else if (trash.empty()) {
+        return;
+    }
+
+    // Containers are gone once in trash; deleting their trees only frees disk space.
+    if (auto pid = fork_into_background(); pid > 0) {
+        SPDLOG_INFO("Deleting containers in background; pid={} entries={}",
+                    pid, sync ? leftovers.size() : trash.size());
+        return;
+    }
+
+    if (sync) {
+        empty_trash(leftovers, jobs);
+        return;
+    }
+
+    // Picks up entries left by interrupted deletions as well, after those of this process.
+    auto entries = list_container_trash();
+    std::stable_partition(entries.begin(), entries.end(), is_ours);
+    empty_trash(entries, jobs);
 }
 
 } // namespace lumper
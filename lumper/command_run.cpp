@@ -4,113 +4,132 @@
 
 #include "lumper/commands.h"
 
+#include <algorithm>
 #include <array>
+#include <cerrno>
 #include <chrono>
 #include <cstdint>
+#include <cstdio>
 #include <cstdlib>
 #include <filesystem>
+#include <optional>
+#include <stdexcept>
 #include <string_view>
-#include <tuple>
+#include <system_error>
 #include <utility>
+#include <vector>
 
+#include <fcntl.h>
 #include <sched.h>
+#include <signal.h>
 #include <unistd.h>
 
 #include "esl/scope_guard.h"
 #include "esl/strings.h"
-#include "fmt/chrono.h"
 #include "fmt/format.h"
 #include "fmt/ranges.h"
 #include "spdlog/spdlog.h"
-#include "uuidxx/uuidxx.h"
 
 #include "base/exception.h"
-#include "base/ignore.h"
 #include "base/subprocess.h"
+#include "base/thread_pool.h"
 #include "lumper/cgroups/cgroup_manager.h"
+#include "lumper/container_cpuset.h"
 #include "lumper/container_info.h"
+#include "lumper/container_root.h"
+#include "lumper/container_status.h"
+#include "lumper/cpu_topology.h"
+#include "lumper/cpuset_allocator.h"
+#include "lumper/event_journal.h"
+#include "lumper/image_store.h"
 #include "lumper/mount_container_before_exec.h"
 #include "lumper/path_constants.h"
+#include "lumper/prefetch_profile.h"
+#include "lumper/state_root.h"
 
 namespace lumper {
 namespace {
 
-// Use last part of uuid-v4 as container-id.
-inline std::string generate_container_id() {
-    auto uuid = uuidxx::make_v4().to_string();
-    return uuid.substr(uuid.rfind('-') + 1);
-}
-
-std::filesystem::path get_image_path(std::string_view image_name) {
-    std::filesystem::path path(k_images_dir);
-    path /= image_name;
-    return path;
-}
-
-std::filesystem::path get_container_path(std::string_view container_id, std::string_view subdir) {
-    std::filesystem::path path(k_container_dir);
-    path /= container_id;
-    path /= subdir;
-    return path;
+// Returns `std::nullopt` if unknown, in which case OOM kills are not told.
+std::optional<std::uint64_t> read_oom_kills(const cgroups::cgroup_manager& cgroup_mgr) noexcept {
+    try {
+        return cgroup_mgr.oom_kills();
+    } catch (const std::exception& ex) {
+        SPDLOG_WARN("Failed to read OOM kills of cgroup; ex={}", ex.what());
+        return std::nullopt;
+    }
 }
 
-std::tuple<std::string, std::filesystem::path, std::string>
-create_container_root(std::string_view image_name) {
-    auto image_root = get_image_path(image_name);
-    if (!std::filesystem::exists(image_root)) {
-        // TODO(KC): untar image first if image_root doesn't exist.
-        throw std::invalid_argument(
-                fmt::format("image root ({}) doesn't exist", image_root.string()));
+// Exits of detached containers are recorded once noticed by `reconcile_container_status()`.
+void record_exit_event(const container_info& info,
+                       base::process_exit_code exit_code,
+                       const cgroups::cgroup_manager& cgroup_mgr,
+                       std::optional<std::uint64_t> oom_kills_before) noexcept {
+    auto [reason, value] = exit_code.cause();
+    if (reason == base::process_exit_code::reason::exited) {
+        record_container_event(container_event_type::exited, info.id, info.pid, value);
+        return;
     }
 
-    std::string container_id;
-    while (true) {
-        container_id = generate_container_id();
-        auto created = std::filesystem::create_directory(get_container_path(container_id, ""));
-        if (created) {
-            SPDLOG_INFO("Successfully chosed container-id={}", container_id);
-            break;
-        }
-        SPDLOG_WARN("Generated container-id({}) already in use, try another one", container_id);
+    // A SIGKILL is taken as an OOM kill only if the OOM killer has killed in the container's
+    // cgroup since it started, as anyone may send it.
+    bool oom = false;
+    if (value == SIGKILL && oom_kills_before) {
+        auto oom_kills = read_oom_kills(cgroup_mgr);
+        oom = oom_kills && *oom_kills > *oom_kills_before;
     }
+    record_container_event(oom ? container_event_type::oom : container_event_type::exited,
+                           info.id, info.pid, -1, value);
+}
 
-    // Create directories for:
-    //  - cow layer (upperdir)
-    //  - overlay workdir
-    //  - a mount point
-    auto cow_rw = get_container_path(container_id, "cow_rw");
-    auto cow_workdir = get_container_path(container_id, "cow_workdir");
-    auto rootfs = get_container_path(container_id, "rootfs");
-    for (const auto& path : {std::cref(cow_rw), std::cref(cow_workdir), std::cref(rootfs)}) {
-        if (!std::filesystem::exists(path)) {
-            std::filesystem::create_directories(path);
-        }
+// Only images with a manifest record digests of their layers.
+void verify_image(std::string_view image_name) {
+    auto manifest = load_image_manifest(image_name);
+    if (!manifest) {
+        SPDLOG_WARN("No layer digests to verify for image; image={}", image_name);
+        return;
     }
 
-    auto mount_data = fmt::format("lowerdir={},upperdir={},workdir={}",
-                                  image_root.native(), cow_rw.native(), cow_workdir.native());
-
-    SPDLOG_INFO("Create container root; image_root={}\ncontainer_root={}\nmount_data={}",
-                image_root.native(), rootfs.native(), mount_data);
-
-    return {container_id, rootfs, mount_data};
+    auto start = std::chrono::steady_clock::now();
+    base::thread_pool pool(
+            std::clamp<std::size_t>(manifest->layers.size(), 1, base::thread_pool::default_size()));
+    verify_image_layers(*manifest, pool);
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start);
+    SPDLOG_INFO("Verified image layers; image={} layers={} elapsed={}ms",
+                image_name, manifest->layers.size(), elapsed.count());
 }
 
-inline std::string time_point_to_str(const std::chrono::system_clock::time_point& tp) {
-    auto time = std::chrono::system_clock::to_time_t(tp);
-    return fmt::format("{:%Y-%m-%d %H:%M:%S}", fmt::localtime(time));
-}
+// Opens in the window are recorded by a forked process, thus the container is not held up; the
+// profile is saved for later runs of the image.
+void record_prefetch_profile_in_background(prefetch_recorder& recorder,
+                                           std::string_view image_name,
+                                           const std::string& fingerprint,
+                                           std::chrono::seconds window) {
+    std::fflush(nullptr);
+    auto pid = ::fork();
+    if (pid < 0) {
+        SPDLOG_WARN("Failed to fork prefetch recorder; errno={}", errno);
+        return;
+    }
 
-esl::unique_fd create_file(const std::string& path) {
-    constexpr int perm = 0666;
-    int fd = ::open(path.c_str(), O_CREAT | O_WRONLY | O_CLOEXEC, perm);
-    if (fd == -1) {
-        std::string what("create file failure: ");
-        what += path;
-        throw std::system_error(errno, std::system_category(), what);
+    if (pid > 0) {
+        SPDLOG_INFO("Recording prefetch profile; image={} recorder_pid={} window={}s",
+                    image_name, pid, window.count());
+        return;
     }
 
-    return esl::wrap_unique_fd(fd);
+    int exit_code = EXIT_SUCCESS;
+    try {
+        auto ranges = recorder.record(window);
+        auto range_count = ranges.size();
+        save_prefetch_profile(image_name, prefetch_profile{fingerprint, std::move(ranges)});
+        SPDLOG_INFO("Saved prefetch profile; image={} ranges={}", image_name, range_count);
+    } catch (const std::exception& ex) {
+        SPDLOG_WARN("Failed to record prefetch profile; image={} ex={}", image_name, ex.what());
+        exit_code = EXIT_FAILURE;
+    }
+    ::_exit(exit_code);
 }
 
 } // namespace
@@ -119,7 +138,38 @@ void process(cli::cmd_run_t) {
     const auto& parser = cli::for_current_process().command_parser();
 
     auto image_name = parser.get<std::string>("--image");
-    auto&& [container_id, container_root, root_mount_data] = create_container_root(image_name);
+
+    // Keeps the image from being pruned until the container info referencing it is saved.
+    auto store_lock = lock_image_store(image_store_lock_mode::shared);
+
+    if (parser.get<bool>("--verify")) {
+        verify_image(image_name);
+    }
+
+    auto&& [container_id, container_root, upperdir, root_mount_data, image_mount_key, lowerdirs,
+            layers, pinned, container_lock] = create_container_root(image_name);
+
+    // Replaying runs along with setting up namespaces of the container.
+    // Pinned images are in memory already.
+    auto prefetch_window = std::chrono::seconds(parser.get<int>("--prefetch-window"));
+    std::optional<base::thread_pool> prefetch_pool;
+    std::optional<prefetch_recorder> recorder;
+    std::string fingerprint;
+    if (prefetch_window.count() > 0 && !pinned) {
+        try {
+            fingerprint = fingerprint_lowerdirs(lowerdirs);
+            if (auto profile = load_prefetch_profile(image_name, fingerprint); profile) {
+                prefetch_pool.emplace(base::thread_pool::default_size());
+                replay_prefetch_profile(*profile, *prefetch_pool);
+                SPDLOG_INFO("Replaying prefetch profile; image={} ranges={}",
+                            image_name, profile->ranges.size());
+            } else {
+                recorder.emplace(lowerdirs);
+            }
+        } catch (const std::exception& ex) {
+            SPDLOG_WARN("Failed to set up prefetching; image={} ex={}", image_name, ex.what());
+        }
+    }
 
     base::subprocess::options opts;
     opts.clone_with_flags(CLONE_NEWUTS | CLONE_NEWPID | CLONE_NEWNS | CLONE_NEWNET | CLONE_NEWIPC);
@@ -130,8 +180,9 @@ void process(cli::cmd_run_t) {
     SPDLOG_INFO("running in detach-mode={}", detach_mode);
     esl::unique_fd logfile_fd;
     if (detach_mode) {
-        auto logfile = get_container_path(container_id, k_container_log_filename);
-        logfile_fd = create_file(logfile.native());
+        constexpr mode_t perm = 0666;
+        logfile_fd = state_root::get().open_container_file(
+                container_id, k_container_log_filename, O_CREAT | O_WRONLY, perm);
         opts.set_stdout(base::subprocess::use_fd, logfile_fd.get());
         opts.set_stderr(base::subprocess::use_fd, logfile_fd.get());
         opts.detach();
@@ -169,18 +220,47 @@ void process(cli::cmd_run_t) {
         res_cfg.set_cpus(*cpus_limit);
     }
 
+    // Held until the container info is saved, thus exclusive cpus are not handed out twice.
+    esl::unique_fd cpuset_lock;
+    std::optional<cpuset_assignment> cpuset;
+    auto cpuset_arg = parser.present<std::string>("--cpuset");
+    auto numa_node = parser.present<int>("--numa");
+    if (cpuset_arg || numa_node) {
+        cpuset_request request{cpuset_arg.value_or(""), cpus_limit.value_or(0), numa_node};
+        cpuset_lock = lock_cpuset_allocator();
+        cpuset = assign_cpuset(cpu_topology::read(), request, query_exclusive_cpus());
+        res_cfg.set_cpuset(format_cpu_list(cpuset->cpus), format_cpu_list(cpuset->mems));
+        SPDLOG_INFO("Assigned cpuset; container_id={} cpus={} mems={} exclusive={}",
+                    container_id, res_cfg.cpuset_cpus(), res_cfg.cpuset_mems(),
+                    cpuset->exclusive);
+    }
+
     auto argv = parser.get<std::vector<std::string>>("CMD");
     SPDLOG_INFO("Prepare to run cmd: {}", argv);
     try {
-        cgroups::cgroup_manager cgroup_mgr("lumper-cgroup", res_cfg);
+        cgroups::cgroup_manager cgroup_mgr(cgroups::container_cgroup_name(container_id), res_cfg);
+        auto oom_kills_before = read_oom_kills(cgroup_mgr);
+        opts.clone_into_cgroup(cgroup_mgr.cgroup_fd());
         base::subprocess proc(argv, opts);
         container_info info;
+        // Released once the container info is saved; still held on the way out if saving failed.
+        auto info_lock = std::move(container_lock);
         ESL_ON_SCOPE_EXIT {
             if (!detach_mode) {
                 try {
-                    base::ignore_unused(proc.wait());
+                    auto exit_code = proc.wait();
+                    if (!info.id.empty()) {
+                        record_exit_event(info, exit_code, cgroup_mgr, oom_kills_before);
+                    }
                     info.status = k_container_status_stopped;
-                    save_container_info(info);
+                    // Don't bring back the container if removed meanwhile.
+                    // Locking again while the lock is held would block on ourselves.
+                    if (auto lock = info_lock ? std::move(info_lock)
+                                              : state_root::get().lock_container(
+                                                        info.id, container_lock_mode::exclusive);
+                        lock) {
+                        save_container_info(info);
+                    }
                 } catch (const std::exception& ex) {
                     // NOLINTNEXTLINE(bugprone-lambda-function-name)
                     SPDLOG_ERROR("Unexpected failure during waiting container to exit; "
@@ -192,14 +272,45 @@ void process(cli::cmd_run_t) {
             SPDLOG_INFO("Command {} completed", esl::strings::join(argv, " "));
         };
 
-        cgroup_mgr.apply(proc.pid());
+        auto pid = detach_mode ? proc.detached_pid() : proc.pid();
+        // Created in the cgroup already with cgroup v2 on Linux 5.7+; otherwise it has run without
+        // limits till now.
+        cgroup_mgr.apply(pid);
+        // The cgroup of a detached container is removed along with the container.
+        if (detach_mode) {
+            cgroup_mgr.keep();
+        }
         info = container_info{container_id,
                               image_name,
                               esl::strings::join(argv, " "),
-                              time_point_to_str(std::chrono::system_clock::now()),
+                              format_create_time(std::chrono::system_clock::now()),
                               k_container_status_running,
-                              proc.pid()};
+                              pid,
+                              image_mount_key,
+                              layers,
+                              get_process_start_time(pid),
+                              cgroup_mgr.has_cgroup() ? cgroup_mgr.name() : ""};
+        info.argv = argv;
+        info.lowerdirs.assign(lowerdirs.begin(), lowerdirs.end());
+        info.memory_limit = mem_limit.value_or("");
+        info.cpus = cpus_limit.value_or(0);
+        if (cpuset) {
+            info.cpuset_cpus = res_cfg.cpuset_cpus();
+            info.cpuset_mems = res_cfg.cpuset_mems();
+            info.cpuset_exclusive = cpuset->exclusive;
+        }
         save_container_info(info);
+        cpuset_lock.reset();
+        record_container_event(container_event_type::created, info.id);
+        record_container_event(container_event_type::started, info.id, pid);
+        info_lock.reset();
+        store_lock.reset();
+
+        if (recorder) {
+            record_prefetch_profile_in_background(*recorder, image_name, fingerprint,
+                                                  prefetch_window);
+            recorder.reset();
+        }
     } catch (const base::spawn_subprocess_error& ex) {
         auto errc = mount_container.read_error();
         if (errc != mount_errc::ok) {
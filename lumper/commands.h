@@ -23,6 +23,32 @@ void process(cli::cmd_ps_t);
 
 void process(cli::cmd_rm_t);
 
+void process(cli::cmd_prune_t);
+
+void process(cli::cmd_pull_t);
+
+void process(cli::cmd_commit_t);
+
+void process(cli::cmd_clone_t);
+
+void process(cli::cmd_export_t);
+
+void process(cli::cmd_events_t);
+
+void process(cli::cmd_image_prune_t);
+
+void process(cli::cmd_image_squash_t);
+
+void process(cli::cmd_image_pin_t);
+
+void process(cli::cmd_image_pins_t);
+
+void process(cli::cmd_image_unpin_t);
+
+void process(cli::cmd_inspect_t);
+
+void process(cli::cmd_limit_t);
+
 } // namespace lumper
 
 #endif // LUMPER_COMMANDS_H_
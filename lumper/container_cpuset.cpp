@@ -0,0 +1,80 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "lumper/container_cpuset.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <filesystem>
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/file.h>
+
+#include "spdlog/spdlog.h"
+
+#include "lumper/container_info.h"
+#include "lumper/container_status.h"
+#include "lumper/cpu_topology.h"
+#include "lumper/path_constants.h"
+#include "lumper/state_index.h"
+
+namespace lumper {
+
+esl::unique_fd lock_cpuset_allocator() {
+    constexpr mode_t perm = 0644;
+    std::filesystem::path lock_path(k_cpuset_lock_file);
+    std::filesystem::create_directories(lock_path.parent_path());
+    esl::unique_fd fd(::open(lock_path.c_str(), O_CREAT | O_RDWR | O_CLOEXEC, perm));
+    if (!fd) {
+        throw std::filesystem::filesystem_error("cannot open cpuset lock", lock_path,
+                                                std::error_code(errno, std::system_category()));
+    }
+
+    int rv;
+    do {
+        rv = ::flock(fd.get(), LOCK_EX);
+    } while (rv != 0 && errno == EINTR);
+    if (rv != 0) {
+        throw std::filesystem::filesystem_error("cannot lock cpuset", lock_path,
+                                                std::error_code(errno, std::system_category()));
+    }
+
+    return fd;
+}
+
+std::vector<int> query_exclusive_cpus() {
+    std::vector<int> cpus;
+    for (const auto& info : query_container_infos(true)) {
+        if (!info.cpuset_exclusive) {
+            continue;
+        }
+
+        // Containers exited but not marked stopped yet give their cpus back; those unknown keep
+        // them, as handing out cpus in use is worse.
+        try {
+            if (!is_container_process_alive(info)) {
+                continue;
+            }
+        } catch (const std::exception& ex) {
+            SPDLOG_WARN("Failed to check container process; container_id={} ex={}",
+                        info.id, ex.what());
+        }
+
+        try {
+            auto ids = parse_cpu_list(info.cpuset_cpus);
+            cpus.insert(cpus.end(), ids.begin(), ids.end());
+        } catch (const std::invalid_argument&) {
+            SPDLOG_WARN("Invalid cpuset of container; container_id={} cpuset={}",
+                        info.id, info.cpuset_cpus);
+        }
+    }
+
+    std::sort(cpus.begin(), cpus.end());
+    cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+    return cpus;
+}
+
+} // namespace lumper
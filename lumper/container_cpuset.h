@@ -0,0 +1,27 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#pragma once
+
+#ifndef LUMPER_CONTAINER_CPUSET_H_
+#define LUMPER_CONTAINER_CPUSET_H_
+
+#include <vector>
+
+#include "esl/unique_handle.h"
+
+namespace lumper {
+
+// Serializes handing out cpusets across processes, from querying exclusive cpus till the info of
+// the container is saved; released once the returned fd is closed.
+// Throws `std::filesystem::filesystem_error` when failed.
+esl::unique_fd lock_cpuset_allocator();
+
+// Returns sorted cpus handed out exclusively to running containers, as recorded in their infos.
+// Throws `std::filesystem::filesystem_error` if failed to read infos.
+std::vector<int> query_exclusive_cpus();
+
+} // namespace lumper
+
+#endif // LUMPER_CONTAINER_CPUSET_H_
@@ -0,0 +1,106 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "lumper/container_filter.h"
+
+#include <charconv>
+#include <cstdint>
+#include <ctime>
+#include <stdexcept>
+#include <string>
+
+#include <time.h>
+
+#include "fmt/format.h"
+
+#include "lumper/container_info.h"
+
+namespace lumper {
+namespace {
+
+constexpr char k_filter_image[] = "image=";
+
+} // namespace
+
+std::chrono::seconds parse_age(std::string_view age) {
+    std::int64_t count = 0;
+    auto [end, ec] = std::from_chars(age.data(), age.data() + age.size(), count);
+    if (ec != std::errc{} || count < 0) {
+        throw std::invalid_argument(fmt::format("invalid age: {}", age));
+    }
+
+    std::string_view unit(end, static_cast<std::size_t>(age.data() + age.size() - end));
+    std::int64_t scale = 0;
+    if (unit.empty() || unit == "s") {
+        scale = 1;
+    } else if (unit == "m") {
+        scale = 60;
+    } else if (unit == "h") {
+        scale = 60 * 60;
+    } else if (unit == "d") {
+        scale = 24 * 60 * 60;
+    } else {
+        throw std::invalid_argument(fmt::format("invalid age: {}", age));
+    }
+
+    if (count > INT64_MAX / scale) {
+        throw std::invalid_argument(fmt::format("age is too large: {}", age));
+    }
+    return std::chrono::seconds(count * scale);
+}
+
+std::optional<std::chrono::system_clock::time_point> parse_create_time(
+        std::string_view create_time) {
+    std::string str(create_time);
+    std::tm tm{};
+    auto* end = ::strptime(str.c_str(), "%Y-%m-%d %H:%M:%S", &tm);
+    if (end == nullptr || *end != '\0') {
+        return std::nullopt;
+    }
+
+    // Let mktime() tell whether daylight saving time is in effect.
+    tm.tm_isdst = -1;
+    auto time = std::mktime(&tm);
+    if (time == static_cast<std::time_t>(-1)) {
+        return std::nullopt;
+    }
+    return std::chrono::system_clock::from_time_t(time);
+}
+
+// static
+container_filter container_filter::parse(const std::optional<std::string>& until,
+                                         const std::optional<std::string>& filter) {
+    container_filter result;
+    if (until) {
+        result.until = parse_age(*until);
+    }
+
+    if (filter) {
+        std::string_view kv(*filter);
+        if (kv.rfind(k_filter_image, 0) != 0 || kv.size() == sizeof(k_filter_image) - 1) {
+            throw std::invalid_argument(fmt::format("unsupported filter: {}", kv));
+        }
+        result.image = std::string(kv.substr(sizeof(k_filter_image) - 1));
+    }
+
+    return result;
+}
+
+bool container_filter::matches(const container_info& info,
+                               std::chrono::system_clock::time_point now) const {
+    if (image && info.image != *image) {
+        return false;
+    }
+
+    if (until) {
+        auto created = parse_create_time(info.create_time);
+        if (!created || now - *created < *until) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+} // namespace lumper
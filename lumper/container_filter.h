@@ -0,0 +1,47 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#pragma once
+
+#ifndef LUMPER_CONTAINER_FILTER_H_
+#define LUMPER_CONTAINER_FILTER_H_
+
+#include <chrono>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace lumper {
+
+struct container_info;
+
+// Parses an age like `90s`, `30m`, `24h` or `7d`; a bare number is in seconds.
+// Throws `std::invalid_argument` if `age` is malformed.
+std::chrono::seconds parse_age(std::string_view age);
+
+// Parses `container_info::create_time`, which is in local time.
+// Returns `std::nullopt` if `create_time` is malformed.
+std::optional<std::chrono::system_clock::time_point> parse_create_time(
+        std::string_view create_time);
+
+// Selects containers by criteria given in commandline, e.g. to `lumper prune`; containers are
+// selected only if all criteria given are met.
+struct container_filter {
+    // Containers created at least this long ago.
+    std::optional<std::chrono::seconds> until;
+    // Containers run from the image.
+    std::optional<std::string> image;
+
+    // `until` is an age as in `parse_age()`, and `filter` is in the form of `image=NAME`.
+    // Throws `std::invalid_argument` if either is malformed.
+    static container_filter parse(const std::optional<std::string>& until,
+                                  const std::optional<std::string>& filter);
+
+    // Containers whose create time is malformed are never old enough.
+    bool matches(const container_info& info, std::chrono::system_clock::time_point now) const;
+};
+
+} // namespace lumper
+
+#endif // LUMPER_CONTAINER_FILTER_H_
@@ -5,14 +5,31 @@
 #include "lumper/container_info.h"
 
 #include <filesystem>
-#include <fstream>
+#include <string>
+#include <system_error>
+#include <vector>
 
+#include <fcntl.h>
+
+#include "esl/unique_handle.h"
+#include "fmt/chrono.h"
+#include "fmt/format.h"
 #include "nlohmann/json.hpp"
 
+#include "base/file_util.h"
+#include "lumper/container_record.h"
 #include "lumper/path_constants.h"
+#include "lumper/state_file.h"
+#include "lumper/state_index.h"
+#include "lumper/state_root.h"
 
 namespace lumper {
 
+std::string format_create_time(const std::chrono::system_clock::time_point& tp) {
+    auto time = std::chrono::system_clock::to_time_t(tp);
+    return fmt::format("{:%Y-%m-%d %H:%M:%S}", fmt::localtime(time));
+}
+
 void to_json(nlohmann::json& j, const container_info& info) {
     j = nlohmann::json{
             {"id", info.id},
@@ -20,7 +37,18 @@ void to_json(nlohmann::json& j, const container_info& info) {
             {"command", info.command},
             {"create_time", info.create_time},
             {"status", info.status},
-            {"pid", info.pid}};
+            {"pid", info.pid},
+            {"image_mount", info.image_mount},
+            {"layers", info.layers},
+            {"start_time", info.start_time},
+            {"cgroup", info.cgroup},
+            {"cpuset_cpus", info.cpuset_cpus},
+            {"cpuset_mems", info.cpuset_mems},
+            {"cpuset_exclusive", info.cpuset_exclusive},
+            {"argv", info.argv},
+            {"lowerdirs", info.lowerdirs},
+            {"memory_limit", info.memory_limit},
+            {"cpus", info.cpus}};
 }
 
 void from_json(const nlohmann::json& j, container_info& info) {
@@ -30,14 +58,96 @@ void from_json(const nlohmann::json& j, container_info& info) {
     j.at("create_time").get_to(info.create_time);
     j.at("status").get_to(info.status);
     j.at("pid").get_to(info.pid);
+    info.image_mount = j.value("image_mount", "");
+    info.layers = j.value("layers", std::vector<std::string>{});
+    info.start_time = j.value("start_time", std::uint64_t{0});
+    info.cgroup = j.value("cgroup", "");
+    info.cpuset_cpus = j.value("cpuset_cpus", "");
+    info.cpuset_mems = j.value("cpuset_mems", "");
+    info.cpuset_exclusive = j.value("cpuset_exclusive", false);
+    info.argv = j.value("argv", std::vector<std::string>{});
+    info.lowerdirs = j.value("lowerdirs", std::vector<std::string>{});
+    info.memory_limit = j.value("memory_limit", "");
+    info.cpus = j.value("cpus", 0);
 }
 
+namespace {
+
+// Records are written relative to directories of containers, which must outlive the writes.
+esl::unique_fd open_info_dir(const container_info& info) {
+    auto dir = state_root::get().open_container_dir(info.id);
+    if (!dir) {
+        throw std::filesystem::filesystem_error(
+                "cannot save container info", std::filesystem::path(k_container_dir) / info.id,
+                std::make_error_code(std::errc::no_such_file_or_directory));
+    }
+    return dir;
+}
+
+state_file_write make_info_file_write(const container_info& info, int dirfd) {
+    return {k_record_filename, encode_container_record(info), dirfd};
+}
+
+} // namespace
+
 void save_container_info(const container_info& info) {
-    auto info_path = std::filesystem::path(k_container_dir) / info.id / k_info_filename;
-    nlohmann::json config;
-    to_json(config, info);
-    std::ofstream out(info_path);
-    out << config;
+    auto dir = open_info_dir(info);
+    state_index_intent intent({info.id});
+    write_state_files({make_info_file_write(info, dir.get())});
+    // The record supersedes the json file once written.
+    state_root::get().remove_container_file(info.id, k_info_filename);
+    index_container_info(info);
+    intent.commit();
+}
+
+void save_container_infos(const std::vector<container_info>& infos) {
+    if (infos.empty()) {
+        return;
+    }
+
+    std::vector<esl::unique_fd> dirs;
+    std::vector<state_file_write> writes;
+    std::vector<std::string> ids;
+    dirs.reserve(infos.size());
+    writes.reserve(infos.size());
+    ids.reserve(infos.size());
+    for (const auto& info : infos) {
+        dirs.push_back(open_info_dir(info));
+        writes.push_back(make_info_file_write(info, dirs.back().get()));
+        ids.push_back(info.id);
+    }
+    state_index_intent intent(ids);
+    write_state_files(writes);
+    for (const auto& info : infos) {
+        state_root::get().remove_container_file(info.id, k_info_filename);
+    }
+    index_container_infos(infos);
+    intent.commit();
+}
+
+container_info load_container_info(std::string_view container_id) {
+    const auto& root = state_root::get();
+    auto record_path = std::filesystem::path(k_container_dir) / container_id / k_record_filename;
+    if (auto fd = root.open_container_file(container_id, k_record_filename, O_RDONLY); fd) {
+        return mapped_container_record(fd.get(), record_path).view().to_container_info();
+    }
+
+    // Only read once for each container saved by older versions.
+    auto fd = root.open_container_file(container_id, k_info_filename, O_RDONLY);
+    if (!fd) {
+        throw std::filesystem::filesystem_error(
+                "cannot load container info",
+                std::filesystem::path(k_container_dir) / container_id / k_info_filename,
+                std::make_error_code(std::errc::no_such_file_or_directory));
+    }
+    return nlohmann::json::parse(base::read_file_to_string(get_fd_path(fd.get())))
+            .get<container_info>();
+}
+
+bool has_container_info(std::string_view container_id) {
+    const auto& root = state_root::get();
+    return root.has_container_file(container_id, k_record_filename) ||
+           root.has_container_file(container_id, k_info_filename);
 }
 
 } // namespace lumper
@@ -7,7 +7,11 @@
 #ifndef LUMPER_CONTAINER_INFO_H_
 #define LUMPER_CONTAINER_INFO_H_
 
+#include <chrono>
+#include <cstdint>
 #include <string>
+#include <string_view>
+#include <vector>
 
 #include "nlohmann/json_fwd.hpp"
 
@@ -23,14 +27,65 @@ struct container_info {
     std::string create_time;
     std::string status;
     int pid;
+    // Key of the shared image mount, empty if the image is not a single-file image.
+    std::string image_mount;
+    // Ids of image layers the container's overlay is stacked on, which stay in use even if the
+    // image is changed afterwards, e.g. by `lumper image squash`.
+    std::vector<std::string> layers;
+    // Start time of the process in clock ticks after boot, which tells the process from another
+    // one reusing its pid; 0 if unknown, e.g. recorded by older versions.
+    std::uint64_t start_time{0};
+    // Path of the container's cgroup relative to the hierarchy root, e.g. lumper/<id>; empty if
+    // the container has no cgroup, e.g. recorded by older versions.
+    std::string cgroup;
+    // Cpus and NUMA nodes the container is pinned to, as cpu lists, e.g. 0-3; empty if not
+    // pinned.
+    std::string cpuset_cpus;
+    std::string cpuset_mems;
+    // True if the cpus were handed out by `assign_cpuset()` for the container alone.
+    bool cpuset_exclusive{false};
+    // Arguments of the container process, which `command` joins by spaces for display; empty if
+    // recorded by older versions.
+    std::vector<std::string> argv;
+    // Directories the overlay is stacked on, top-most first, including the mountpoint of
+    // `image_mount`; empty if recorded by older versions.
+    std::vector<std::string> lowerdirs;
+    // Limits given to `lumper run`; empty and 0 respectively if not limited.
+    std::string memory_limit;
+    int cpus{0};
 };
 
+// Formats `tp` as in `container_info::create_time`.
+std::string format_create_time(const std::chrono::system_clock::time_point& tp);
+
+// Infos are stored as binary records, see `container_record_view`; json is only for output, e.g.
+// `lumper inspect`, and reading infos saved by older versions.
 void to_json(nlohmann::json& j, const container_info& info);
 
 void from_json(const nlohmann::json& j, container_info& info);
 
+// Replaces the info file of the container atomically, and records it in the state index; both are
+// flushed as per `get_state_durability()`.
+// Throws `std::filesystem::filesystem_error` when failed.
 void save_container_info(const container_info& info);
 
+// Same as `save_container_info()` for each, while files are synced together and the state index
+// is updated at once.
+// Throws `std::filesystem::filesystem_error` when failed.
+void save_container_infos(const std::vector<container_info>& infos);
+
+// Reads the json file saved by older versions if the container has no record file.
+// Throws:
+//  - `std::invalid_argument` if `container_id` can't be an id.
+//  - `std::filesystem::filesystem_error` if failed to read the info file, or the record is
+//    corrupted.
+//  - `nlohmann::json::exception` if the json file is corrupted.
+container_info load_container_info(std::string_view container_id);
+
+// Returns false if the container has no info file, e.g. left by a failed run.
+// Throws `std::filesystem::filesystem_error` when failed.
+bool has_container_info(std::string_view container_id);
+
 } // namespace lumper
 
 #endif // LUMPER_CONTAINER_INFO_H_
@@ -0,0 +1,267 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "lumper/container_record.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "esl/unique_handle.h"
+
+#include "lumper/container_info.h"
+
+namespace lumper {
+namespace {
+
+using string_ref = container_record_view::string_ref;
+using record_header = container_record_view::header;
+
+// Size of the header of version 1, the smallest one.
+constexpr std::size_t k_min_header_size = offsetof(record_header, cgroup);
+
+// Returns the least header size of `version`, which is supported.
+constexpr std::size_t header_size_of(std::uint16_t version) noexcept {
+    switch (version) {
+    case 1:
+        return k_min_header_size;
+    case 2:
+        return offsetof(record_header, cpuset_cpus);
+    case 3:
+        return offsetof(record_header, args_offset);
+    default:
+        return sizeof(record_header);
+    }
+}
+
+bool is_in_record(string_ref ref, std::uint32_t record_size) noexcept {
+    return std::uint64_t{ref.offset} + ref.len <= record_size;
+}
+
+// Checks the table of `count` `string_ref`s at `offset`, along with strings they refer to.
+bool is_table_in_record(std::string_view record,
+                        std::uint32_t offset,
+                        std::uint32_t count) noexcept {
+    if (std::uint64_t{offset} + std::uint64_t{count} * sizeof(string_ref) > record.size()) {
+        return false;
+    }
+    for (std::uint32_t i = 0; i < count; ++i) {
+        string_ref ref{};
+        std::memcpy(&ref, record.data() + offset + i * sizeof(ref), sizeof(ref));
+        if (!is_in_record(ref, static_cast<std::uint32_t>(record.size()))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Heap strings are appended right after the header and tables of layers, args and lowerdirs, in
+// order.
+class record_builder {
+public:
+    explicit record_builder(std::size_t table_entries)
+        : heap_begin_(sizeof(record_header) + table_entries * sizeof(string_ref)) {}
+
+    string_ref add(std::string_view str) {
+        auto offset = heap_begin_ + heap_.size();
+        if (offset + str.size() > UINT32_MAX) {
+            throw std::length_error("container record is too large");
+        }
+        heap_.append(str);
+        return {static_cast<std::uint32_t>(offset), static_cast<std::uint32_t>(str.size())};
+    }
+
+    std::size_t size() const noexcept {
+        return heap_begin_ + heap_.size();
+    }
+
+    const std::string& heap() const noexcept {
+        return heap_;
+    }
+
+private:
+    std::size_t heap_begin_;
+    std::string heap_;
+};
+
+[[noreturn]] void throw_fs_error(const char* what, const std::filesystem::path& path) {
+    throw std::filesystem::filesystem_error(what, path,
+                                            std::error_code(errno, std::system_category()));
+}
+
+} // namespace
+
+// static
+std::optional<container_record_view> container_record_view::parse(std::string_view data) noexcept {
+    if (data.size() < k_min_header_size) {
+        return std::nullopt;
+    }
+
+    // `data` may be unaligned, e.g. a payload of the state index.
+    // Fields appended after the header of an older version stay zeros, i.e. empty strings.
+    header hdr{};
+    std::memcpy(&hdr, data.data(), k_min_header_size);
+    if (std::memcmp(hdr.magic, k_magic, sizeof(k_magic)) != 0 || hdr.version < k_min_version ||
+        hdr.version > k_version || hdr.header_size < header_size_of(hdr.version) ||
+        hdr.size < hdr.header_size || hdr.size > data.size()) {
+        return std::nullopt;
+    }
+    std::memcpy(&hdr, data.data(), std::min<std::size_t>(hdr.header_size, sizeof(header)));
+
+    for (auto ref : {hdr.id, hdr.image, hdr.command, hdr.create_time, hdr.status,
+                     hdr.image_mount, hdr.cgroup, hdr.cpuset_cpus, hdr.cpuset_mems,
+                     hdr.memory_limit}) {
+        if (!is_in_record(ref, hdr.size)) {
+            return std::nullopt;
+        }
+    }
+
+    auto record = data.substr(0, hdr.size);
+    if (!is_table_in_record(record, hdr.layers_offset, hdr.layer_count) ||
+        !is_table_in_record(record, hdr.args_offset, hdr.arg_count) ||
+        !is_table_in_record(record, hdr.lowerdirs_offset, hdr.lowerdir_count)) {
+        return std::nullopt;
+    }
+
+    return container_record_view(record, hdr);
+}
+
+std::string_view container_record_view::table_entry(std::uint32_t table_offset,
+                                                    std::size_t i) const noexcept {
+    string_ref ref{};
+    std::memcpy(&ref, data_.data() + table_offset + i * sizeof(ref), sizeof(ref));
+    return str(ref);
+}
+
+container_info container_record_view::to_container_info() const {
+    container_info info;
+    info.id = id();
+    info.image = image();
+    info.command = command();
+    info.create_time = create_time();
+    info.status = status();
+    info.pid = pid();
+    info.image_mount = image_mount();
+    info.layers.reserve(layer_count());
+    for (std::size_t i = 0; i < layer_count(); ++i) {
+        info.layers.emplace_back(layer(i));
+    }
+    info.start_time = start_time();
+    info.cgroup = cgroup();
+    info.cpuset_cpus = cpuset_cpus();
+    info.cpuset_mems = cpuset_mems();
+    info.cpuset_exclusive = cpuset_exclusive();
+    info.argv.reserve(arg_count());
+    for (std::size_t i = 0; i < arg_count(); ++i) {
+        info.argv.emplace_back(arg(i));
+    }
+    info.lowerdirs.reserve(lowerdir_count());
+    for (std::size_t i = 0; i < lowerdir_count(); ++i) {
+        info.lowerdirs.emplace_back(lowerdir(i));
+    }
+    info.memory_limit = memory_limit();
+    info.cpus = cpus();
+    return info;
+}
+
+std::string encode_container_record(const container_info& info) {
+    record_builder builder(info.layers.size() + info.argv.size() + info.lowerdirs.size());
+
+    record_header hdr{};
+    std::memcpy(hdr.magic, container_record_view::k_magic, sizeof(hdr.magic));
+    hdr.version = container_record_view::k_version;
+    hdr.header_size = sizeof(record_header);
+    hdr.pid = info.pid;
+    hdr.start_time = info.start_time;
+    hdr.id = builder.add(info.id);
+    hdr.image = builder.add(info.image);
+    hdr.command = builder.add(info.command);
+    hdr.create_time = builder.add(info.create_time);
+    hdr.status = builder.add(info.status);
+    hdr.image_mount = builder.add(info.image_mount);
+    hdr.layers_offset = sizeof(record_header);
+    hdr.layer_count = static_cast<std::uint32_t>(info.layers.size());
+    hdr.cgroup = builder.add(info.cgroup);
+    hdr.cpuset_cpus = builder.add(info.cpuset_cpus);
+    hdr.cpuset_mems = builder.add(info.cpuset_mems);
+    hdr.flags = info.cpuset_exclusive ? container_record_view::k_flag_cpuset_exclusive : 0;
+    hdr.cpus = info.cpus;
+    hdr.args_offset = static_cast<std::uint32_t>(hdr.layers_offset +
+                                                 hdr.layer_count * sizeof(string_ref));
+    hdr.arg_count = static_cast<std::uint32_t>(info.argv.size());
+    hdr.lowerdirs_offset = static_cast<std::uint32_t>(hdr.args_offset +
+                                                      hdr.arg_count * sizeof(string_ref));
+    hdr.lowerdir_count = static_cast<std::uint32_t>(info.lowerdirs.size());
+    hdr.memory_limit = builder.add(info.memory_limit);
+
+    std::vector<string_ref> tables;
+    tables.reserve(info.layers.size() + info.argv.size() + info.lowerdirs.size());
+    for (const auto* strs : {&info.layers, &info.argv, &info.lowerdirs}) {
+        for (const auto& str : *strs) {
+            tables.push_back(builder.add(str));
+        }
+    }
+    hdr.size = static_cast<std::uint32_t>(builder.size());
+
+    std::string record;
+    record.reserve(builder.size());
+    record.append(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+    record.append(reinterpret_cast<const char*>(tables.data()), tables.size() * sizeof(string_ref));
+    record.append(builder.heap());
+    return record;
+}
+
+mapped_container_record::mapped_container_record(const std::filesystem::path& path) {
+    esl::unique_fd fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (!fd) {
+        throw_fs_error("cannot open container record", path);
+    }
+    map(fd.get(), path);
+}
+
+mapped_container_record::mapped_container_record(int fd, const std::filesystem::path& path) {
+    map(fd, path);
+}
+
+void mapped_container_record::map(int fd, const std::filesystem::path& path) {
+    struct stat st {};
+    if (::fstat(fd, &st) != 0) {
+        throw_fs_error("cannot stat container record", path);
+    }
+
+    size_ = static_cast<std::size_t>(st.st_size);
+    if (size_ > 0) {
+        void* addr = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+        if (addr == MAP_FAILED) {
+            throw_fs_error("cannot map container record", path);
+        }
+        data_ = static_cast<const char*>(addr);
+    }
+
+    view_ = container_record_view::parse({data_, size_});
+    if (!view_) {
+        if (data_ != nullptr) {
+            ::munmap(const_cast<char*>(data_), size_);
+        }
+        throw std::filesystem::filesystem_error(
+                "container record is corrupted", path,
+                std::make_error_code(std::errc::illegal_byte_sequence));
+    }
+}
+
+mapped_container_record::~mapped_container_record() {
+    if (data_ != nullptr) {
+        ::munmap(const_cast<char*>(data_), size_);
+    }
+}
+
+} // namespace lumper
@@ -0,0 +1,217 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#pragma once
+
+#ifndef LUMPER_CONTAINER_RECORD_H_
+#define LUMPER_CONTAINER_RECORD_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace lumper {
+
+struct container_info;
+
+// A container info in a fixed layout: a header of fixed-size fields, whose strings refer to a heap
+// following it, thus fields are read in place, e.g. from a mapped file, without parsing nor
+// allocating.
+// All integers are in host byte order, as records never leave the host.
+// Records of newer versions are rejected; fields appended since an older version read as empty in
+// its records.
+class container_record_view {
+public:
+    static constexpr char k_magic[4] = {'L', 'M', 'P', 'C'};
+    // Version 2 appends `cgroup`, 3 appends cpuset fields and `flags`, and 4 appends the command
+    // line, lowerdirs and resource limits.
+    static constexpr std::uint16_t k_version = 4;
+    static constexpr std::uint16_t k_min_version = 1;
+
+    // Refers to `len` bytes at `offset` from the beginning of the record.
+    struct string_ref {
+        std::uint32_t offset;
+        std::uint32_t len;
+    };
+
+    struct header {
+        char magic[4];
+        std::uint16_t version;
+        // Size of the header; fields may only be appended in later versions.
+        std::uint16_t header_size;
+        // Size of the whole record, including the heap.
+        std::uint32_t size;
+        std::int32_t pid;
+        std::uint64_t start_time;
+        string_ref id;
+        string_ref image;
+        string_ref command;
+        string_ref create_time;
+        string_ref status;
+        string_ref image_mount;
+        // Offset of an array of `layer_count` `string_ref`s.
+        std::uint32_t layers_offset;
+        std::uint32_t layer_count;
+        string_ref cgroup;
+        string_ref cpuset_cpus;
+        string_ref cpuset_mems;
+        // Bits of `k_flag_*`.
+        std::uint32_t flags;
+        // Reserved, thus zero, before version 4.
+        std::int32_t cpus;
+        // Offsets of arrays of `string_ref`s, as `layers_offset`.
+        std::uint32_t args_offset;
+        std::uint32_t arg_count;
+        std::uint32_t lowerdirs_offset;
+        std::uint32_t lowerdir_count;
+        string_ref memory_limit;
+    };
+
+    static constexpr std::uint32_t k_flag_cpuset_exclusive = 1;
+
+    // Returns `std::nullopt` if `data` doesn't begin with a well-formed record; the record may be
+    // followed by other data.
+    // `data` must outlive the view.
+    static std::optional<container_record_view> parse(std::string_view data) noexcept;
+
+    std::size_t size() const noexcept {
+        return header_.size;
+    }
+
+    int pid() const noexcept {
+        return header_.pid;
+    }
+
+    std::uint64_t start_time() const noexcept {
+        return header_.start_time;
+    }
+
+    std::string_view id() const noexcept {
+        return str(header_.id);
+    }
+
+    std::string_view image() const noexcept {
+        return str(header_.image);
+    }
+
+    std::string_view command() const noexcept {
+        return str(header_.command);
+    }
+
+    std::string_view create_time() const noexcept {
+        return str(header_.create_time);
+    }
+
+    std::string_view status() const noexcept {
+        return str(header_.status);
+    }
+
+    std::string_view image_mount() const noexcept {
+        return str(header_.image_mount);
+    }
+
+    std::string_view cgroup() const noexcept {
+        return str(header_.cgroup);
+    }
+
+    std::string_view cpuset_cpus() const noexcept {
+        return str(header_.cpuset_cpus);
+    }
+
+    std::string_view cpuset_mems() const noexcept {
+        return str(header_.cpuset_mems);
+    }
+
+    bool cpuset_exclusive() const noexcept {
+        return (header_.flags & k_flag_cpuset_exclusive) != 0;
+    }
+
+    std::string_view memory_limit() const noexcept {
+        return str(header_.memory_limit);
+    }
+
+    int cpus() const noexcept {
+        return header_.cpus;
+    }
+
+    std::size_t layer_count() const noexcept {
+        return header_.layer_count;
+    }
+
+    std::string_view layer(std::size_t i) const noexcept {
+        return table_entry(header_.layers_offset, i);
+    }
+
+    std::size_t arg_count() const noexcept {
+        return header_.arg_count;
+    }
+
+    std::string_view arg(std::size_t i) const noexcept {
+        return table_entry(header_.args_offset, i);
+    }
+
+    std::size_t lowerdir_count() const noexcept {
+        return header_.lowerdir_count;
+    }
+
+    std::string_view lowerdir(std::size_t i) const noexcept {
+        return table_entry(header_.lowerdirs_offset, i);
+    }
+
+    container_info to_container_info() const;
+
+private:
+    container_record_view(std::string_view data, const header& hdr) noexcept
+        : data_(data), header_(hdr) {}
+
+    std::string_view str(string_ref ref) const noexcept {
+        return data_.substr(ref.offset, ref.len);
+    }
+
+    std::string_view table_entry(std::uint32_t table_offset, std::size_t i) const noexcept;
+
+    std::string_view data_;
+    header header_;
+};
+
+static_assert(sizeof(container_record_view::header) == 136);
+
+// Throws `std::length_error` if a field is too long to be referred to.
+std::string encode_container_record(const container_info& info);
+
+// A record file mapped into memory, which is read in place.
+class mapped_container_record {
+public:
+    // Throws `std::filesystem::filesystem_error` if failed to map the file or the record in it is
+    // malformed.
+    explicit mapped_container_record(const std::filesystem::path& path);
+
+    // Maps the file opened as `fd`, which may be closed afterwards; `path` is for errors only.
+    // Throws as above.
+    mapped_container_record(int fd, const std::filesystem::path& path);
+
+    ~mapped_container_record();
+
+    mapped_container_record(const mapped_container_record&) = delete;
+
+    mapped_container_record& operator=(const mapped_container_record&) = delete;
+
+    const container_record_view& view() const noexcept {
+        return *view_;
+    }
+
+private:
+    void map(int fd, const std::filesystem::path& path);
+
+    const char* data_{nullptr};
+    std::size_t size_{0};
+    std::optional<container_record_view> view_;
+};
+
+} // namespace lumper
+
+#endif // LUMPER_CONTAINER_RECORD_H_
@@ -0,0 +1,167 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "lumper/container_root.h"
+
+#include <optional>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+#include "fmt/format.h"
+#include "spdlog/spdlog.h"
+#include "uuidxx/uuidxx.h"
+
+#include "lumper/image_mount.h"
+#include "lumper/image_pin.h"
+#include "lumper/image_store.h"
+#include "lumper/overlay_view.h"
+#include "lumper/path_constants.h"
+#include "lumper/state_index.h"
+#include "lumper/state_root.h"
+
+namespace lumper {
+namespace {
+
+// Use last part of uuid-v4 as container-id.
+inline std::string generate_container_id() {
+    auto uuid = uuidxx::make_v4().to_string();
+    return uuid.substr(uuid.rfind('-') + 1);
+}
+
+// Chooses a container-id, and creates directories of the container, which is locked
+// exclusively.
+std::pair<std::string, esl::unique_fd> create_container_dirs() {
+    std::string container_id;
+    esl::unique_fd lock;
+    while (true) {
+        container_id = generate_container_id();
+        // Ids of containers being created are not indexed yet, while creating the directory
+        // still tells.
+        if (is_container_indexed(container_id)) {
+            SPDLOG_WARN("Generated container-id({}) already in use, try another one",
+                        container_id);
+            continue;
+        }
+        // Locked before others learn of the id, which is not until it's indexed.
+        if (state_root::get().create_container_dir(container_id)) {
+            lock = state_root::get().lock_container(container_id, container_lock_mode::exclusive);
+            if (!lock) {
+                throw std::filesystem::filesystem_error(
+                        "container removed while being created",
+                        get_container_path(container_id, ""),
+                        std::make_error_code(std::errc::no_such_file_or_directory));
+            }
+            SPDLOG_INFO("Successfully chosed container-id={}", container_id);
+            break;
+        }
+        SPDLOG_WARN("Generated container-id({}) already in use, try another one", container_id);
+    }
+
+    // Create directories for:
+    //  - cow layer (upperdir)
+    //  - overlay workdir
+    //  - a mount point
+    for (const char* subdir : {"cow_rw", "cow_workdir", "rootfs"}) {
+        state_root::get().create_container_subdir(container_id, subdir);
+    }
+
+    return {std::move(container_id), std::move(lock)};
+}
+
+container_root_info make_container_root(std::string container_id,
+                                        esl::unique_fd lock,
+                                        std::vector<std::filesystem::path> lowerdirs,
+                                        std::string image_mount_key,
+                                        bool pinned) {
+    std::vector<std::string> layers;
+    for (const auto& dir : lowerdirs) {
+        if (dir.parent_path() == k_layers_dir) {
+            layers.push_back(dir.filename().native());
+        }
+    }
+
+    // Overlay mount data and the container itself take absolute paths.
+    auto cow_rw = get_container_path(container_id, "cow_rw");
+    auto cow_workdir = get_container_path(container_id, "cow_workdir");
+    auto rootfs = get_container_path(container_id, "rootfs");
+
+    auto image_root = join_overlay_lowerdirs(lowerdirs);
+    auto mount_data = fmt::format("lowerdir={},upperdir={},workdir={}",
+                                  image_root, cow_rw.native(), cow_workdir.native());
+
+    SPDLOG_INFO("Create container root; image_root={}\ncontainer_root={}\nmount_data={}",
+                image_root, rootfs.native(), mount_data);
+
+    return {std::move(container_id), std::move(rootfs), std::move(cow_rw), std::move(mount_data),
+            std::move(image_mount_key), std::move(lowerdirs), std::move(layers), pinned,
+            std::move(lock)};
+}
+
+} // namespace
+
+std::filesystem::path get_container_path(std::string_view container_id, std::string_view subdir) {
+    std::filesystem::path path(k_container_dir);
+    path /= container_id;
+    path /= subdir;
+    return path;
+}
+
+container_root_info create_container_root(std::string_view image_name) {
+    // Single-file image at the bottom is mounted after the container-id is chosen.
+    auto image = resolve_image(image_name);
+    auto pinned_rootfs = find_pinned_rootfs(image_name, image);
+    if (pinned_rootfs) {
+        SPDLOG_INFO("Use pinned image; image={} rootfs={}", image_name, pinned_rootfs->native());
+        image = resolved_image{{*pinned_rootfs}, std::nullopt};
+    }
+    auto& [lowerdirs, image_file] = image;
+
+    auto [container_id, lock] = create_container_dirs();
+
+    std::string image_mount_key;
+    if (image_file) {
+        auto mount = acquire_image_mount(*image_file, container_id);
+        image_mount_key = std::move(mount.key);
+        lowerdirs.push_back(std::move(mount.mountpoint));
+    }
+
+    return make_container_root(std::move(container_id), std::move(lock), std::move(lowerdirs),
+                               std::move(image_mount_key), pinned_rootfs.has_value());
+}
+
+container_root_info create_container_root(const container_info& source) {
+    if (source.lowerdirs.empty()) {
+        SPDLOG_WARN("No lowerdirs recorded for container, resolve its image instead; "
+                    "container_id={} image={}",
+                    source.id, source.image);
+        return create_container_root(source.image);
+    }
+
+    std::vector<std::filesystem::path> lowerdirs(source.lowerdirs.begin(),
+                                                 source.lowerdirs.end());
+    bool pinned = false;
+    for (const auto& dir : lowerdirs) {
+        // E.g. the image was unpinned.
+        if (!std::filesystem::exists(dir)) {
+            throw std::invalid_argument(
+                    fmt::format("lowerdir {} of container {} is gone", dir.native(), source.id));
+        }
+        pinned = pinned || dir.parent_path() == k_image_pins_dir;
+    }
+
+    auto [container_id, lock] = create_container_dirs();
+
+    // The mountpoint is in `lowerdirs` already, which may have been unmounted by a reboot.
+    std::string image_mount_key;
+    if (!source.image_mount.empty()) {
+        restore_image_mount(source.image_mount, source.id);
+        image_mount_key = share_image_mount(source.image_mount, source.id, container_id).key;
+    }
+
+    return make_container_root(std::move(container_id), std::move(lock), std::move(lowerdirs),
+                               std::move(image_mount_key), pinned);
+}
+
+} // namespace lumper
@@ -0,0 +1,59 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#pragma once
+
+#ifndef LUMPER_CONTAINER_ROOT_H_
+#define LUMPER_CONTAINER_ROOT_H_
+
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "esl/unique_handle.h"
+
+#include "lumper/container_info.h"
+
+namespace lumper {
+
+struct container_root_info {
+    std::string container_id;
+    std::filesystem::path rootfs;
+    // Copy-on-write layer of the container, empty when created.
+    std::filesystem::path upperdir;
+    // Overlay mount data.
+    std::string mount_data;
+    // Empty if the image is not a single-file image.
+    std::string image_mount_key;
+    // Top-most first, including the mounted single-file image.
+    std::vector<std::filesystem::path> lowerdirs;
+    // Ids of layers used.
+    std::vector<std::string> layers;
+    // Whether the image is run from its pin.
+    bool pinned;
+    // Exclusive lock of the container, held until its info is saved.
+    esl::unique_fd lock;
+};
+
+std::filesystem::path get_container_path(std::string_view container_id, std::string_view subdir);
+
+// Chooses a container-id and prepares directories of the overlay stacked on the image, which is
+// mounted by the container itself; the container is locked exclusively.
+// Throws:
+//  - `std::invalid_argument` if the image doesn't exist.
+//  - `std::system_error` or `std::filesystem::filesystem_error` when failed.
+container_root_info create_container_root(std::string_view image_name);
+
+// Same as above, while the overlay is stacked on lowerdirs recorded for `source`, e.g. a container
+// being cloned, whose image mount is shared; thus the image changed since doesn't matter.
+// The image of `source` is resolved instead if it has no lowerdirs recorded.
+// Throws:
+//  - `std::invalid_argument` if a lowerdir is gone, e.g. the image is unpinned.
+//  - `std::system_error` or `std::filesystem::filesystem_error` when failed.
+container_root_info create_container_root(const container_info& source);
+
+} // namespace lumper
+
+#endif // LUMPER_CONTAINER_ROOT_H_
@@ -0,0 +1,195 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "lumper/container_status.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <exception>
+#include <future>
+#include <system_error>
+#include <utility>
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "esl/unique_handle.h"
+#include "spdlog/spdlog.h"
+
+#include "base/procfs.h"
+#include "base/thread_pool.h"
+#include "lumper/event_journal.h"
+#include "lumper/state_root.h"
+
+namespace lumper {
+namespace {
+
+esl::unique_fd open_pidfd(pid_t pid) {
+    return esl::unique_fd(static_cast<int>(::syscall(SYS_pidfd_open, pid, 0)));
+}
+
+bool is_pidfd_alive(int pidfd) {
+    if (::syscall(SYS_pidfd_send_signal, pidfd, 0, nullptr, 0) == 0) {
+        return true;
+    }
+    if (errno == ESRCH) {
+        return false;
+    }
+    throw std::system_error(errno, std::system_category(), "failed to signal pidfd");
+}
+
+} // namespace
+
+std::uint64_t get_process_start_time(pid_t pid) noexcept {
+    try {
+        auto stat = base::read_process_stat(pid);
+        return stat ? stat->start_time : 0;
+    } catch (const std::exception& ex) {
+        SPDLOG_WARN("Failed to read process stat; pid={} ex={}", pid, ex.what());
+        return 0;
+    }
+}
+
+namespace {
+
+// Returns false if `pidfd`, or the pid if `pidfd` is invalid, doesn't refer to the process of
+// the container.
+bool is_container_process(const container_info& info, int pidfd) {
+    auto stat = base::read_process_stat(info.pid);
+    if (!stat || stat->state == 'Z' || stat->state == 'X') {
+        return false;
+    }
+
+    if (info.start_time != 0 && stat->start_time != info.start_time) {
+        return false;
+    }
+
+    // The stat read may be of another process, if the pinned one has exited and its pid has been
+    // reused in between.
+    return pidfd < 0 || is_pidfd_alive(pidfd);
+}
+
+} // namespace
+
+bool is_container_process_alive(const container_info& info) {
+    if (info.pid <= 0) {
+        return false;
+    }
+
+    auto pidfd = open_pidfd(info.pid);
+    if (!pidfd) {
+        if (errno == ESRCH) {
+            return false;
+        }
+        // Kernels before 5.3 have no pidfd, where the check below is racy against pid reuse.
+        if (errno != ENOSYS) {
+            throw std::system_error(errno, std::system_category(), "failed to open pidfd");
+        }
+    }
+
+    return is_container_process(info, pidfd.get());
+}
+
+esl::unique_fd open_container_pidfd(const container_info& info) {
+    if (info.pid <= 0) {
+        return {};
+    }
+
+    auto pidfd = open_pidfd(info.pid);
+    if (!pidfd) {
+        if (errno == ESRCH || errno == ENOSYS) {
+            return {};
+        }
+        throw std::system_error(errno, std::system_category(), "failed to open pidfd");
+    }
+
+    return is_container_process(info, pidfd.get()) ? std::move(pidfd) : esl::unique_fd{};
+}
+
+std::size_t reconcile_container_status(std::vector<container_info>& infos,
+                                       base::thread_pool& pool,
+                                       std::vector<std::string>* unsaved) {
+    std::vector<container_info*> running;
+    for (auto& info : infos) {
+        if (info.status == k_container_status_running) {
+            running.push_back(&info);
+        }
+    }
+    if (running.empty()) {
+        return 0;
+    }
+
+    // A check takes a few syscalls, thus containers are checked in chunks rather than a task
+    // for each.
+    // Not vector<bool>, which can't be written concurrently.
+    std::vector<char> alive(running.size(), 1);
+    auto num_chunks = std::min(pool.size(), running.size());
+    auto chunk_size = (running.size() + num_chunks - 1) / num_chunks;
+    std::vector<std::future<void>> futures;
+    futures.reserve(num_chunks);
+    for (std::size_t begin = 0; begin < running.size(); begin += chunk_size) {
+        auto end = std::min(begin + chunk_size, running.size());
+        futures.push_back(pool.submit([&running, &alive, begin, end] {
+            for (auto i = begin; i < end; ++i) {
+                try {
+                    alive[i] = is_container_process_alive(*running[i]);
+                } catch (const std::exception& ex) {
+                    // Leaves the status as is.
+                    SPDLOG_WARN("Failed to check container process; container_id={} pid={} ex={}",
+                                running[i]->id, running[i]->pid, ex.what());
+                }
+            }
+        }));
+    }
+    base::wait_all(futures);
+
+    std::size_t marked = 0;
+    std::vector<container_info> stopped;
+    std::vector<esl::unique_fd> locks;
+    for (std::size_t i = 0; i < running.size(); ++i) {
+        if (alive[i]) {
+            continue;
+        }
+        ++marked;
+        running[i]->status = k_container_status_stopped;
+        // Containers being changed or removed are left to their owners, or next time, rather than
+        // waited for; thus a removed container is never brought back either.
+        auto lock = state_root::get().lock_container(running[i]->id,
+                                                     container_lock_mode::exclusive, false);
+        if (!lock) {
+            if (unsaved != nullptr) {
+                unsaved->push_back(running[i]->id);
+            }
+            continue;
+        }
+
+        // `infos` may be stale, e.g. read from the index before others changed the container, thus
+        // only the status is changed, on the record read under the lock; and only if it is still
+        // of the process checked.
+        try {
+            auto info = load_container_info(running[i]->id);
+            if (info.status == k_container_status_running && info.pid == running[i]->pid &&
+                info.start_time == running[i]->start_time) {
+                info.status = k_container_status_stopped;
+                stopped.push_back(std::move(info));
+                locks.push_back(std::move(lock));
+            }
+        } catch (const std::exception& ex) {
+            SPDLOG_WARN("Failed to load container info; container_id={} ex={}",
+                        running[i]->id, ex.what());
+            if (unsaved != nullptr) {
+                unsaved->push_back(running[i]->id);
+            }
+        }
+    }
+
+    save_container_infos(stopped);
+    for (const auto& info : stopped) {
+        record_container_event(container_event_type::exited, info.id, info.pid);
+    }
+    SPDLOG_INFO("Reconciled container status; checked={} stopped={}", running.size(), marked);
+    return marked;
+}
+
+} // namespace lumper
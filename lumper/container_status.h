@@ -0,0 +1,55 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#pragma once
+
+#ifndef LUMPER_CONTAINER_STATUS_H_
+#define LUMPER_CONTAINER_STATUS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "esl/unique_handle.h"
+
+#include "lumper/container_info.h"
+
+namespace base {
+class thread_pool;
+} // namespace base
+
+namespace lumper {
+
+// Returns start time of the process to be recorded in `container_info::start_time`, or 0 if
+// unknown, e.g. the process has exited already.
+std::uint64_t get_process_start_time(pid_t pid) noexcept;
+
+// Returns true if the process recorded for the container is still running.
+// The process is pinned with a pidfd while its start time is checked, thus a process reusing the
+// pid is never taken for it.
+// Throws `std::system_error` when failed.
+bool is_container_process_alive(const container_info& info);
+
+// Returns a pidfd of the container process, which becomes readable once the process exits, or an
+// invalid fd if the process is not running, or pidfd is not supported.
+// Throws `std::system_error` when failed.
+esl::unique_fd open_container_pidfd(const container_info& info);
+
+// Containers exited on their own, e.g. detached ones, are still recorded as running.
+// Checks processes of containers recorded as running on `pool`, and marks exited ones as stopped,
+// both in `infos` and in their saved records.
+// Returns the number of containers marked.
+// Records of containers being changed or removed meanwhile are left to their owners, whose ids
+// are appended to `unsaved` if not null, thus callers may try them again later.
+// Throws `std::filesystem::filesystem_error` or `nlohmann::json::exception` if failed to save.
+std::size_t reconcile_container_status(std::vector<container_info>& infos,
+                                       base::thread_pool& pool,
+                                       std::vector<std::string>* unsaved = nullptr);
+
+} // namespace lumper
+
+#endif // LUMPER_CONTAINER_STATUS_H_
@@ -0,0 +1,172 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "lumper/container_trash.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <future>
+#include <string>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#include "esl/unique_handle.h"
+#include "fmt/format.h"
+#include "spdlog/spdlog.h"
+
+#include "base/file_util.h"
+#include "base/thread_pool.h"
+#include "lumper/cgroups/cgroup_manager.h"
+#include "lumper/container_info.h"
+#include "lumper/image_mount.h"
+#include "lumper/path_constants.h"
+#include "lumper/state_root.h"
+
+namespace lumper {
+namespace {
+
+// Returns an invalid fd if the entry is gone, i.e. deleted by another process.
+esl::unique_fd lock_trash_entry(const std::filesystem::path& entry) {
+    esl::unique_fd fd(::open(entry.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC));
+    if (!fd) {
+        if (errno == ENOENT) {
+            return fd;
+        }
+        throw std::filesystem::filesystem_error("cannot open trash entry", entry,
+                                                std::error_code(errno, std::system_category()));
+    }
+
+    int rv;
+    do {
+        rv = ::flock(fd.get(), LOCK_EX);
+    } while (rv != 0 && errno == EINTR);
+    if (rv != 0) {
+        throw std::filesystem::filesystem_error("cannot lock trash entry", entry,
+                                                std::error_code(errno, std::system_category()));
+    }
+
+    return fd;
+}
+
+// Directories of the entry are removed concurrently on `pool` if it's not null.
+// Returns 0 if failed, leaving the entry for next time.
+std::uint64_t delete_trash_entry(const std::filesystem::path& entry,
+                                 base::thread_pool* pool) noexcept {
+    try {
+        // Released once deleted, thus a process waiting for it finds the entry gone.
+        auto lock = lock_trash_entry(entry);
+        if (!lock) {
+            return 0;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        auto bytes = pool ? base::remove_tree(entry, *pool) : base::remove_tree(entry);
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - start);
+        SPDLOG_INFO("Deleted container trash; entry={} freed_bytes={} elapsed={}ms",
+                    entry.native(), bytes, elapsed.count());
+        return bytes;
+    } catch (const std::exception& ex) {
+        SPDLOG_ERROR("Failed to delete container trash; entry={} ex={}",
+                     entry.native(), ex.what());
+        return 0;
+    }
+}
+
+} // namespace
+
+void release_container_resources(const container_info& info) noexcept {
+    try {
+        if (!info.cgroup.empty()) {
+            cgroups::remove_cgroup(info.cgroup);
+        }
+    } catch (const std::exception& ex) {
+        SPDLOG_WARN("Failed to remove cgroup; container_id={} cgroup={} ex={}",
+                    info.id, info.cgroup, ex.what());
+    }
+
+    try {
+        if (!info.image_mount.empty()) {
+            release_image_mount(info.image_mount, info.id);
+        }
+    } catch (const std::exception& ex) {
+        SPDLOG_WARN("Failed to release image mount; container_id={} ex={}", info.id, ex.what());
+    }
+}
+
+std::optional<std::filesystem::path> move_container_to_trash(std::string_view container_id) {
+    const auto& root = state_root::get();
+    if (!root.has_container(container_id)) {
+        return std::nullopt;
+    }
+
+    auto stamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch());
+    auto entry_name = fmt::format("{:x}-{}", stamp.count(), container_id);
+    std::string name(container_id);
+    if (::renameat2(root.containers_fd(), name.c_str(), root.container_trash_fd(),
+                    entry_name.c_str(), RENAME_NOREPLACE) == 0) {
+        return std::filesystem::path(k_container_trash_dir) / entry_name;
+    }
+
+    auto err = errno;
+    auto path = std::filesystem::path(k_container_dir) / container_id;
+    if (err == ENOENT) {
+        // Removed by another process meanwhile.
+        return std::nullopt;
+    }
+    if (err != EXDEV) {
+        throw std::filesystem::filesystem_error(
+                "cannot move into trash", path,
+                std::filesystem::path(k_container_trash_dir) / entry_name,
+                std::error_code(err, std::system_category()));
+    }
+
+    SPDLOG_WARN("Deleting in place as trash is on another filesystem; path={}", path.native());
+    base::remove_tree(path);
+    return std::nullopt;
+}
+
+std::vector<std::filesystem::path> list_container_trash() {
+    std::vector<std::filesystem::path> entries;
+    if (!std::filesystem::exists(k_container_trash_dir)) {
+        return entries;
+    }
+
+    for (const auto& entry : std::filesystem::directory_iterator(k_container_trash_dir)) {
+        entries.push_back(entry.path());
+    }
+    return entries;
+}
+
+std::uint64_t empty_container_trash(const std::vector<std::filesystem::path>& entries,
+                                    base::thread_pool& pool) {
+    // Entries outnumbering threads keep them all busy, even if trees are small and deleted
+    // serially each.
+    if (entries.size() >= pool.size()) {
+        std::vector<std::future<std::uint64_t>> futures;
+        futures.reserve(entries.size());
+        for (const auto& entry : entries) {
+            futures.push_back(pool.submit([&entry] { return delete_trash_entry(entry, nullptr); }));
+        }
+
+        std::uint64_t freed = 0;
+        for (auto& fut : futures) {
+            freed += fut.get();
+        }
+        return freed;
+    }
+
+    std::uint64_t freed = 0;
+    for (const auto& entry : entries) {
+        freed += delete_trash_entry(entry, &pool);
+    }
+    return freed;
+}
+
+} // namespace lumper
@@ -0,0 +1,51 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#pragma once
+
+#ifndef LUMPER_CONTAINER_TRASH_H_
+#define LUMPER_CONTAINER_TRASH_H_
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+namespace base {
+class thread_pool;
+} // namespace base
+
+namespace lumper {
+
+struct container_info;
+
+// Containers are removed by renaming their directories into `k_container_trash_dir`, which takes
+// a single rename no matter how large their trees are; trash entries are deleted afterwards.
+// The trash is apart from that of images, which is emptied by image prunes on their own.
+
+// Releases the image mount and the cgroup of the container, which is about to go into trash.
+// Failures are logged only, as stale references of image mounts are pruned by their next users.
+void release_container_resources(const container_info& info) noexcept;
+
+// Returns the trash entry, or `std::nullopt` if the container doesn't exist.
+// The container is deleted in place if the trash is on another filesystem.
+// Throws `std::filesystem::filesystem_error` when failed.
+std::optional<std::filesystem::path> move_container_to_trash(std::string_view container_id);
+
+// Returns all trash entries, including those left by interrupted deletions.
+// Throws `std::filesystem::filesystem_error` when failed.
+std::vector<std::filesystem::path> list_container_trash();
+
+// Deletes entries concurrently on `pool` if there are enough of them, e.g. pruned containers;
+// otherwise one after another, each with its directories removed concurrently on `pool`.
+// An entry being deleted by another process is waited for rather than deleted twice.
+// Must not be called from a task of `pool`.
+// Returns disk space freed in bytes. Entries failed to delete are kept for next time.
+std::uint64_t empty_container_trash(const std::vector<std::filesystem::path>& entries,
+                                    base::thread_pool& pool);
+
+} // namespace lumper
+
+#endif // LUMPER_CONTAINER_TRASH_H_
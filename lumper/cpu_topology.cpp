@@ -0,0 +1,169 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "lumper/cpu_topology.h"
+
+#include <algorithm>
+#include <charconv>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+#include "fmt/format.h"
+
+#include "base/procfs.h"
+
+namespace lumper {
+namespace {
+
+// Sysfs files of topology are short, except cpu lists of huge hosts.
+constexpr std::size_t k_sysfs_buf_size = 4096;
+
+// Caps ranges of a cpu list, thus a malformed one never takes down the host.
+constexpr int k_max_cpu_id = 65535;
+
+std::string_view trim(std::string_view sv) noexcept {
+    constexpr std::string_view spaces = " \t\n";
+    auto begin = sv.find_first_not_of(spaces);
+    if (begin == std::string_view::npos) {
+        return {};
+    }
+    return sv.substr(begin, sv.find_last_not_of(spaces) - begin + 1);
+}
+
+int parse_id(std::string_view sv, std::string_view list) {
+    int id = -1;
+    auto [ptr, ec] = std::from_chars(sv.data(), sv.data() + sv.size(), id);
+    if (ec != std::errc{} || ptr != sv.data() + sv.size() || id < 0 || id > k_max_cpu_id) {
+        throw std::invalid_argument(fmt::format("invalid cpu list: {}", list));
+    }
+    return id;
+}
+
+std::string_view read_sysfs_file(const std::filesystem::path& path, char* buf, std::size_t size) {
+    return trim(base::read_proc_file(path.c_str(), buf, size));
+}
+
+int read_sysfs_int(const std::filesystem::path& path) {
+    char buf[k_sysfs_buf_size];
+    auto content = read_sysfs_file(path, buf, sizeof(buf));
+    int value = 0;
+    auto [ptr, ec] = std::from_chars(content.data(), content.data() + content.size(), value);
+    if (ec != std::errc{}) {
+        throw std::invalid_argument(fmt::format("malformed {}", path.native()));
+    }
+    return value;
+}
+
+std::vector<int> read_sysfs_cpu_list(const std::filesystem::path& path) {
+    char buf[k_sysfs_buf_size];
+    return parse_cpu_list(read_sysfs_file(path, buf, sizeof(buf)));
+}
+
+} // namespace
+
+std::vector<int> parse_cpu_list(std::string_view list) {
+    std::vector<int> ids;
+    auto rest = trim(list);
+    while (!rest.empty()) {
+        auto comma = rest.find(',');
+        auto item = rest.substr(0, comma);
+        rest.remove_prefix(comma == std::string_view::npos ? rest.size() : comma + 1);
+
+        auto dash = item.find('-');
+        auto first = parse_id(item.substr(0, dash), list);
+        auto last = dash == std::string_view::npos ? first : parse_id(item.substr(dash + 1), list);
+        if (last < first) {
+            throw std::invalid_argument(fmt::format("invalid cpu list: {}", list));
+        }
+        for (auto id = first; id <= last; ++id) {
+            ids.push_back(id);
+        }
+    }
+
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    return ids;
+}
+
+std::string format_cpu_list(const std::vector<int>& ids) {
+    std::string list;
+    for (std::size_t i = 0; i < ids.size();) {
+        auto j = i;
+        while (j + 1 < ids.size() && ids[j + 1] == ids[j] + 1) {
+            ++j;
+        }
+        if (!list.empty()) {
+            list.push_back(',');
+        }
+        list += j == i ? fmt::to_string(ids[i]) : fmt::format("{}-{}", ids[i], ids[j]);
+        i = j + 1;
+    }
+    return list;
+}
+
+// static
+cpu_topology cpu_topology::read(const std::filesystem::path& sysfs_root) {
+    auto cpu_dir = sysfs_root / "cpu";
+    std::vector<cpu_info> cpus;
+    for (auto id : read_sysfs_cpu_list(cpu_dir / "online")) {
+        auto topology_dir = cpu_dir / fmt::format("cpu{}", id) / "topology";
+        cpus.push_back({id, read_sysfs_int(topology_dir / "core_id"),
+                        read_sysfs_int(topology_dir / "physical_package_id"), 0});
+    }
+
+    // Node directories are absent without NUMA support.
+    auto node_dir = sysfs_root / "node";
+    if (std::filesystem::exists(node_dir)) {
+        for (const auto& entry : std::filesystem::directory_iterator(node_dir)) {
+            auto name = entry.path().filename().native();
+            int node = -1;
+            if (name.rfind("node", 0) != 0 ||
+                std::from_chars(name.data() + 4, name.data() + name.size(), node).ec !=
+                        std::errc{}) {
+                continue;
+            }
+            for (auto id : read_sysfs_cpu_list(entry.path() / "cpulist")) {
+                auto it = std::find_if(cpus.begin(), cpus.end(),
+                                       [id](const cpu_info& cpu) { return cpu.id == id; });
+                if (it != cpus.end()) {
+                    it->node = node;
+                }
+            }
+        }
+    }
+
+    return cpu_topology(std::move(cpus));
+}
+
+cpu_topology::cpu_topology(std::vector<cpu_info> cpus)
+    : cpus_(std::move(cpus)) {}
+
+const cpu_info* cpu_topology::find(int id) const noexcept {
+    auto it = std::lower_bound(cpus_.begin(), cpus_.end(), id,
+                               [](const cpu_info& cpu, int value) { return cpu.id < value; });
+    return it != cpus_.end() && it->id == id ? &*it : nullptr;
+}
+
+std::vector<int> cpu_topology::nodes() const {
+    std::vector<int> nodes;
+    for (const auto& cpu : cpus_) {
+        nodes.push_back(cpu.node);
+    }
+    std::sort(nodes.begin(), nodes.end());
+    nodes.erase(std::unique(nodes.begin(), nodes.end()), nodes.end());
+    return nodes;
+}
+
+std::vector<int> cpu_topology::cpus_of_node(int node) const {
+    std::vector<int> ids;
+    for (const auto& cpu : cpus_) {
+        if (cpu.node == node) {
+            ids.push_back(cpu.id);
+        }
+    }
+    return ids;
+}
+
+} // namespace lumper
@@ -0,0 +1,64 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#pragma once
+
+#ifndef LUMPER_CPU_TOPOLOGY_H_
+#define LUMPER_CPU_TOPOLOGY_H_
+
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace lumper {
+
+inline constexpr char k_sysfs_system_dir[] = "/sys/devices/system";
+
+// Parses a cpu list as in sysfs and `cpuset.cpus`, e.g. 0-3,8,10-11, into sorted ids without
+// duplicates.
+// Throws `std::invalid_argument` if malformed.
+std::vector<int> parse_cpu_list(std::string_view list);
+
+// Formats sorted ids as a cpu list, with consecutive ids merged into ranges.
+std::string format_cpu_list(const std::vector<int>& ids);
+
+struct cpu_info {
+    int id;
+    // Logical cpus of the same core and package are hyper-threads sharing the core.
+    int core_id;
+    int package_id;
+    int node;
+};
+
+// Online cpus of the host, along with their cores and NUMA nodes.
+class cpu_topology {
+public:
+    // Reads the topology under `sysfs_root`, i.e. /sys/devices/system; all cpus are in node 0 if
+    // the kernel has no NUMA support.
+    // Throws `std::system_error` when failed, or `std::invalid_argument` if a file is malformed.
+    static cpu_topology read(const std::filesystem::path& sysfs_root = k_sysfs_system_dir);
+
+    // `cpus` are sorted by id.
+    explicit cpu_topology(std::vector<cpu_info> cpus);
+
+    const std::vector<cpu_info>& cpus() const noexcept {
+        return cpus_;
+    }
+
+    // Returns nullptr if cpu `id` is not online.
+    const cpu_info* find(int id) const noexcept;
+
+    // Returns sorted ids of nodes having cpus.
+    std::vector<int> nodes() const;
+
+    std::vector<int> cpus_of_node(int node) const;
+
+private:
+    std::vector<cpu_info> cpus_;
+};
+
+} // namespace lumper
+
+#endif // LUMPER_CPU_TOPOLOGY_H_
@@ -0,0 +1,167 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "lumper/cpuset_allocator.h"
+
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+
+#include "fmt/format.h"
+
+#include "lumper/cpu_topology.h"
+
+namespace lumper {
+namespace {
+
+void check_node(const cpu_topology& topology, int node) {
+    auto nodes = topology.nodes();
+    if (!std::binary_search(nodes.begin(), nodes.end(), node)) {
+        throw std::invalid_argument(fmt::format("NUMA node {} has no cpus", node));
+    }
+}
+
+bool contains(const std::vector<int>& sorted, int id) {
+    return std::binary_search(sorted.begin(), sorted.end(), id);
+}
+
+// Free cpus of whole cores go first, thus hyper-threads of a core are not split between
+// containers unless cores run out; cpus of a core stay together.
+std::vector<int> pick_cpus(const cpu_topology& topology,
+                           const std::vector<int>& free_cpus,
+                           std::size_t count) {
+    struct core {
+        std::size_t total{0};
+        std::vector<int> free;
+    };
+    std::map<std::pair<int, int>, core> cores;
+    for (const auto& cpu : topology.cpus()) {
+        auto& c = cores[{cpu.package_id, cpu.core_id}];
+        ++c.total;
+        if (contains(free_cpus, cpu.id)) {
+            c.free.push_back(cpu.id);
+        }
+    }
+
+    std::vector<const core*> order;
+    for (const auto& [key, c] : cores) {
+        if (!c.free.empty()) {
+            order.push_back(&c);
+        }
+    }
+    std::sort(order.begin(), order.end(), [](const core* lhs, const core* rhs) {
+        return std::make_tuple(lhs->free.size() != lhs->total, lhs->free.front()) <
+               std::make_tuple(rhs->free.size() != rhs->total, rhs->free.front());
+    });
+
+    std::vector<int> cpus;
+    for (const auto* c : order) {
+        for (auto id : c->free) {
+            if (cpus.size() == count) {
+                break;
+            }
+            cpus.push_back(id);
+        }
+    }
+    std::sort(cpus.begin(), cpus.end());
+    return cpus;
+}
+
+cpuset_assignment assign_auto(const cpu_topology& topology,
+                              const cpuset_request& request,
+                              const std::vector<int>& exclusive_cpus) {
+    if (request.cpus <= 0) {
+        throw std::invalid_argument("number of cpus must be positive");
+    }
+    auto count = static_cast<std::size_t>(request.cpus);
+
+    std::vector<int> nodes;
+    if (request.numa_node) {
+        check_node(topology, *request.numa_node);
+        nodes.push_back(*request.numa_node);
+    } else {
+        nodes = topology.nodes();
+    }
+
+    // Best fit keeps nodes with many free cpus for larger containers.
+    std::optional<int> best_node;
+    std::vector<int> best_free;
+    for (auto node : nodes) {
+        std::vector<int> free_cpus;
+        for (auto id : topology.cpus_of_node(node)) {
+            if (!contains(exclusive_cpus, id)) {
+                free_cpus.push_back(id);
+            }
+        }
+        if (free_cpus.size() >= count && (!best_node || free_cpus.size() < best_free.size())) {
+            best_node = node;
+            best_free = std::move(free_cpus);
+        }
+    }
+
+    if (!best_node) {
+        throw std::runtime_error(
+                request.numa_node
+                        ? fmt::format("not enough free cpus on NUMA node {} for {} cpus",
+                                      *request.numa_node, count)
+                        : fmt::format("not enough free cpus on any NUMA node for {} cpus", count));
+    }
+
+    return {pick_cpus(topology, best_free, count), {*best_node}, true};
+}
+
+} // namespace
+
+cpuset_assignment assign_cpuset(const cpu_topology& topology,
+                                const cpuset_request& request,
+                                const std::vector<int>& exclusive_cpus) {
+    if (request.cpuset == k_cpuset_auto) {
+        return assign_auto(topology, request, exclusive_cpus);
+    }
+
+    cpuset_assignment assignment;
+    if (request.cpuset.empty()) {
+        if (!request.numa_node) {
+            throw std::invalid_argument("neither cpuset nor NUMA node is given");
+        }
+        check_node(topology, *request.numa_node);
+        for (auto id : topology.cpus_of_node(*request.numa_node)) {
+            if (!contains(exclusive_cpus, id)) {
+                assignment.cpus.push_back(id);
+            }
+        }
+        if (assignment.cpus.empty()) {
+            throw std::runtime_error(fmt::format(
+                    "all cpus on NUMA node {} are handed out exclusively", *request.numa_node));
+        }
+        assignment.mems.push_back(*request.numa_node);
+        return assignment;
+    }
+
+    assignment.cpus = parse_cpu_list(request.cpuset);
+    for (auto id : assignment.cpus) {
+        const auto* cpu = topology.find(id);
+        if (cpu == nullptr) {
+            throw std::invalid_argument(fmt::format("cpu {} is not online", id));
+        }
+        if (contains(exclusive_cpus, id)) {
+            throw std::runtime_error(fmt::format("cpu {} is handed out exclusively", id));
+        }
+        assignment.mems.push_back(cpu->node);
+    }
+
+    if (request.numa_node) {
+        check_node(topology, *request.numa_node);
+        assignment.mems.assign(1, *request.numa_node);
+    } else {
+        std::sort(assignment.mems.begin(), assignment.mems.end());
+        assignment.mems.erase(std::unique(assignment.mems.begin(), assignment.mems.end()),
+                              assignment.mems.end());
+    }
+    return assignment;
+}
+
+} // namespace lumper
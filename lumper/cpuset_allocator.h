@@ -0,0 +1,51 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#pragma once
+
+#ifndef LUMPER_CPUSET_ALLOCATOR_H_
+#define LUMPER_CPUSET_ALLOCATOR_H_
+
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace lumper {
+
+class cpu_topology;
+
+inline constexpr char k_cpuset_auto[] = "auto";
+
+struct cpuset_request {
+    // `k_cpuset_auto` for cpus of the container alone, or a cpu list shared with others; empty if
+    // only `numa_node` is given, for all cpus of the node.
+    std::string cpuset;
+    // Number of cpus handed out for `k_cpuset_auto`.
+    int cpus{0};
+    std::optional<int> numa_node;
+};
+
+struct cpuset_assignment {
+    std::vector<int> cpus;
+    // NUMA nodes of the cpus, which memory is allocated from.
+    std::vector<int> mems;
+    bool exclusive{false};
+};
+
+// Cpus of `k_cpuset_auto` are exclusive: they are never handed out again while the container
+// runs, and are picked from a single node, best fit by free cpus, with whole cores first, thus
+// the container neither reaches remote memory nor shares cores with others.
+// `exclusive_cpus` are those handed out to running containers, which a node requested alone
+// gives without, and a cpu list requested must not have.
+// Throws:
+//  - `std::invalid_argument` if cpus or the node requested are not on the host.
+//  - `std::runtime_error` if no node has enough free cpus, or cpus requested are handed out
+//    exclusively.
+cpuset_assignment assign_cpuset(const cpu_topology& topology,
+                                const cpuset_request& request,
+                                const std::vector<int>& exclusive_cpus);
+
+} // namespace lumper
+
+#endif // LUMPER_CPUSET_ALLOCATOR_H_
@@ -0,0 +1,303 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "lumper/event_journal.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstddef>
+#include <cstring>
+#include <ctime>
+#include <system_error>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "esl/scope_guard.h"
+#include "esl/unique_handle.h"
+#include "fmt/format.h"
+#include "spdlog/spdlog.h"
+
+#include "lumper/path_constants.h"
+
+namespace lumper {
+
+// Followed by `capacity` slots.
+struct event_journal::header {
+    char magic[8];
+    std::uint32_t slot_size;
+    std::uint32_t capacity;
+    // On a cache line of its own, as every writer bumps it.
+    alignas(64) std::atomic<std::uint64_t> next_seq;
+    // Bumped on every commit, which waiters sleep on.
+    std::atomic<std::uint32_t> futex_word;
+};
+
+struct event_journal::slot {
+    // Sequence plus 1 once committed, 0 while being written.
+    std::atomic<std::uint64_t> commit;
+    std::int64_t time_ns;
+    std::uint16_t type;
+    std::uint16_t id_len;
+    std::int32_t pid;
+    std::int32_t exit_code;
+    std::int32_t signal;
+    char container_id[96];
+};
+
+namespace {
+
+// Slots begin at this offset, i.e. a slot size, thus all of them are aligned.
+constexpr std::size_t k_header_size = 128;
+
+static_assert(sizeof(event_journal::header) <= k_header_size);
+static_assert(sizeof(event_journal::slot) == 128);
+// Atomics are shared by processes mapping the same file, which works only if they are lock-free.
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free);
+static_assert(std::atomic<std::uint32_t>::is_always_lock_free);
+
+[[noreturn]] void throw_fs_error(const char* what, const std::filesystem::path& path) {
+    throw std::filesystem::filesystem_error(what, path,
+                                            std::error_code(errno, std::system_category()));
+}
+
+std::size_t journal_size(std::uint32_t capacity) noexcept {
+    return k_header_size + std::size_t{capacity} * sizeof(event_journal::slot);
+}
+
+// The journal is initialized in a temp file and linked into place, thus is never seen half
+// initialized; a process losing the race uses the one linked by the winner.
+void create_journal(const std::filesystem::path& path, std::uint32_t capacity) {
+    std::filesystem::create_directories(path.parent_path());
+    auto tmp_path = path;
+    tmp_path += fmt::format(".{}.tmp", ::getpid());
+    esl::unique_fd fd(::open(tmp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644));
+    if (!fd) {
+        throw_fs_error("cannot create event journal", tmp_path);
+    }
+    ESL_ON_SCOPE_EXIT {
+        ::unlink(tmp_path.c_str());
+    };
+
+    // Slots are zeros, i.e. never committed.
+    if (::ftruncate(fd.get(), static_cast<off_t>(journal_size(capacity))) != 0) {
+        throw_fs_error("cannot resize event journal", tmp_path);
+    }
+
+    char hdr[k_header_size]{};
+    std::memcpy(hdr, event_journal::k_magic, sizeof(event_journal::k_magic));
+    auto slot_size = static_cast<std::uint32_t>(sizeof(event_journal::slot));
+    std::memcpy(hdr + offsetof(event_journal::header, slot_size), &slot_size, sizeof(slot_size));
+    std::memcpy(hdr + offsetof(event_journal::header, capacity), &capacity, sizeof(capacity));
+    if (::pwrite(fd.get(), hdr, sizeof(hdr), 0) != static_cast<ssize_t>(sizeof(hdr))) {
+        throw_fs_error("cannot write event journal", tmp_path);
+    }
+
+    if (::link(tmp_path.c_str(), path.c_str()) != 0 && errno != EEXIST) {
+        throw_fs_error("cannot create event journal", path);
+    }
+}
+
+esl::unique_fd open_journal(const std::filesystem::path& path, std::uint32_t capacity) {
+    esl::unique_fd fd(::open(path.c_str(), O_RDWR | O_CLOEXEC));
+    if (!fd && errno == ENOENT) {
+        create_journal(path, capacity);
+        fd.reset(::open(path.c_str(), O_RDWR | O_CLOEXEC));
+    }
+    if (!fd) {
+        throw_fs_error("cannot open event journal", path);
+    }
+    return fd;
+}
+
+std::int64_t now_ns() noexcept {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::system_clock::now().time_since_epoch())
+            .count();
+}
+
+} // namespace
+
+std::string_view to_string(container_event_type type) noexcept {
+    switch (type) {
+    case container_event_type::created:
+        return "created";
+    case container_event_type::started:
+        return "started";
+    case container_event_type::exited:
+        return "exited";
+    case container_event_type::oom:
+        return "oom";
+    case container_event_type::removed:
+        return "removed";
+    }
+    return "unknown";
+}
+
+// static
+event_journal& event_journal::get() {
+    static event_journal journal(k_event_journal_file);
+    return journal;
+}
+
+event_journal::event_journal(const std::filesystem::path& path, std::uint32_t capacity) {
+    auto fd = open_journal(path, capacity);
+
+    struct stat st {};
+    if (::fstat(fd.get(), &st) != 0) {
+        throw_fs_error("cannot stat event journal", path);
+    }
+    auto size = static_cast<std::size_t>(st.st_size);
+    if (size < k_header_size) {
+        throw std::filesystem::filesystem_error(
+                "event journal is corrupted", path,
+                std::make_error_code(std::errc::illegal_byte_sequence));
+    }
+
+    void* addr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd.get(), 0);
+    if (addr == MAP_FAILED) {
+        throw_fs_error("cannot map event journal", path);
+    }
+    header_ = static_cast<header*>(addr);
+    map_size_ = size;
+
+    // The capacity of an existing journal wins over the one given.
+    capacity_ = header_->capacity;
+    if (std::memcmp(header_->magic, k_magic, sizeof(k_magic)) != 0 ||
+        header_->slot_size != sizeof(slot) || capacity_ == 0 || journal_size(capacity_) > size) {
+        ::munmap(addr, size);
+        throw std::filesystem::filesystem_error(
+                "event journal is corrupted", path,
+                std::make_error_code(std::errc::illegal_byte_sequence));
+    }
+    slots_ = reinterpret_cast<slot*>(static_cast<char*>(addr) + k_header_size);
+}
+
+event_journal::~event_journal() {
+    ::munmap(header_, map_size_);
+}
+
+std::uint64_t event_journal::next_seq() const noexcept {
+    return header_->next_seq.load(std::memory_order_acquire);
+}
+
+std::uint64_t event_journal::oldest_seq() const noexcept {
+    auto next = next_seq();
+    return next > capacity_ ? next - capacity_ : 0;
+}
+
+void event_journal::append(container_event_type type,
+                           std::string_view container_id,
+                           int pid,
+                           int exit_code,
+                           int signal) noexcept {
+    auto seq = header_->next_seq.fetch_add(1, std::memory_order_relaxed);
+    auto& s = slots_[seq % capacity_];
+
+    // Readers copying the slot meanwhile see the commit changed and drop what they copied.
+    s.commit.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    s.time_ns = now_ns();
+    s.type = static_cast<std::uint16_t>(type);
+    auto id_len = std::min(container_id.size(), sizeof(s.container_id));
+    s.id_len = static_cast<std::uint16_t>(id_len);
+    std::memcpy(s.container_id, container_id.data(), id_len);
+    s.pid = pid;
+    s.exit_code = exit_code;
+    s.signal = signal;
+    s.commit.store(seq + 1, std::memory_order_release);
+
+    header_->futex_word.fetch_add(1, std::memory_order_release);
+    ::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&header_->futex_word), FUTEX_WAKE,
+              INT_MAX, nullptr, nullptr, 0);
+}
+
+event_journal::read_result event_journal::read(std::uint64_t& cursor) const {
+    read_result result;
+    auto next = next_seq();
+    auto oldest = next > capacity_ ? next - capacity_ : 0;
+    if (cursor < oldest) {
+        result.lost += oldest - cursor;
+        cursor = oldest;
+    }
+
+    while (cursor < next) {
+        const auto& s = slots_[cursor % capacity_];
+        auto commit = s.commit.load(std::memory_order_acquire);
+        if (commit < cursor + 1) {
+            // Reserved but not committed yet, while the slot holds the event of the last lap.
+            result.pending = true;
+            break;
+        }
+
+        if (commit == cursor + 1) {
+            container_event event;
+            event.seq = cursor;
+            event.time = std::chrono::system_clock::time_point(
+                    std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                            std::chrono::nanoseconds(s.time_ns)));
+            event.type = static_cast<container_event_type>(s.type);
+            event.container_id.assign(s.container_id,
+                                      std::min<std::size_t>(s.id_len, sizeof(s.container_id)));
+            event.pid = s.pid;
+            event.exit_code = s.exit_code;
+            event.signal = s.signal;
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (s.commit.load(std::memory_order_relaxed) == commit) {
+                result.events.push_back(std::move(event));
+                ++cursor;
+                continue;
+            }
+        }
+
+        // Overwritten by a writer a lap ahead, before or while being copied.
+        ++result.lost;
+        ++cursor;
+    }
+
+    return result;
+}
+
+std::uint32_t event_journal::wait_token() const noexcept {
+    return header_->futex_word.load(std::memory_order_acquire);
+}
+
+bool event_journal::wait(std::uint32_t token, std::chrono::milliseconds timeout) const noexcept {
+    auto secs = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+    timespec ts{};
+    ts.tv_sec = static_cast<time_t>(secs.count());
+    ts.tv_nsec = static_cast<long>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(timeout - secs).count());
+
+    // Not FUTEX_PRIVATE_FLAG, as writers are other processes.
+    if (::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&header_->futex_word), FUTEX_WAIT,
+                  token, &ts, nullptr, 0) == 0) {
+        return true;
+    }
+    // EAGAIN if bumped before sleeping, and EINTR is taken as a spurious wakeup.
+    return errno != ETIMEDOUT;
+}
+
+void record_container_event(container_event_type type,
+                            std::string_view container_id,
+                            int pid,
+                            int exit_code,
+                            int signal) noexcept {
+    try {
+        event_journal::get().append(type, container_id, pid, exit_code, signal);
+    } catch (const std::exception& ex) {
+        SPDLOG_WARN("Failed to record container event; type={} container_id={} ex={}",
+                    to_string(type), container_id, ex.what());
+    }
+}
+
+} // namespace lumper
@@ -0,0 +1,128 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#pragma once
+
+#ifndef LUMPER_EVENT_JOURNAL_H_
+#define LUMPER_EVENT_JOURNAL_H_
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace lumper {
+
+enum class container_event_type : std::uint16_t {
+    created = 1,
+    started,
+    exited,
+    oom,
+    removed,
+};
+
+// Returns "unknown" for values of newer versions.
+std::string_view to_string(container_event_type type) noexcept;
+
+struct container_event {
+    std::uint64_t seq{0};
+    std::chrono::system_clock::time_point time;
+    container_event_type type{};
+    std::string container_id;
+    // -1 if not applicable or unknown, e.g. an exit noticed only once the process is gone.
+    int pid{-1};
+    int exit_code{-1};
+    int signal{-1};
+};
+
+// Lifecycle events of all containers, in a ring of fixed-size slots in a file mapped by every
+// lumper process; the oldest events are overwritten once the ring is full.
+// Writers never block each other: a slot is reserved by a fetch-add of the sequence in the shared
+// header, and is committed by storing its sequence into the slot once written, like a seqlock;
+// thus readers tell a slot being written, or overwritten by a writer a lap ahead, from a
+// complete one.
+// Each commit bumps a futex word in the header and wakes waiters, thus readers following the
+// journal sleep until events are appended rather than polling.
+class event_journal {
+public:
+    struct header;
+    struct slot;
+
+    static constexpr char k_magic[8] = {'L', 'M', 'P', 'E', 'V', 'J', '0', '1'};
+    static constexpr std::uint32_t k_default_capacity = 8192;
+
+    // The journal of `k_event_journal_file`, opened on the first call.
+    // Throws `std::filesystem::filesystem_error` when failed.
+    static event_journal& get();
+
+    // Creates the journal with `capacity` slots if it doesn't exist; processes racing to create
+    // it end up with the same one.
+    // Throws `std::filesystem::filesystem_error` if failed, or the file is not a journal.
+    explicit event_journal(const std::filesystem::path& path,
+                           std::uint32_t capacity = k_default_capacity);
+
+    ~event_journal();
+
+    event_journal(const event_journal&) = delete;
+
+    event_journal& operator=(const event_journal&) = delete;
+
+    std::uint32_t capacity() const noexcept {
+        return capacity_;
+    }
+
+    // Sequence of the next event appended; events are numbered from 0.
+    std::uint64_t next_seq() const noexcept;
+
+    // Sequence of the oldest event not overwritten yet.
+    std::uint64_t oldest_seq() const noexcept;
+
+    // `container_id` is truncated if too long for a slot.
+    void append(container_event_type type,
+                std::string_view container_id,
+                int pid = -1,
+                int exit_code = -1,
+                int signal = -1) noexcept;
+
+    struct read_result {
+        std::vector<container_event> events;
+        // Events overwritten before being read.
+        std::uint64_t lost{0};
+        // True if stopped at a slot reserved but not committed yet.
+        bool pending{false};
+    };
+
+    // Reads events from `cursor` on, up to the latest or a pending one, and advances `cursor`
+    // past them.
+    read_result read(std::uint64_t& cursor) const;
+
+    // Returns a token for `wait()`, taken before reading, thus events appended after reading are
+    // never missed.
+    std::uint32_t wait_token() const noexcept;
+
+    // Sleeps until an event is committed since `token` was taken, or `timeout` elapses.
+    // Returns false on timeout.
+    bool wait(std::uint32_t token, std::chrono::milliseconds timeout) const noexcept;
+
+private:
+    header* header_{nullptr};
+    slot* slots_{nullptr};
+    std::uint32_t capacity_{0};
+    std::size_t map_size_{0};
+};
+
+// Appends an event to the journal of the host, logging rather than throwing on failures, as
+// events are for diagnosis and never fail container operations.
+void record_container_event(container_event_type type,
+                            std::string_view container_id,
+                            int pid = -1,
+                            int exit_code = -1,
+                            int signal = -1) noexcept;
+
+} // namespace lumper
+
+#endif // LUMPER_EVENT_JOURNAL_H_
@@ -0,0 +1,232 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "lumper/image_gc.h"
+
+#include <chrono>
+#include <future>
+#include <map>
+#include <numeric>
+#include <set>
+#include <stdexcept>
+#include <string_view>
+#include <system_error>
+#include <utility>
+
+#include "fmt/format.h"
+#include "spdlog/spdlog.h"
+
+#include "base/file_util.h"
+#include "base/thread_pool.h"
+#include "lumper/container_info.h"
+#include "lumper/image_pin.h"
+#include "lumper/image_store.h"
+#include "lumper/path_constants.h"
+#include "lumper/prefetch_profile.h"
+
+namespace lumper {
+namespace {
+
+// Guards against cycles of base images.
+constexpr std::size_t k_max_image_chain_depth = 64;
+
+constexpr std::string_view k_manifest_ext = ".json";
+constexpr std::string_view k_partial_blob_ext = ".partial";
+constexpr std::string_view k_image_file_exts[] = {".sqfs", ".erofs"};
+
+bool ends_with(std::string_view str, std::string_view suffix) noexcept {
+    return str.size() >= suffix.size() && str.substr(str.size() - suffix.size()) == suffix;
+}
+
+std::vector<std::filesystem::path> list_dir(const std::filesystem::path& dir) {
+    std::vector<std::filesystem::path> entries;
+    if (!std::filesystem::exists(dir)) {
+        return entries;
+    }
+
+    for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+        entries.push_back(entry.path());
+    }
+    return entries;
+}
+
+struct container_refs {
+    // Including base images.
+    std::set<std::string> images;
+    std::set<std::string> layers;
+};
+
+container_refs collect_container_refs() {
+    container_refs refs;
+    for (const auto& container_path : list_dir(k_container_dir)) {
+        auto container_id = container_path.filename().native();
+        if (!has_container_info(container_id)) {
+            // Left by a failed run, which references nothing.
+            continue;
+        }
+
+        container_info info;
+        try {
+            info = load_container_info(container_id);
+        } catch (const std::exception& ex) {
+            throw std::runtime_error(fmt::format(
+                    "cannot tell image of container {}: {}", container_id, ex.what()));
+        }
+
+        refs.layers.insert(info.layers.begin(), info.layers.end());
+
+        std::string name = std::move(info.image);
+        for (std::size_t depth = 0; depth < k_max_image_chain_depth && !name.empty(); ++depth) {
+            if (!refs.images.insert(name).second) {
+                break;
+            }
+            auto manifest = load_image_manifest(name);
+            name = manifest ? std::move(manifest->base_image) : std::string();
+        }
+    }
+
+    return refs;
+}
+
+// Returns image name -> paths of all forms of the image.
+std::map<std::string, std::vector<std::filesystem::path>> list_images() {
+    std::map<std::string, std::vector<std::filesystem::path>> images;
+    for (const auto& path : list_dir(k_manifests_dir)) {
+        if (path.extension() == k_manifest_ext) {
+            images[path.stem().native()].push_back(path);
+        }
+    }
+
+    for (const auto& path : list_dir(k_images_dir)) {
+        if (std::filesystem::is_directory(std::filesystem::symlink_status(path))) {
+            images[path.filename().native()].push_back(path);
+            continue;
+        }
+
+        for (auto ext : k_image_file_exts) {
+            if (path.extension() == ext) {
+                images[path.stem().native()].push_back(path);
+                break;
+            }
+        }
+    }
+
+    return images;
+}
+
+class trash_bin {
+public:
+    trash_bin()
+        : stamp_(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         std::chrono::system_clock::now().time_since_epoch())
+                         .count()) {
+        std::filesystem::create_directories(k_trash_dir);
+    }
+
+    // Moves `path` into trash and records the trash entry.
+    void throw_away(const std::filesystem::path& path, std::vector<std::filesystem::path>& trash) {
+        auto dst = std::filesystem::path(k_trash_dir) /
+                   fmt::format("{:x}-{}-{}", stamp_, seq_++, path.filename().native());
+        std::error_code ec;
+        std::filesystem::rename(path, dst, ec);
+        if (!ec) {
+            trash.push_back(std::move(dst));
+            return;
+        }
+
+        if (ec != std::errc::cross_device_link) {
+            throw std::filesystem::filesystem_error("cannot move into trash", path, dst, ec);
+        }
+
+        // Stores on other filesystems can't be renamed into trash, delete under the lock.
+        SPDLOG_WARN("Deleting in place as trash is on another filesystem; path={}", path.native());
+        base::remove_tree(path);
+    }
+
+private:
+    std::int64_t stamp_;
+    std::size_t seq_{0};
+};
+
+} // namespace
+
+image_garbage collect_image_garbage(bool all_unused) {
+    auto store_lock = lock_image_store(image_store_lock_mode::exclusive);
+
+    image_garbage garbage;
+    garbage.trash = list_dir(k_trash_dir);
+    trash_bin bin;
+
+    auto refs = collect_container_refs();
+    auto images = list_images();
+    if (all_unused) {
+        for (auto it = images.begin(); it != images.end();) {
+            if (refs.images.count(it->first) != 0) {
+                ++it;
+                continue;
+            }
+
+            for (const auto& path : it->second) {
+                bin.throw_away(path, garbage.trash);
+            }
+            unpin_image(it->first);
+            if (auto profile = get_prefetch_profile_path(it->first);
+                std::filesystem::exists(profile)) {
+                bin.throw_away(profile, garbage.trash);
+            }
+            garbage.images.push_back(it->first);
+            it = images.erase(it);
+        }
+    }
+
+    // Containers may be using layers their images no longer have.
+    auto& used_layers = refs.layers;
+    for (const auto& [name, paths] : images) {
+        if (auto manifest = load_image_manifest(name); manifest) {
+            used_layers.insert(manifest->layers.begin(), manifest->layers.end());
+        }
+    }
+
+    // Staging dirs are collected as well: pulls and commits in progress hold the lock, thus any
+    // found here are left by interrupted ones.
+    for (const auto& path : list_dir(k_layers_dir)) {
+        auto layer_id = path.filename().native();
+        if (used_layers.count(layer_id) == 0) {
+            bin.throw_away(path, garbage.trash);
+            garbage.layers.push_back(std::move(layer_id));
+        }
+    }
+
+    // Partial blobs are kept for resuming downloads.
+    for (const auto& path : list_dir(std::filesystem::path(k_blobs_dir) / "sha256")) {
+        auto name = path.filename().native();
+        if (!ends_with(name, k_partial_blob_ext) && used_layers.count(name) == 0) {
+            bin.throw_away(path, garbage.trash);
+            ++garbage.blobs;
+        }
+    }
+
+    SPDLOG_INFO("Collected image garbage; images={} layers={} blobs={} trash_entries={}",
+                garbage.images.size(), garbage.layers.size(), garbage.blobs,
+                garbage.trash.size());
+
+    return garbage;
+}
+
+std::uint64_t empty_trash(const std::vector<std::filesystem::path>& entries,
+                          base::thread_pool& pool) {
+    std::vector<std::uint64_t> freed(entries.size());
+    std::vector<std::future<void>> results;
+    results.reserve(entries.size());
+    for (std::size_t i = 0; i < entries.size(); ++i) {
+        results.push_back(pool.submit([&entries, &freed, i] {
+            freed[i] = base::remove_tree(entries[i]);
+        }));
+    }
+    base::wait_all(results);
+
+    return std::accumulate(freed.begin(), freed.end(), std::uint64_t{0});
+}
+
+} // namespace lumper
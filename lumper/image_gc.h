@@ -0,0 +1,49 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#pragma once
+
+#ifndef LUMPER_IMAGE_GC_H_
+#define LUMPER_IMAGE_GC_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace base {
+class thread_pool;
+} // namespace base
+
+namespace lumper {
+
+struct image_garbage {
+    std::vector<std::string> images;
+    std::vector<std::string> layers;
+    std::size_t blobs{0};
+    // Entries in `k_trash_dir`, including those left by interrupted prunes.
+    std::vector<std::filesystem::path> trash;
+};
+
+// Computes references to images and layers from all container records, following base images,
+// then references to layers and blobs from the manifests, and moves whatever is unreferenced into
+// `k_trash_dir`, which takes only a rename for each.
+// Images, along with their prefetch profiles and pins, are collected only if `all_unused` is true,
+// otherwise only layers and blobs neither images nor containers refer to are.
+// The image store is locked exclusively meanwhile.
+// Throws:
+//  - `std::runtime_error` if the image of any container can't be told.
+//  - `std::filesystem::filesystem_error` or `nlohmann::json::exception` when failed.
+image_garbage collect_image_garbage(bool all_unused);
+
+// Deletes trash entries concurrently on `pool`; returns disk space freed in bytes.
+// Entries failed to delete are kept for next time.
+// Throws `std::filesystem::filesystem_error` when failed.
+std::uint64_t empty_trash(const std::vector<std::filesystem::path>& entries,
+                          base::thread_pool& pool);
+
+} // namespace lumper
+
+#endif // LUMPER_IMAGE_GC_H_
@@ -0,0 +1,296 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "lumper/image_mount.h"
+
+#include <optional>
+#include <system_error>
+#include <utility>
+
+#include <fcntl.h>
+#include <linux/loop.h>
+#include <sys/file.h>
+#include <sys/ioctl.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "esl/unique_handle.h"
+#include "fmt/format.h"
+#include "spdlog/spdlog.h"
+
+#include "base/file_util.h"
+#include "lumper/path_constants.h"
+
+namespace lumper {
+namespace {
+
+constexpr char k_loop_control[] = "/dev/loop-control";
+constexpr int k_max_loop_attempts = 8;
+
+[[noreturn]] void throw_fs_error(const char* what, const std::filesystem::path& path) {
+    throw std::filesystem::filesystem_error(what, path,
+                                            std::error_code(errno, std::system_category()));
+}
+
+std::filesystem::path get_mount_path(std::string_view key) {
+    return std::filesystem::path(k_image_mounts_dir) / key;
+}
+
+// Serializes mounting, unmounting and reference counting of the same image file among lumper
+// processes; released when closed.
+esl::unique_fd lock_mount(const std::filesystem::path& mount_path) {
+    constexpr int perm = 0644;
+    auto lock_path = mount_path / "lock";
+    esl::unique_fd fd(::open(lock_path.c_str(), O_CREAT | O_RDWR | O_CLOEXEC, perm));
+    if (!fd) {
+        throw_fs_error("cannot open image mount lock", lock_path);
+    }
+
+    if (::flock(fd.get(), LOCK_EX) != 0) {
+        throw_fs_error("cannot lock image mount", lock_path);
+    }
+
+    return fd;
+}
+
+bool is_mounted(const std::filesystem::path& mount_path) {
+    struct stat parent {};
+    struct stat root {};
+    auto rootfs = mount_path / "rootfs";
+    if (::stat(mount_path.c_str(), &parent) != 0 || ::stat(rootfs.c_str(), &root) != 0) {
+        throw_fs_error("cannot stat image mountpoint", rootfs);
+    }
+    return parent.st_dev != root.st_dev;
+}
+
+// Drops references of containers that were removed without releasing them, e.g. by hand, and of
+// lumper processes that are gone.
+void prune_stale_refs(const std::filesystem::path& refs_dir) {
+    for (const auto& entry : std::filesystem::directory_iterator(refs_dir)) {
+        auto holder = entry.path().filename().native();
+        auto holder_path = holder.rfind(k_process_holder_prefix, 0) == 0
+                                   ? std::filesystem::path("/proc") /
+                                             holder.substr(std::size(k_process_holder_prefix) - 1)
+                                   : std::filesystem::path(k_container_dir) / holder;
+        if (!std::filesystem::exists(holder_path)) {
+            SPDLOG_INFO("Prune stale image mount ref; ref={}", entry.path().native());
+            std::filesystem::remove(entry.path());
+        }
+    }
+}
+
+// Returns 0 on success, otherwise -1 with errno set.
+int configure_loop_device(int loop_fd, int backing_fd) {
+    // Direct I/O on the backing file avoids caching the same data twice: once for the image
+    // file and once for the filesystem on the loop device.
+    // Autoclear detaches the device once the filesystem is unmounted.
+#if defined(LOOP_CONFIGURE)
+    loop_config config{};
+    config.fd = static_cast<std::uint32_t>(backing_fd);
+    config.info.lo_flags = LO_FLAGS_READ_ONLY | LO_FLAGS_AUTOCLEAR | LO_FLAGS_DIRECT_IO;
+    if (::ioctl(loop_fd, LOOP_CONFIGURE, &config) == 0) {
+        return 0;
+    }
+
+    if (errno != EINVAL && errno != ENOTTY) {
+        return -1;
+    }
+#endif
+
+    // Kernels before 5.8 don't have LOOP_CONFIGURE.
+    if (::ioctl(loop_fd, LOOP_SET_FD, backing_fd) != 0) {
+        return -1;
+    }
+
+    loop_info64 info{};
+    info.lo_flags = LO_FLAGS_AUTOCLEAR;
+    if (::ioctl(loop_fd, LOOP_SET_STATUS64, &info) != 0) {
+        auto err = errno;
+        ::ioctl(loop_fd, LOOP_CLR_FD, 0);
+        errno = err;
+        return -1;
+    }
+
+    if (::ioctl(loop_fd, LOOP_SET_DIRECT_IO, 1) != 0) {
+        SPDLOG_WARN("Direct I/O is not supported for loop device; errno={}", errno);
+    }
+
+    return 0;
+}
+
+// Returns fd and path of the attached loop device.
+// The device is detached automatically if it is closed without being mounted.
+std::pair<esl::unique_fd, std::string> attach_loop_device(const std::filesystem::path& file) {
+    esl::unique_fd backing_fd(::open(file.c_str(), O_RDONLY | O_CLOEXEC));
+    if (!backing_fd) {
+        throw_fs_error("cannot open image file", file);
+    }
+
+    esl::unique_fd ctl_fd(::open(k_loop_control, O_RDWR | O_CLOEXEC));
+    if (!ctl_fd) {
+        throw std::system_error(errno, std::system_category(), "failed to open loop-control");
+    }
+
+    for (int attempt = 0; attempt < k_max_loop_attempts; ++attempt) {
+        auto nr = ::ioctl(ctl_fd.get(), LOOP_CTL_GET_FREE);
+        if (nr < 0) {
+            throw std::system_error(errno, std::system_category(), "failed to get free loop device");
+        }
+
+        auto dev_path = fmt::format("/dev/loop{}", nr);
+        esl::unique_fd loop_fd(::open(dev_path.c_str(), O_RDONLY | O_CLOEXEC));
+        if (!loop_fd) {
+            throw_fs_error("cannot open loop device", dev_path);
+        }
+
+        if (configure_loop_device(loop_fd.get(), backing_fd.get()) == 0) {
+            return {std::move(loop_fd), std::move(dev_path)};
+        }
+
+        // Another process took the device in the meantime.
+        if (errno != EBUSY) {
+            throw std::system_error(errno, std::system_category(),
+                                    fmt::format("failed to configure {}", dev_path));
+        }
+    }
+
+    throw std::system_error(EBUSY, std::system_category(), "failed to attach loop device");
+}
+
+void mount_image_file(const image_file& file, const std::filesystem::path& rootfs) {
+    auto [loop_fd, dev_path] = attach_loop_device(file.path);
+    if (::mount(dev_path.c_str(), rootfs.c_str(), file.fs_type, MS_RDONLY | MS_NODEV, nullptr) !=
+        0) {
+        throw std::system_error(errno, std::system_category(),
+                                fmt::format("failed to mount {} on {}", dev_path, rootfs.native()));
+    }
+
+    SPDLOG_INFO("Mounted image file; file={} device={} mountpoint={}",
+                file.path.native(), dev_path, rootfs.native());
+}
+
+} // namespace
+
+std::string make_process_holder() {
+    return fmt::format("{}{}", k_process_holder_prefix, ::getpid());
+}
+
+image_mount acquire_image_mount(const image_file& file, std::string_view container_id) {
+    struct stat st {};
+    if (::stat(file.path.c_str(), &st) != 0) {
+        throw_fs_error("cannot stat image file", file.path);
+    }
+
+    auto key = fmt::format("{:x}-{:x}", st.st_dev, st.st_ino);
+    auto mount_path = get_mount_path(key);
+    auto rootfs = mount_path / "rootfs";
+    auto refs_dir = mount_path / "refs";
+    std::filesystem::create_directories(rootfs);
+    std::filesystem::create_directories(refs_dir);
+
+    auto lock = lock_mount(mount_path);
+
+    // References surviving a reboot are kept for their containers, which mount the image again
+    // by `restore_image_mount()`, e.g. to be exported or cloned.
+    prune_stale_refs(refs_dir);
+    if (!is_mounted(mount_path)) {
+        mount_image_file(file, rootfs);
+    }
+
+    base::write_to_file(refs_dir / container_id, file.path.native());
+
+    return {std::move(key), std::move(rootfs)};
+}
+
+image_mount share_image_mount(std::string_view key,
+                              std::string_view holder,
+                              std::string_view container_id) {
+    auto mount_path = get_mount_path(key);
+    if (!std::filesystem::exists(mount_path)) {
+        throw std::filesystem::filesystem_error(
+                "image mount doesn't exist", mount_path,
+                std::make_error_code(std::errc::no_such_file_or_directory));
+    }
+
+    auto lock = lock_mount(mount_path);
+
+    // References are dropped under the lock only; those left over a reboot don't count.
+    auto refs_dir = mount_path / "refs";
+    auto holder_ref = refs_dir / holder;
+    if (!std::filesystem::exists(holder_ref) || !is_mounted(mount_path)) {
+        throw std::filesystem::filesystem_error(
+                "image mount is not held", holder_ref,
+                std::make_error_code(std::errc::no_such_file_or_directory));
+    }
+
+    base::write_to_file(refs_dir / container_id, base::read_file_to_string(holder_ref));
+
+    return {std::string(key), mount_path / "rootfs"};
+}
+
+image_mount restore_image_mount(std::string_view key, std::string_view container_id) {
+    auto mount_path = get_mount_path(key);
+    auto ref = mount_path / "refs" / container_id;
+    if (!std::filesystem::exists(mount_path)) {
+        throw std::filesystem::filesystem_error(
+                "image mount is not held", ref,
+                std::make_error_code(std::errc::no_such_file_or_directory));
+    }
+
+    auto lock = lock_mount(mount_path);
+
+    // References are dropped under the lock only.
+    if (!std::filesystem::exists(ref)) {
+        throw std::filesystem::filesystem_error(
+                "image mount is not held", ref,
+                std::make_error_code(std::errc::no_such_file_or_directory));
+    }
+
+    auto rootfs = mount_path / "rootfs";
+    if (!is_mounted(mount_path)) {
+        auto file = image_file_from_path(base::read_file_to_string(ref));
+        struct stat st {};
+        if (!file || ::stat(file->path.c_str(), &st) != 0 ||
+            fmt::format("{:x}-{:x}", st.st_dev, st.st_ino) != key) {
+            throw std::filesystem::filesystem_error(
+                    "image file of mount is gone", ref,
+                    std::make_error_code(std::errc::no_such_file_or_directory));
+        }
+        mount_image_file(*file, rootfs);
+    }
+
+    return {std::string(key), std::move(rootfs)};
+}
+
+void release_image_mount(std::string_view key, std::string_view container_id) {
+    auto mount_path = get_mount_path(key);
+    if (!std::filesystem::exists(mount_path)) {
+        return;
+    }
+
+    auto lock = lock_mount(mount_path);
+
+    auto refs_dir = mount_path / "refs";
+    if (!std::filesystem::remove(refs_dir / container_id)) {
+        return;
+    }
+
+    prune_stale_refs(refs_dir);
+    if (!std::filesystem::is_empty(refs_dir) || !is_mounted(mount_path)) {
+        return;
+    }
+
+    // Lazy unmount in case some lumper process is still walking the tree; the loop device is
+    // detached once the filesystem is finally gone.
+    auto rootfs = mount_path / "rootfs";
+    if (::umount2(rootfs.c_str(), MNT_DETACH) != 0) {
+        throw std::system_error(errno, std::system_category(),
+                                fmt::format("failed to unmount {}", rootfs.native()));
+    }
+
+    SPDLOG_INFO("Unmounted unused image file; mountpoint={}", rootfs.native());
+}
+
+} // namespace lumper
@@ -0,0 +1,64 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#pragma once
+
+#ifndef LUMPER_IMAGE_MOUNT_H_
+#define LUMPER_IMAGE_MOUNT_H_
+
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+#include "lumper/image_store.h"
+
+namespace lumper {
+
+// Single-file image is attached to a loop device and mounted read-only once, then shared as the
+// lowerdir by all containers of the image, and so is the page cache of it.
+struct image_mount {
+    // Identifies the mount; recorded in container info to release the mount later.
+    std::string key;
+    std::filesystem::path mountpoint;
+};
+
+inline constexpr char k_process_holder_prefix[] = "pid-";
+
+// Returns a holder id for the calling process using an image mount for a while, e.g. to copy the
+// image, whose reference is dropped once the process is gone even if not released.
+std::string make_process_holder();
+
+// Mounts the image file if it is not mounted yet, and takes a reference on behalf of the
+// container, or of the holder made by `make_process_holder()`.
+// Mounts are keyed by device and inode of the image file, thus replacing the file doesn't
+// affect containers using the old one.
+// Throws:
+//  - `std::system_error` if failed to attach loop device or to mount.
+//  - `std::filesystem::filesystem_error` for other filesystem failures.
+image_mount acquire_image_mount(const image_file& file, std::string_view container_id);
+
+// Takes a reference on the mount of `key` on behalf of the container, as `holder`, a container
+// holding a reference, e.g. one being cloned, does; the mount stays as long as `holder` keeps its
+// reference meanwhile.
+// Throws `std::filesystem::filesystem_error` if `holder` holds no reference, or when failed.
+image_mount share_image_mount(std::string_view key,
+                              std::string_view holder,
+                              std::string_view container_id);
+
+// Makes sure the mount of `key`, which the container holds a reference on, is mounted, e.g. after
+// a reboot, by mounting the image file again if it is still the same file.
+// Throws:
+//  - `std::filesystem::filesystem_error` if the container holds no reference, or the image file is
+//    replaced, or for other filesystem failures.
+//  - `std::system_error` if failed to attach loop device or to mount.
+image_mount restore_image_mount(std::string_view key, std::string_view container_id);
+
+// Drops the reference of the container, and unmounts the image when no container uses it.
+// Does nothing if the container holds no reference.
+// Throws `std::filesystem::filesystem_error` or `std::system_error` when failed.
+void release_image_mount(std::string_view key, std::string_view container_id);
+
+} // namespace lumper
+
+#endif // LUMPER_IMAGE_MOUNT_H_
@@ -0,0 +1,277 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "lumper/image_pin.h"
+
+#include <algorithm>
+#include <chrono>
+#include <system_error>
+
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+#include <unistd.h>
+
+#include "esl/scope_guard.h"
+#include "fmt/format.h"
+#include "nlohmann/json.hpp"
+#include "spdlog/spdlog.h"
+
+#include "base/file_util.h"
+#include "lumper/image_mount.h"
+#include "lumper/layer_copy.h"
+#include "lumper/path_constants.h"
+#include "lumper/prefetch_profile.h"
+
+namespace lumper {
+namespace {
+
+constexpr std::string_view k_pin_ext = ".json";
+
+[[noreturn]] void throw_fs_error(const char* what, const std::filesystem::path& path) {
+    throw std::filesystem::filesystem_error(what, path,
+                                            std::error_code(errno, std::system_category()));
+}
+
+std::filesystem::path get_pin_path(std::string_view image_name) {
+    std::filesystem::path path(k_image_pins_dir);
+    path /= image_name;
+    path += k_pin_ext;
+    return path;
+}
+
+std::optional<image_pin> load_image_pin(std::string_view image_name) {
+    auto path = get_pin_path(image_name);
+    if (!std::filesystem::exists(path)) {
+        return std::nullopt;
+    }
+    return nlohmann::json::parse(base::read_file_to_string(path)).get<image_pin>();
+}
+
+void save_image_pin(const image_pin& pin) {
+    auto path = get_pin_path(pin.image);
+    auto tmp_path = path;
+    tmp_path += fmt::format(".tmp-{}", ::getpid());
+    base::write_to_file(tmp_path, nlohmann::json(pin).dump());
+    std::filesystem::rename(tmp_path, path);
+}
+
+// Mounts of single-file images get a new device each time, thus the image file is fingerprinted
+// instead.
+std::string fingerprint_image(const resolved_image& image) {
+    auto paths = image.lowerdirs;
+    if (image.bottom_file) {
+        paths.push_back(image.bottom_file->path);
+    }
+    return fingerprint_lowerdirs(paths);
+}
+
+// Pins made before mountpoints were named by time may have ':' in their mountpoints, and are
+// re-made, as they cannot be lowerdirs.
+bool is_stale(const image_pin& pin) {
+    return pin.mountpoint.native().find_first_of(":,") != std::string::npos;
+}
+
+// Pins don't survive reboots, while their records do.
+bool is_mounted(const std::filesystem::path& mountpoint) {
+    struct stat parent {};
+    struct stat root {};
+    if (::stat(mountpoint.parent_path().c_str(), &parent) != 0 ||
+        ::stat(mountpoint.c_str(), &root) != 0) {
+        return false;
+    }
+    return parent.st_dev != root.st_dev;
+}
+
+void unmount_pin(const std::filesystem::path& mountpoint) {
+    if (is_mounted(mountpoint) && ::umount2(mountpoint.c_str(), MNT_DETACH) != 0) {
+        throw std::system_error(errno, std::system_category(),
+                                fmt::format("failed to unmount {}", mountpoint.native()));
+    }
+
+    std::error_code ec;
+    std::filesystem::remove(mountpoint, ec);
+}
+
+// Merges layers of the image into a new tmpfs, which is then made read-only and shrunk to the
+// size taken.
+image_pin make_image_pin(std::string_view image_name, const resolved_image& image) {
+    image_pin pin{std::string(image_name),
+                  make_pin_mountpoint(std::chrono::system_clock::now()),
+                  fingerprint_image(image)};
+
+    std::filesystem::create_directories(pin.mountpoint);
+    constexpr unsigned long mount_flags = MS_NODEV | MS_NOSUID;
+    if (::mount("tmpfs", pin.mountpoint.c_str(), "tmpfs", mount_flags, "mode=0755") != 0) {
+        auto err = errno;
+        std::filesystem::remove(pin.mountpoint);
+        throw std::system_error(err, std::system_category(),
+                                fmt::format("failed to mount tmpfs on {}",
+                                            pin.mountpoint.native()));
+    }
+    ESL_ON_SCOPE_FAIL {
+        try {
+            unmount_pin(pin.mountpoint);
+        } catch (const std::exception& ex) {
+            // NOLINTNEXTLINE(bugprone-lambda-function-name)
+            SPDLOG_ERROR("Failed to clean up pin; mountpoint={} ex={}",
+                         pin.mountpoint.native(), ex.what());
+        }
+    };
+
+    auto sources = image.lowerdirs;
+    std::string image_mount_key;
+    auto holder = make_process_holder();
+    if (image.bottom_file) {
+        auto mount = acquire_image_mount(*image.bottom_file, holder);
+        image_mount_key = std::move(mount.key);
+        sources.push_back(std::move(mount.mountpoint));
+    }
+    ESL_ON_SCOPE_EXIT {
+        if (!image_mount_key.empty()) {
+            try {
+                release_image_mount(image_mount_key, holder);
+            } catch (const std::exception& ex) {
+                // NOLINTNEXTLINE(bugprone-lambda-function-name)
+                SPDLOG_WARN("Failed to release image mount; key={} ex={}",
+                            image_mount_key, ex.what());
+            }
+        }
+    };
+
+    // Nothing is beneath the merged tree, thus whiteouts are not needed.
+    auto stats = squash_layer_trees(sources, pin.rootfs(), false);
+
+    // size=0 means unlimited.
+    auto usage = get_image_pin_usage(pin);
+    auto page_size = static_cast<std::uint64_t>(::sysconf(_SC_PAGESIZE));
+    auto options = fmt::format("mode=0755,size={}", std::max(usage.bytes, page_size));
+    if (::mount(nullptr, pin.mountpoint.c_str(), nullptr, MS_REMOUNT | MS_RDONLY | mount_flags,
+                options.c_str()) != 0) {
+        throw std::system_error(errno, std::system_category(),
+                                fmt::format("failed to remount {} read-only",
+                                            pin.mountpoint.native()));
+    }
+
+    SPDLOG_INFO("Pinned image; image={} mountpoint={} layers={} files={} bytes={} inodes={}",
+                image_name, pin.mountpoint.native(), sources.size(), stats.files, usage.bytes,
+                usage.inodes);
+
+    return pin;
+}
+
+} // namespace
+
+void to_json(nlohmann::json& j, const image_pin& pin) {
+    j = nlohmann::json{
+            {"image", pin.image},
+            {"mountpoint", pin.mountpoint.native()},
+            {"fingerprint", pin.fingerprint}};
+}
+
+void from_json(const nlohmann::json& j, image_pin& pin) {
+    j.at("image").get_to(pin.image);
+    pin.mountpoint = j.at("mountpoint").get<std::string>();
+    j.at("fingerprint").get_to(pin.fingerprint);
+}
+
+std::pair<image_pin, bool> pin_image(std::string_view image_name) {
+    // Keeps layers being copied from being pruned.
+    auto store_lock = lock_image_store(image_store_lock_mode::shared);
+
+    auto image = resolve_image(image_name);
+    if (auto pinned = load_image_pin(image_name);
+        pinned && !is_stale(*pinned) && is_mounted(pinned->mountpoint) &&
+        pinned->fingerprint == fingerprint_image(image)) {
+        return {std::move(*pinned), false};
+    }
+
+    std::filesystem::create_directories(k_image_pins_dir);
+    auto pin = make_image_pin(image_name, image);
+    ESL_ON_SCOPE_FAIL {
+        try {
+            unmount_pin(pin.mountpoint);
+        } catch (const std::exception& ex) {
+            // NOLINTNEXTLINE(bugprone-lambda-function-name)
+            SPDLOG_ERROR("Failed to clean up pin; mountpoint={} ex={}",
+                         pin.mountpoint.native(), ex.what());
+        }
+    };
+
+    // Containers being created may be about to mount the previous pin.
+    store_lock.reset();
+    store_lock = lock_image_store(image_store_lock_mode::exclusive);
+    auto previous = load_image_pin(image_name);
+    save_image_pin(pin);
+    if (previous) {
+        unmount_pin(previous->mountpoint);
+    }
+
+    return {std::move(pin), true};
+}
+
+bool unpin_image(std::string_view image_name) {
+    auto pin = load_image_pin(image_name);
+    if (!pin) {
+        return false;
+    }
+
+    std::filesystem::remove(get_pin_path(image_name));
+    unmount_pin(pin->mountpoint);
+    SPDLOG_INFO("Unpinned image; image={} mountpoint={}", image_name, pin->mountpoint.native());
+    return true;
+}
+
+std::vector<image_pin> list_image_pins() {
+    std::vector<image_pin> pins;
+    if (!std::filesystem::exists(k_image_pins_dir)) {
+        return pins;
+    }
+
+    for (const auto& entry : std::filesystem::directory_iterator(k_image_pins_dir)) {
+        if (entry.path().extension() == k_pin_ext) {
+            pins.push_back(nlohmann::json::parse(base::read_file_to_string(entry.path()))
+                                   .get<image_pin>());
+        }
+    }
+    return pins;
+}
+
+image_pin_usage get_image_pin_usage(const image_pin& pin) {
+    if (!is_mounted(pin.mountpoint)) {
+        return {0, 0};
+    }
+
+    struct statfs st {};
+    if (::statfs(pin.mountpoint.c_str(), &st) != 0) {
+        throw_fs_error("cannot statfs pin", pin.mountpoint);
+    }
+    return {static_cast<std::uint64_t>(st.f_blocks - st.f_bfree) *
+                    static_cast<std::uint64_t>(st.f_bsize),
+            static_cast<std::uint64_t>(st.f_files - st.f_ffree)};
+}
+
+std::optional<std::filesystem::path> find_pinned_rootfs(std::string_view image_name,
+                                                       const resolved_image& image) {
+    std::optional<image_pin> pin;
+    try {
+        pin = load_image_pin(image_name);
+    } catch (const nlohmann::json::exception& ex) {
+        SPDLOG_WARN("Ignore corrupted pin; image={} ex={}", image_name, ex.what());
+        return std::nullopt;
+    }
+
+    if (!pin || is_stale(*pin) || !is_mounted(pin->mountpoint)) {
+        return std::nullopt;
+    }
+
+    if (pin->fingerprint != fingerprint_image(image)) {
+        SPDLOG_WARN("Image changed since pinned, pin is not used; image={}", image_name);
+        return std::nullopt;
+    }
+
+    return pin->rootfs();
+}
+
+} // namespace lumper
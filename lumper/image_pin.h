@@ -0,0 +1,91 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#pragma once
+
+#ifndef LUMPER_IMAGE_PIN_H_
+#define LUMPER_IMAGE_PIN_H_
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "nlohmann/json_fwd.hpp"
+
+#include "lumper/image_store.h"
+#include "lumper/path_constants.h"
+
+namespace lumper {
+
+// An image copied into a tmpfs of its own, which is never evicted under page cache pressure,
+// unlike page cache of layers on disk; it may still be swapped out if swap is enabled.
+// Layers of the image are merged into a single tree, thus also saves lookups through layers.
+struct image_pin {
+    // Names the pin, while the mountpoint doesn't, see `make_pin_mountpoint()`.
+    std::string image;
+    // Where the tmpfs is mounted; the tree is under `rootfs` of it.
+    std::filesystem::path mountpoint;
+    // Fingerprint of the image when pinned; the pin is not used once the image is changed.
+    std::string fingerprint;
+
+    std::filesystem::path rootfs() const {
+        return mountpoint / "rootfs";
+    }
+};
+
+// Mountpoints of pins are named by when they are made, as image names, e.g. repo:tag, may have
+// ':', which separates lowerdirs of overlay.
+inline std::filesystem::path make_pin_mountpoint(std::chrono::system_clock::time_point pinned_at) {
+    auto stamp = std::chrono::duration_cast<std::chrono::nanoseconds>(pinned_at.time_since_epoch());
+    return std::filesystem::path(k_image_pins_dir) / std::to_string(stamp.count());
+}
+
+// Memory taken by a pin.
+struct image_pin_usage {
+    std::uint64_t bytes;
+    std::uint64_t inodes;
+};
+
+void to_json(nlohmann::json& j, const image_pin& pin);
+
+void from_json(const nlohmann::json& j, image_pin& pin);
+
+// Pins the image, or re-pins it if changed since pinned; the previous copy is unmounted lazily.
+// Returns the pin and whether it is newly made.
+// The image store is locked by the function itself.
+// Throws:
+//  - `std::invalid_argument` if the image doesn't exist.
+//  - `std::system_error` if failed to mount tmpfs, e.g. lacking CAP_SYS_ADMIN.
+//  - `std::filesystem::filesystem_error` for other failures, e.g. the image is too large for
+//    the tmpfs, which is limited to half of RAM.
+std::pair<image_pin, bool> pin_image(std::string_view image_name);
+
+// Unmounts the tmpfs lazily, thus running containers keep using it, and the memory is freed once
+// all of them exit.
+// Returns false if the image is not pinned.
+// The image store must be locked exclusively by the caller, as containers being created may be
+// about to mount the pin.
+// Throws `std::system_error` or `std::filesystem::filesystem_error` when failed.
+bool unpin_image(std::string_view image_name);
+
+// Throws `std::filesystem::filesystem_error` or `nlohmann::json::exception` when failed.
+std::vector<image_pin> list_image_pins();
+
+// Throws `std::filesystem::filesystem_error` when failed.
+image_pin_usage get_image_pin_usage(const image_pin& pin);
+
+// Returns the pinned tree for `image`, resolved from `image_name`, or `std::nullopt` if the image
+// is not pinned or has changed since pinned.
+// Throws `std::filesystem::filesystem_error` when failed.
+std::optional<std::filesystem::path> find_pinned_rootfs(std::string_view image_name,
+                                                       const resolved_image& image);
+
+} // namespace lumper
+
+#endif // LUMPER_IMAGE_PIN_H_
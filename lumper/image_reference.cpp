@@ -0,0 +1,102 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "lumper/image_reference.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "fmt/format.h"
+
+namespace lumper {
+namespace {
+
+bool looks_like_registry(std::string_view component) {
+    return component.find_first_of(".:") != std::string_view::npos || component == "localhost";
+}
+
+bool valid_repository(std::string_view repo) {
+    if (repo.empty() || repo.front() == '/' || repo.back() == '/' ||
+        repo.find("//") != std::string_view::npos) {
+        return false;
+    }
+
+    return std::all_of(repo.begin(), repo.end(), [](char ch) {
+        return (ch >= 'a' && ch <= 'z') || (ch >= '0' && ch <= '9') ||
+               ch == '.' || ch == '_' || ch == '-' || ch == '/';
+    });
+}
+
+} // namespace
+
+// static
+image_reference image_reference::parse(std::string_view ref) {
+    if (ref.empty()) {
+        throw std::invalid_argument("empty image reference");
+    }
+
+    image_reference result;
+
+    if (auto at = ref.find('@'); at != std::string_view::npos) {
+        result.digest = std::string(ref.substr(at + 1));
+        ref = ref.substr(0, at);
+        if (result.digest.find(':') == std::string::npos) {
+            throw std::invalid_argument(fmt::format("malformed digest: {}", result.digest));
+        }
+    }
+
+    if (auto slash = ref.find('/');
+        slash != std::string_view::npos && looks_like_registry(ref.substr(0, slash))) {
+        result.registry = std::string(ref.substr(0, slash));
+        ref = ref.substr(slash + 1);
+    } else {
+        result.registry = k_default_registry;
+    }
+
+    // Colon after the last slash separates the tag; registry port has been stripped above.
+    auto last_slash = ref.rfind('/');
+    auto colon = ref.find(':', last_slash == std::string_view::npos ? 0 : last_slash);
+    if (colon != std::string_view::npos) {
+        result.tag = std::string(ref.substr(colon + 1));
+        ref = ref.substr(0, colon);
+        if (result.tag.empty()) {
+            throw std::invalid_argument("empty image tag");
+        }
+    } else if (result.digest.empty()) {
+        result.tag = k_default_tag;
+    }
+
+    if (!valid_repository(ref)) {
+        throw std::invalid_argument(fmt::format("invalid repository name: {}", ref));
+    }
+    result.repository = std::string(ref);
+
+    return result;
+}
+
+std::string image_reference::local_name() const {
+    auto name = repository;
+    std::replace(name.begin(), name.end(), '/', '_');
+    if (!tag.empty()) {
+        return name + ":" + tag;
+    }
+
+    // Pinned by digest only: use a short form of the digest as the tag.
+    constexpr std::size_t short_digest_len = 12;
+    auto hex = digest.substr(digest.find(':') + 1);
+    return name + ":" + hex.substr(0, short_digest_len);
+}
+
+std::string image_reference::to_string() const {
+    auto str = fmt::format("{}/{}", registry, repository);
+    if (!tag.empty()) {
+        str.append(":").append(tag);
+    }
+    if (!digest.empty()) {
+        str.append("@").append(digest);
+    }
+    return str;
+}
+
+} // namespace lumper
@@ -0,0 +1,44 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#pragma once
+
+#ifndef LUMPER_IMAGE_REFERENCE_H_
+#define LUMPER_IMAGE_REFERENCE_H_
+
+#include <string>
+#include <string_view>
+
+namespace lumper {
+
+// Registry used when the reference doesn't name one, e.g. `alpine:3.16`.
+// We deliberately default to a local registry rather than docker hub.
+inline constexpr char k_default_registry[] = "localhost:5000";
+inline constexpr char k_default_tag[] = "latest";
+
+// [registry/]repository[:tag][@digest]
+struct image_reference {
+    std::string registry;
+    std::string repository;
+    std::string tag;
+    std::string digest;
+
+    // Throws `std::invalid_argument` if `ref` is malformed.
+    static image_reference parse(std::string_view ref);
+
+    // Returns the digest if pinned by digest, otherwise the tag; used in manifest urls.
+    const std::string& manifest_ref() const noexcept {
+        return digest.empty() ? tag : digest;
+    }
+
+    // Returns the name used for the local image, e.g. `library_alpine:3.16`.
+    // Slashes are replaced so that the name is a single path component.
+    std::string local_name() const;
+
+    std::string to_string() const;
+};
+
+} // namespace lumper
+
+#endif // LUMPER_IMAGE_REFERENCE_H_
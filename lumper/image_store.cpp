@@ -0,0 +1,273 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "lumper/image_store.h"
+
+#include <iterator>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/xattr.h>
+#include <unistd.h>
+
+#include "fmt/format.h"
+#include "nlohmann/json.hpp"
+
+#include "base/file_util.h"
+#include "base/sha256.h"
+#include "lumper/path_constants.h"
+
+namespace lumper {
+namespace {
+
+constexpr std::string_view k_whiteout_prefix = ".wh.";
+constexpr std::string_view k_opaque_marker = ".wh..wh..opq";
+constexpr char k_overlay_opaque_xattr[] = "trusted.overlay.opaque";
+
+struct image_file_format {
+    const char* ext;
+    const char* fs_type;
+};
+
+constexpr image_file_format k_image_file_formats[] = {
+        {".sqfs", "squashfs"},
+        {".erofs", "erofs"}};
+
+// Guards against cycles of base images.
+constexpr std::size_t k_max_image_chain_depth = 64;
+
+constexpr std::string_view k_sha256_prefix = "sha256:";
+constexpr std::size_t k_sha256_hex_len = 64;
+
+[[noreturn]] void throw_fs_error(const char* what, const std::filesystem::path& path) {
+    throw std::filesystem::filesystem_error(what, path,
+                                            std::error_code(errno, std::system_category()));
+}
+
+} // namespace
+
+void to_json(nlohmann::json& j, const image_manifest& manifest) {
+    j = nlohmann::json{
+            {"name", manifest.name},
+            {"reference", manifest.reference},
+            {"layers", manifest.layers},
+            {"base_image", manifest.base_image}};
+}
+
+void from_json(const nlohmann::json& j, image_manifest& manifest) {
+    j.at("name").get_to(manifest.name);
+    j.at("reference").get_to(manifest.reference);
+    j.at("layers").get_to(manifest.layers);
+    manifest.base_image = j.value("base_image", "");
+}
+
+std::filesystem::path get_manifest_path(std::string_view image_name) {
+    std::filesystem::path path(k_manifests_dir);
+    path /= image_name;
+    path += ".json";
+    return path;
+}
+
+std::filesystem::path get_layer_path(std::string_view layer_id) {
+    std::filesystem::path path(k_layers_dir);
+    path /= layer_id;
+    return path;
+}
+
+std::filesystem::path get_blob_path(std::string_view digest) {
+    std::filesystem::path path(k_blobs_dir);
+    path /= "sha256";
+    path /= layer_id_from_digest(digest);
+    return path;
+}
+
+std::string layer_id_from_digest(std::string_view digest) {
+    if (digest.substr(0, k_sha256_prefix.size()) != k_sha256_prefix) {
+        throw std::invalid_argument(fmt::format("unsupported digest algorithm: {}", digest));
+    }
+
+    auto hex = digest.substr(k_sha256_prefix.size());
+    if (hex.size() != k_sha256_hex_len ||
+        hex.find_first_not_of("0123456789abcdef") != std::string_view::npos) {
+        throw std::invalid_argument(fmt::format("malformed sha256 digest: {}", digest));
+    }
+
+    return std::string(hex);
+}
+
+std::optional<image_manifest> load_image_manifest(std::string_view image_name) {
+    auto path = get_manifest_path(image_name);
+    if (!std::filesystem::exists(path)) {
+        return std::nullopt;
+    }
+
+    return nlohmann::json::parse(base::read_file_to_string(path)).get<image_manifest>();
+}
+
+void save_image_manifest(const image_manifest& manifest) {
+    std::filesystem::create_directories(k_manifests_dir);
+    auto path = get_manifest_path(manifest.name);
+    auto tmp_path = path;
+    tmp_path += fmt::format(".tmp-{}", ::getpid());
+    base::write_to_file(tmp_path, nlohmann::json(manifest).dump());
+    std::filesystem::rename(tmp_path, path);
+}
+
+bool is_local_layer(std::string_view layer_id) noexcept {
+    return layer_id.substr(0, std::size(k_local_layer_prefix) - 1) == k_local_layer_prefix;
+}
+
+esl::unique_fd lock_image_store(image_store_lock_mode mode) {
+    constexpr int perm = 0644;
+    std::filesystem::path lock_path(k_image_store_lock_file);
+    std::filesystem::create_directories(lock_path.parent_path());
+    esl::unique_fd fd(::open(lock_path.c_str(), O_CREAT | O_RDWR | O_CLOEXEC, perm));
+    if (!fd) {
+        throw_fs_error("cannot open image store lock", lock_path);
+    }
+
+    auto op = mode == image_store_lock_mode::shared ? LOCK_SH : LOCK_EX;
+    int rv;
+    do {
+        rv = ::flock(fd.get(), op);
+    } while (rv != 0 && errno == EINTR);
+    if (rv != 0) {
+        throw_fs_error("cannot lock image store", lock_path);
+    }
+
+    return fd;
+}
+
+std::optional<image_file> find_image_file(std::string_view image_name) {
+    for (const auto& format : k_image_file_formats) {
+        auto path = std::filesystem::path(k_images_dir) / image_name;
+        path += format.ext;
+        if (std::filesystem::is_regular_file(path)) {
+            return image_file{std::move(path), format.fs_type};
+        }
+    }
+
+    return std::nullopt;
+}
+
+std::optional<image_file> image_file_from_path(std::filesystem::path path) {
+    for (const auto& format : k_image_file_formats) {
+        if (path.extension() == format.ext) {
+            return image_file{std::move(path), format.fs_type};
+        }
+    }
+
+    return std::nullopt;
+}
+
+resolved_image resolve_image(std::string_view image_name) {
+    resolved_image resolved;
+    std::string name(image_name);
+    for (std::size_t depth = 0;; ++depth) {
+        if (depth == k_max_image_chain_depth) {
+            throw std::invalid_argument(
+                    fmt::format("image {} has too deep chain of base images", image_name));
+        }
+
+        auto manifest = load_image_manifest(name);
+        if (!manifest) {
+            if (auto file = find_image_file(name); file) {
+                resolved.bottom_file = std::move(file);
+                return resolved;
+            }
+
+            auto image_root = std::filesystem::path(k_images_dir) / name;
+            if (!std::filesystem::exists(image_root)) {
+                // TODO(KC): untar image first if image_root doesn't exist.
+                throw std::invalid_argument(
+                        fmt::format("image root ({}) doesn't exist", image_root.string()));
+            }
+            resolved.lowerdirs.push_back(std::move(image_root));
+            return resolved;
+        }
+
+        if (manifest->layers.empty()) {
+            throw std::invalid_argument(fmt::format("image {} has no layers", name));
+        }
+
+        for (auto it = manifest->layers.rbegin(); it != manifest->layers.rend(); ++it) {
+            auto layer_path = get_layer_path(*it);
+            if (!std::filesystem::exists(layer_path)) {
+                throw std::invalid_argument(
+                        fmt::format("layer {} of image {} is missing", *it, name));
+            }
+            resolved.lowerdirs.push_back(std::move(layer_path));
+        }
+
+        if (manifest->base_image.empty()) {
+            return resolved;
+        }
+
+        name = std::move(manifest->base_image);
+    }
+}
+
+void verify_image_layers(const image_manifest& manifest, base::thread_pool& pool) {
+    std::vector<std::string> layer_ids;
+    std::vector<std::filesystem::path> blobs;
+    for (const auto& layer_id : manifest.layers) {
+        if (is_local_layer(layer_id)) {
+            continue;
+        }
+
+        auto blob_path = get_blob_path(fmt::format("{}{}", k_sha256_prefix, layer_id));
+        if (!std::filesystem::exists(blob_path)) {
+            throw image_integrity_error(
+                    fmt::format("blob of layer {} of image {} is missing", layer_id, manifest.name));
+        }
+        layer_ids.push_back(layer_id);
+        blobs.push_back(std::move(blob_path));
+    }
+
+    auto digests = base::sha256_files(blobs, pool);
+    for (std::size_t i = 0; i < digests.size(); ++i) {
+        if (digests[i] != layer_ids[i]) {
+            throw image_integrity_error(
+                    fmt::format("layer {} of image {} is corrupted; actual digest={}",
+                                layer_ids[i], manifest.name, digests[i]));
+        }
+    }
+}
+
+void convert_oci_whiteouts(const std::filesystem::path& layer_root) {
+    // Collect first, because mutating a directory while iterating it is unspecified.
+    std::vector<std::filesystem::path> markers;
+    for (const auto& entry : std::filesystem::recursive_directory_iterator(layer_root)) {
+        auto name = entry.path().filename().native();
+        if (std::string_view(name).substr(0, k_whiteout_prefix.size()) == k_whiteout_prefix) {
+            markers.push_back(entry.path());
+        }
+    }
+
+    for (const auto& marker : markers) {
+        auto name = marker.filename().native();
+        auto parent = marker.parent_path();
+        std::filesystem::remove(marker);
+
+        if (name == k_opaque_marker) {
+            if (::setxattr(parent.c_str(), k_overlay_opaque_xattr, "y", 1, 0) != 0) {
+                throw_fs_error("cannot mark opaque dir", parent);
+            }
+            continue;
+        }
+
+        auto target = parent / name.substr(k_whiteout_prefix.size());
+        std::filesystem::remove_all(target);
+        if (::mknod(target.c_str(), S_IFCHR, ::makedev(0, 0)) != 0) {
+            throw_fs_error("cannot create whiteout", target);
+        }
+    }
+}
+
+} // namespace lumper
@@ -0,0 +1,131 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#pragma once
+
+#ifndef LUMPER_IMAGE_STORE_H_
+#define LUMPER_IMAGE_STORE_H_
+
+#include <filesystem>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "esl/unique_handle.h"
+#include "nlohmann/json_fwd.hpp"
+
+namespace base {
+class thread_pool;
+} // namespace base
+
+namespace lumper {
+
+class image_integrity_error : public std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+// An image is one of:
+//  - a manifest under `k_manifests_dir` naming layers stored under `k_layers_dir`;
+//  - a single-file squashfs or erofs image in `k_images_dir`, named `<image>.sqfs` or
+//    `<image>.erofs`, e.g. made by `mksquashfs rootfs/ alpine.sqfs -comp zstd`;
+//  - a plain directory tree under `k_images_dir`, which is the legacy layout.
+// Layers are stored in overlayfs-native format, thus can be used as lowerdir directly.
+struct image_manifest {
+    std::string name;
+    // Where the image came from, e.g. `localhost:5000/alpine:3.16`.
+    std::string reference;
+    // Layer ids, bottom-most first.
+    // Layers pulled from registries are named by digests of their blobs; layers created locally,
+    // e.g. by `lumper commit`, have no blob and their ids start with `k_local_layer_prefix`.
+    std::vector<std::string> layers;
+    // The image the layers are stacked on, empty if none; it can be of any form above.
+    std::string base_image;
+};
+
+inline constexpr char k_local_layer_prefix[] = "local-";
+
+struct image_file {
+    std::filesystem::path path;
+    // Filesystem type passed to mount(2).
+    const char* fs_type;
+};
+
+// Result of resolving an image and its base images.
+struct resolved_image {
+    // Top-most first, which is the order overlayfs expects.
+    std::vector<std::filesystem::path> lowerdirs;
+    // Single-file image at the bottom, whose mountpoint goes after `lowerdirs`.
+    std::optional<image_file> bottom_file;
+};
+
+enum class image_store_lock_mode {
+    // Held by commands creating references to images, i.e. pull, commit and run, until the
+    // references are recorded in manifests or container info.
+    shared,
+    // Held by image garbage collection while it decides what to delete.
+    exclusive,
+};
+
+void to_json(nlohmann::json& j, const image_manifest& manifest);
+
+void from_json(const nlohmann::json& j, image_manifest& manifest);
+
+std::filesystem::path get_manifest_path(std::string_view image_name);
+
+std::filesystem::path get_layer_path(std::string_view layer_id);
+
+// Blobs are kept in the content store by digest.
+// Throws `std::invalid_argument` if `digest` is not a well-formed sha256 digest.
+std::filesystem::path get_blob_path(std::string_view digest);
+
+// `sha256:<hex>` -> `<hex>`.
+// Throws `std::invalid_argument` for digests of other algorithms or malformed ones.
+std::string layer_id_from_digest(std::string_view digest);
+
+// Returns `std::nullopt` if the image has no manifest.
+// Throws:
+//  - `std::filesystem::filesystem_error` if failed to read the manifest.
+//  - `nlohmann::json::exception` if the manifest is corrupted.
+std::optional<image_manifest> load_image_manifest(std::string_view image_name);
+
+// Replaces the manifest atomically.
+// Throws `std::filesystem::filesystem_error` when failed.
+void save_image_manifest(const image_manifest& manifest);
+
+bool is_local_layer(std::string_view layer_id) noexcept;
+
+// Blocks until the lock is acquired; the lock is released by closing the returned fd.
+// Throws `std::filesystem::filesystem_error` when failed.
+esl::unique_fd lock_image_store(image_store_lock_mode mode);
+
+// Returns `std::nullopt` if the image has no single-file form.
+std::optional<image_file> find_image_file(std::string_view image_name);
+
+// Returns `std::nullopt` if `path` is not named as a single-file image is.
+std::optional<image_file> image_file_from_path(std::filesystem::path path);
+
+// Throws:
+//  - `std::invalid_argument` if the image, any of its layers or base images doesn't exist.
+//  - `std::filesystem::filesystem_error` or `nlohmann::json::exception` if failed to load
+//    manifests.
+resolved_image resolve_image(std::string_view image_name);
+
+// Checks blobs of all layers against their digests, hashing them concurrently on `pool`.
+// Local layers are skipped, as they have no digest.
+// Throws:
+//  - `image_integrity_error` if any blob is missing or corrupted.
+//  - `std::filesystem::filesystem_error` if failed to read blobs.
+void verify_image_layers(const image_manifest& manifest, base::thread_pool& pool);
+
+// Translates OCI whiteout markers in an extracted layer into overlayfs-native form:
+//  - `.wh..wh..opq` becomes `trusted.overlay.opaque=y` on its parent directory.
+//  - `.wh.<name>` becomes a 0/0 character device named `<name>`.
+// Throws `std::filesystem::filesystem_error` when failed.
+void convert_oci_whiteouts(const std::filesystem::path& layer_root);
+
+} // namespace lumper
+
+#endif // LUMPER_IMAGE_STORE_H_
@@ -0,0 +1,397 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "lumper/layer_copy.h"
+
+#include <array>
+#include <atomic>
+#include <future>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/xattr.h>
+#include <unistd.h>
+
+#include "fmt/format.h"
+
+#include "base/file_util.h"
+#include "base/thread_pool.h"
+
+namespace lumper {
+namespace {
+
+constexpr std::string_view k_overlay_xattr_prefix = "trusted.overlay.";
+constexpr std::string_view k_overlay_opaque_xattr = "trusted.overlay.opaque";
+constexpr std::string_view k_overlay_redirect_xattr = "trusted.overlay.redirect";
+constexpr std::string_view k_overlay_metacopy_xattr = "trusted.overlay.metacopy";
+
+constexpr mode_t k_perm_mask = 07777;
+
+[[noreturn]] void throw_fs_error(const char* what, const std::filesystem::path& path) {
+    throw std::filesystem::filesystem_error(what, path,
+                                            std::error_code(errno, std::system_category()));
+}
+
+bool starts_with(std::string_view str, std::string_view prefix) noexcept {
+    return str.substr(0, prefix.size()) == prefix;
+}
+
+bool is_whiteout(const struct stat& st) noexcept {
+    return S_ISCHR(st.st_mode) && st.st_rdev == ::makedev(0, 0);
+}
+
+bool is_opaque_dir(const std::filesystem::path& dir) {
+    char value = 0;
+    auto len = ::lgetxattr(dir.c_str(), k_overlay_opaque_xattr.data(), &value, sizeof(value));
+    return len == 1 && value == 'y';
+}
+
+// If `pool` is given, regular files are copied on it, and hardlinks to them are made once
+// they are done, see `wait_files()`.
+class tree_copier {
+public:
+    tree_copier(overlay_xattrs mode, bool link_files, base::thread_pool* pool = nullptr)
+        : mode_(mode),
+          link_files_(link_files),
+          pool_(pool) {}
+
+    ~tree_copier() {
+        // Pending copies refer to the copier.
+        for (auto& pending : pending_files_) {
+            if (pending.valid()) {
+                pending.wait();
+            }
+        }
+    }
+
+    tree_copier(const tree_copier&) = delete;
+
+    tree_copier& operator=(const tree_copier&) = delete;
+
+    void copy_entry(const std::filesystem::path& from, const std::filesystem::path& to) {
+        struct stat st {};
+        if (::lstat(from.c_str(), &st) != 0) {
+            throw_fs_error("cannot stat entry to copy", from);
+        }
+        copy_entry(from, to, st);
+    }
+
+    void copy_entry(const std::filesystem::path& from,
+                    const std::filesystem::path& to,
+                    const struct stat& st) {
+        ++stats_.entries;
+
+        // Metadata is shared as well.
+        if (S_ISREG(st.st_mode) && link_files_ && ::link(from.c_str(), to.c_str()) == 0) {
+            ++stats_.files;
+            ++stats_.hardlinked_files;
+            stats_.file_bytes += static_cast<std::uint64_t>(st.st_size);
+            return;
+        }
+
+        if (S_ISREG(st.st_mode) && st.st_nlink > 1) {
+            auto [it, inserted] = links_.try_emplace({st.st_dev, st.st_ino}, to);
+            if (!inserted) {
+                if (pool_ != nullptr) {
+                    deferred_links_.emplace_back(it->second, to);
+                    return;
+                }
+                if (::link(it->second.c_str(), to.c_str()) != 0) {
+                    throw_fs_error("cannot create hardlink", to);
+                }
+                return;
+            }
+        }
+
+        switch (st.st_mode & S_IFMT) {
+        case S_IFDIR:
+            if (::mkdir(to.c_str(), st.st_mode & k_perm_mask) != 0) {
+                throw_fs_error("cannot create directory", to);
+            }
+            break;
+
+        case S_IFREG:
+            ++stats_.files;
+            stats_.file_bytes += static_cast<std::uint64_t>(st.st_size);
+            if (pool_ != nullptr) {
+                pending_files_.push_back(pool_->submit([this, from, to, st] {
+                    if (base::clone_file(from, to)) {
+                        ++reflinked_files_;
+                    }
+                    copy_metadata(from, to, st);
+                }));
+                return;
+            }
+            if (base::clone_file(from, to)) {
+                ++reflinked_files_;
+            }
+            break;
+
+        case S_IFLNK:
+            copy_symlink(from, to, st);
+            break;
+
+        default:
+            if (is_whiteout(st)) {
+                ++stats_.whiteouts;
+            }
+            if (::mknod(to.c_str(), st.st_mode, st.st_rdev) != 0) {
+                throw_fs_error("cannot create special file", to);
+            }
+            break;
+        }
+
+        copy_metadata(from, to, st);
+    }
+
+    // Waits for files being copied on the pool, then makes hardlinks to them.
+    void wait_files() {
+        base::wait_all(pending_files_);
+        pending_files_.clear();
+        for (const auto& [target, link] : deferred_links_) {
+            if (::link(target.c_str(), link.c_str()) != 0) {
+                throw_fs_error("cannot create hardlink", link);
+            }
+        }
+        deferred_links_.clear();
+    }
+
+    // Directory timestamps are changed by creating entries in them, so restore them last, and
+    // children first.
+    void restore_dir_times() {
+        for (auto it = dir_times_.rbegin(); it != dir_times_.rend(); ++it) {
+            if (::utimensat(AT_FDCWD, it->first.c_str(), it->second.data(), AT_SYMLINK_NOFOLLOW) !=
+                0) {
+                throw_fs_error("cannot set directory timestamps", it->first);
+            }
+        }
+    }
+
+    layer_copy_stats stats() const noexcept {
+        auto stats = stats_;
+        stats.reflinked_files = reflinked_files_;
+        return stats;
+    }
+
+private:
+    static void copy_symlink(const std::filesystem::path& from,
+                             const std::filesystem::path& to,
+                             const struct stat& st) {
+        std::string target(static_cast<std::size_t>(st.st_size) + 1, '\0');
+        auto len = ::readlink(from.c_str(), target.data(), target.size());
+        if (len == -1) {
+            throw_fs_error("cannot read symlink", from);
+        }
+        target.resize(static_cast<std::size_t>(len));
+        if (::symlink(target.c_str(), to.c_str()) != 0) {
+            throw_fs_error("cannot create symlink", to);
+        }
+    }
+
+    // Touches no state of the copier but for directories, thus is safe to call concurrently for
+    // files.
+    void copy_metadata(const std::filesystem::path& from,
+                       const std::filesystem::path& to,
+                       const struct stat& st) {
+        if (::lchown(to.c_str(), st.st_uid, st.st_gid) != 0) {
+            throw_fs_error("cannot change owner", to);
+        }
+
+        // chown clears set-user-ID and set-group-ID bits, and symlinks have no permission.
+        if (!S_ISLNK(st.st_mode) && ::chmod(to.c_str(), st.st_mode & k_perm_mask) != 0) {
+            throw_fs_error("cannot change permission", to);
+        }
+
+        // Set after chown, which drops security.capability as well.
+        copy_xattrs(from, to);
+
+        std::array<timespec, 2> times{st.st_atim, st.st_mtim};
+        if (S_ISDIR(st.st_mode)) {
+            dir_times_.emplace_back(to, times);
+        } else if (::utimensat(AT_FDCWD, to.c_str(), times.data(), AT_SYMLINK_NOFOLLOW) != 0) {
+            throw_fs_error("cannot set timestamps", to);
+        }
+    }
+
+    void copy_xattrs(const std::filesystem::path& from, const std::filesystem::path& to) {
+        auto list_len = ::llistxattr(from.c_str(), nullptr, 0);
+        if (list_len == -1) {
+            if (errno == ENOTSUP) {
+                return;
+            }
+            throw_fs_error("cannot list xattrs", from);
+        }
+
+        if (list_len == 0) {
+            return;
+        }
+
+        std::string names(static_cast<std::size_t>(list_len), '\0');
+        list_len = ::llistxattr(from.c_str(), names.data(), names.size());
+        if (list_len == -1) {
+            throw_fs_error("cannot list xattrs", from);
+        }
+        names.resize(static_cast<std::size_t>(list_len));
+
+        std::string value;
+        for (std::size_t pos = 0; pos < names.size();) {
+            std::string_view name(names.c_str() + pos);
+            pos += name.size() + 1;
+
+            if (mode_ == overlay_xattrs::to_layer && starts_with(name, k_overlay_xattr_prefix)) {
+                if (name == k_overlay_redirect_xattr || name == k_overlay_metacopy_xattr) {
+                    throw std::invalid_argument(fmt::format(
+                            "{} uses overlay {}, which can't be converted into a layer",
+                            from.native(), name.substr(k_overlay_xattr_prefix.size())));
+                }
+                if (name != k_overlay_opaque_xattr) {
+                    continue;
+                }
+            }
+
+            auto value_len = ::lgetxattr(from.c_str(), name.data(), nullptr, 0);
+            if (value_len == -1) {
+                throw_fs_error("cannot read xattr", from);
+            }
+            value.resize(static_cast<std::size_t>(value_len));
+            value_len = ::lgetxattr(from.c_str(), name.data(), value.data(), value.size());
+            if (value_len == -1) {
+                throw_fs_error("cannot read xattr", from);
+            }
+            if (::lsetxattr(to.c_str(), name.data(), value.data(),
+                            static_cast<std::size_t>(value_len), 0) != 0) {
+                throw_fs_error("cannot write xattr", to);
+            }
+        }
+    }
+
+private:
+    overlay_xattrs mode_;
+    bool link_files_;
+    base::thread_pool* pool_;
+    layer_copy_stats stats_;
+    std::atomic<std::size_t> reflinked_files_{0};
+    std::vector<std::future<void>> pending_files_;
+    // Hardlinks to files being copied, as pairs of the target and the link.
+    std::vector<std::pair<std::filesystem::path, std::filesystem::path>> deferred_links_;
+    std::map<std::pair<dev_t, ino_t>, std::filesystem::path> links_;
+    std::vector<std::pair<std::filesystem::path, std::array<timespec, 2>>> dir_times_;
+};
+
+} // namespace
+
+layer_copy_stats copy_layer_tree(const std::filesystem::path& src,
+                                 const std::filesystem::path& dst,
+                                 overlay_xattrs xattrs_mode) {
+    tree_copier copier(xattrs_mode, false);
+    copier.copy_entry(src, dst);
+    for (const auto& entry : std::filesystem::recursive_directory_iterator(src)) {
+        copier.copy_entry(entry.path(), dst / entry.path().lexically_relative(src));
+    }
+    copier.restore_dir_times();
+    return copier.stats();
+}
+
+layer_copy_stats copy_layer_tree(const std::filesystem::path& src,
+                                 const std::filesystem::path& dst,
+                                 overlay_xattrs xattrs_mode,
+                                 base::thread_pool& pool) {
+    tree_copier copier(xattrs_mode, false, &pool);
+    copier.copy_entry(src, dst);
+    for (const auto& entry : std::filesystem::recursive_directory_iterator(src)) {
+        copier.copy_entry(entry.path(), dst / entry.path().lexically_relative(src));
+    }
+    copier.wait_files();
+    copier.restore_dir_times();
+    return copier.stats();
+}
+
+layer_copy_stats squash_layer_trees(const std::vector<std::filesystem::path>& layers,
+                                    const std::filesystem::path& dst,
+                                    bool keep_whiteouts) {
+    if (layers.empty()) {
+        throw std::invalid_argument("no layer to squash");
+    }
+
+    tree_copier copier(overlay_xattrs::to_layer, true);
+    copier.copy_entry(layers.front(), dst);
+
+    // Relative paths hidden from lower layers: `<path>` for whiteouts and `<path>/` for contents
+    // of opaque directories.
+    std::set<std::string> hidden;
+    auto is_hidden = [&hidden](const std::string& rel_path) {
+        for (auto pos = rel_path.find('/'); pos != std::string::npos;
+             pos = rel_path.find('/', pos + 1)) {
+            if (hidden.count(rel_path.substr(0, pos)) != 0 ||
+                hidden.count(rel_path.substr(0, pos + 1)) != 0) {
+                return true;
+            }
+        }
+        return hidden.count(rel_path) != 0;
+    };
+
+    for (const auto& layer : layers) {
+        // Takes effect after the whole layer is merged, as what a layer hides is beneath it.
+        std::vector<std::string> hiding;
+        std::filesystem::recursive_directory_iterator it(layer);
+        for (; it != std::filesystem::recursive_directory_iterator(); ++it) {
+            const auto& from = it->path();
+            auto rel_path = from.lexically_relative(layer).native();
+            auto to = dst / rel_path;
+
+            if (is_hidden(rel_path)) {
+                it.disable_recursion_pending();
+                continue;
+            }
+
+            struct stat st {};
+            if (::lstat(from.c_str(), &st) != 0) {
+                throw_fs_error("cannot stat entry to squash", from);
+            }
+
+            struct stat upper_st {};
+            if (::lstat(to.c_str(), &upper_st) == 0) {
+                // Directories present in upper layers are merged, anything else is shadowed.
+                if (S_ISDIR(st.st_mode) && S_ISDIR(upper_st.st_mode)) {
+                    if (is_opaque_dir(from)) {
+                        hiding.push_back(rel_path + '/');
+                    }
+                } else {
+                    it.disable_recursion_pending();
+                }
+                continue;
+            }
+
+            if (is_whiteout(st)) {
+                hiding.push_back(rel_path);
+                if (keep_whiteouts) {
+                    copier.copy_entry(from, to, st);
+                }
+                continue;
+            }
+
+            if (S_ISDIR(st.st_mode) && is_opaque_dir(from)) {
+                hiding.push_back(rel_path + '/');
+            }
+
+            copier.copy_entry(from, to, st);
+        }
+
+        hidden.insert(hiding.begin(), hiding.end());
+    }
+
+    copier.restore_dir_times();
+    return copier.stats();
+}
+
+} // namespace lumper
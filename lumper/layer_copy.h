@@ -0,0 +1,74 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#pragma once
+
+#ifndef LUMPER_LAYER_COPY_H_
+#define LUMPER_LAYER_COPY_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+namespace base {
+class thread_pool;
+} // namespace base
+
+namespace lumper {
+
+enum class overlay_xattrs {
+    // Copy as is, e.g. when the copy is used as upperdir again.
+    keep,
+    // Keep only what lowerdirs understand, i.e. `trusted.overlay.opaque`; whiteouts need no
+    // translation as they are 0/0 character devices in both upperdir and layers.
+    to_layer,
+};
+
+struct layer_copy_stats {
+    std::size_t entries{0};
+    std::size_t files{0};
+    std::size_t reflinked_files{0};
+    // Files sharing inodes with their sources.
+    std::size_t hardlinked_files{0};
+    std::uint64_t file_bytes{0};
+    std::size_t whiteouts{0};
+};
+
+// Copies directory tree `src` to `dst` preserving ownership, permissions, xattrs, timestamps
+// and hardlinks; `dst` must not exist.
+// File data is shared via reflinks when possible, thus copying large trees on btrfs or XFS takes
+// time proportional to the number of files rather than their size.
+// Throws:
+//  - `std::invalid_argument` if `src` uses overlay redirect_dir or metacopy, which can't be
+//    represented in layers, in `overlay_xattrs::to_layer` mode.
+//  - `std::filesystem::filesystem_error` when failed.
+layer_copy_stats copy_layer_tree(const std::filesystem::path& src,
+                                 const std::filesystem::path& dst,
+                                 overlay_xattrs xattrs_mode);
+
+// Same as above, but files are copied concurrently on `pool`, which pays off where reflinks are
+// not supported and data is copied in full, or files are many.
+layer_copy_stats copy_layer_tree(const std::filesystem::path& src,
+                                 const std::filesystem::path& dst,
+                                 overlay_xattrs xattrs_mode,
+                                 base::thread_pool& pool);
+
+// Merges layer trees `layers`, top-most first, into a single layer `dst` as overlayfs would
+// present them: upper entries shadow lower ones, and whiteouts and opaque directories hide what
+// is beneath them. `dst` must not exist.
+// Whiteouts are dropped unless `keep_whiteouts`, which is needed if `dst` will still be stacked
+// on other layers.
+// Layers are immutable, thus files are hardlinked to their sources when possible, which takes
+// no space and preserves all metadata; otherwise they are cloned as by `copy_layer_tree()`.
+// Throws:
+//  - `std::invalid_argument` if any layer uses overlay redirect_dir or metacopy.
+//  - `std::filesystem::filesystem_error` when failed.
+layer_copy_stats squash_layer_trees(const std::vector<std::filesystem::path>& layers,
+                                    const std::filesystem::path& dst,
+                                    bool keep_whiteouts);
+
+} // namespace lumper
+
+#endif // LUMPER_LAYER_COPY_H_
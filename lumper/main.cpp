@@ -12,6 +12,7 @@
 
 #include "lumper/cli.h"
 #include "lumper/commands.h"
+#include "lumper/state_file.h"
 
 void initialize_logger() {
     try {
@@ -29,6 +30,7 @@ int main(int argc, const char* argv[]) {
 
     try {
         lumper::cli::init(argc, argv);
+        lumper::set_state_durability(lumper::cli::for_current_process().state_durability_policy());
         lumper::cli::for_current_process().process_command([](auto cmd) {
             lumper::process(cmd);
         });
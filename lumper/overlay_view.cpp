@@ -0,0 +1,88 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "lumper/overlay_view.h"
+
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+#include <sched.h>
+#include <stdlib.h>
+#include <sys/mount.h>
+
+#include "esl/scope_guard.h"
+#include "esl/strings.h"
+#include "fmt/format.h"
+#include "spdlog/spdlog.h"
+
+namespace lumper {
+
+void enter_private_mount_namespace() {
+    if (::unshare(CLONE_NEWNS) != 0) {
+        throw std::system_error(errno, std::system_category(), "failed to unshare mount ns");
+    }
+
+    if (::mount(nullptr, "/", nullptr, MS_PRIVATE | MS_REC, nullptr) != 0) {
+        throw std::system_error(errno, std::system_category(), "failed to make / private");
+    }
+}
+
+std::string join_overlay_lowerdirs(const std::vector<std::filesystem::path>& lowerdirs) {
+    for (const auto& dir : lowerdirs) {
+        if (dir.native().find_first_of(":,") != std::string::npos) {
+            throw std::invalid_argument(
+                    fmt::format("lowerdir cannot contain ':' or ','; path={}", dir.native()));
+        }
+    }
+
+    return esl::strings::join(lowerdirs, ":", [](const auto& dir, std::string& ap) {
+        ap.append(dir.native());
+    });
+}
+
+readonly_overlay::readonly_overlay(const std::vector<std::filesystem::path>& lowerdirs) {
+    std::string dir_tmpl = std::filesystem::temp_directory_path() / "lumper-overlay.XXXXXX";
+    if (!::mkdtemp(dir_tmpl.data())) {
+        throw std::system_error(errno, std::system_category(), "failed to create overlay dir");
+    }
+
+    work_dir_ = dir_tmpl;
+    ESL_ON_SCOPE_FAIL {
+        std::error_code ec;
+        std::filesystem::remove_all(work_dir_, ec);
+    };
+
+    mountpoint_ = work_dir_ / "merged";
+    std::filesystem::create_directory(mountpoint_);
+
+    auto mount_data = fmt::format("lowerdir={}", join_overlay_lowerdirs(lowerdirs));
+    // Overlay needs at least 2 lowerdirs without upperdir.
+    if (lowerdirs.size() == 1) {
+        auto empty_dir = work_dir_ / "empty";
+        std::filesystem::create_directory(empty_dir);
+        mount_data.append(":").append(empty_dir.native());
+    }
+
+    if (::mount("overlay", mountpoint_.c_str(), "overlay", MS_RDONLY, mount_data.c_str()) != 0) {
+        throw std::system_error(errno, std::system_category(),
+                                fmt::format("failed to mount overlay; data={}", mount_data));
+    }
+
+    SPDLOG_INFO("Mounted read-only overlay; mountpoint={} mount_data={}",
+                mountpoint_.native(), mount_data);
+}
+
+readonly_overlay::~readonly_overlay() {
+    if (::umount2(mountpoint_.c_str(), MNT_DETACH) != 0) {
+        SPDLOG_WARN("Failed to unmount read-only overlay; mountpoint={} errno={}",
+                    mountpoint_.native(), errno);
+        return;
+    }
+
+    std::error_code ec;
+    std::filesystem::remove_all(work_dir_, ec);
+}
+
+} // namespace lumper
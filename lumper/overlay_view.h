@@ -0,0 +1,57 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#pragma once
+
+#ifndef LUMPER_OVERLAY_VIEW_H_
+#define LUMPER_OVERLAY_VIEW_H_
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace lumper {
+
+// Moves the process into a new mount namespace with all mounts private, thus mounts made
+// afterwards are invisible to others and go away with the process even if it crashes.
+// Throws `std::system_error` when failed.
+void enter_private_mount_namespace();
+
+// Joins `lowerdirs`, top-most first, as the value of `lowerdir=` in overlay mount data.
+// Throws `std::invalid_argument` if a path has ':' or ',', which separate lowerdirs and options.
+std::string join_overlay_lowerdirs(const std::vector<std::filesystem::path>& lowerdirs);
+
+// A read-only overlay of directory trees, e.g. to look at a container's filesystem from the
+// host without copying anything.
+// Overlay without upperdir is read-only, and whiteouts and opaque directories in lowerdirs still
+// apply.
+class readonly_overlay {
+public:
+    // `lowerdirs` are top-most first.
+    // Throws `std::system_error` or `std::filesystem::filesystem_error` when failed.
+    explicit readonly_overlay(const std::vector<std::filesystem::path>& lowerdirs);
+
+    ~readonly_overlay();
+
+    readonly_overlay(const readonly_overlay&) = delete;
+
+    readonly_overlay(readonly_overlay&&) = delete;
+
+    readonly_overlay& operator=(const readonly_overlay&) = delete;
+
+    readonly_overlay& operator=(readonly_overlay&&) = delete;
+
+    const std::filesystem::path& path() const noexcept {
+        return mountpoint_;
+    }
+
+private:
+    // Holds the mountpoint and an empty lowerdir padding single-layer overlays.
+    std::filesystem::path work_dir_;
+    std::filesystem::path mountpoint_;
+};
+
+} // namespace lumper
+
+#endif // LUMPER_OVERLAY_VIEW_H_
@@ -10,7 +10,28 @@
 namespace lumper {
 
 inline constexpr char k_images_dir[] = "/var/lib/lumper/images";
+inline constexpr char k_manifests_dir[] = "/var/lib/lumper/manifests";
+inline constexpr char k_layers_dir[] = "/var/lib/lumper/layers";
+inline constexpr char k_blobs_dir[] = "/var/lib/lumper/blobs";
+inline constexpr char k_image_mounts_dir[] = "/var/lib/lumper/image_mounts";
+inline constexpr char k_image_pins_dir[] = "/var/lib/lumper/image_pins";
+inline constexpr char k_image_store_lock_file[] = "/var/lib/lumper/image_store.lock";
+inline constexpr char k_trash_dir[] = "/var/lib/lumper/trash";
 inline constexpr char k_container_dir[] = "/var/lib/lumper/containers";
+inline constexpr char k_container_trash_dir[] = "/var/lib/lumper/container_trash";
+inline constexpr char k_state_index_file[] = "/var/lib/lumper/containers.index";
+inline constexpr char k_state_index_lock_file[] = "/var/lib/lumper/containers.index.lock";
+// Marks of containers being changed, see `state_index_intent`.
+inline constexpr char k_state_index_intent_dir[] = "/var/lib/lumper/containers.index.intents";
+// Serializes handing out cpusets by `lumper run`.
+inline constexpr char k_cpuset_lock_file[] = "/var/lib/lumper/cpuset.lock";
+// Ring of container lifecycle events, see `event_journal`.
+inline constexpr char k_event_journal_file[] = "/var/lib/lumper/events.journal";
+// Lives in tmpfs, thus is reset on reboot.
+inline constexpr char k_state_sync_file[] = "/run/lumper/state.sync";
+// Container info in the binary record format, see `container_record_view`.
+inline constexpr char k_record_filename[] = "config.rec";
+// Container info in json, written by older versions, which is converted once saved again.
 inline constexpr char k_info_filename[] = "config.json";
 inline constexpr char k_container_log_filename[] = "container.log";
 
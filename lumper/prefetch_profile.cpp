@@ -0,0 +1,367 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "lumper/prefetch_profile.h"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <charconv>
+#include <cstdint>
+#include <set>
+#include <system_error>
+#include <utility>
+
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <sys/fanotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "esl/scope_guard.h"
+#include "esl/strings.h"
+#include "fmt/format.h"
+#include "spdlog/spdlog.h"
+
+#include "base/file_util.h"
+#include "base/sha256.h"
+#include "base/thread_pool.h"
+#include "lumper/path_constants.h"
+
+namespace lumper {
+namespace {
+
+constexpr std::string_view k_profile_ext = ".prefetch";
+constexpr std::string_view k_profile_header = "lumper-prefetch-profile v1";
+constexpr std::string_view k_fingerprint_key = "fingerprint ";
+
+// Keeps a profile from growing without bound, e.g. when the container scans the whole image.
+constexpr std::size_t k_max_profile_files = 8192;
+
+[[noreturn]] void throw_fs_error(const char* what, const std::filesystem::path& path) {
+    throw std::filesystem::filesystem_error(what, path,
+                                            std::error_code(errno, std::system_category()));
+}
+
+template<typename T>
+bool parse_number(std::string_view str, T& value) {
+    auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), value);
+    return ec == std::errc{} && ptr == str.data() + str.size();
+}
+
+// Returns `std::nullopt` if the content is malformed.
+std::optional<prefetch_profile> parse_profile(std::string_view content) {
+    auto lines = esl::strings::split(content, '\n', esl::strings::skip_empty{})
+                         .to<std::vector<std::string_view>>();
+    if (lines.size() < 2 || lines[0] != k_profile_header ||
+        lines[1].substr(0, k_fingerprint_key.size()) != k_fingerprint_key) {
+        return std::nullopt;
+    }
+
+    prefetch_profile profile;
+    profile.fingerprint = std::string(lines[1].substr(k_fingerprint_key.size()));
+    for (std::size_t i = 2; i < lines.size(); ++i) {
+        // <offset> <length> <path>, and the path may contain spaces.
+        auto line = lines[i];
+        auto first = line.find(' ');
+        auto second = first == std::string_view::npos ? first : line.find(' ', first + 1);
+        if (second == std::string_view::npos) {
+            return std::nullopt;
+        }
+
+        prefetch_range range;
+        if (!parse_number(line.substr(0, first), range.offset) ||
+            !parse_number(line.substr(first + 1, second - first - 1), range.length)) {
+            return std::nullopt;
+        }
+        range.path = std::string(line.substr(second + 1));
+        profile.ranges.push_back(std::move(range));
+    }
+
+    return profile;
+}
+
+// Returns ranges of pages of the file resident in page cache.
+std::vector<std::pair<off_t, off_t>> resident_ranges(int fd, off_t size) {
+    std::vector<std::pair<off_t, off_t>> ranges;
+    if (size == 0) {
+        return ranges;
+    }
+
+    auto len = static_cast<std::size_t>(size);
+    void* addr = ::mmap(nullptr, len, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        return ranges;
+    }
+    ESL_ON_SCOPE_EXIT {
+        ::munmap(addr, len);
+    };
+
+    auto page_size = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    std::vector<unsigned char> pages((len + page_size - 1) / page_size);
+    if (::mincore(addr, len, pages.data()) != 0) {
+        return ranges;
+    }
+
+    for (std::size_t i = 0; i < pages.size();) {
+        if ((pages[i] & 1) == 0) {
+            ++i;
+            continue;
+        }
+        auto begin = i;
+        while (i < pages.size() && (pages[i] & 1) != 0) {
+            ++i;
+        }
+        auto offset = static_cast<off_t>(begin * page_size);
+        ranges.emplace_back(offset, std::min<off_t>(static_cast<off_t>((i - begin) * page_size),
+                                                    size - offset));
+    }
+
+    return ranges;
+}
+
+// O_NOATIME is only permitted to owners of files, and is dropped otherwise.
+esl::unique_fd open_noatime(const std::string& path) {
+    esl::unique_fd fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NOATIME));
+    if (!fd && errno == EPERM) {
+        fd.reset(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    }
+    return fd;
+}
+
+void prefetch_file(const std::string& path, const std::vector<std::pair<off_t, off_t>>& ranges) {
+    auto fd = open_noatime(path);
+    if (!fd) {
+        // The file may be gone with the image changed since fingerprinted; not worth failing.
+        return;
+    }
+
+    for (auto [offset, length] : ranges) {
+        // readahead(2) is not supported by every filesystem, e.g. FUSE before 5.x.
+        if (::readahead(fd.get(), offset, static_cast<std::size_t>(length)) != 0) {
+            ::posix_fadvise(fd.get(), offset, length, POSIX_FADV_WILLNEED);
+        }
+    }
+}
+
+} // namespace
+
+std::filesystem::path get_prefetch_profile_path(std::string_view image_name) {
+    std::filesystem::path path(k_images_dir);
+    path /= image_name;
+    path += k_profile_ext;
+    return path;
+}
+
+std::string fingerprint_lowerdirs(const std::vector<std::filesystem::path>& lowerdirs) {
+    base::sha256 hasher;
+    for (const auto& dir : lowerdirs) {
+        struct stat st {};
+        if (::stat(dir.c_str(), &st) != 0) {
+            throw_fs_error("cannot stat lowerdir", dir);
+        }
+
+        // Device ids are left out, as the single-file image gets another one each time mounted.
+        hasher.update(dir.native());
+        hasher.update(fmt::format(":{}:{}.{}\n", st.st_ino, st.st_mtim.tv_sec,
+                                  st.st_mtim.tv_nsec));
+    }
+    return hasher.hex_finalize();
+}
+
+std::optional<prefetch_profile> load_prefetch_profile(std::string_view image_name,
+                                                      std::string_view fingerprint) {
+    auto path = get_prefetch_profile_path(image_name);
+    if (!std::filesystem::exists(path)) {
+        return std::nullopt;
+    }
+
+    auto profile = parse_profile(base::read_file_to_string(path));
+    if (profile && profile->fingerprint == fingerprint) {
+        return profile;
+    }
+
+    SPDLOG_INFO("Drop stale prefetch profile; image={} path={}", image_name, path.native());
+    std::error_code ec;
+    std::filesystem::remove(path, ec);
+    return std::nullopt;
+}
+
+void save_prefetch_profile(std::string_view image_name, const prefetch_profile& profile) {
+    std::string content;
+    content.append(k_profile_header).append("\n");
+    content.append(k_fingerprint_key).append(profile.fingerprint).append("\n");
+    for (const auto& range : profile.ranges) {
+        content.append(fmt::format("{} {} {}\n", range.offset, range.length, range.path));
+    }
+
+    std::filesystem::create_directories(k_images_dir);
+    auto path = get_prefetch_profile_path(image_name);
+    auto tmp_path = path;
+    tmp_path += fmt::format(".tmp-{}", ::getpid());
+    base::write_to_file(tmp_path, content);
+    std::filesystem::rename(tmp_path, path);
+}
+
+void replay_prefetch_profile(const prefetch_profile& profile, base::thread_pool& pool) {
+    // Ranges of a file are adjacent in the profile.
+    for (auto it = profile.ranges.begin(); it != profile.ranges.end();) {
+        auto path = it->path;
+        std::vector<std::pair<off_t, off_t>> ranges;
+        for (; it != profile.ranges.end() && it->path == path; ++it) {
+            ranges.emplace_back(it->offset, it->length);
+        }
+        // Futures are dropped, nothing waits for prefetching.
+        pool.submit([path = std::move(path), ranges = std::move(ranges)] {
+            prefetch_file(path, ranges);
+        });
+    }
+}
+
+prefetch_recorder::prefetch_recorder(std::vector<std::filesystem::path> lowerdirs)
+    : lowerdirs_(std::move(lowerdirs)) {
+    fan_fd_.reset(::fanotify_init(FAN_CLASS_NOTIF | FAN_CLOEXEC | FAN_NONBLOCK,
+                                  O_RDONLY | O_LARGEFILE | O_CLOEXEC | O_NOATIME));
+    if (!fan_fd_) {
+        throw std::system_error(errno, std::system_category(), "fanotify_init() failed");
+    }
+
+    // Lowerdirs on a same filesystem share the mark.
+    for (const auto& dir : lowerdirs_) {
+        if (::fanotify_mark(fan_fd_.get(), FAN_MARK_ADD | FAN_MARK_FILESYSTEM, FAN_OPEN,
+                            AT_FDCWD, dir.c_str()) != 0) {
+            throw std::system_error(errno, std::system_category(),
+                                    "fanotify_mark() failed for " + dir.native());
+        }
+
+        struct stat st {};
+        if (::stat(dir.c_str(), &st) != 0) {
+            throw std::system_error(errno, std::system_category(),
+                                    "cannot stat lowerdir " + dir.native());
+        }
+        devices_.insert(st.st_dev);
+    }
+}
+
+std::optional<std::string> prefetch_recorder::resolve_file(int event_fd,
+                                                            const struct stat& st) const {
+    std::array<char, PATH_MAX> buf{};
+    auto link = fmt::format("/proc/self/fd/{}", event_fd);
+    auto len = ::readlink(link.c_str(), buf.data(), buf.size() - 1);
+    if (len <= 0) {
+        return std::nullopt;
+    }
+    std::string_view rel(buf.data(), static_cast<std::size_t>(len));
+
+    // Opened via overlay, the path is relative to the lowerdir; otherwise it's the host path,
+    // which matches only if the file is opened from the store directly.
+    for (const auto& dir : lowerdirs_) {
+        const auto& prefix = dir.native();
+        auto candidate = rel.substr(0, prefix.size()) == prefix ? std::string(rel)
+                                                                  : prefix + std::string(rel);
+
+        struct stat cst {};
+        if (::stat(candidate.c_str(), &cst) == 0 && cst.st_dev == st.st_dev &&
+            cst.st_ino == st.st_ino) {
+            return candidate;
+        }
+    }
+
+    return std::nullopt;
+}
+
+std::vector<prefetch_range> prefetch_recorder::record(std::chrono::milliseconds window) {
+    // Event fds are closed once handled, thus the recorder never runs out of fds however many
+    // files are opened; files are opened again by paths when collecting their ranges.
+    std::vector<std::string> files;
+    std::set<std::pair<dev_t, ino_t>> seen;
+
+    // Files of the same inode are reported once, see below.
+    auto handle_event = [this, &files, &seen](const fanotify_event_metadata& event) {
+        esl::unique_fd fd(event.fd);
+        struct stat st {};
+        if (::fstat(fd.get(), &st) != 0 || !seen.emplace(st.st_dev, st.st_ino).second) {
+            return;
+        }
+
+        // Following opens of the inode, even those of host processes, are no longer reported.
+        ::fanotify_mark(fan_fd_.get(),
+                        FAN_MARK_ADD | FAN_MARK_IGNORED_MASK | FAN_MARK_IGNORED_SURV_MODIFY,
+                        FAN_OPEN, fd.get(), nullptr);
+
+        // Files on other devices, e.g. of host processes, are not looked up.
+        if (devices_.count(st.st_dev) == 0 || !S_ISREG(st.st_mode) ||
+            files.size() == k_max_profile_files) {
+            return;
+        }
+
+        if (auto path = resolve_file(fd.get(), st); path) {
+            files.push_back(std::move(*path));
+        }
+    };
+
+    alignas(fanotify_event_metadata) std::array<char, 64 * 1024> buf{};
+    auto deadline = std::chrono::steady_clock::now() + window;
+    while (true) {
+        auto now = std::chrono::steady_clock::now();
+        if (now >= deadline) {
+            break;
+        }
+
+        auto timeout = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now);
+        pollfd pfd{fan_fd_.get(), POLLIN, 0};
+        int rv = ::poll(&pfd, 1, static_cast<int>(timeout.count()) + 1);
+        if (rv < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::system_error(errno, std::system_category(), "poll() failed");
+        }
+        if (rv == 0) {
+            continue;
+        }
+
+        auto len = ::read(fan_fd_.get(), buf.data(), buf.size());
+        if (len < 0) {
+            if (errno == EAGAIN || errno == EINTR) {
+                continue;
+            }
+            throw std::system_error(errno, std::system_category(), "read fanotify events failed");
+        }
+
+        auto* event = reinterpret_cast<const fanotify_event_metadata*>(buf.data());
+        for (; FAN_EVENT_OK(event, len); event = FAN_EVENT_NEXT(event, len)) {
+            if (event->vers != FANOTIFY_METADATA_VERSION) {
+                throw std::system_error(std::make_error_code(std::errc::protocol_not_supported),
+                                        "unexpected fanotify metadata version");
+            }
+            if ((event->mask & FAN_Q_OVERFLOW) != 0) {
+                SPDLOG_WARN("fanotify queue overflowed, prefetch profile may be incomplete");
+                continue;
+            }
+            if (event->fd != FAN_NOFD) {
+                handle_event(*event);
+            }
+        }
+    }
+
+    std::vector<prefetch_range> ranges;
+    for (const auto& path : files) {
+        // The file may be gone meanwhile, e.g. the image is removed.
+        auto fd = open_noatime(path);
+        struct stat st {};
+        if (!fd || ::fstat(fd.get(), &st) != 0) {
+            continue;
+        }
+        for (auto [offset, length] : resident_ranges(fd.get(), st.st_size)) {
+            ranges.push_back({path, offset, length});
+        }
+    }
+
+    return ranges;
+}
+
+} // namespace lumper
@@ -0,0 +1,106 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#pragma once
+
+#ifndef LUMPER_PREFETCH_PROFILE_H_
+#define LUMPER_PREFETCH_PROFILE_H_
+
+#include <chrono>
+#include <filesystem>
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "esl/unique_handle.h"
+
+namespace base {
+class thread_pool;
+} // namespace base
+
+namespace lumper {
+
+// A range of an image file read by containers when starting.
+struct prefetch_range {
+    std::string path;
+    off_t offset;
+    off_t length;
+};
+
+// Files read by a container of the image during its startup, recorded on the first run and
+// replayed into page cache on later runs.
+struct prefetch_profile {
+    // Identifies the lowerdirs recorded against; the profile is stale if they are changed.
+    std::string fingerprint;
+    // In order of first open.
+    std::vector<prefetch_range> ranges;
+};
+
+std::filesystem::path get_prefetch_profile_path(std::string_view image_name);
+
+// `lowerdirs` are top-most first.
+// Throws `std::filesystem::filesystem_error` when failed.
+std::string fingerprint_lowerdirs(const std::vector<std::filesystem::path>& lowerdirs);
+
+// Returns `std::nullopt` if the image has no profile, or it doesn't match `fingerprint`, in which
+// case it is removed.
+// Throws `std::filesystem::filesystem_error` when failed.
+std::optional<prefetch_profile> load_prefetch_profile(std::string_view image_name,
+                                                      std::string_view fingerprint);
+
+// Replaces the profile atomically.
+// Throws `std::filesystem::filesystem_error` when failed.
+void save_prefetch_profile(std::string_view image_name, const prefetch_profile& profile);
+
+// Issues readahead(2) for the ranges on `pool`, a file per task in the order of the profile,
+// and returns without waiting for them.
+void replay_prefetch_profile(const prefetch_profile& profile, base::thread_pool& pool);
+
+// Records files opened in lowerdirs with fanotify.
+// Overlayfs opens files of lowerdirs via private clones of their mounts, thus only filesystem
+// marks see the opens, and the paths reported are relative to the lowerdir; files are told apart
+// by their inodes. The marks see opens of the whole filesystems, of which events on devices other
+// than those of lowerdirs are not looked up, and each inode is handled once.
+// fanotify reports no offsets, so ranges are taken from pages of the files resident in page cache
+// at the end of recording, which include what readahead brought in.
+class prefetch_recorder {
+public:
+    // Events are queued from now on.
+    // Throws `std::system_error` if fanotify is not available, e.g. lacking CAP_SYS_ADMIN.
+    explicit prefetch_recorder(std::vector<std::filesystem::path> lowerdirs);
+
+    ~prefetch_recorder() = default;
+
+    prefetch_recorder(const prefetch_recorder&) = delete;
+
+    prefetch_recorder(prefetch_recorder&&) = default;
+
+    prefetch_recorder& operator=(const prefetch_recorder&) = delete;
+
+    prefetch_recorder& operator=(prefetch_recorder&&) = default;
+
+    // Collects opened files until `window` elapses, then returns their ranges in page cache.
+    // Throws `std::system_error` when failed.
+    std::vector<prefetch_range> record(std::chrono::milliseconds window);
+
+private:
+    // Returns the path of the file in lowerdirs, or `std::nullopt` if the file is not in any.
+    // `st` is of `event_fd`.
+    std::optional<std::string> resolve_file(int event_fd, const struct stat& st) const;
+
+private:
+    std::vector<std::filesystem::path> lowerdirs_;
+    // Devices of lowerdirs, of which opened files are looked up.
+    std::set<dev_t> devices_;
+    esl::unique_fd fan_fd_;
+};
+
+} // namespace lumper
+
+#endif // LUMPER_PREFETCH_PROFILE_H_
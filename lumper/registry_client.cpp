@@ -0,0 +1,390 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "lumper/registry_client.h"
+
+#include <algorithm>
+#include <csignal>
+#include <filesystem>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "esl/scope_guard.h"
+#include "esl/unique_handle.h"
+#include "fmt/format.h"
+#include "nlohmann/json.hpp"
+#include "spdlog/spdlog.h"
+
+#include "base/http_client.h"
+#include "base/ignore.h"
+#include "base/sha256.h"
+#include "base/subprocess.h"
+#include "lumper/image_store.h"
+#include "lumper/path_constants.h"
+
+namespace lumper {
+namespace {
+
+constexpr char k_manifest_accept[] = "application/vnd.oci.image.index.v1+json, "
+                                     "application/vnd.docker.distribution.manifest.list.v2+json, "
+                                     "application/vnd.oci.image.manifest.v1+json, "
+                                     "application/vnd.docker.distribution.manifest.v2+json";
+constexpr int k_max_fetch_attempts = 3;
+constexpr std::size_t k_feed_buf_size = 1024 * 1024;
+
+#if defined(__x86_64__)
+constexpr char k_platform_arch[] = "amd64";
+#elif defined(__aarch64__)
+constexpr char k_platform_arch[] = "arm64";
+#else
+#error "Unsupported platform architecture"
+#endif
+
+void write_all(int fd, std::string_view data, const char* what) {
+    while (!data.empty()) {
+        auto n = ::write(fd, data.data(), data.size());
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::system_error(errno, std::system_category(), what);
+        }
+        data.remove_prefix(static_cast<std::size_t>(n));
+    }
+}
+
+off_t file_size(int fd) {
+    struct stat st {};
+    if (::fstat(fd, &st) != 0) {
+        throw std::system_error(errno, std::system_category(), "failed to fstat blob");
+    }
+    return st.st_size;
+}
+
+// Calls `fn` with successive chunks of the first `length` bytes of file `fd`.
+template<typename F>
+void for_each_file_chunk(int fd, off_t length, F&& fn) {
+    std::vector<char> buf(k_feed_buf_size);
+    off_t offset = 0;
+    while (offset < length) {
+        auto want = std::min<off_t>(length - offset, static_cast<off_t>(buf.size()));
+        auto n = ::pread(fd, buf.data(), static_cast<std::size_t>(want), offset);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            throw std::system_error(n == 0 ? EIO : errno, std::system_category(),
+                                    "failed to read blob");
+        }
+        fn(std::string_view(buf.data(), static_cast<std::size_t>(n)));
+        offset += n;
+    }
+}
+
+oci_descriptor parse_descriptor(const nlohmann::json& j) {
+    oci_descriptor desc;
+    j.at("mediaType").get_to(desc.media_type);
+    j.at("digest").get_to(desc.digest);
+    j.at("size").get_to(desc.size);
+    return desc;
+}
+
+// Unpacks a layer tarball streamed into stdin of a tar process, so that decompression and
+// unpacking run concurrently with the download.
+class layer_extractor {
+public:
+    layer_extractor(const std::filesystem::path& dest, std::string_view media_type)
+        : proc_(make_argv(dest, media_type),
+                base::subprocess::options()
+                        .set_stdin(base::subprocess::use_pipe)
+                        .set_stdout(base::subprocess::use_null)
+                        .set_stderr(base::subprocess::use_null)) {}
+
+    ~layer_extractor() {
+        if (proc_.waitable()) {
+            proc_.close_stdin_pipe();
+            ::kill(proc_.pid(), SIGKILL);
+            base::ignore_unused(proc_.wait());
+        }
+    }
+
+    layer_extractor(const layer_extractor&) = delete;
+
+    layer_extractor(layer_extractor&&) = delete;
+
+    layer_extractor& operator=(const layer_extractor&) = delete;
+
+    layer_extractor& operator=(layer_extractor&&) = delete;
+
+    // Caller must ignore SIGPIPE, which is raised if tar exits prematurely.
+    void feed(std::string_view data) {
+        write_all(proc_.stdin_pipe(), data, "failed to feed layer extractor");
+    }
+
+    void finish() {
+        proc_.close_stdin_pipe();
+        auto [reason, code] = proc_.wait().cause();
+        if (reason != base::process_exit_code::reason::exited || code != 0) {
+            throw registry_error(fmt::format("failed to extract layer; tar exited with {}", code));
+        }
+    }
+
+private:
+    static std::vector<std::string> make_argv(const std::filesystem::path& dest,
+                                              std::string_view media_type) {
+        std::vector<std::string> argv{"tar",
+                                      "--extract",
+                                      "--file=-",
+                                      "--numeric-owner",
+                                      "--xattrs",
+                                      "--xattrs-include=*",
+                                      "--directory=" + dest.native()};
+        if (media_type.find("gzip") != std::string_view::npos) {
+            argv.emplace_back("--gzip");
+        } else if (media_type.find("zstd") != std::string_view::npos) {
+            argv.emplace_back("--zstd");
+        } else if (media_type.find("tar") == std::string_view::npos) {
+            throw registry_error(fmt::format("unsupported layer media type: {}", media_type));
+        }
+        return argv;
+    }
+
+private:
+    base::subprocess proc_;
+};
+
+} // namespace
+
+oci_manifest registry_client::fetch_manifest() const {
+    auto fetch = [this](std::string_view ref) {
+        auto resp = base::http_get(api_url("manifests", ref), {{"Accept", k_manifest_accept}});
+        if (!resp.ok()) {
+            throw registry_error(fmt::format("failed to fetch manifest {}; status={} body={}",
+                                             ref, resp.status, resp.body));
+        }
+        const auto* digest = resp.find_header("docker-content-digest");
+        return std::make_pair(nlohmann::json::parse(resp.body), digest ? *digest : std::string());
+    };
+
+    auto [doc, digest] = fetch(ref_.manifest_ref());
+    if (doc.contains("manifests")) {
+        const auto& entries = doc.at("manifests");
+        auto it = std::find_if(entries.begin(), entries.end(), [](const nlohmann::json& e) {
+            auto platform = e.value("platform", nlohmann::json::object());
+            return platform.value("os", "") == "linux" &&
+                   platform.value("architecture", "") == k_platform_arch;
+        });
+        if (it == entries.end()) {
+            throw registry_error(fmt::format("no manifest for linux/{} in {}",
+                                             k_platform_arch, ref_.to_string()));
+        }
+        std::tie(doc, digest) = fetch(it->at("digest").get<std::string>());
+    }
+
+    if (!doc.contains("layers")) {
+        throw registry_error(fmt::format("unsupported manifest schema for {}", ref_.to_string()));
+    }
+
+    oci_manifest manifest;
+    manifest.digest = std::move(digest);
+    manifest.config = parse_descriptor(doc.at("config"));
+    for (const auto& layer : doc.at("layers")) {
+        manifest.layers.push_back(parse_descriptor(layer));
+    }
+
+    return manifest;
+}
+
+void registry_client::fetch_layer(const oci_descriptor& layer) const {
+    for (int attempt = 1;; ++attempt) {
+        try {
+            fetch_layer_once(layer);
+            return;
+        } catch (const base::http_error& ex) {
+            if (attempt == k_max_fetch_attempts) {
+                throw;
+            }
+            SPDLOG_WARN("Failed to fetch layer, will resume; digest={} attempt={} ex={}",
+                        layer.digest, attempt, ex.what());
+        } catch (const std::system_error& ex) {
+            if (attempt == k_max_fetch_attempts) {
+                throw;
+            }
+            SPDLOG_WARN("Failed to fetch layer, will resume; digest={} attempt={} ex={}",
+                        layer.digest, attempt, ex.what());
+        }
+    }
+}
+
+void registry_client::fetch_layer_once(const oci_descriptor& layer) const {
+    auto layer_id = layer_id_from_digest(layer.digest);
+    auto blob_path = get_blob_path(layer.digest);
+    auto partial_path = blob_path;
+    partial_path += ".partial";
+    std::filesystem::create_directories(blob_path.parent_path());
+    std::filesystem::create_directories(k_layers_dir);
+
+    // Serialize with other lumper processes pulling the same layer. The lock file stays put,
+    // unlike the partial blob which is renamed once complete.
+    constexpr int perm = 0644;
+    auto lock_path = blob_path;
+    lock_path += ".lock";
+    esl::unique_fd lock_fd(::open(lock_path.c_str(), O_CREAT | O_RDWR | O_CLOEXEC, perm));
+    if (!lock_fd) {
+        throw std::filesystem::filesystem_error(
+                "cannot open blob lock", lock_path,
+                std::error_code(errno, std::system_category()));
+    }
+
+    int rv;
+    do {
+        rv = ::flock(lock_fd.get(), LOCK_EX);
+    } while (rv != 0 && errno == EINTR);
+    if (rv != 0) {
+        throw std::system_error(errno, std::system_category(), "failed to lock blob");
+    }
+
+    if (std::filesystem::exists(get_layer_path(layer_id))) {
+        SPDLOG_INFO("Layer was fetched by another process; digest={}", layer.digest);
+        return;
+    }
+
+    esl::unique_fd blob_fd(::open(partial_path.c_str(), O_CREAT | O_RDWR | O_CLOEXEC, perm));
+    if (!blob_fd) {
+        throw std::filesystem::filesystem_error(
+                "cannot open partial blob", partial_path,
+                std::error_code(errno, std::system_category()));
+    }
+
+    auto extract_dir = get_layer_path(layer_id);
+    extract_dir += fmt::format(".extracting-{}", ::getpid());
+    std::filesystem::remove_all(extract_dir);
+    std::filesystem::create_directory(extract_dir);
+    ESL_ON_SCOPE_FAIL {
+        std::error_code ec;
+        std::filesystem::remove_all(extract_dir, ec);
+    };
+
+    layer_extractor extractor(extract_dir, layer.media_type);
+
+    // The blob is verified while being extracted, so a corrupted one never gets committed.
+    base::sha256 hasher;
+    auto consume = [&hasher, &extractor](std::string_view chunk) {
+        hasher.update(chunk);
+        extractor.feed(chunk);
+    };
+
+    if (std::filesystem::exists(blob_path)) {
+        esl::unique_fd fd(::open(blob_path.c_str(), O_RDONLY | O_CLOEXEC));
+        if (!fd) {
+            throw std::filesystem::filesystem_error(
+                    "cannot open blob", blob_path,
+                    std::error_code(errno, std::system_category()));
+        }
+        for_each_file_chunk(fd.get(), file_size(fd.get()), consume);
+        if (auto digest = hasher.hex_finalize(); digest != layer_id) {
+            std::filesystem::remove(blob_path);
+            throw registry_error(fmt::format("stored blob is corrupted; digest={} actual={}",
+                                             layer.digest, digest));
+        }
+    } else {
+        auto offset = file_size(blob_fd.get());
+        auto expected = static_cast<off_t>(layer.size);
+        if (offset > expected) {
+            offset = 0;
+            if (::ftruncate(blob_fd.get(), 0) != 0) {
+                throw std::system_error(errno, std::system_category(), "failed to truncate blob");
+            }
+        }
+
+        bool body_started = false;
+        auto resume_partial = [&] {
+            for_each_file_chunk(blob_fd.get(), offset, consume);
+            ::lseek(blob_fd.get(), offset, SEEK_SET);
+        };
+
+        if (offset < expected) {
+            base::http_headers headers;
+            if (offset > 0) {
+                headers.emplace_back("Range", fmt::format("bytes={}-", offset));
+                SPDLOG_INFO("Resume layer download; digest={} offset={}", layer.digest, offset);
+            }
+
+            auto resp = base::http_get(
+                    api_url("blobs", layer.digest), headers,
+                    [&](const base::http_response& head, std::string_view chunk) {
+                        if (!body_started) {
+                            body_started = true;
+                            // 200 means the registry ignored our range request.
+                            if (head.status != 206) {
+                                offset = 0;
+                                if (::ftruncate(blob_fd.get(), 0) != 0) {
+                                    throw std::system_error(errno, std::system_category(),
+                                                            "failed to truncate blob");
+                                }
+                            }
+                            resume_partial();
+                        }
+                        write_all(blob_fd.get(), chunk, "failed to write blob");
+                        consume(chunk);
+                    });
+            if (!resp.ok()) {
+                throw registry_error(fmt::format("failed to fetch blob {}; status={} body={}",
+                                                 layer.digest, resp.status, resp.body));
+            }
+        }
+
+        if (!body_started) {
+            resume_partial();
+        }
+
+        if (auto size = file_size(blob_fd.get()); size != expected) {
+            throw registry_error(fmt::format("blob size mismatch; digest={} expected={} actual={}",
+                                             layer.digest, expected, size));
+        }
+
+        if (auto digest = hasher.hex_finalize(); digest != layer_id) {
+            // Start over next time, as we can't tell which part is broken.
+            if (::ftruncate(blob_fd.get(), 0) != 0) {
+                SPDLOG_WARN("Failed to discard corrupted blob; digest={} errno={}",
+                            layer.digest, errno);
+            }
+            throw registry_error(fmt::format("blob digest mismatch; digest={} actual={}",
+                                             layer.digest, digest));
+        }
+
+        std::filesystem::rename(partial_path, blob_path);
+    }
+
+    extractor.finish();
+    convert_oci_whiteouts(extract_dir);
+
+    std::error_code ec;
+    std::filesystem::rename(extract_dir, get_layer_path(layer_id), ec);
+    if ((ec == std::errc::directory_not_empty || ec == std::errc::file_exists) &&
+        std::filesystem::exists(get_layer_path(layer_id))) {
+        // Committed by a pull which didn't take the lock, e.g. of an older lumper; the layer
+        // content is the same as ours, as verified by digest.
+        SPDLOG_INFO("Layer was fetched by another process; digest={}", layer.digest);
+        std::filesystem::remove_all(extract_dir, ec);
+        return;
+    }
+    if (ec) {
+        throw std::filesystem::filesystem_error("cannot commit extracted layer",
+                                                extract_dir, get_layer_path(layer_id), ec);
+    }
+
+    SPDLOG_INFO("Layer fetched; digest={} size={}", layer.digest, layer.size);
+}
+
+std::string registry_client::api_url(std::string_view kind, std::string_view ref) const {
+    return fmt::format("http://{}/v2/{}/{}/{}", ref_.registry, ref_.repository, kind, ref);
+}
+
+} // namespace lumper
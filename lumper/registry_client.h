@@ -0,0 +1,71 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#pragma once
+
+#ifndef LUMPER_REGISTRY_CLIENT_H_
+#define LUMPER_REGISTRY_CLIENT_H_
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "lumper/image_reference.h"
+
+namespace lumper {
+
+class registry_error : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+struct oci_descriptor {
+    std::string media_type;
+    std::string digest;
+    std::uint64_t size{0};
+};
+
+struct oci_manifest {
+    // Digest of the manifest itself, as reported by the registry.
+    std::string digest;
+    oci_descriptor config;
+    // Bottom-most first.
+    std::vector<oci_descriptor> layers;
+};
+
+// Talks the OCI distribution API to a plain-http registry anonymously.
+class registry_client {
+public:
+    explicit registry_client(image_reference ref)
+        : ref_(std::move(ref)) {}
+
+    // Resolves a manifest list/index to the manifest of current platform if necessary.
+    // Throws:
+    //  - `registry_error` for unexpected registry responses.
+    //  - `std::system_error` or `base::http_error` for transport failures.
+    oci_manifest fetch_manifest() const;
+
+    // Downloads the layer blob into the content store and extracts it into the layer store.
+    // Download resumes from previous partial blob by range requests, and the blob is
+    // decompressed and unpacked while downloading rather than after landing on disk.
+    // Safe to be called concurrently for different layers.
+    // Throws:
+    //  - `registry_error` for unexpected registry responses or failed extraction.
+    //  - `std::system_error` or `base::http_error` for transport failures.
+    //  - `std::filesystem::filesystem_error` for local storage failures.
+    void fetch_layer(const oci_descriptor& layer) const;
+
+private:
+    void fetch_layer_once(const oci_descriptor& layer) const;
+
+    std::string api_url(std::string_view kind, std::string_view ref) const;
+
+private:
+    image_reference ref_;
+};
+
+} // namespace lumper
+
+#endif // LUMPER_REGISTRY_CLIENT_H_
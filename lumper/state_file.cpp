@@ -0,0 +1,259 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "lumper/state_file.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "esl/scope_guard.h"
+#include "esl/unique_handle.h"
+#include "fmt/format.h"
+
+#include "base/file_util.h"
+#include "lumper/path_constants.h"
+
+namespace lumper {
+namespace {
+
+// NOLINTNEXTLINE(cppcoreguidelines-avoid-non-const-global-variables)
+std::atomic<state_durability> current_durability{state_durability::sync};
+
+[[noreturn]] void throw_fs_error(const char* what, const std::filesystem::path& path) {
+    throw std::filesystem::filesystem_error(what, path,
+                                            std::error_code(errno, std::system_category()));
+}
+
+// Shared by all lumper processes via a mapped file, which lives in tmpfs thus is reset on reboot.
+struct sync_counters {
+    // Tickets taken by writers whose files are ready to be synced.
+    std::atomic<std::uint64_t> requested;
+    // Tickets covered by the last completed sync.
+    std::atomic<std::uint64_t> synced;
+};
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free);
+
+class sync_group {
+public:
+    sync_group() {
+        std::filesystem::path path(k_state_sync_file);
+        std::filesystem::create_directories(path.parent_path());
+        constexpr int perm = 0644;
+        fd_.reset(::open(path.c_str(), O_CREAT | O_RDWR | O_CLOEXEC, perm));
+        if (!fd_) {
+            throw_fs_error("cannot open state sync file", path);
+        }
+
+        // Extends a new file with zeros, and is no-op otherwise.
+        if (::ftruncate(fd_.get(), sizeof(sync_counters)) != 0) {
+            throw_fs_error("cannot resize state sync file", path);
+        }
+
+        void* addr = ::mmap(nullptr, sizeof(sync_counters), PROT_READ | PROT_WRITE, MAP_SHARED,
+                            fd_.get(), 0);
+        if (addr == MAP_FAILED) {
+            throw_fs_error("cannot map state sync file", path);
+        }
+        counters_ = static_cast<sync_counters*>(addr);
+    }
+
+    ~sync_group() {
+        ::munmap(counters_, sizeof(sync_counters));
+    }
+
+    sync_group(const sync_group&) = delete;
+
+    sync_group& operator=(const sync_group&) = delete;
+
+    // Returns once a filesystem sync started after the call has completed, which is either made
+    // by the caller, or by another writer while the caller waits for its turn.
+    void sync(int dirfd, const std::filesystem::path& dir) {
+        auto ticket = counters_->requested.fetch_add(1) + 1;
+
+        int rv;
+        do {
+            rv = ::flock(fd_.get(), LOCK_EX);
+        } while (rv != 0 && errno == EINTR);
+        if (rv != 0) {
+            throw_fs_error("cannot lock state sync file", k_state_sync_file);
+        }
+        ESL_ON_SCOPE_EXIT {
+            ::flock(fd_.get(), LOCK_UN);
+        };
+
+        if (counters_->synced.load() >= ticket) {
+            return;
+        }
+
+        // Files of tickets taken so far are all written.
+        auto target = counters_->requested.load();
+        if (dirfd == AT_FDCWD) {
+            base::sync_filesystem(dir);
+        } else if (::syncfs(dirfd) != 0) {
+            throw_fs_error("cannot sync filesystem", dir);
+        }
+        counters_->synced.store(target);
+    }
+
+private:
+    esl::unique_fd fd_;
+    sync_counters* counters_{nullptr};
+};
+
+sync_group& get_sync_group() {
+    static sync_group group;
+    return group;
+}
+
+std::filesystem::path make_temp_path(const std::filesystem::path& path) {
+    static std::atomic<std::uint32_t> seq{0};
+    auto tmp_path = path;
+    tmp_path += fmt::format(".tmp-{}-{}", ::getpid(), seq.fetch_add(1));
+    return tmp_path;
+}
+
+void write_temp_file(int dirfd,
+                     const std::filesystem::path& tmp_path,
+                     std::string_view data,
+                     bool sync) {
+    constexpr int perm = 0644;
+    esl::unique_fd fd(::openat(dirfd, tmp_path.c_str(), O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC,
+                               perm));
+    if (!fd) {
+        throw_fs_error("cannot create state file", tmp_path);
+    }
+
+    while (!data.empty()) {
+        auto n = ::write(fd.get(), data.data(), data.size());
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n == -1) {
+            throw_fs_error("cannot write state file", tmp_path);
+        }
+        data.remove_prefix(static_cast<std::size_t>(n));
+    }
+
+    if (sync && ::fdatasync(fd.get()) != 0) {
+        throw_fs_error("cannot sync state file", tmp_path);
+    }
+}
+
+void fsync_dir(int dirfd, const std::filesystem::path& dir) {
+    if (dir.empty()) {
+        if (::fsync(dirfd) != 0) {
+            throw_fs_error("cannot sync directory", ".");
+        }
+        return;
+    }
+
+    esl::unique_fd fd(::openat(dirfd, dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    if (!fd || ::fsync(fd.get()) != 0) {
+        throw_fs_error("cannot sync directory", dir);
+    }
+}
+
+} // namespace
+
+state_durability parse_state_durability(std::string_view name) {
+    if (name == "none") {
+        return state_durability::none;
+    }
+    if (name == "sync") {
+        return state_durability::sync;
+    }
+    if (name == "batch") {
+        return state_durability::batch;
+    }
+    throw std::invalid_argument(fmt::format("unknown state durability: {}", name));
+}
+
+void set_state_durability(state_durability durability) noexcept {
+    current_durability.store(durability);
+}
+
+state_durability get_state_durability() noexcept {
+    return current_durability.load();
+}
+
+void write_state_files(const std::vector<state_file_write>& writes) {
+    if (writes.empty()) {
+        return;
+    }
+
+    auto durability = get_state_durability();
+    std::vector<std::filesystem::path> tmp_paths;
+    tmp_paths.reserve(writes.size());
+    ESL_ON_SCOPE_FAIL {
+        for (std::size_t i = 0; i < tmp_paths.size(); ++i) {
+            ::unlinkat(writes[i].dirfd, tmp_paths[i].c_str(), 0);
+        }
+    };
+
+    for (const auto& write : writes) {
+        tmp_paths.push_back(make_temp_path(write.path));
+        write_temp_file(write.dirfd, tmp_paths.back(), write.data,
+                        durability == state_durability::sync);
+    }
+
+    // Contents must reach the disk before renames do, or a power loss may leave empty files.
+    if (durability == state_durability::batch) {
+        const auto& front = writes.front();
+        get_sync_group().sync(front.dirfd, front.path.parent_path());
+    }
+
+    for (std::size_t i = 0; i < writes.size(); ++i) {
+        if (::renameat(writes[i].dirfd, tmp_paths[i].c_str(), writes[i].dirfd,
+                       writes[i].path.c_str()) != 0) {
+            throw std::filesystem::filesystem_error(
+                    "cannot replace state file", tmp_paths[i], writes[i].path,
+                    std::error_code(errno, std::system_category()));
+        }
+    }
+    tmp_paths.clear();
+
+    if (durability == state_durability::sync) {
+        for (const auto& write : writes) {
+            fsync_dir(write.dirfd, write.path.parent_path());
+        }
+    }
+}
+
+void write_state_file(const std::filesystem::path& path, std::string_view data) {
+    write_state_files({{path, std::string(data)}});
+}
+
+void sync_appended_state(int fd, const std::filesystem::path& path) {
+    switch (get_state_durability()) {
+    case state_durability::sync:
+        if (::fdatasync(fd) != 0) {
+            throw_fs_error("cannot sync state file", path);
+        }
+        break;
+    case state_durability::batch:
+        // Appended data is not covered by the sync made before replacing files, which it
+        // usually follows.
+        get_sync_group().sync(fd, path);
+        break;
+    case state_durability::none:
+        break;
+    }
+}
+
+void sync_state_dir(const std::filesystem::path& dir) {
+    if (get_state_durability() == state_durability::sync) {
+        fsync_dir(AT_FDCWD, dir);
+    }
+}
+
+} // namespace lumper
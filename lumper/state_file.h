@@ -0,0 +1,67 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#pragma once
+
+#ifndef LUMPER_STATE_FILE_H_
+#define LUMPER_STATE_FILE_H_
+
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>
+
+namespace lumper {
+
+// How container state is flushed to disk. Files are replaced atomically under all policies, thus
+// a crash leaves either the old or the new content; policies differ in what a power loss may
+// revert.
+enum class state_durability {
+    // Nothing is flushed; recent changes may be lost on power loss.
+    none,
+    // Each write is flushed before return, at the cost of a couple of syncs each.
+    sync,
+    // Concurrent writers, of all lumper processes, share a single filesystem sync before their
+    // files are replaced; thus no file is torn on power loss, while the latest replacements may
+    // be reverted.
+    batch,
+};
+
+// Throws `std::invalid_argument` if `name` is not one of "none", "sync" and "batch".
+state_durability parse_state_durability(std::string_view name);
+
+// Applies to the whole process; defaults to `state_durability::sync`.
+void set_state_durability(state_durability durability) noexcept;
+
+state_durability get_state_durability() noexcept;
+
+struct state_file_write {
+    // Relative to `dirfd` if not absolute.
+    std::filesystem::path path;
+    std::string data;
+    int dirfd{AT_FDCWD};
+};
+
+// Replaces each file with a temp file written besides, as per the durability policy; all of them
+// are synced together.
+// Throws `std::filesystem::filesystem_error` when failed.
+void write_state_files(const std::vector<state_file_write>& writes);
+
+// Throws `std::filesystem::filesystem_error` when failed.
+void write_state_file(const std::filesystem::path& path, std::string_view data);
+
+// Flushes data appended to `fd` if required by the durability policy; under
+// `state_durability::batch` the flush is shared with concurrent writers, as for replaced files.
+// Throws `std::filesystem::filesystem_error` when failed.
+void sync_appended_state(int fd, const std::filesystem::path& path);
+
+// Flushes the directory, for a file renamed into it, if required by the durability policy.
+// Throws `std::filesystem::filesystem_error` when failed.
+void sync_state_dir(const std::filesystem::path& dir);
+
+} // namespace lumper
+
+#endif // LUMPER_STATE_FILE_H_
@@ -0,0 +1,819 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "lumper/state_index.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "esl/scope_guard.h"
+#include "esl/strings.h"
+#include "esl/unique_handle.h"
+#include "fmt/format.h"
+#include "fmt/ranges.h"
+#include "spdlog/spdlog.h"
+
+#include "base/crc32.h"
+#include "base/file_util.h"
+#include "lumper/container_record.h"
+#include "lumper/path_constants.h"
+#include "lumper/state_file.h"
+
+namespace lumper {
+namespace {
+
+// Indices of other versions are rebuilt.
+constexpr char k_index_magic[8] = {'L', 'M', 'P', 'I', 'D', 'X', '0', '3'};
+
+// Appended records are folded into the snapshot beyond this, which bounds the cost of listing
+// running containers.
+constexpr std::uint32_t k_max_appended_records = 1024;
+
+constexpr char k_op_put = 'P';
+constexpr char k_op_remove = 'D';
+
+struct index_header {
+    char magic[8];
+    // Records at the beginning of the snapshot, of containers running when compacted.
+    std::uint32_t running_records;
+    std::uint32_t snapshot_records;
+    // Offset of records appended after the snapshot.
+    std::uint64_t snapshot_end;
+    // Offset of the id table following snapshot records, which has offsets of the records, as
+    // `std::uint64_t`, ordered by container-id.
+    std::uint64_t id_table;
+};
+
+static_assert(sizeof(index_header) == 32);
+
+struct record_head {
+    std::uint32_t len;
+    std::uint32_t crc;
+};
+
+// Payload of a record is an op, the length of the container-id as a byte, and the container-id,
+// followed by the info as a container record for puts; ids are thus read without decoding infos.
+struct record_payload {
+    char op;
+    std::string_view id;
+    std::string_view data;
+};
+
+// Returns `std::nullopt` if the payload is malformed.
+std::optional<record_payload> parse_payload(std::string_view payload) {
+    if (payload.size() < 2) {
+        return std::nullopt;
+    }
+    auto id_len = static_cast<std::uint8_t>(payload[1]);
+    if (payload.size() < 2 + id_len) {
+        return std::nullopt;
+    }
+    return record_payload{payload[0], payload.substr(2, id_len), payload.substr(2 + id_len)};
+}
+
+// Empty unless relocated by `relocate_state_index()`.
+std::filesystem::path& relocated_index_dir() {
+    static std::filesystem::path dir;
+    return dir;
+}
+
+// Returns where `default_path`, one of files of the index, currently is.
+std::filesystem::path index_path(const char* default_path) {
+    const auto& dir = relocated_index_dir();
+    if (dir.empty()) {
+        return default_path;
+    }
+    return dir / std::filesystem::path(default_path).filename();
+}
+
+[[noreturn]] void throw_fs_error(const char* what, const std::filesystem::path& path) {
+    throw std::filesystem::filesystem_error(what, path,
+                                            std::error_code(errno, std::system_category()));
+}
+
+void write_all(int fd, std::string_view data, const std::filesystem::path& path) {
+    while (!data.empty()) {
+        auto n = ::write(fd, data.data(), data.size());
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n == -1) {
+            throw_fs_error("cannot write state index", path);
+        }
+        data.remove_prefix(static_cast<std::size_t>(n));
+    }
+}
+
+void append_record(std::string& buf, char op, std::string_view id, std::string_view data) {
+    if (id.size() > UINT8_MAX) {
+        throw std::filesystem::filesystem_error(
+                fmt::format("container-id is too long: {}", id), index_path(k_state_index_file),
+                std::make_error_code(std::errc::invalid_argument));
+    }
+    std::string payload(1, op);
+    payload.push_back(static_cast<char>(id.size()));
+    payload.append(id);
+    payload.append(data);
+    record_head head{static_cast<std::uint32_t>(payload.size()), base::crc32(payload)};
+    buf.append(reinterpret_cast<const char*>(&head), sizeof(head));
+    buf.append(payload);
+}
+
+std::string make_put_record(const container_info& info) {
+    std::string buf;
+    append_record(buf, k_op_put, info.id, encode_container_record(info));
+    return buf;
+}
+
+void apply_payload(std::string_view payload, std::map<std::string, container_info>& infos) {
+    auto record = parse_payload(payload);
+    if (!record) {
+        return;
+    }
+    if (record->op == k_op_put) {
+        auto view = container_record_view::parse(record->data);
+        if (!view) {
+            return;
+        }
+        infos.insert_or_assign(std::string(record->id), view->to_container_info());
+    } else if (record->op == k_op_remove) {
+        infos.erase(std::string(record->id));
+    }
+}
+
+// Keeps removals as `std::nullopt`.
+void apply_payload(std::string_view payload,
+                   std::map<std::string, std::optional<container_info>>& changes) {
+    auto record = parse_payload(payload);
+    if (!record) {
+        return;
+    }
+    if (record->op == k_op_put) {
+        auto view = container_record_view::parse(record->data);
+        if (!view) {
+            return;
+        }
+        changes.insert_or_assign(std::string(record->id), view->to_container_info());
+    } else if (record->op == k_op_remove) {
+        changes.insert_or_assign(std::string(record->id), std::nullopt);
+    }
+}
+
+class index_file {
+public:
+    explicit index_file(const std::filesystem::path& path) {
+        fd_.reset(::open(path.c_str(), O_RDWR | O_CLOEXEC));
+        if (!fd_) {
+            throw_fs_error("cannot open state index", path);
+        }
+
+        struct stat st {};
+        if (::fstat(fd_.get(), &st) != 0) {
+            throw_fs_error("cannot stat state index", path);
+        }
+
+        inode_ = static_cast<std::uint64_t>(st.st_ino);
+        size_ = static_cast<std::size_t>(st.st_size);
+        if (size_ < sizeof(index_header)) {
+            throw std::filesystem::filesystem_error(
+                    "state index is truncated", path,
+                    std::make_error_code(std::errc::illegal_byte_sequence));
+        }
+
+        void* addr = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd_.get(), 0);
+        if (addr == MAP_FAILED) {
+            throw_fs_error("cannot map state index", path);
+        }
+        data_ = static_cast<const char*>(addr);
+
+        std::memcpy(&header_, data_, sizeof(header_));
+        if (std::memcmp(header_.magic, k_index_magic, sizeof(k_index_magic)) != 0 ||
+            header_.snapshot_end < sizeof(index_header) || header_.snapshot_end > size_ ||
+            header_.id_table < sizeof(index_header) ||
+            header_.id_table + std::uint64_t{header_.snapshot_records} * sizeof(std::uint64_t) !=
+                    header_.snapshot_end) {
+            ::munmap(addr, size_);
+            throw std::filesystem::filesystem_error(
+                    "state index is corrupted", path,
+                    std::make_error_code(std::errc::illegal_byte_sequence));
+        }
+    }
+
+    ~index_file() {
+        ::munmap(const_cast<char*>(data_), size_);
+    }
+
+    index_file(const index_file&) = delete;
+
+    index_file& operator=(const index_file&) = delete;
+
+    int fd() const noexcept {
+        return fd_.get();
+    }
+
+    std::uint64_t inode() const noexcept {
+        return inode_;
+    }
+
+    std::size_t size() const noexcept {
+        return size_;
+    }
+
+    const index_header& header() const noexcept {
+        return header_;
+    }
+
+    // Applies at most `max_records` records from `offset` to `infos` until the end or a torn
+    // record; returns the end offset of the last good record and the number of records applied.
+    // Records are only validated if `infos` is null.
+    template<typename Map>
+    std::pair<std::size_t, std::uint32_t> apply(std::size_t offset,
+                                                std::uint32_t max_records,
+                                                Map* infos) const {
+        std::uint32_t count = 0;
+        while (count < max_records && size_ - offset >= sizeof(record_head)) {
+            record_head head{};
+            std::memcpy(&head, data_ + offset, sizeof(head));
+            if (head.len == 0 || head.len > size_ - offset - sizeof(head)) {
+                break;
+            }
+
+            std::string_view payload(data_ + offset + sizeof(head), head.len);
+            if (base::crc32(payload) != head.crc) {
+                break;
+            }
+
+            if (infos != nullptr) {
+                apply_payload(payload, *infos);
+            }
+            offset += sizeof(head) + head.len;
+            ++count;
+        }
+
+        return {offset, count};
+    }
+
+    // Calls `fn(op, id)` for each record from `offset` until the end or a torn record.
+    template<typename F>
+    void for_each_id(std::size_t offset, F&& fn) const {
+        while (size_ - offset >= sizeof(record_head)) {
+            record_head head{};
+            std::memcpy(&head, data_ + offset, sizeof(head));
+            if (head.len == 0 || head.len > size_ - offset - sizeof(head)) {
+                break;
+            }
+
+            std::string_view payload(data_ + offset + sizeof(head), head.len);
+            if (base::crc32(payload) != head.crc) {
+                break;
+            }
+
+            if (auto record = parse_payload(payload); record) {
+                fn(record->op, record->id);
+            }
+            offset += sizeof(head) + head.len;
+        }
+    }
+
+    // Appends ids of snapshot records starting with `prefix` to `ids`, in order, until `limit`
+    // ids are appended; takes a binary search over the id table.
+    void find_snapshot_ids(std::string_view prefix,
+                           std::size_t limit,
+                           std::vector<std::string>& ids) const {
+        std::size_t lo = 0;
+        std::size_t hi = header_.snapshot_records;
+        while (lo < hi) {
+            auto mid = lo + (hi - lo) / 2;
+            if (snapshot_id(mid) < prefix) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+
+        for (auto i = lo; i < header_.snapshot_records && ids.size() < limit; ++i) {
+            auto id = snapshot_id(i);
+            if (id.substr(0, prefix.size()) != prefix) {
+                break;
+            }
+            ids.emplace_back(id);
+        }
+    }
+
+private:
+    // Returns id of the `i`th snapshot record in id order.
+    std::string_view snapshot_id(std::size_t i) const {
+        std::uint64_t offset = 0;
+        std::memcpy(&offset, data_ + header_.id_table + i * sizeof(offset), sizeof(offset));
+        if (offset + sizeof(record_head) > header_.id_table) {
+            return {};
+        }
+        record_head head{};
+        std::memcpy(&head, data_ + offset, sizeof(head));
+        if (head.len > header_.id_table - offset - sizeof(head)) {
+            return {};
+        }
+        auto record = parse_payload({data_ + offset + sizeof(head), head.len});
+        return record ? record->id : std::string_view{};
+    }
+
+    esl::unique_fd fd_;
+    const char* data_{nullptr};
+    std::uint64_t inode_{0};
+    std::size_t size_{0};
+    index_header header_{};
+};
+
+// Serializes writers, and readers against writers; released when closed.
+// The index itself can't be locked, as compaction replaces it.
+esl::unique_fd lock_index(int op) {
+    constexpr int perm = 0644;
+    auto lock_path = index_path(k_state_index_lock_file);
+    std::filesystem::create_directories(lock_path.parent_path());
+    esl::unique_fd fd(::open(lock_path.c_str(), O_CREAT | O_RDWR | O_CLOEXEC, perm));
+    if (!fd) {
+        throw_fs_error("cannot open state index lock", lock_path);
+    }
+
+    int rv;
+    do {
+        rv = ::flock(fd.get(), op);
+    } while (rv != 0 && errno == EINTR);
+    if (rv != 0) {
+        throw_fs_error("cannot lock state index", lock_path);
+    }
+
+    return fd;
+}
+
+// Replaces the index with a snapshot of `infos`, running ones first.
+void write_snapshot(const std::map<std::string, container_info>& infos) {
+    index_header header{};
+    std::memcpy(header.magic, k_index_magic, sizeof(k_index_magic));
+
+    std::string records;
+    std::map<std::string_view, std::uint64_t> offsets;
+    for (int pass = 0; pass < 2; ++pass) {
+        for (const auto& [id, info] : infos) {
+            bool running = info.status == k_container_status_running;
+            if (running == (pass == 0)) {
+                offsets.emplace(id, sizeof(header) + records.size());
+                records.append(make_put_record(info));
+                ++header.snapshot_records;
+                header.running_records += running ? 1 : 0;
+            }
+        }
+    }
+    header.id_table = sizeof(header) + records.size();
+    for (const auto& [id, offset] : offsets) {
+        records.append(reinterpret_cast<const char*>(&offset), sizeof(offset));
+    }
+    header.snapshot_end = sizeof(header) + records.size();
+
+    auto path = index_path(k_state_index_file);
+    auto tmp_path = path;
+    tmp_path += fmt::format(".tmp-{}", ::getpid());
+    constexpr int perm = 0644;
+    esl::unique_fd fd(::open(tmp_path.c_str(), O_CREAT | O_TRUNC | O_WRONLY | O_CLOEXEC, perm));
+    if (!fd) {
+        throw_fs_error("cannot create state index", tmp_path);
+    }
+    ESL_ON_SCOPE_FAIL {
+        std::error_code ec;
+        std::filesystem::remove(tmp_path, ec);
+    };
+
+    write_all(fd.get(), {reinterpret_cast<const char*>(&header), sizeof(header)}, tmp_path);
+    write_all(fd.get(), records, tmp_path);
+    if (::fsync(fd.get()) != 0) {
+        throw_fs_error("cannot write state index", tmp_path);
+    }
+    std::filesystem::rename(tmp_path, path);
+    sync_state_dir(path.parent_path());
+
+    SPDLOG_INFO("Wrote state index snapshot; records={} running={}",
+                header.snapshot_records, header.running_records);
+}
+
+// Config files of containers are the source of truth; a relocated index has none.
+void rebuild_index() {
+    std::map<std::string, container_info> infos;
+    if (relocated_index_dir().empty() && std::filesystem::exists(k_container_dir)) {
+        for (const auto& entry : std::filesystem::directory_iterator(k_container_dir)) {
+            auto container_id = entry.path().filename().native();
+            if (!has_container_info(container_id)) {
+                continue;
+            }
+            try {
+                infos.emplace(container_id, load_container_info(container_id));
+            } catch (const std::exception& ex) {
+                SPDLOG_WARN("Skip container with broken info; container_id={} ex={}",
+                            container_id, ex.what());
+            }
+        }
+    }
+
+    SPDLOG_INFO("Rebuilding state index from container info files; containers={}", infos.size());
+    write_snapshot(infos);
+}
+
+// Returns false if the index is missing or of another version.
+bool is_index_usable() {
+    esl::unique_fd fd(::open(index_path(k_state_index_file).c_str(), O_RDONLY | O_CLOEXEC));
+    if (!fd) {
+        return false;
+    }
+    char magic[sizeof(k_index_magic)]{};
+    return ::pread(fd.get(), magic, sizeof(magic), 0) == static_cast<ssize_t>(sizeof(magic)) &&
+           std::memcmp(magic, k_index_magic, sizeof(magic)) == 0;
+}
+
+// Must be called with the exclusive lock held, and the index usable.
+// `records` are complete records, which are appended at once.
+void append_records(std::string_view records) {
+    auto path = index_path(k_state_index_file);
+    std::map<std::string, container_info> infos;
+    {
+        index_file index(path);
+        auto [valid_end, appended] = index.apply(
+                index.header().snapshot_end, UINT32_MAX,
+                static_cast<std::map<std::string, container_info>*>(nullptr));
+        // A record torn by a crash is dropped by compaction rather than truncated, as readers
+        // may have the index mapped.
+        if (appended < k_max_appended_records && valid_end == index.size()) {
+            if (::pwrite(index.fd(), records.data(), records.size(),
+                         static_cast<off_t>(valid_end)) != static_cast<ssize_t>(records.size())) {
+                throw_fs_error("cannot append to state index", path);
+            }
+            sync_appended_state(index.fd(), path);
+            return;
+        }
+
+        // Folds everything into a new snapshot, which takes reading the whole index.
+        // The id table lies between snapshot records and appended ones.
+        infos.clear();
+        index.apply(sizeof(index_header), index.header().snapshot_records, &infos);
+        index.apply(index.header().snapshot_end, UINT32_MAX, &infos);
+    }
+
+    while (!records.empty()) {
+        record_head head{};
+        std::memcpy(&head, records.data(), sizeof(head));
+        apply_payload(records.substr(sizeof(head), head.len), infos);
+        records.remove_prefix(sizeof(head) + head.len);
+    }
+    write_snapshot(infos);
+}
+
+// A mark of `state_index_intent` left by a writer that never committed.
+struct orphan_intent {
+    std::filesystem::path path;
+    // Holds the lock of the mark, thus no one else recovers it meanwhile.
+    esl::unique_fd fd;
+    std::vector<std::string> container_ids;
+    // False if the content is lost, e.g. by a power loss.
+    bool complete{false};
+};
+
+// Marks are renamed into place only when locked, thus a mark that can be locked is orphaned.
+// Temp files of marks, i.e. hidden ones, are orphaned too, while nothing was changed yet; they are
+// left for a while, as one just created is not locked yet.
+std::vector<orphan_intent> find_orphan_intents(bool read_ids) {
+    constexpr auto k_temp_grace = std::chrono::minutes(1);
+    std::vector<orphan_intent> orphans;
+    std::error_code ec;
+    std::filesystem::directory_iterator it(index_path(k_state_index_intent_dir), ec);
+    if (ec) {
+        return orphans;
+    }
+
+    for (const auto& entry : it) {
+        bool temp = entry.path().filename().native().front() == '.';
+        if (temp && std::filesystem::file_time_type::clock::now() -
+                                    entry.last_write_time(ec) < k_temp_grace) {
+            continue;
+        }
+
+        esl::unique_fd fd(::open(entry.path().c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC));
+        if (!fd || ::flock(fd.get(), LOCK_EX | LOCK_NB) != 0) {
+            continue;
+        }
+
+        orphan_intent orphan{entry.path(), std::move(fd), {}, true};
+        if (read_ids && !temp) {
+            try {
+                auto content = base::read_file_to_string(entry.path());
+                orphan.complete = !content.empty() && content.back() == '\n';
+                for (auto id : esl::strings::split(content, '\n', esl::strings::skip_empty{})) {
+                    orphan.container_ids.emplace_back(id);
+                }
+            } catch (const std::exception& ex) {
+                SPDLOG_WARN("Failed to read state index intent; path={} ex={}",
+                            entry.path().native(), ex.what());
+                orphan.complete = false;
+            }
+        }
+        orphans.push_back(std::move(orphan));
+    }
+    return orphans;
+}
+
+// Must be called with the exclusive lock held, and the index usable.
+void recover_orphan_intents() {
+    auto orphans = find_orphan_intents(true);
+    if (orphans.empty()) {
+        return;
+    }
+
+    bool rebuild = false;
+    std::string records;
+    for (const auto& orphan : orphans) {
+        if (!orphan.complete) {
+            rebuild = true;
+            break;
+        }
+        for (const auto& id : orphan.container_ids) {
+            std::optional<container_info> info;
+            if (relocated_index_dir().empty() && has_container_info(id)) {
+                try {
+                    info = load_container_info(id);
+                } catch (const std::exception& ex) {
+                    // Dropped, as when rebuilding.
+                    SPDLOG_WARN("Unindex container with broken info; container_id={} ex={}",
+                                id, ex.what());
+                }
+            }
+            if (info) {
+                records.append(make_put_record(*info));
+            } else {
+                append_record(records, k_op_remove, id, {});
+            }
+        }
+    }
+
+    SPDLOG_WARN("Recovering state index from interrupted changes; intents={} rebuild={}",
+                orphans.size(), rebuild);
+    if (rebuild) {
+        rebuild_index();
+    } else if (!records.empty()) {
+        append_records(records);
+    }
+
+    for (const auto& orphan : orphans) {
+        ::unlink(orphan.path.c_str());
+    }
+}
+
+// Must be called with the exclusive lock held.
+void ensure_index() {
+    if (!is_index_usable()) {
+        rebuild_index();
+    }
+    recover_orphan_intents();
+}
+
+void append_to_index(std::string_view records) {
+    ensure_index();
+    append_records(records);
+}
+
+// Readers take no lock: the index is only ever appended to, or replaced by a rename, which
+// leaves the one opened intact; and records are checksummed, thus one being appended is just not
+// seen yet.
+// The lock is only taken to rebuild the index if it's missing or of another version, or to
+// recover changes interrupted by crashes.
+void open_index_for_read(std::optional<index_file>& index) {
+    if (find_orphan_intents(false).empty()) {
+        try {
+            index.emplace(index_path(k_state_index_file));
+            return;
+        } catch (const std::filesystem::filesystem_error&) {
+            // Falls back to rebuilding.
+        }
+    }
+
+    auto lock = lock_index(LOCK_EX);
+    ensure_index();
+    index.emplace(index_path(k_state_index_file));
+}
+
+// Returns ids starting with `prefix`, at most `limit` of them.
+std::vector<std::string> find_ids(std::string_view prefix, std::size_t limit) {
+    std::optional<index_file> opened;
+    open_index_for_read(opened);
+    const auto& index = *opened;
+
+    // Appended records, bounded by compaction, override the snapshot.
+    std::map<std::string, bool, std::less<>> appended;
+    index.for_each_id(index.header().snapshot_end, [&](char op, std::string_view id) {
+        if (id.substr(0, prefix.size()) == prefix) {
+            appended.insert_or_assign(std::string(id), op == k_op_put);
+        }
+    });
+
+    // Removed ones may take places of matches.
+    std::vector<std::string> ids;
+    index.find_snapshot_ids(prefix, limit + appended.size(), ids);
+    ids.erase(std::remove_if(ids.begin(), ids.end(),
+                             [&appended](const auto& id) { return appended.count(id) != 0; }),
+              ids.end());
+    for (const auto& [id, present] : appended) {
+        if (present) {
+            ids.push_back(id);
+        }
+    }
+
+    std::sort(ids.begin(), ids.end());
+    if (ids.size() > limit) {
+        ids.resize(limit);
+    }
+    return ids;
+}
+
+} // namespace
+
+state_index_intent::state_index_intent(const std::vector<std::string>& container_ids) {
+    static std::atomic<std::uint32_t> seq{0};
+    auto stamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch());
+    auto name = fmt::format("{:x}-{}-{}", stamp.count(), ::getpid(), seq.fetch_add(1));
+    auto dir = index_path(k_state_index_intent_dir);
+    std::filesystem::create_directories(dir);
+    auto tmp_path = dir / ("." + name);
+
+    constexpr int perm = 0644;
+    fd_.reset(::open(tmp_path.c_str(), O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC, perm));
+    if (!fd_) {
+        throw_fs_error("cannot create state index intent", tmp_path);
+    }
+    ESL_ON_SCOPE_FAIL {
+        ::unlink(tmp_path.c_str());
+    };
+    if (::flock(fd_.get(), LOCK_EX) != 0) {
+        throw_fs_error("cannot lock state index intent", tmp_path);
+    }
+
+    std::string content;
+    for (const auto& id : container_ids) {
+        content.append(id).push_back('\n');
+    }
+    write_all(fd_.get(), content, tmp_path);
+
+    // Renamed when locked and complete; must reach the disk before files of the containers do.
+    path_ = dir / name;
+    std::filesystem::rename(tmp_path, path_);
+    sync_state_dir(dir);
+}
+
+state_index_intent::~state_index_intent() {
+    if (committed_) {
+        ::unlink(path_.c_str());
+    }
+}
+
+void index_container_info(const container_info& info) {
+    auto lock = lock_index(LOCK_EX);
+    append_to_index(make_put_record(info));
+}
+
+void index_container_infos(const std::vector<container_info>& infos) {
+    if (infos.empty()) {
+        return;
+    }
+
+    std::string records;
+    for (const auto& info : infos) {
+        records.append(make_put_record(info));
+    }
+    auto lock = lock_index(LOCK_EX);
+    append_to_index(records);
+}
+
+void unindex_container(std::string_view container_id) {
+    std::string record;
+    append_record(record, k_op_remove, container_id, {});
+    auto lock = lock_index(LOCK_EX);
+    append_to_index(record);
+}
+
+void unindex_containers(const std::vector<std::string>& container_ids) {
+    if (container_ids.empty()) {
+        return;
+    }
+
+    std::string records;
+    for (const auto& id : container_ids) {
+        append_record(records, k_op_remove, id, {});
+    }
+    auto lock = lock_index(LOCK_EX);
+    append_to_index(records);
+}
+
+std::vector<container_info> query_container_infos(bool running_only) {
+    std::optional<index_file> opened;
+    open_index_for_read(opened);
+    const auto& index = *opened;
+
+    std::map<std::string, container_info> infos;
+    const auto& header = index.header();
+    if (running_only) {
+        index.apply(sizeof(index_header), header.running_records, &infos);
+    } else {
+        index.apply(sizeof(index_header), header.snapshot_records, &infos);
+    }
+    index.apply(header.snapshot_end, UINT32_MAX, &infos);
+
+    std::vector<container_info> result;
+    result.reserve(infos.size());
+    for (auto& [id, info] : infos) {
+        if (!running_only || info.status == k_container_status_running) {
+            result.push_back(std::move(info));
+        }
+    }
+    return result;
+}
+
+state_index_changes read_state_index_changes(state_index_cursor& cursor) {
+    std::optional<index_file> opened;
+    open_index_for_read(opened);
+    const auto& index = *opened;
+
+    state_index_changes changes;
+    if (index.inode() != cursor.inode || cursor.offset < index.header().snapshot_end ||
+        cursor.offset > index.size()) {
+        std::map<std::string, container_info> infos;
+        index.apply(sizeof(index_header), index.header().snapshot_records, &infos);
+        auto end = index.apply(index.header().snapshot_end, UINT32_MAX, &infos).first;
+        changes.full = true;
+        changes.puts.reserve(infos.size());
+        for (auto& [id, info] : infos) {
+            changes.puts.push_back(std::move(info));
+        }
+        cursor = {index.inode(), end};
+        return changes;
+    }
+
+    std::map<std::string, std::optional<container_info>> latest;
+    auto end = index.apply(cursor.offset, UINT32_MAX, &latest).first;
+    for (auto& [id, info] : latest) {
+        if (info) {
+            changes.puts.push_back(std::move(*info));
+        } else {
+            changes.removes.push_back(id);
+        }
+    }
+    cursor.offset = end;
+    return changes;
+}
+
+std::string resolve_container_id(std::string_view prefix) {
+    if (prefix.empty()) {
+        throw std::invalid_argument("container-id must not be empty");
+    }
+
+    // Shows a few of the candidates if ambiguous.
+    constexpr std::size_t k_max_shown = 5;
+    auto ids = find_ids(prefix, k_max_shown);
+    if (ids.empty()) {
+        throw std::invalid_argument(fmt::format("no such container: {}", prefix));
+    }
+
+    // A complete id is never ambiguous.
+    if (ids.size() == 1 || ids.front() == prefix) {
+        return ids.front();
+    }
+
+    throw std::invalid_argument(fmt::format("container-id prefix {} is ambiguous: {}...",
+                                            prefix, fmt::join(ids, ", ")));
+}
+
+bool is_container_indexed(std::string_view container_id) {
+    auto ids = find_ids(container_id, 1);
+    return !ids.empty() && ids.front() == container_id;
+}
+
+std::filesystem::path relocate_state_index(const std::filesystem::path& dir) {
+    return std::exchange(relocated_index_dir(), dir);
+}
+
+} // namespace lumper
@@ -0,0 +1,116 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#pragma once
+
+#ifndef LUMPER_STATE_INDEX_H_
+#define LUMPER_STATE_INDEX_H_
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "esl/unique_handle.h"
+
+#include "lumper/container_info.h"
+
+namespace lumper {
+
+// Container records are kept in a single append-only log besides per-container config files, thus
+// listing containers needs neither a directory scan nor opening and parsing a file for each.
+// The log begins with a snapshot, records of running containers first, written by compaction once
+// enough records are appended; thus listing running containers reads only those and the records
+// appended since, no matter how many containers were ever created.
+// The snapshot ends with a table of its records ordered by container-id, which resolves id
+// prefixes with a binary search, plus a scan of the appended records.
+// Records are checksummed; a record torn by a crash is dropped along with what follows it.
+// Writers are serialized by a lock, while readers, e.g. `lumper ps`, take none.
+// The index is rebuilt from config files if it is missing, e.g. deleted to recover, or of an older
+// version; containers whose files were changed without the index being updated after, e.g. by a
+// crash in between, are re-indexed from their files, see `state_index_intent`.
+
+// Marks containers whose files are about to change, from before the change till the index is
+// updated after; the mark is locked while its writer is alive.
+// A mark left by a writer that never commits, e.g. crashed, is found by the next one opening the
+// index, and the containers are re-indexed from their files.
+class state_index_intent {
+public:
+    // Throws `std::filesystem::filesystem_error` when failed.
+    explicit state_index_intent(const std::vector<std::string>& container_ids);
+
+    ~state_index_intent();
+
+    state_index_intent(const state_index_intent&) = delete;
+
+    state_index_intent& operator=(const state_index_intent&) = delete;
+
+    // Called once the index is updated; the mark is removed on destruction, otherwise left for
+    // recovery.
+    void commit() noexcept {
+        committed_ = true;
+    }
+
+private:
+    std::filesystem::path path_;
+    esl::unique_fd fd_;
+    bool committed_{false};
+};
+
+// Throws `std::filesystem::filesystem_error` when failed.
+void index_container_info(const container_info& info);
+
+// Records all of `infos` in a single append.
+// Throws `std::filesystem::filesystem_error` when failed.
+void index_container_infos(const std::vector<container_info>& infos);
+
+// Throws `std::filesystem::filesystem_error` when failed.
+void unindex_container(std::string_view container_id);
+
+// Removes all of `container_ids` in a single append.
+// Throws `std::filesystem::filesystem_error` when failed.
+void unindex_containers(const std::vector<std::string>& container_ids);
+
+// Returns records ordered by container-id.
+// Throws `std::filesystem::filesystem_error` when failed.
+std::vector<container_info> query_container_infos(bool running_only);
+
+// Where a reader of the index has read up to, thus only records appended later are read next time.
+struct state_index_cursor {
+    // Compaction replaces the index, after which records are read from the beginning.
+    std::uint64_t inode{0};
+    std::uint64_t offset{0};
+};
+
+struct state_index_changes {
+    // True if the whole index is read, i.e. the cursor is new or the index has been replaced, in
+    // which case `puts` has records of all containers and `removes` is empty.
+    bool full{false};
+    // Only the latest record of each container is kept, ordered by container-id.
+    std::vector<container_info> puts;
+    std::vector<std::string> removes;
+};
+
+// Reads records recorded since `cursor`, and advances it.
+// Throws `std::filesystem::filesystem_error` when failed.
+state_index_changes read_state_index_changes(state_index_cursor& cursor);
+
+// Returns the id of the only container whose id starts with `prefix`, or is `prefix`.
+// Throws:
+//  - `std::invalid_argument` if no container matches, or more than one does.
+//  - `std::filesystem::filesystem_error` when failed.
+std::string resolve_container_id(std::string_view prefix);
+
+// Throws `std::filesystem::filesystem_error` when failed.
+bool is_container_indexed(std::string_view container_id);
+
+// Keeps files of the index under `dir` instead, or back at the default places if `dir` is empty;
+// returns the previous one. Applies to the whole process, and is meant for tests: a relocated
+// index is rebuilt, and recovered, without reading config files of containers.
+std::filesystem::path relocate_state_index(const std::filesystem::path& dir);
+
+} // namespace lumper
+
+#endif // LUMPER_STATE_INDEX_H_
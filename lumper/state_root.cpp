@@ -0,0 +1,236 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "lumper/state_root.h"
+
+#include <cerrno>
+#include <filesystem>
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fmt/format.h"
+
+#include "lumper/path_constants.h"
+
+namespace lumper {
+namespace {
+
+[[noreturn]] void throw_fs_error(const char* what, const std::filesystem::path& path) {
+    throw std::filesystem::filesystem_error(what, path,
+                                            std::error_code(errno, std::system_category()));
+}
+
+bool is_valid_container_id(std::string_view container_id) noexcept {
+    return !container_id.empty() && container_id != "." && container_id != ".." &&
+           container_id.find('/') == std::string_view::npos;
+}
+
+void check_container_id(std::string_view container_id) {
+    if (!is_valid_container_id(container_id)) {
+        throw std::invalid_argument(fmt::format("invalid container-id: {}", container_id));
+    }
+}
+
+esl::unique_fd open_state_dir(const char* path) {
+    std::filesystem::create_directories(path);
+    esl::unique_fd fd(::open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    if (!fd) {
+        throw_fs_error("cannot open state directory", path);
+    }
+    return fd;
+}
+
+void check_file_name(std::string_view filename) {
+    if (!is_valid_container_id(filename)) {
+        throw std::invalid_argument(fmt::format("invalid container file name: {}", filename));
+    }
+}
+
+std::filesystem::path get_container_file_path(std::string_view container_id,
+                                              std::string_view filename) {
+    auto path = std::filesystem::path(k_container_dir) / container_id;
+    if (!filename.empty()) {
+        path /= filename;
+    }
+    return path;
+}
+
+// Returns false if `name` doesn't exist.
+bool stat_at(int dirfd, const std::string& name, const std::filesystem::path& path) {
+    struct stat st {};
+    if (::fstatat(dirfd, name.c_str(), &st, AT_SYMLINK_NOFOLLOW) == 0) {
+        return true;
+    }
+    if (errno == ENOENT || errno == ENOTDIR) {
+        return false;
+    }
+    throw_fs_error("cannot stat container file", path);
+}
+
+// Returns false if `name` exists already.
+bool mkdir_at(int dirfd, const std::string& name, const std::filesystem::path& path) {
+    constexpr mode_t perm = 0755;
+    if (::mkdirat(dirfd, name.c_str(), perm) == 0) {
+        return true;
+    }
+    if (errno == EEXIST) {
+        return false;
+    }
+    throw_fs_error("cannot create container directory", path);
+}
+
+} // namespace
+
+std::filesystem::path get_fd_path(int fd) {
+    return fmt::format("/proc/self/fd/{}", fd);
+}
+
+// static
+const state_root& state_root::get() {
+    static state_root root;
+    return root;
+}
+
+state_root::state_root()
+    : containers_fd_(open_state_dir(k_container_dir)),
+      container_trash_fd_(open_state_dir(k_container_trash_dir)) {}
+
+bool state_root::has_container(std::string_view container_id) const {
+    return is_valid_container_id(container_id) &&
+           stat_at(containers_fd(), std::string(container_id),
+                   get_container_file_path(container_id, ""));
+}
+
+esl::unique_fd state_root::open_container_dir(std::string_view container_id) const {
+    check_container_id(container_id);
+    std::string name(container_id);
+    esl::unique_fd fd(::openat(containers_fd(), name.c_str(),
+                               O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC));
+    if (!fd && errno != ENOENT) {
+        throw_fs_error("cannot open container directory",
+                       get_container_file_path(container_id, ""));
+    }
+    return fd;
+}
+
+bool state_root::create_container_dir(std::string_view container_id) const {
+    check_container_id(container_id);
+    return mkdir_at(containers_fd(), std::string(container_id),
+                    get_container_file_path(container_id, ""));
+}
+
+void state_root::create_container_subdir(std::string_view container_id,
+                                         std::string_view name) const {
+    check_file_name(name);
+    auto path = get_container_file_path(container_id, name);
+    auto dir = open_container_dir(container_id);
+    if (!dir) {
+        // errno is ENOENT.
+        throw_fs_error("cannot create container directory", path);
+    }
+    mkdir_at(dir.get(), std::string(name), path);
+}
+
+bool state_root::has_container_file(std::string_view container_id,
+                                    std::string_view filename) const {
+    check_file_name(filename);
+    auto dir = open_container_dir(container_id);
+    return dir && stat_at(dir.get(), std::string(filename),
+                          get_container_file_path(container_id, filename));
+}
+
+esl::unique_fd state_root::open_container_file(std::string_view container_id,
+                                               std::string_view filename,
+                                               int flags,
+                                               mode_t mode) const {
+    check_file_name(filename);
+    auto path = get_container_file_path(container_id, filename);
+    auto dir = open_container_dir(container_id);
+    if (!dir) {
+        if ((flags & O_CREAT) != 0) {
+            throw_fs_error("cannot open container file", path);
+        }
+        return dir;
+    }
+
+    esl::unique_fd fd(::openat(dir.get(), std::string(filename).c_str(),
+                               flags | O_NOFOLLOW | O_CLOEXEC, mode));
+    if (!fd && !(errno == ENOENT && (flags & O_CREAT) == 0)) {
+        throw_fs_error("cannot open container file", path);
+    }
+    return fd;
+}
+
+bool state_root::remove_container_file(std::string_view container_id,
+                                       std::string_view filename) const {
+    check_file_name(filename);
+    auto dir = open_container_dir(container_id);
+    if (!dir) {
+        return false;
+    }
+    if (::unlinkat(dir.get(), std::string(filename).c_str(), 0) == 0) {
+        return true;
+    }
+    if (errno == ENOENT) {
+        return false;
+    }
+    throw_fs_error("cannot remove container file",
+                   get_container_file_path(container_id, filename));
+}
+
+esl::unique_fd state_root::lock_container(std::string_view container_id,
+                                          container_lock_mode mode,
+                                          bool wait) const {
+    if (!is_valid_container_id(container_id)) {
+        return {};
+    }
+
+    std::string name(container_id);
+    auto path = std::filesystem::path(k_container_dir) / name;
+    esl::unique_fd fd(::openat(containers_fd(), name.c_str(),
+                               O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC));
+    if (!fd) {
+        if (errno == ENOENT) {
+            return fd;
+        }
+        throw_fs_error("cannot open container directory", path);
+    }
+
+    int op = (mode == container_lock_mode::shared ? LOCK_SH : LOCK_EX) | (wait ? 0 : LOCK_NB);
+    int rv;
+    do {
+        rv = ::flock(fd.get(), op);
+    } while (rv != 0 && errno == EINTR);
+    if (rv != 0) {
+        if (errno == EWOULDBLOCK) {
+            return {};
+        }
+        throw_fs_error("cannot lock container", path);
+    }
+
+    // The directory may have been moved into trash while waiting, by the one holding the lock.
+    struct stat locked {};
+    struct stat current {};
+    if (::fstat(fd.get(), &locked) != 0) {
+        throw_fs_error("cannot stat container directory", path);
+    }
+    if (::fstatat(containers_fd(), name.c_str(), &current, AT_SYMLINK_NOFOLLOW) != 0) {
+        if (errno == ENOENT) {
+            return {};
+        }
+        throw_fs_error("cannot stat container directory", path);
+    }
+    if (locked.st_ino != current.st_ino || locked.st_dev != current.st_dev) {
+        return {};
+    }
+
+    return fd;
+}
+
+} // namespace lumper
@@ -0,0 +1,120 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#pragma once
+
+#ifndef LUMPER_STATE_ROOT_H_
+#define LUMPER_STATE_ROOT_H_
+
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+#include <sys/types.h>
+
+#include "esl/unique_handle.h"
+
+namespace lumper {
+
+enum class container_lock_mode {
+    // Taken by those reading the container, e.g. its upperdir.
+    shared,
+    // Taken by those changing or removing the container.
+    exclusive,
+};
+
+// Directories of containers' state, opened once per process; containers are then accessed
+// relative to them with *at() syscalls, thus paths are not resolved from the root each time,
+// and a component above, e.g. /var/lib/lumper, replaced with a symlink can't redirect accesses.
+// Neither directories of containers nor names of container files are followed if they are
+// symlinks; files are accessed relative to the directory of the container opened first.
+class state_root {
+public:
+    // Opens directories on the first call, creating missing ones.
+    // Throws `std::filesystem::filesystem_error` when failed.
+    static const state_root& get();
+
+    ~state_root() = default;
+
+    state_root(const state_root&) = delete;
+
+    state_root& operator=(const state_root&) = delete;
+
+    // The directory of `k_container_dir`.
+    int containers_fd() const noexcept {
+        return containers_fd_.get();
+    }
+
+    // The directory of `k_container_trash_dir`.
+    int container_trash_fd() const noexcept {
+        return container_trash_fd_.get();
+    }
+
+    // Returns false also if `container_id` can't be an id, e.g. contains a '/'.
+    // Throws `std::filesystem::filesystem_error` when failed.
+    bool has_container(std::string_view container_id) const;
+
+    // Returns an invalid fd if the container doesn't exist.
+    // Throws:
+    //  - `std::invalid_argument` if `container_id` can't be an id.
+    //  - `std::filesystem::filesystem_error` when failed, e.g. the directory is a symlink.
+    esl::unique_fd open_container_dir(std::string_view container_id) const;
+
+    // Returns false if the directory exists already.
+    // Throws:
+    //  - `std::invalid_argument` if `container_id` can't be an id.
+    //  - `std::filesystem::filesystem_error` when failed.
+    bool create_container_dir(std::string_view container_id) const;
+
+    // Creates `name` in the directory of the container; it's fine if it exists already.
+    // Throws:
+    //  - `std::invalid_argument` if `container_id` can't be an id.
+    //  - `std::filesystem::filesystem_error` when failed.
+    void create_container_subdir(std::string_view container_id, std::string_view name) const;
+
+    // Throws:
+    //  - `std::invalid_argument` if `container_id` can't be an id.
+    //  - `std::filesystem::filesystem_error` when failed.
+    bool has_container_file(std::string_view container_id, std::string_view filename) const;
+
+    // Returns an invalid fd if the file or the container doesn't exist and `O_CREAT` is not in
+    // `flags`; `filename` must be a single component.
+    // Throws:
+    //  - `std::invalid_argument` if `container_id` can't be an id.
+    //  - `std::filesystem::filesystem_error` when failed.
+    esl::unique_fd open_container_file(std::string_view container_id,
+                                       std::string_view filename,
+                                       int flags,
+                                       mode_t mode = 0) const;
+
+    // Returns false if the file doesn't exist.
+    // Throws:
+    //  - `std::invalid_argument` if `container_id` can't be an id.
+    //  - `std::filesystem::filesystem_error` when failed.
+    bool remove_container_file(std::string_view container_id, std::string_view filename) const;
+
+    // Locks the container, thus invocations on different containers never wait for each other.
+    // The directory of the container is locked with flock(2), which is released once the returned
+    // fd is closed, and stays with the directory when it's moved into trash.
+    // Returns an invalid fd if the container doesn't exist, or is removed while waiting; or if the
+    // container is locked in conflict and `wait` is false.
+    // Throws `std::filesystem::filesystem_error` when failed.
+    esl::unique_fd lock_container(std::string_view container_id,
+                                  container_lock_mode mode,
+                                  bool wait = true) const;
+
+private:
+    state_root();
+
+    esl::unique_fd containers_fd_;
+    esl::unique_fd container_trash_fd_;
+};
+
+// Returns the path referring to the file opened as `fd` by procfs, e.g. to pass a directory opened
+// by `state_root` to those taking paths, like mount(2); valid as long as `fd` is open.
+std::filesystem::path get_fd_path(int fd);
+
+} // namespace lumper
+
+#endif // LUMPER_STATE_ROOT_H_
@@ -0,0 +1,30 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "doctest/doctest.h"
+
+#include <string_view>
+
+#include "base/crc32.h"
+
+namespace {
+
+TEST_SUITE_BEGIN("crc32");
+
+TEST_CASE("known values") {
+    CHECK_EQ(base::crc32(""), 0u);
+    CHECK_EQ(base::crc32("123456789"), 0xcbf43926u);
+    CHECK_EQ(base::crc32("The quick brown fox jumps over the lazy dog"), 0x414fa339u);
+}
+
+TEST_CASE("incremental computation") {
+    std::string_view data = "The quick brown fox jumps over the lazy dog";
+    auto crc = base::crc32(data.substr(0, 10));
+    crc = base::crc32(data.substr(10), crc);
+    CHECK_EQ(crc, base::crc32(data));
+}
+
+TEST_SUITE_END();
+
+} // namespace
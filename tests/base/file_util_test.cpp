@@ -6,10 +6,12 @@
 
 #include <chrono>
 #include <fstream>
+#include <string>
 
 #include "fmt/format.h"
 
 #include "base/file_util.h"
+#include "base/thread_pool.h"
 
 namespace {
 
@@ -59,6 +61,55 @@ TEST_CASE("throws when reading file failed") {
     }
 }
 
+TEST_CASE("remove tree") {
+    auto ts = std::chrono::system_clock::now().time_since_epoch().count();
+    auto root = std::filesystem::path(fmt::format("/tmp/test_remove_tree_{}", ts));
+    std::filesystem::create_directories(root / "a" / "b");
+    base::write_to_file(root / "a" / "b" / "data", std::string(64 * 1024, 'x'));
+    std::filesystem::create_symlink("/tmp", root / "a" / "tmp-link");
+
+    auto outside = std::filesystem::path(fmt::format("/tmp/test_remove_tree_link_{}", ts));
+    base::write_to_file(root / "a" / "shared", std::string(64 * 1024, 'y'));
+    std::filesystem::create_hard_link(root / "a" / "shared", outside);
+
+    auto freed = base::remove_tree(root);
+    CHECK_FALSE(std::filesystem::exists(root));
+    // Symlinks are not followed.
+    CHECK(std::filesystem::exists("/tmp"));
+    // Only the file not linked from elsewhere is freed, plus directories.
+    CHECK_GE(freed, 64 * 1024);
+    CHECK_LT(freed, 128 * 1024);
+    CHECK_EQ(base::read_file_to_string(outside), std::string(64 * 1024, 'y'));
+
+    CHECK_EQ(base::remove_tree(root), 0);
+    std::filesystem::remove(outside);
+}
+
+TEST_CASE("remove tree on pool") {
+    auto ts = std::chrono::system_clock::now().time_since_epoch().count();
+    auto root = std::filesystem::path(fmt::format("/tmp/test_remove_tree_pool_{}", ts));
+    for (int i = 0; i < 8; ++i) {
+        auto dir = root / fmt::format("d{}", i) / "nested" / "deeper";
+        std::filesystem::create_directories(dir);
+        for (int j = 0; j < 16; ++j) {
+            base::write_to_file(dir / fmt::format("f{}", j), std::string(4096, 'x'));
+        }
+    }
+    std::filesystem::create_symlink("/tmp", root / "tmp-link");
+
+    base::thread_pool pool(4);
+    auto freed = base::remove_tree(root, pool);
+    CHECK_FALSE(std::filesystem::exists(root));
+    CHECK(std::filesystem::exists("/tmp"));
+    CHECK_GE(freed, 8 * 16 * 4096);
+
+    CHECK_EQ(base::remove_tree(root, pool), 0);
+
+    base::write_to_file(root, "a file");
+    CHECK_GT(base::remove_tree(root, pool), 0);
+    CHECK_FALSE(std::filesystem::exists(root));
+}
+
 TEST_SUITE_END();
 
 } // namespace
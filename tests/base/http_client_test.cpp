@@ -0,0 +1,225 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "doctest/doctest.h"
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "esl/unique_handle.h"
+#include "fmt/format.h"
+
+#include "base/http_client.h"
+
+namespace {
+
+// A tiny single-threaded http server serving one canned response per connection.
+class fixture_server {
+public:
+    using handler = std::function<std::string(const std::string& request)>;
+
+    explicit fixture_server(handler handle)
+        : handle_(std::move(handle)) {
+        listener_.reset(::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0));
+        REQUIRE(static_cast<bool>(listener_));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+        REQUIRE_EQ(::bind(listener_.get(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)), 0);
+        REQUIRE_EQ(::listen(listener_.get(), 8), 0);
+        socklen_t len = sizeof(addr);
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+        ::getsockname(listener_.get(), reinterpret_cast<sockaddr*>(&addr), &len);
+        port_ = ntohs(addr.sin_port);
+        worker_ = std::thread([this] { serve(); });
+    }
+
+    ~fixture_server() {
+        ::shutdown(listener_.get(), SHUT_RDWR);
+        worker_.join();
+    }
+
+    fixture_server(const fixture_server&) = delete;
+
+    fixture_server& operator=(const fixture_server&) = delete;
+
+    std::string url(std::string_view target) const {
+        return fmt::format("http://127.0.0.1:{}{}", port_, target);
+    }
+
+    std::string last_request() const {
+        std::lock_guard<std::mutex> lock(mtx_);
+        return last_request_;
+    }
+
+private:
+    void serve() {
+        while (true) {
+            esl::unique_fd conn(::accept4(listener_.get(), nullptr, nullptr, SOCK_CLOEXEC));
+            if (!conn) {
+                return;
+            }
+
+            std::string request;
+            char buf[4096];
+            while (request.find("\r\n\r\n") == std::string::npos) {
+                auto n = ::recv(conn.get(), buf, sizeof(buf), 0);
+                if (n <= 0) {
+                    break;
+                }
+                request.append(buf, static_cast<std::size_t>(n));
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                last_request_ = request;
+            }
+            auto resp = handle_(request);
+            ::send(conn.get(), resp.data(), resp.size(), MSG_NOSIGNAL);
+        }
+    }
+
+private:
+    handler handle_;
+    esl::unique_fd listener_;
+    std::uint16_t port_{0};
+    mutable std::mutex mtx_;
+    std::string last_request_;
+    std::thread worker_;
+};
+
+std::string collect(std::string_view url, const base::http_headers& headers = {}) {
+    std::string body;
+    auto resp = base::http_get(url, headers, [&body](const auto&, std::string_view chunk) {
+        body.append(chunk);
+    });
+    REQUIRE(resp.ok());
+    return body;
+}
+
+TEST_SUITE_BEGIN("http_client");
+
+TEST_CASE("parse url") {
+    SUBCASE("default port and target") {
+        auto url = base::http_url::parse("http://localhost");
+        CHECK_EQ(url.host, "localhost");
+        CHECK_EQ(url.port, "80");
+        CHECK_EQ(url.target, "/");
+        CHECK_EQ(url.authority(), "localhost");
+    }
+
+    SUBCASE("explicit port and target") {
+        auto url = base::http_url::parse("http://localhost:5000/v2/alpine/manifests/3.16");
+        CHECK_EQ(url.host, "localhost");
+        CHECK_EQ(url.port, "5000");
+        CHECK_EQ(url.target, "/v2/alpine/manifests/3.16");
+        CHECK_EQ(url.authority(), "localhost:5000");
+    }
+
+    SUBCASE("ipv6 literal") {
+        auto url = base::http_url::parse("http://[::1]:5000/v2/");
+        CHECK_EQ(url.host, "::1");
+        CHECK_EQ(url.authority(), "[::1]:5000");
+    }
+
+    SUBCASE("https is not supported") {
+        CHECK_THROWS_AS(base::http_url::parse("https://localhost"), std::invalid_argument);
+    }
+}
+
+TEST_CASE("fetch body with content-length") {
+    fixture_server server([](const std::string&) {
+        return std::string("HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nhello");
+    });
+    CHECK_EQ(collect(server.url("/blob")), "hello");
+    CHECK_NE(server.last_request().find("GET /blob HTTP/1.1\r\n"), std::string::npos);
+}
+
+TEST_CASE("fetch chunked body") {
+    fixture_server server([](const std::string&) {
+        return std::string("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+                           "5\r\nhello\r\n6;ext=1\r\n world\r\n0\r\n\r\n");
+    });
+    CHECK_EQ(collect(server.url("/")), "hello world");
+}
+
+TEST_CASE("fetch body until connection closed") {
+    fixture_server server([](const std::string&) {
+        return std::string("HTTP/1.0 200 OK\r\n\r\nuntil eof");
+    });
+    CHECK_EQ(collect(server.url("/")), "until eof");
+}
+
+TEST_CASE("resume with range request") {
+    constexpr std::string_view blob = "0123456789";
+    fixture_server server([blob](const std::string& req) {
+        auto pos = req.find("Range: bytes=");
+        if (pos == std::string::npos) {
+            return fmt::format("HTTP/1.1 200 OK\r\nContent-Length: {}\r\n\r\n{}",
+                               blob.size(), blob);
+        }
+        auto offset = std::stoul(req.substr(pos + 13));
+        auto rest = blob.substr(offset);
+        return fmt::format("HTTP/1.1 206 Partial Content\r\nContent-Length: {}\r\n\r\n{}",
+                           rest.size(), rest);
+    });
+
+    int status = 0;
+    std::string body;
+    base::http_get(server.url("/blob"), {{"Range", "bytes=4-"}},
+                   [&](const base::http_response& head, std::string_view chunk) {
+                       status = head.status;
+                       body.append(chunk);
+                   });
+    CHECK_EQ(status, 206);
+    CHECK_EQ(body, "456789");
+}
+
+TEST_CASE("follow redirects") {
+    std::atomic<int> hits{0};
+    fixture_server server([&hits](const std::string& req) {
+        ++hits;
+        if (req.find("GET /old ") != std::string::npos) {
+            return std::string("HTTP/1.1 307 Temporary Redirect\r\nLocation: /new\r\n"
+                               "Content-Length: 0\r\n\r\n");
+        }
+        return std::string("HTTP/1.1 200 OK\r\nContent-Length: 3\r\n\r\nnew");
+    });
+    CHECK_EQ(collect(server.url("/old")), "new");
+    CHECK_EQ(hits.load(), 2);
+}
+
+TEST_CASE("error body is buffered rather than streamed") {
+    fixture_server server([](const std::string&) {
+        return std::string("HTTP/1.1 404 Not Found\r\nContent-Length: 9\r\n\r\nnot found");
+    });
+    bool sink_called = false;
+    auto resp = base::http_get(server.url("/"), {}, [&](const auto&, std::string_view) {
+        sink_called = true;
+    });
+    CHECK_FALSE(resp.ok());
+    CHECK_EQ(resp.status, 404);
+    CHECK_EQ(resp.body, "not found");
+    CHECK_FALSE(sink_called);
+}
+
+TEST_CASE("throws for malformed response") {
+    fixture_server server([](const std::string&) {
+        return std::string("garbage\r\n\r\n");
+    });
+    CHECK_THROWS_AS(base::http_get(server.url("/"), {}), base::http_error);
+}
+
+TEST_SUITE_END();
+
+} // namespace
@@ -0,0 +1,248 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "doctest/doctest.h"
+
+#include <chrono>
+#include <csignal>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "fmt/format.h"
+
+#include "base/file_util.h"
+#include "base/procfs.h"
+
+namespace {
+
+std::filesystem::path make_temp_path(std::string_view name) {
+    auto ts = std::chrono::system_clock::now().time_since_epoch().count();
+    return std::filesystem::temp_directory_path() / fmt::format("test_procfs_{}_{}", name, ts);
+}
+
+TEST_SUITE_BEGIN("procfs");
+
+TEST_CASE("read proc file") {
+    char buf[4096];
+    auto content = base::read_proc_file("/proc/self/stat", buf, sizeof(buf));
+    CHECK_EQ(content.data(), buf);
+    CHECK_EQ(content.back(), '\n');
+
+    SUBCASE("file not fitting the buffer") {
+        std::error_code ec;
+        try {
+            base::read_proc_file("/proc/self/stat", buf, 8);
+        } catch (const std::system_error& ex) {
+            ec = ex.code();
+        }
+        CHECK(ec == std::errc::value_too_large);
+    }
+
+    SUBCASE("file not exists") {
+        CHECK_THROWS_AS(base::read_proc_file("/proc/self/no-such-file", buf, sizeof(buf)),
+                        std::system_error);
+    }
+}
+
+TEST_CASE("read lines") {
+    auto path = make_temp_path("lines");
+    std::string long_line(base::line_reader::k_buf_size + 100, 'x');
+    base::write_to_file(path, "first\n\n" + long_line + "\nafter long\nlast without newline");
+
+    std::vector<std::string> lines;
+    {
+        base::line_reader reader(path.c_str());
+        for (std::string_view line; reader.next(line);) {
+            lines.emplace_back(line);
+        }
+    }
+    CHECK_EQ(lines, std::vector<std::string>{"first", "", "after long", "last without newline"});
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("parse mountinfo line") {
+    SUBCASE("with optional fields") {
+        auto entry = base::parse_mountinfo_line(
+                "36 35 98:0 /mnt1 /mnt2 rw,noatime master:1 shared:2 - ext3 /dev/root "
+                "rw,errors=continue");
+        REQUIRE(entry.has_value());
+        CHECK_EQ(entry->root, "/mnt1");
+        CHECK_EQ(entry->mount_point, "/mnt2");
+        CHECK_EQ(entry->fs_type, "ext3");
+        CHECK_EQ(entry->source, "/dev/root");
+        CHECK_EQ(entry->super_options, "rw,errors=continue");
+    }
+
+    SUBCASE("without optional fields") {
+        auto entry = base::parse_mountinfo_line(
+                "30 24 0:26 / /sys/fs/cgroup/memory rw,nosuid - cgroup cgroup rw,memory");
+        REQUIRE(entry.has_value());
+        CHECK_EQ(entry->fs_type, "cgroup");
+        CHECK_EQ(entry->super_options, "rw,memory");
+    }
+
+    SUBCASE("malformed") {
+        CHECK_FALSE(base::parse_mountinfo_line("").has_value());
+        CHECK_FALSE(base::parse_mountinfo_line("36 35 98:0 / /mnt rw").has_value());
+        CHECK_FALSE(base::parse_mountinfo_line("36 35 98:0 / /mnt rw - ext3").has_value());
+    }
+}
+
+TEST_CASE("mount table") {
+    auto path = make_temp_path("mountinfo");
+    base::write_to_file(
+            path,
+            "22 1 8:1 / / rw - ext4 /dev/sda1 rw\n"
+            "25 22 0:22 / /sys/fs/cgroup/unified rw - cgroup2 cgroup2 rw\n"
+            "26 22 0:23 / /sys/fs/cgroup/cpu,cpuacct rw - cgroup cgroup rw,cpu,cpuacct\n"
+            "27 22 0:24 / /sys/fs/cgroup/memory rw - cgroup cgroup rw,memory\n"
+            "28 22 0:25 / /mnt/memory rw - tmpfs memory rw\n");
+
+    base::mount_table table(path.c_str());
+    CHECK_EQ(table.mounts().size(), 5);
+    CHECK_EQ(table.find_cgroup_mount_point("memory"), "/sys/fs/cgroup/memory");
+    CHECK_EQ(table.find_cgroup_mount_point("cpu"), "/sys/fs/cgroup/cpu,cpuacct");
+    CHECK_EQ(table.find_cgroup_mount_point("cpuacct"), "/sys/fs/cgroup/cpu,cpuacct");
+    CHECK(table.find_cgroup_mount_point("cpuset").empty());
+    CHECK(table.find_cgroup_mount_point("rw,memory").empty());
+    CHECK_EQ(table.find_cgroup2_mount_point(), "/sys/fs/cgroup/unified");
+
+    std::filesystem::remove(path);
+
+    // The table of the process is taken once.
+    CHECK_EQ(&base::mount_table::get(), &base::mount_table::get());
+    CHECK_FALSE(base::mount_table::get().mounts().empty());
+}
+
+TEST_CASE("parse memory stat") {
+    SUBCASE("v2") {
+        auto stat = base::parse_memory_stat(
+                "anon 1048576\nfile 2097152\nkernel 4096\nshmem 8192\npgfault 100\n"
+                "pgmajfault 3\n");
+        CHECK_EQ(stat.anon, 1048576);
+        CHECK_EQ(stat.file, 2097152);
+        CHECK_EQ(stat.shmem, 8192);
+        CHECK_EQ(stat.pgfault, 100);
+        CHECK_EQ(stat.pgmajfault, 3);
+    }
+
+    SUBCASE("v1") {
+        auto stat = base::parse_memory_stat(
+                "cache 4096\nrss 8192\nrss_huge 0\nshmem 0\npgfault 7\ntotal_rss 16384\n");
+        CHECK_EQ(stat.anon, 8192);
+        CHECK_EQ(stat.file, 4096);
+        CHECK_EQ(stat.pgfault, 7);
+    }
+}
+
+TEST_CASE("parse cpu stat") {
+    SUBCASE("v2") {
+        auto stat = base::parse_cpu_stat(
+                "usage_usec 5000\nuser_usec 3000\nsystem_usec 2000\nnr_periods 10\n"
+                "nr_throttled 2\nthrottled_usec 700");
+        CHECK_EQ(stat.usage_usec, 5000);
+        CHECK_EQ(stat.user_usec, 3000);
+        CHECK_EQ(stat.system_usec, 2000);
+        CHECK_EQ(stat.nr_periods, 10);
+        CHECK_EQ(stat.nr_throttled, 2);
+        CHECK_EQ(stat.throttled_usec, 700);
+    }
+
+    SUBCASE("v1") {
+        auto stat = base::parse_cpu_stat("nr_periods 10\nnr_throttled 2\nthrottled_time 7000\n");
+        CHECK_EQ(stat.nr_throttled, 2);
+        CHECK_EQ(stat.throttled_usec, 7);
+        CHECK_EQ(stat.usage_usec, 0);
+    }
+
+    SUBCASE("malformed lines are skipped") {
+        auto stat = base::parse_cpu_stat("usage_usec\nnr_periods x\nnr_throttled 2\n");
+        CHECK_EQ(stat.usage_usec, 0);
+        CHECK_EQ(stat.nr_periods, 0);
+        CHECK_EQ(stat.nr_throttled, 2);
+    }
+}
+
+TEST_CASE("parse io stat") {
+    constexpr std::string_view content =
+            "8:16 rbytes=1459200 wbytes=314773504 rios=192 wios=353 dbytes=0 dios=0\n"
+            "8:0 rbytes=100 wbytes=200 rios=1 wios=2 dbytes=3 dios=4\n";
+
+    auto line = base::parse_io_stat_line(content.substr(0, content.find('\n')));
+    REQUIRE(line.has_value());
+    CHECK_EQ(line->major, 8);
+    CHECK_EQ(line->minor, 16);
+    CHECK_EQ(line->wbytes, 314773504);
+
+    auto total = base::parse_io_stat(content);
+    CHECK_EQ(total.rbytes, 1459300);
+    CHECK_EQ(total.wios, 355);
+    CHECK_EQ(total.dios, 4);
+
+    CHECK_FALSE(base::parse_io_stat_line("8 rbytes=1").has_value());
+    CHECK_FALSE(base::parse_io_stat_line("8:0 rbytes").has_value());
+}
+
+TEST_CASE("parse stat of process") {
+    constexpr std::string_view content =
+            "4242 (a) b (c)) S 1 4242 4242 0 -1 4194560 500 0 3 0 25 7 0 0 20 0 3 0 98765 "
+            "10485760 256 18446744073709551615 1 1 0 0 0 0 0 0 0 0 0 0 17 0 0 0 0 0 0\n";
+    auto stat = base::parse_process_stat(content);
+    REQUIRE(stat.has_value());
+    CHECK_EQ(stat->state, 'S');
+    CHECK_EQ(stat->ppid, 1);
+    CHECK_EQ(stat->utime, 25);
+    CHECK_EQ(stat->stime, 7);
+    CHECK_EQ(stat->num_threads, 3);
+    CHECK_EQ(stat->start_time, 98765);
+    CHECK_EQ(stat->vsize, 10485760);
+    CHECK_EQ(stat->rss, 256);
+
+    CHECK_FALSE(base::parse_process_stat("4242 (a) S 1 2 3").has_value());
+    CHECK_FALSE(base::parse_process_stat("4242 a S").has_value());
+}
+
+TEST_CASE("read stat of process") {
+    SUBCASE("current process") {
+        auto stat = base::read_process_stat(::getpid());
+        REQUIRE(stat.has_value());
+        CHECK_EQ(stat->state, 'R');
+        CHECK_GT(stat->start_time, 0u);
+
+        // Stays the same for the lifetime of the process.
+        auto again = base::read_process_stat(::getpid());
+        REQUIRE(again.has_value());
+        CHECK_EQ(again->start_time, stat->start_time);
+    }
+
+    SUBCASE("exited process") {
+        auto pid = ::fork();
+        REQUIRE_GE(pid, 0);
+        if (pid == 0) {
+            ::_exit(0);
+        }
+
+        // Not reaped yet.
+        siginfo_t info{};
+        REQUIRE_EQ(::waitid(P_PID, static_cast<id_t>(pid), &info, WEXITED | WNOWAIT), 0);
+        auto stat = base::read_process_stat(pid);
+        REQUIRE(stat.has_value());
+        CHECK_EQ(stat->state, 'Z');
+
+        int status = 0;
+        REQUIRE_EQ(::waitpid(pid, &status, 0), pid);
+        CHECK_FALSE(base::read_process_stat(pid).has_value());
+    }
+}
+
+TEST_SUITE_END;
+
+} // namespace
@@ -0,0 +1,110 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "doctest/doctest.h"
+
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "fmt/format.h"
+
+#include "base/file_util.h"
+#include "base/sha256.h"
+#include "base/thread_pool.h"
+
+namespace {
+
+std::string hash(std::string_view data, base::sha256::engine eng) {
+    base::sha256 hasher(eng);
+    hasher.update(data);
+    return hasher.hex_finalize();
+}
+
+std::string random_data(std::size_t len) {
+    std::mt19937 gen(static_cast<std::uint32_t>(len));
+    std::uniform_int_distribution<int> dist(0, 255);
+    std::string data(len, '\0');
+    for (auto& ch : data) {
+        ch = static_cast<char>(dist(gen));
+    }
+    return data;
+}
+
+std::string temp_file_path() {
+    auto ts = std::chrono::system_clock::now().time_since_epoch().count();
+    return fmt::format("/tmp/test_sha256_file_{}.bin", ts);
+}
+
+TEST_SUITE_BEGIN("sha256");
+
+TEST_CASE("known answers") {
+    for (auto eng : {base::sha256::engine::best, base::sha256::engine::portable}) {
+        CAPTURE(static_cast<int>(eng));
+        CHECK_EQ(hash("", eng),
+                 "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+        CHECK_EQ(hash("abc", eng),
+                 "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+        CHECK_EQ(hash("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", eng),
+                 "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+        CHECK_EQ(hash(std::string(1000000, 'a'), eng),
+                 "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+    }
+}
+
+TEST_CASE("accelerated engine agrees with portable one") {
+    for (std::size_t len : {1, 55, 56, 63, 64, 65, 127, 128, 1000, 4096 + 7}) {
+        CAPTURE(len);
+        auto data = random_data(len);
+        CHECK_EQ(hash(data, base::sha256::engine::best),
+                 hash(data, base::sha256::engine::portable));
+    }
+}
+
+TEST_CASE("incremental update") {
+    auto data = random_data(1000);
+    auto expected = hash(data, base::sha256::engine::best);
+
+    base::sha256 hasher;
+    std::size_t pos = 0;
+    for (std::size_t step : {1, 3, 60, 64, 100, 200}) {
+        hasher.update(std::string_view(data).substr(pos, step));
+        pos += step;
+    }
+    hasher.update(std::string_view(data).substr(pos));
+    CHECK_EQ(hasher.hex_finalize(), expected);
+}
+
+TEST_CASE("hash files") {
+    SUBCASE("empty file") {
+        auto path = temp_file_path();
+        base::write_to_file(path, "");
+        CHECK_EQ(base::sha256_file(path),
+                 "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+    }
+
+    SUBCASE("concurrently") {
+        std::vector<std::filesystem::path> paths;
+        std::vector<std::string> expected;
+        for (std::size_t len : {100, 1024 * 1024 + 1, 9 * 1024 * 1024}) {
+            auto data = random_data(len);
+            paths.emplace_back(temp_file_path() + std::to_string(len));
+            base::write_to_file(paths.back(), data);
+            expected.push_back(hash(data, base::sha256::engine::portable));
+        }
+
+        base::thread_pool pool(2);
+        CHECK_EQ(base::sha256_files(paths, pool), expected);
+    }
+
+    SUBCASE("throws when file doesn't exist") {
+        CHECK_THROWS_AS(base::sha256_file("/tmp/no/such/file"),
+                        std::filesystem::filesystem_error);
+    }
+}
+
+TEST_SUITE_END();
+
+} // namespace
@@ -6,14 +6,21 @@
 
 #include <chrono>
 #include <csignal>
+#include <cstdint>
 #include <filesystem>
+#include <optional>
 #include <stdexcept>
 #include <string_view>
 #include <system_error>
+#include <thread>
 #include <vector>
 
 #include <fcntl.h>
+#include <linux/magic.h>
+#include <sys/statfs.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
+#include <unistd.h>
 
 #include "esl/strings.h"
 #include "fmt/core.h"
@@ -26,6 +33,13 @@ namespace {
 
 namespace fs = std::filesystem;
 
+#ifndef SYS_clone3
+#define SYS_clone3 435
+#endif
+#ifndef CLONE_INTO_CGROUP
+#define CLONE_INTO_CGROUP 0x200000000ULL
+#endif
+
 std::string drain_fd(int fd) {
     std::string result;
 
@@ -343,6 +357,15 @@ TEST_CASE("detach subprocess") {
         CHECK_LE(t2 - t1, std::chrono::seconds(5));
     }
 
+    SUBCASE("pid of detached process is available") {
+        base::subprocess new_proc({"/bin/sleep", "10"}, base::subprocess::options().detach());
+        auto pid = new_proc.detached_pid();
+        REQUIRE_GT(pid, 0);
+        CHECK_NE(pid, ::getpid());
+        CHECK_EQ(::kill(pid, 0), 0);
+        ::kill(pid, SIGKILL);
+    }
+
     SUBCASE("notify parent process when detached process exec failed") {
         CHECK_THROWS_AS({ base::subprocess new_proc({"/no/such/file"},
                                                     base::subprocess::options().detach()); },
@@ -350,6 +373,92 @@ TEST_CASE("detach subprocess") {
     }
 }
 
+// Returns the mount point of cgroup2 to create the test cgroup in, or `std::nullopt` if cloning
+// into it is not possible here, which takes root, a writable cgroup2 and `CLONE_INTO_CGROUP` of
+// Linux 5.7+.
+std::optional<fs::path> find_clone_cgroup_root() {
+    if (::geteuid() != 0) {
+        return std::nullopt;
+    }
+
+    // Probes with an invalid cgroup fd: EINVAL tells the flag is known; clone3(2) is missing or
+    // takes shorter args otherwise.
+    struct {
+        std::uint64_t flags;
+        std::uint64_t pidfd;
+        std::uint64_t child_tid;
+        std::uint64_t parent_tid;
+        std::uint64_t exit_signal;
+        std::uint64_t stack;
+        std::uint64_t stack_size;
+        std::uint64_t tls;
+        std::uint64_t set_tid;
+        std::uint64_t set_tid_size;
+        std::uint64_t cgroup;
+    } args{};
+    args.flags = CLONE_INTO_CGROUP;
+    args.exit_signal = SIGCHLD;
+    args.cgroup = UINT64_MAX;
+    if (::syscall(SYS_clone3, &args, sizeof(args)) != -1 || errno != EINVAL) {
+        return std::nullopt;
+    }
+
+    // Unified hierarchy is at /sys/fs/cgroup/unified on hybrid hosts.
+    for (const char* root : {"/sys/fs/cgroup", "/sys/fs/cgroup/unified"}) {
+        struct statfs st {};
+        if (::statfs(root, &st) == 0 && st.f_type == CGROUP2_SUPER_MAGIC &&
+            ::access(root, W_OK) == 0) {
+            return fs::path(root);
+        }
+    }
+
+    return std::nullopt;
+}
+
+TEST_CASE("clone into cgroup") {
+    auto root = find_clone_cgroup_root();
+    if (!root) {
+        MESSAGE("skipped: requires root, a writable cgroup2 and Linux 5.7+");
+        return;
+    }
+
+    auto cgroup_path = *root / "lumper-subprocess-test";
+    fs::create_directories(cgroup_path);
+    auto cgroup_fd = ::open(cgroup_path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    REQUIRE_NE(cgroup_fd, -1);
+
+    auto run_in_cgroup = [cgroup_fd](base::subprocess::options opts) {
+        fs::path out = fmt::format("/tmp/subprocess_cgroup_test_{}", ::getpid());
+        auto fd = ::open(out.c_str(), O_CREAT | O_TRUNC | O_WRONLY | O_CLOEXEC, 0644);
+        opts.set_stdout(base::subprocess::use_fd, fd).clone_into_cgroup(cgroup_fd);
+        {
+            base::subprocess proc({"/bin/sh", "-c", "cat /proc/self/cgroup; sleep 0.2"}, opts);
+            if (proc.waitable()) {
+                base::ignore_unused(proc.wait());
+            } else {
+                std::this_thread::sleep_for(std::chrono::milliseconds(500));
+            }
+        }
+        ::close(fd);
+        auto content = base::read_file_to_string(out);
+        fs::remove(out);
+        return content;
+    };
+
+    SUBCASE("child is created in the cgroup") {
+        CHECK_NE(run_in_cgroup({}).find("0::/lumper-subprocess-test\n"), std::string::npos);
+    }
+
+    SUBCASE("detached process is created in the cgroup") {
+        CHECK_NE(run_in_cgroup(base::subprocess::options().detach())
+                         .find("0::/lumper-subprocess-test\n"),
+                 std::string::npos);
+    }
+
+    ::close(cgroup_fd);
+    ::rmdir(cgroup_path.c_str());
+}
+
 TEST_SUITE_END;
 
 } // namespace
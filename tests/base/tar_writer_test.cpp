@@ -0,0 +1,159 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "doctest/doctest.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "esl/unique_handle.h"
+#include "fmt/format.h"
+
+#include "base/file_util.h"
+#include "base/tar_writer.h"
+
+namespace {
+
+namespace fs = std::filesystem;
+
+fs::path make_temp_dir() {
+    auto ts = std::chrono::system_clock::now().time_since_epoch().count();
+    auto dir = fs::path(fmt::format("/tmp/test_tar_writer_{}", ts));
+    fs::create_directories(dir);
+    return dir;
+}
+
+struct stat lstat_of(const fs::path& path) {
+    struct stat st {};
+    REQUIRE_EQ(::lstat(path.c_str(), &st), 0);
+    return st;
+}
+
+TEST_SUITE_BEGIN("tar_writer");
+
+TEST_CASE("archive is extracted by tar") {
+    auto root = make_temp_dir();
+    auto src = root / "src";
+    auto dst = root / "dst";
+    fs::create_directories(src / "etc");
+    fs::create_directories(dst);
+
+    base::write_to_file(src / "etc" / "hostname", "lumper\n");
+    ::chmod((src / "etc" / "hostname").c_str(), 0600);
+    fs::create_hard_link(src / "etc" / "hostname", src / "hostname-link");
+    fs::create_symlink("etc/hostname", src / "hostname-symlink");
+
+    // Exceeds both name and prefix of ustar header.
+    auto long_dir = src / std::string(120, 'd') / std::string(120, 'e');
+    fs::create_directories(long_dir);
+    base::write_to_file(long_dir / std::string(150, 'f'), "deep");
+
+    // 8MiB file with data only at 1MiB and at the end.
+    constexpr off_t sparse_size = 8 * 1024 * 1024;
+    {
+        esl::unique_fd fd(::open((src / "sparse").c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644));
+        REQUIRE(fd);
+        REQUIRE_EQ(::pwrite(fd.get(), "head", 4, 1024 * 1024), 4);
+        REQUIRE_EQ(::pwrite(fd.get(), "tail", 4, sparse_size - 4), 4);
+    }
+
+    auto archive = root / "out.tar";
+    base::tar_stats stats;
+    {
+        esl::unique_fd fd(::open(archive.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644));
+        REQUIRE(fd);
+        base::tar_writer writer(fd.get());
+        writer.add_tree(src);
+        writer.finish();
+        stats = writer.stats();
+    }
+
+    CHECK_EQ(stats.entries, 8);
+    CHECK_EQ(stats.archive_bytes, fs::file_size(archive));
+    CHECK_EQ(stats.archive_bytes % 512, 0);
+
+    auto cmd = fmt::format("tar -xf {} -C {} 2>/dev/null", archive.native(), dst.native());
+    REQUIRE_EQ(std::system(cmd.c_str()), 0);
+
+    SUBCASE("regular files and permissions") {
+        CHECK_EQ(base::read_file_to_string(dst / "etc" / "hostname"), "lumper\n");
+        CHECK_EQ(lstat_of(dst / "etc" / "hostname").st_mode & 07777, 0600);
+        CHECK_EQ(lstat_of(dst / "etc" / "hostname").st_mtim.tv_sec,
+                 lstat_of(src / "etc" / "hostname").st_mtim.tv_sec);
+    }
+
+    SUBCASE("links") {
+        CHECK_EQ(lstat_of(dst / "etc" / "hostname").st_ino,
+                 lstat_of(dst / "hostname-link").st_ino);
+        CHECK_EQ(fs::read_symlink(dst / "hostname-symlink"), "etc/hostname");
+    }
+
+    SUBCASE("long names") {
+        auto path = dst / std::string(120, 'd') / std::string(120, 'e') / std::string(150, 'f');
+        CHECK_EQ(base::read_file_to_string(path), "deep");
+    }
+
+    SUBCASE("sparse files") {
+        CHECK_EQ(stats.sparse_files, 1);
+        CHECK_LT(stats.archive_bytes, sparse_size);
+        auto content = base::read_file_to_string(dst / "sparse");
+        REQUIRE_EQ(content.size(), sparse_size);
+        CHECK_EQ(content.substr(1024 * 1024, 4), "head");
+        CHECK_EQ(content.substr(sparse_size - 4), "tail");
+        CHECK_EQ(content.find_first_not_of('\0'), 1024 * 1024);
+        CHECK_FALSE(fs::exists(dst / "GNUSparseFile.0"));
+    }
+
+    fs::remove_all(root);
+}
+
+TEST_CASE("archive through a pipe") {
+    auto root = make_temp_dir();
+    base::write_to_file(root / "file", std::string(100000, 'x'));
+
+    int fds[2];
+    REQUIRE_EQ(::pipe(fds), 0);
+    esl::unique_fd rd(fds[0]);
+    esl::unique_fd wr(fds[1]);
+
+    // The pipe buffer can't hold the archive; drain it from tar meanwhile.
+    auto dst = root / "dst";
+    fs::create_directories(dst);
+    auto pid = ::fork();
+    REQUIRE_NE(pid, -1);
+    if (pid == 0) {
+        ::dup2(rd.get(), STDIN_FILENO);
+        ::close(rd.get());
+        ::close(wr.get());
+        ::execlp("tar", "tar", "-xf", "-", "-C", dst.c_str(), nullptr);
+        ::_exit(127);
+    }
+    rd.reset();
+
+    {
+        base::tar_writer writer(wr.get());
+        writer.add(root / "file", "file");
+        writer.finish();
+    }
+    wr.reset();
+
+    int status = 0;
+    REQUIRE_EQ(::waitpid(pid, &status, 0), pid);
+    REQUIRE(WIFEXITED(status));
+    REQUIRE_EQ(WEXITSTATUS(status), 0);
+    CHECK_EQ(base::read_file_to_string(dst / "file"), std::string(100000, 'x'));
+
+    fs::remove_all(root);
+}
+
+TEST_SUITE_END();
+
+} // namespace
@@ -0,0 +1,57 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "doctest/doctest.h"
+
+#include <atomic>
+#include <future>
+#include <stdexcept>
+#include <vector>
+
+#include "base/thread_pool.h"
+
+namespace {
+
+TEST_SUITE_BEGIN("thread_pool");
+
+TEST_CASE("zero thread is not allowed") {
+    CHECK_THROWS_AS(base::thread_pool(0), std::invalid_argument);
+}
+
+TEST_CASE("run all submitted tasks") {
+    std::atomic<int> sum{0};
+    std::vector<std::future<int>> results;
+    {
+        base::thread_pool pool(4);
+        CHECK_EQ(pool.size(), 4);
+        for (int i = 1; i <= 100; ++i) {
+            results.push_back(pool.submit([i, &sum] {
+                sum += i;
+                return i;
+            }));
+        }
+    }
+    CHECK_EQ(sum.load(), 5050);
+    CHECK_EQ(results[41].get(), 42);
+}
+
+TEST_CASE("exception propagates through future") {
+    base::thread_pool pool(2);
+    std::vector<std::future<void>> results;
+    std::atomic<int> completed{0};
+    results.push_back(pool.submit([] { throw std::runtime_error("failed task"); }));
+    for (int i = 0; i < 8; ++i) {
+        results.push_back(pool.submit([&completed] { ++completed; }));
+    }
+
+    CHECK_THROWS_AS(base::wait_all(results), std::runtime_error);
+
+    SUBCASE("other tasks are still waited") {
+        CHECK_EQ(completed.load(), 8);
+    }
+}
+
+TEST_SUITE_END();
+
+} // namespace
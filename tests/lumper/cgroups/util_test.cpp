@@ -4,6 +4,10 @@
 
 #include "doctest/doctest.h"
 
+#include <filesystem>
+#include <string_view>
+#include <vector>
+
 #include "lumper/cgroups/util.h"
 
 namespace {
@@ -34,6 +38,30 @@ TEST_CASE("empty result for unknown or invalid subsystem") {
     CHECK(mp.empty());
 }
 
+TEST_CASE("mount point of unified hierarchy") {
+    auto mp = cgroups::find_cgroup2_mount_point();
+    if (!mp.empty()) {
+        CHECK(std::filesystem::exists(std::filesystem::path(mp) / "cgroup.controllers"));
+    }
+}
+
+TEST_CASE("parse cgroup controllers") {
+    CHECK(cgroups::parse_cgroup_controllers("").empty());
+    CHECK(cgroups::parse_cgroup_controllers("\n").empty());
+    CHECK_EQ(cgroups::parse_cgroup_controllers("cpuset cpu io memory pids\n"),
+             std::vector<std::string_view>{"cpuset", "cpu", "io", "memory", "pids"});
+}
+
+TEST_CASE("find value by key") {
+    constexpr std::string_view events = "low 0\nhigh 2\nmax 5\noom 1\noom_kill 1\n";
+    CHECK_EQ(cgroups::find_cgroup_key_value(events, "oom_kill"), "1");
+    CHECK_EQ(cgroups::find_cgroup_key_value(events, "oom"), "1");
+    CHECK_EQ(cgroups::find_cgroup_key_value(events, "max"), "5");
+    CHECK_FALSE(cgroups::find_cgroup_key_value(events, "oom_group_kill").has_value());
+    CHECK_FALSE(cgroups::find_cgroup_key_value(events, "oom_").has_value());
+    CHECK_EQ(cgroups::find_cgroup_key_value("oom_kill 3", "oom_kill"), "3");
+}
+
 TEST_CASE("throws when no cgroup path and no auto-create") {
     constexpr char mem_subsys[] = "memory";
     constexpr char name[] = "cgroup-test";
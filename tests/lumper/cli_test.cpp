@@ -10,6 +10,7 @@
 
 #include "uuidxx/uuidxx.h"
 
+#include "base/thread_pool.h"
 #include "lumper/cli.h"
 
 #include "tests/stringification.h"
@@ -54,6 +55,30 @@ TEST_CASE("command is mandatory") {
     }
 }
 
+TEST_CASE("global option state durability") {
+    SUBCASE("defaults to sync") {
+        const char* args[] = {"./lumper", "ps"};
+        cli_test_stub cli;
+        cli.parse(ssize(args), args);
+        CHECK_EQ(cli.state_durability_policy(), lumper::state_durability::sync);
+    }
+
+    SUBCASE("given before command") {
+        const char* args[] = {"./lumper", "--state-durability", "batch", "ps", "-a"};
+        cli_test_stub cli;
+        cli.parse(ssize(args), args);
+        CHECK_EQ(cli.state_durability_policy(), lumper::state_durability::batch);
+        CHECK_EQ(cli.command_name(), "ps");
+        CHECK(cli.command_parser().get<bool>("--all"));
+    }
+
+    SUBCASE("throws when unknown policy") {
+        const char* args[] = {"./lumper", "--state-durability", "always", "ps"};
+        cli_test_stub cli;
+        CHECK_THROWS_AS(cli.parse(ssize(args), args), cli_parse_failure);
+    }
+}
+
 TEST_CASE("command run") {
     std::vector<const char*> args{"./lumper", "run", "-i", "image_name"};
     CAPTURE(args);
@@ -168,6 +193,41 @@ TEST_CASE("command run") {
         }
     }
 
+    SUBCASE("support cpuset and numa flags") {
+        SUBCASE("auto along with cpus") {
+            args.insert(args.end(), {"--cpuset", "auto", "--cpus", "2", "--numa", "1", "some_cmd"});
+            cli_test_stub cli;
+            cli.parse(ssize(args), args.data());
+            CHECK_EQ(cli.command_parser().get<std::string>("--cpuset"), "auto");
+            CHECK_EQ(cli.command_parser().get<int>("--numa"), 1);
+        }
+
+        SUBCASE("cpu list") {
+            args.insert(args.end(), {"--cpuset", "0-3,8", "some_cmd"});
+            cli_test_stub cli;
+            cli.parse(ssize(args), args.data());
+            CHECK_EQ(cli.command_parser().get<std::string>("--cpuset"), "0-3,8");
+        }
+
+        SUBCASE("auto requires cpus") {
+            args.insert(args.end(), {"--cpuset", "auto", "some_cmd"});
+            cli_test_stub cli;
+            CHECK_THROWS_AS(cli.parse(ssize(args), args.data()), cli_parse_failure);
+        }
+
+        SUBCASE("malformed cpu list") {
+            args.insert(args.end(), {"--cpuset", "3-1", "some_cmd"});
+            cli_test_stub cli;
+            CHECK_THROWS_AS(cli.parse(ssize(args), args.data()), cli_parse_failure);
+        }
+
+        SUBCASE("negative numa node") {
+            args.insert(args.end(), {"--numa", "-1", "some_cmd"});
+            cli_test_stub cli;
+            CHECK_THROWS_AS(cli.parse(ssize(args), args.data()), cli_parse_failure);
+        }
+    }
+
     SUBCASE("support volume flag") {
         SUBCASE("specify volume folder correctly") {
             args.insert(args.end(), {"-v", "/path/in/host:/path/in/container", "some_cmd"});
@@ -182,6 +242,28 @@ TEST_CASE("command run") {
             CHECK_THROWS_AS(cli.parse(ssize(args), args.data()), cli_parse_failure);
         }
     }
+
+    SUBCASE("support prefetch-window flag") {
+        SUBCASE("10 seconds when not specified") {
+            args.push_back("some_cmd");
+            cli_test_stub cli;
+            cli.parse(ssize(args), args.data());
+            CHECK_EQ(cli.command_parser().get<int>("--prefetch-window"), 10);
+        }
+
+        SUBCASE("0 to disable") {
+            args.insert(args.end(), {"--prefetch-window", "0", "some_cmd"});
+            cli_test_stub cli;
+            cli.parse(ssize(args), args.data());
+            CHECK_EQ(cli.command_parser().get<int>("--prefetch-window"), 0);
+        }
+
+        SUBCASE("negative window is rejected") {
+            args.insert(args.end(), {"--prefetch-window", "-1", "some_cmd"});
+            cli_test_stub cli;
+            CHECK_THROWS_AS(cli.parse(ssize(args), args.data()), cli_parse_failure);
+        }
+    }
 }
 
 TEST_CASE("command ps") {
@@ -209,6 +291,245 @@ TEST_CASE("command ps") {
         CHECK_EQ(cli.command_name(), "ps");
         CHECK(cli.command_parser().get<bool>("--all"));
     }
+
+    SUBCASE("watch") {
+        cli_test_stub cli;
+        cli.parse(ssize(args), args.data());
+        CHECK_FALSE(cli.command_parser().get<bool>("--watch"));
+
+        args.push_back("-w");
+        cli_test_stub cli_watch;
+        cli_watch.parse(ssize(args), args.data());
+        CHECK(cli_watch.command_parser().get<bool>("--watch"));
+    }
+}
+
+TEST_CASE("command pull") {
+    std::vector<const char*> args{"./lumper", "pull"};
+
+    SUBCASE("image reference is mandatory") {
+        cli_test_stub cli;
+        CHECK_THROWS_AS(cli.parse(ssize(args), args.data()), cli_parse_failure);
+    }
+
+    SUBCASE("pull with reference only") {
+        args.push_back("alpine:3.16");
+        cli_test_stub cli;
+        cli.parse(ssize(args), args.data());
+        CHECK_EQ(cli.command_name(), "pull");
+        CHECK_EQ(cli.command_parser().get<std::string>("REFERENCE"), "alpine:3.16");
+        CHECK_FALSE(cli.command_parser().present("--name").has_value());
+        CHECK_FALSE(cli.command_parser().present<int>("--jobs").has_value());
+        CHECK_EQ(lumper::get_jobs(cli.command_parser()), base::thread_pool::default_size());
+    }
+
+    SUBCASE("specify local name and jobs") {
+        args.insert(args.end(), {"--name", "alpine", "-j", "8", "alpine:3.16"});
+        cli_test_stub cli;
+        cli.parse(ssize(args), args.data());
+        CHECK_EQ(cli.command_parser().get<std::string>("--name"), "alpine");
+        CHECK_EQ(cli.command_parser().get<int>("--jobs"), 8);
+        CHECK_EQ(lumper::get_jobs(cli.command_parser()), 8u);
+    }
+
+    SUBCASE("jobs must be positive") {
+        args.insert(args.end(), {"-j", "0", "alpine:3.16"});
+        cli_test_stub cli;
+        CHECK_THROWS_AS(cli.parse(ssize(args), args.data()), cli_parse_failure);
+    }
+
+    SUBCASE("local name must be a single path component") {
+        for (const char* name : {"../etc/passwd", "a/b", "..", "."}) {
+            CAPTURE(name);
+            auto bad_args = args;
+            bad_args.insert(bad_args.end(), {"--name", name, "alpine:3.16"});
+            cli_test_stub cli;
+            CHECK_THROWS_AS(cli.parse(ssize(bad_args), bad_args.data()), cli_parse_failure);
+        }
+    }
+}
+
+TEST_CASE("command clone") {
+    std::vector<const char*> args{"./lumper", "clone", "abc123"};
+
+    SUBCASE("one clone by default") {
+        cli_test_stub cli;
+        cli.parse(ssize(args), args.data());
+        CHECK_EQ(cli.command_parser().get("CONTAINER_ID"), "abc123");
+        CHECK_EQ(cli.command_parser().get<int>("--count"), 1);
+    }
+
+    SUBCASE("count must be positive") {
+        args.insert(args.end(), {"--count", "0"});
+        cli_test_stub cli;
+        CHECK_THROWS_AS(cli.parse(ssize(args), args.data()), cli_parse_failure);
+    }
+}
+
+TEST_CASE("command events") {
+    std::vector<const char*> args{"./lumper", "events"};
+
+    SUBCASE("all kept events by default") {
+        cli_test_stub cli;
+        cli.parse(ssize(args), args.data());
+        CHECK_EQ(cli.command_name(), "events");
+        CHECK_FALSE(cli.command_parser().present<std::string>("--since").has_value());
+        CHECK_FALSE(cli.command_parser().get<bool>("--follow"));
+    }
+
+    SUBCASE("follow since an age") {
+        args.insert(args.end(), {"--since", "10m", "-f"});
+        cli_test_stub cli;
+        cli.parse(ssize(args), args.data());
+        CHECK_EQ(cli.command_parser().get<std::string>("--since"), "10m");
+        CHECK(cli.command_parser().get<bool>("--follow"));
+    }
+
+    SUBCASE("malformed age is rejected") {
+        args.insert(args.end(), {"--since", "yesterday"});
+        cli_test_stub cli;
+        CHECK_THROWS_AS(cli.parse(ssize(args), args.data()), cli_parse_failure);
+    }
+}
+
+TEST_CASE("command image pin") {
+    SUBCASE("pin an image") {
+        std::vector<const char*> args{"./lumper", "image", "pin", "busybox"};
+        cli_test_stub cli;
+        cli.parse(ssize(args), args.data());
+        CHECK_EQ(cli.command_name(), "image pin");
+        CHECK_EQ(cli.command_parser().get("IMAGE"), "busybox");
+    }
+
+    SUBCASE("image is mandatory") {
+        std::vector<const char*> args{"./lumper", "image", "unpin"};
+        cli_test_stub cli;
+        CHECK_THROWS_AS(cli.parse(ssize(args), args.data()), cli_parse_failure);
+    }
+
+    SUBCASE("list pins") {
+        std::vector<const char*> args{"./lumper", "image", "pins"};
+        cli_test_stub cli;
+        cli.parse(ssize(args), args.data());
+        CHECK_EQ(cli.command_name(), "image pins");
+    }
+}
+
+TEST_CASE("command image prune") {
+    std::vector<const char*> args{"./lumper", "image", "prune"};
+
+    SUBCASE("two words make the command") {
+        cli_test_stub cli;
+        cli.parse(ssize(args), args.data());
+        CHECK_EQ(cli.command_name(), "image prune");
+        CHECK_FALSE(cli.command_parser().get<bool>("--all"));
+        CHECK_FALSE(cli.command_parser().get<bool>("--detach"));
+    }
+
+    SUBCASE("prune all in background") {
+        args.insert(args.end(), {"-a", "-d", "-j", "4"});
+        cli_test_stub cli;
+        cli.parse(ssize(args), args.data());
+        CHECK(cli.command_parser().get<bool>("--all"));
+        CHECK(cli.command_parser().get<bool>("--detach"));
+        CHECK_EQ(cli.command_parser().get<int>("--jobs"), 4);
+    }
+
+    SUBCASE("image alone is not a command") {
+        args.pop_back();
+        cli_test_stub cli;
+        CHECK_THROWS_AS(cli.parse(ssize(args), args.data()), cli_parse_failure);
+    }
+}
+
+TEST_CASE("command inspect") {
+    std::vector<const char*> args{"./lumper", "inspect"};
+
+    SUBCASE("at least one container id is mandatory") {
+        cli_test_stub cli;
+        CHECK_THROWS_AS(cli.parse(ssize(args), args.data()), cli_parse_failure);
+    }
+
+    SUBCASE("given id prefixes") {
+        args.push_back("3fa");
+        args.push_back("b1");
+        cli_test_stub cli;
+        cli.parse(ssize(args), args.data());
+        CHECK_EQ(cli.command_name(), "inspect");
+        auto ids = cli.command_parser().get<std::vector<std::string>>("container_ids");
+        CHECK_EQ(ids, std::vector<std::string>{"3fa", "b1"});
+    }
+}
+
+TEST_CASE("command limit") {
+    std::vector<const char*> args{"./lumper", "limit"};
+
+    SUBCASE("at least one limit is mandatory") {
+        cli_test_stub cli;
+        CHECK_THROWS_AS(cli.parse(ssize(args), args.data()), cli_parse_failure);
+    }
+
+    SUBCASE("given limits") {
+        args.insert(args.end(), {"-m", "8g", "--cpus", "4"});
+        cli_test_stub cli;
+        cli.parse(ssize(args), args.data());
+        CHECK_EQ(cli.command_name(), "limit");
+        CHECK_EQ(cli.command_parser().get<std::string>("--memory"), "8g");
+        CHECK_EQ(cli.command_parser().get<int>("--cpus"), 4);
+    }
+
+    SUBCASE("0 cpus lifts the limit") {
+        args.insert(args.end(), {"--cpus", "0"});
+        cli_test_stub cli;
+        cli.parse(ssize(args), args.data());
+        CHECK_EQ(cli.command_parser().get<int>("--cpus"), 0);
+        CHECK_FALSE(cli.command_parser().present<std::string>("--memory").has_value());
+    }
+
+    SUBCASE("cpus must not be negative") {
+        args.insert(args.end(), {"--cpus", "-1"});
+        cli_test_stub cli;
+        CHECK_THROWS_AS(cli.parse(ssize(args), args.data()), cli_parse_failure);
+    }
+}
+
+TEST_CASE("command prune") {
+    std::vector<const char*> args{"./lumper", "prune"};
+
+    SUBCASE("all stopped containers by default") {
+        cli_test_stub cli;
+        cli.parse(ssize(args), args.data());
+        CHECK_EQ(cli.command_name(), "prune");
+        CHECK_FALSE(cli.command_parser().present<std::string>("--until").has_value());
+        CHECK_FALSE(cli.command_parser().present<std::string>("--filter").has_value());
+    }
+
+    SUBCASE("filtered by age and image") {
+        args.insert(args.end(), {"--until", "24h", "--filter", "image=alpine", "-j", "8"});
+        cli_test_stub cli;
+        cli.parse(ssize(args), args.data());
+        CHECK_EQ(cli.command_parser().get<std::string>("--until"), "24h");
+        CHECK_EQ(cli.command_parser().get<std::string>("--filter"), "image=alpine");
+        CHECK_EQ(cli.command_parser().get<int>("--jobs"), 8);
+    }
+
+    SUBCASE("malformed age is rejected") {
+        args.insert(args.end(), {"--until", "1w"});
+        cli_test_stub cli;
+        CHECK_THROWS_AS(cli.parse(ssize(args), args.data()), cli_parse_failure);
+    }
+
+    SUBCASE("unsupported filter is rejected") {
+        args.insert(args.end(), {"--filter", "status=exited"});
+        cli_test_stub cli;
+        CHECK_THROWS_AS(cli.parse(ssize(args), args.data()), cli_parse_failure);
+    }
+
+    SUBCASE("jobs must be positive") {
+        args.insert(args.end(), {"-j", "0"});
+        cli_test_stub cli;
+        CHECK_THROWS_AS(cli.parse(ssize(args), args.data()), cli_parse_failure);
+    }
 }
 
 TEST_CASE("command rm") {
@@ -239,6 +560,26 @@ TEST_CASE("command rm") {
         cli.parse(ssize(args), args.data());
         auto ids = cli.command_parser().get<std::vector<std::string>>("container_ids");
         CHECK_EQ(ids, std::vector{id1, id2});
+        CHECK_FALSE(cli.command_parser().get<bool>("--sync"));
+    }
+
+    SUBCASE("wait for deletion") {
+        args.push_back("--sync");
+        args.push_back("-j");
+        args.push_back("4");
+        args.push_back("some_id");
+        cli_test_stub cli;
+        cli.parse(ssize(args), args.data());
+        CHECK(cli.command_parser().get<bool>("--sync"));
+        CHECK_EQ(cli.command_parser().get<int>("--jobs"), 4);
+    }
+
+    SUBCASE("throws when jobs is not positive") {
+        args.push_back("-j");
+        args.push_back("0");
+        args.push_back("some_id");
+        cli_test_stub cli;
+        CHECK_THROWS_AS(cli.parse(ssize(args), args.data()), cli_parse_failure);
     }
 }
 
@@ -0,0 +1,118 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "doctest/doctest.h"
+
+#include <chrono>
+#include <stdexcept>
+#include <string>
+
+#include "fmt/chrono.h"
+
+#include "lumper/container_filter.h"
+#include "lumper/container_info.h"
+
+namespace {
+
+using namespace std::chrono_literals;
+
+using lumper::container_filter;
+
+// Same as `format_time()`.
+std::string format_time(std::chrono::system_clock::time_point tp) {
+    auto time = std::chrono::system_clock::to_time_t(tp);
+    return fmt::format("{:%Y-%m-%d %H:%M:%S}", fmt::localtime(time));
+}
+
+lumper::container_info make_info(std::string image, std::string create_time) {
+    lumper::container_info info{};
+    info.id = "c1";
+    info.image = std::move(image);
+    info.create_time = std::move(create_time);
+    info.status = lumper::k_container_status_stopped;
+    return info;
+}
+
+TEST_SUITE_BEGIN("container_filter");
+
+TEST_CASE("parse age") {
+    SUBCASE("units") {
+        CHECK_EQ(lumper::parse_age("90"), 90s);
+        CHECK_EQ(lumper::parse_age("90s"), 90s);
+        CHECK_EQ(lumper::parse_age("30m"), 30min);
+        CHECK_EQ(lumper::parse_age("24h"), 24h);
+        CHECK_EQ(lumper::parse_age("7d"), 7 * 24h);
+        CHECK_EQ(lumper::parse_age("0s"), 0s);
+    }
+
+    SUBCASE("malformed") {
+        CHECK_THROWS_AS(lumper::parse_age(""), std::invalid_argument);
+        CHECK_THROWS_AS(lumper::parse_age("h"), std::invalid_argument);
+        CHECK_THROWS_AS(lumper::parse_age("-1h"), std::invalid_argument);
+        CHECK_THROWS_AS(lumper::parse_age("1w"), std::invalid_argument);
+        CHECK_THROWS_AS(lumper::parse_age("1hh"), std::invalid_argument);
+        CHECK_THROWS_AS(lumper::parse_age("9223372036854775807d"), std::invalid_argument);
+    }
+}
+
+TEST_CASE("parse create time") {
+    SUBCASE("round trip with formatting") {
+        auto now = std::chrono::system_clock::now();
+        auto parsed = lumper::parse_create_time(format_time(now));
+        REQUIRE(parsed.has_value());
+        CHECK_LT(now - *parsed, 1s);
+        CHECK_GE(now - *parsed, 0s);
+    }
+
+    SUBCASE("malformed") {
+        CHECK_FALSE(lumper::parse_create_time("").has_value());
+        CHECK_FALSE(lumper::parse_create_time("2022-01-02").has_value());
+        CHECK_FALSE(lumper::parse_create_time("2022-01-02 03:04:05 extra").has_value());
+    }
+}
+
+TEST_CASE("container filter") {
+    auto now = std::chrono::system_clock::now();
+    auto old = format_time(now - 48h);
+    auto recent = format_time(now - 1h);
+
+    SUBCASE("matches all if nothing given") {
+        auto filter = container_filter::parse(std::nullopt, std::nullopt);
+        CHECK(filter.matches(make_info("alpine", recent), now));
+        CHECK(filter.matches(make_info("busybox", "malformed"), now));
+    }
+
+    SUBCASE("by age") {
+        auto filter = container_filter::parse(std::string("24h"), std::nullopt);
+        CHECK(filter.matches(make_info("alpine", old), now));
+        CHECK_FALSE(filter.matches(make_info("alpine", recent), now));
+        CHECK_FALSE(filter.matches(make_info("alpine", "malformed"), now));
+    }
+
+    SUBCASE("by image") {
+        auto filter = container_filter::parse(std::nullopt, std::string("image=alpine"));
+        CHECK(filter.matches(make_info("alpine", recent), now));
+        CHECK_FALSE(filter.matches(make_info("busybox", recent), now));
+    }
+
+    SUBCASE("by both") {
+        auto filter = container_filter::parse(std::string("1d"), std::string("image=alpine"));
+        CHECK(filter.matches(make_info("alpine", old), now));
+        CHECK_FALSE(filter.matches(make_info("alpine", recent), now));
+        CHECK_FALSE(filter.matches(make_info("busybox", old), now));
+    }
+
+    SUBCASE("unsupported filters") {
+        CHECK_THROWS_AS(container_filter::parse(std::nullopt, std::string("status=exited")),
+                        std::invalid_argument);
+        CHECK_THROWS_AS(container_filter::parse(std::nullopt, std::string("image=")),
+                        std::invalid_argument);
+        CHECK_THROWS_AS(container_filter::parse(std::nullopt, std::string("image")),
+                        std::invalid_argument);
+    }
+}
+
+TEST_SUITE_END();
+
+} // namespace
@@ -0,0 +1,214 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "doctest/doctest.h"
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+
+#include "fmt/format.h"
+
+#include "base/file_util.h"
+#include "lumper/container_info.h"
+#include "lumper/container_record.h"
+
+namespace {
+
+lumper::container_info make_info() {
+    return {"d0c1a7e2b3f4",
+            "ubuntu:22.04",
+            "/bin/sh -c sleep 100",
+            "2022-05-01 12:34:56",
+            lumper::k_container_status_running,
+            4242,
+            "3f5e",
+            {"layer-a", "layer-b", "layer-c"},
+            987654321,
+            "lumper/d0c1a7e2b3f4",
+            "0-3",
+            "0",
+            true,
+            {"/bin/sh", "-c", "sleep 100"},
+            {"/var/lib/lumper/layers/layer-a", "/var/lib/lumper/layers/layer-b"},
+            "100m",
+            2};
+}
+
+TEST_SUITE_BEGIN("container_record");
+
+TEST_CASE("encode and parse") {
+    auto info = make_info();
+    auto record = lumper::encode_container_record(info);
+
+    auto view = lumper::container_record_view::parse(record);
+    REQUIRE(view.has_value());
+    CHECK_EQ(view->size(), record.size());
+    CHECK_EQ(view->id(), info.id);
+    CHECK_EQ(view->image(), info.image);
+    CHECK_EQ(view->command(), info.command);
+    CHECK_EQ(view->create_time(), info.create_time);
+    CHECK_EQ(view->status(), info.status);
+    CHECK_EQ(view->pid(), info.pid);
+    CHECK_EQ(view->image_mount(), info.image_mount);
+    CHECK_EQ(view->start_time(), info.start_time);
+    CHECK_EQ(view->cgroup(), info.cgroup);
+    CHECK_EQ(view->cpuset_cpus(), info.cpuset_cpus);
+    CHECK_EQ(view->cpuset_mems(), info.cpuset_mems);
+    CHECK(view->cpuset_exclusive());
+    REQUIRE_EQ(view->layer_count(), info.layers.size());
+    CHECK_EQ(view->layer(1), info.layers[1]);
+    REQUIRE_EQ(view->arg_count(), info.argv.size());
+    CHECK_EQ(view->arg(2), "sleep 100");
+    REQUIRE_EQ(view->lowerdir_count(), info.lowerdirs.size());
+    CHECK_EQ(view->lowerdir(0), info.lowerdirs[0]);
+    CHECK_EQ(view->memory_limit(), info.memory_limit);
+    CHECK_EQ(view->cpus(), info.cpus);
+
+    auto decoded = view->to_container_info();
+    CHECK_EQ(decoded.id, info.id);
+    CHECK_EQ(decoded.pid, info.pid);
+    CHECK_EQ(decoded.layers, info.layers);
+    CHECK_EQ(decoded.start_time, info.start_time);
+    CHECK_EQ(decoded.cgroup, info.cgroup);
+    CHECK_EQ(decoded.cpuset_cpus, info.cpuset_cpus);
+    CHECK(decoded.cpuset_exclusive);
+    CHECK_EQ(decoded.argv, info.argv);
+    CHECK_EQ(decoded.lowerdirs, info.lowerdirs);
+    CHECK_EQ(decoded.memory_limit, info.memory_limit);
+    CHECK_EQ(decoded.cpus, info.cpus);
+}
+
+TEST_CASE("empty fields") {
+    lumper::container_info info{};
+    info.id = "abc";
+    auto view = lumper::container_record_view::parse(lumper::encode_container_record(info));
+    REQUIRE(view.has_value());
+    CHECK_EQ(view->id(), "abc");
+    CHECK(view->image_mount().empty());
+    CHECK_EQ(view->layer_count(), 0);
+}
+
+TEST_CASE("records of version 1") {
+    auto info = make_info();
+    auto record = lumper::encode_container_record(info);
+
+    // Header of version 1 ends right before `cgroup`, which is ignored then.
+    record[4] = 1;
+    record[6] = 80;
+    auto view = lumper::container_record_view::parse(record);
+    REQUIRE(view.has_value());
+    CHECK_EQ(view->id(), info.id);
+    CHECK_EQ(view->start_time(), info.start_time);
+    REQUIRE_EQ(view->layer_count(), info.layers.size());
+    CHECK_EQ(view->layer(2), info.layers[2]);
+    CHECK(view->cgroup().empty());
+    CHECK(view->cpuset_cpus().empty());
+    CHECK_FALSE(view->cpuset_exclusive());
+}
+
+TEST_CASE("records of version 2") {
+    auto info = make_info();
+    auto record = lumper::encode_container_record(info);
+
+    record[4] = 2;
+    record[6] = 88;
+    auto view = lumper::container_record_view::parse(record);
+    REQUIRE(view.has_value());
+    CHECK_EQ(view->cgroup(), info.cgroup);
+    CHECK(view->cpuset_mems().empty());
+    CHECK_FALSE(view->cpuset_exclusive());
+
+    // Too short for version 2.
+    record[6] = 80;
+    CHECK_FALSE(lumper::container_record_view::parse(record).has_value());
+}
+
+TEST_CASE("records of version 3") {
+    auto info = make_info();
+    info.cpus = 0;
+    auto record = lumper::encode_container_record(info);
+
+    record[4] = 3;
+    record[6] = 112;
+    auto view = lumper::container_record_view::parse(record);
+    REQUIRE(view.has_value());
+    CHECK_EQ(view->cpuset_mems(), info.cpuset_mems);
+    CHECK(view->cpuset_exclusive());
+    CHECK_EQ(view->arg_count(), 0);
+    CHECK_EQ(view->lowerdir_count(), 0);
+    CHECK(view->memory_limit().empty());
+    CHECK_EQ(view->cpus(), 0);
+
+    auto decoded = view->to_container_info();
+    CHECK(decoded.argv.empty());
+    CHECK(decoded.lowerdirs.empty());
+
+    // Too short for version 3.
+    record[6] = 104;
+    CHECK_FALSE(lumper::container_record_view::parse(record).has_value());
+}
+
+TEST_CASE("record followed by other data") {
+    auto record = lumper::encode_container_record(make_info());
+    auto data = record + "trailing";
+    auto view = lumper::container_record_view::parse(data);
+    REQUIRE(view.has_value());
+    CHECK_EQ(view->size(), record.size());
+}
+
+TEST_CASE("reject malformed records") {
+    auto record = lumper::encode_container_record(make_info());
+
+    SUBCASE("truncated") {
+        CHECK_FALSE(lumper::container_record_view::parse(record.substr(0, 16)).has_value());
+        CHECK_FALSE(
+                lumper::container_record_view::parse(record.substr(0, record.size() - 1))
+                        .has_value());
+    }
+
+    SUBCASE("bad magic") {
+        record[0] = 'X';
+        CHECK_FALSE(lumper::container_record_view::parse(record).has_value());
+    }
+
+    SUBCASE("newer version") {
+        record[4] = 5;
+        CHECK_FALSE(lumper::container_record_view::parse(record).has_value());
+    }
+
+    SUBCASE("string out of record") {
+        // Length of the id, which is the first string.
+        record[28] = '\xff';
+        CHECK_FALSE(lumper::container_record_view::parse(record).has_value());
+    }
+
+    SUBCASE("table out of record") {
+        // Highest byte of the arg count.
+        record[119] = '\x7f';
+        CHECK_FALSE(lumper::container_record_view::parse(record).has_value());
+    }
+}
+
+TEST_CASE("mapped record") {
+    auto ts = std::chrono::system_clock::now().time_since_epoch().count();
+    auto path = std::filesystem::path(fmt::format("/tmp/test_container_record_{}", ts));
+
+    auto info = make_info();
+    base::write_to_file(path, lumper::encode_container_record(info));
+    {
+        lumper::mapped_container_record record(path);
+        CHECK_EQ(record.view().id(), info.id);
+        CHECK_EQ(record.view().layer(2), info.layers[2]);
+    }
+
+    base::write_to_file(path, "{}");
+    CHECK_THROWS_AS(lumper::mapped_container_record{path}, std::filesystem::filesystem_error);
+
+    std::filesystem::remove(path);
+}
+
+TEST_SUITE_END();
+
+} // namespace
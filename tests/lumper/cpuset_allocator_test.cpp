@@ -0,0 +1,175 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "doctest/doctest.h"
+
+#include <chrono>
+#include <filesystem>
+#include <stdexcept>
+#include <vector>
+
+#include "fmt/format.h"
+
+#include "base/file_util.h"
+#include "lumper/cpu_topology.h"
+#include "lumper/cpuset_allocator.h"
+
+namespace {
+
+namespace fs = std::filesystem;
+
+using lumper::assign_cpuset;
+using lumper::cpu_topology;
+using lumper::cpuset_request;
+
+// Two nodes of 4 cpus, each of 2 cores with 2 hyper-threads, numbered as linux does, i.e.
+// siblings of a core are apart.
+cpu_topology make_topology() {
+    return cpu_topology({{0, 0, 0, 0}, {1, 1, 0, 0}, {2, 0, 0, 0}, {3, 1, 0, 0},
+                         {4, 0, 1, 1}, {5, 1, 1, 1}, {6, 0, 1, 1}, {7, 1, 1, 1}});
+}
+
+fs::path make_temp_dir() {
+    auto ts = std::chrono::system_clock::now().time_since_epoch().count();
+    auto dir = fs::path(fmt::format("/tmp/test_cpu_topology_{}", ts));
+    fs::create_directories(dir);
+    return dir;
+}
+
+TEST_SUITE_BEGIN("cpuset_allocator");
+
+TEST_CASE("parse and format cpu lists") {
+    CHECK_EQ(lumper::parse_cpu_list("0-3,8,10-11\n"), std::vector<int>{0, 1, 2, 3, 8, 10, 11});
+    CHECK_EQ(lumper::parse_cpu_list("5,1-2,2"), std::vector<int>{1, 2, 5});
+    CHECK(lumper::parse_cpu_list("").empty());
+
+    CHECK_THROWS_AS(lumper::parse_cpu_list("3-1"), std::invalid_argument);
+    CHECK_THROWS_AS(lumper::parse_cpu_list("a"), std::invalid_argument);
+    CHECK_THROWS_AS(lumper::parse_cpu_list("1,,2"), std::invalid_argument);
+    CHECK_THROWS_AS(lumper::parse_cpu_list("0-100000"), std::invalid_argument);
+
+    CHECK_EQ(lumper::format_cpu_list({0, 1, 2, 3, 8, 10, 11}), "0-3,8,10-11");
+    CHECK_EQ(lumper::format_cpu_list({4}), "4");
+    CHECK_EQ(lumper::format_cpu_list({}), "");
+}
+
+TEST_CASE("read topology from sysfs") {
+    auto root = make_temp_dir();
+    fs::create_directories(root / "cpu");
+    base::write_to_file(root / "cpu" / "online", "0-3\n");
+    for (int id = 0; id < 4; ++id) {
+        auto dir = root / "cpu" / fmt::format("cpu{}", id) / "topology";
+        fs::create_directories(dir);
+        base::write_to_file(dir / "core_id", fmt::format("{}\n", id % 2));
+        base::write_to_file(dir / "physical_package_id", fmt::format("{}\n", id / 2));
+    }
+
+    SUBCASE("without NUMA support") {
+        auto topology = cpu_topology::read(root);
+        REQUIRE_EQ(topology.cpus().size(), 4);
+        CHECK_EQ(topology.nodes(), std::vector<int>{0});
+        CHECK_EQ(topology.find(3)->core_id, 1);
+        CHECK_EQ(topology.find(3)->package_id, 1);
+        CHECK(topology.find(4) == nullptr);
+    }
+
+    SUBCASE("with NUMA nodes") {
+        fs::create_directories(root / "node" / "node0");
+        fs::create_directories(root / "node" / "node1");
+        base::write_to_file(root / "node" / "node0" / "cpulist", "0-1\n");
+        base::write_to_file(root / "node" / "node1" / "cpulist", "2-3\n");
+        base::write_to_file(root / "node" / "online", "0-1\n");
+        auto topology = cpu_topology::read(root);
+        CHECK_EQ(topology.nodes(), std::vector<int>{0, 1});
+        CHECK_EQ(topology.cpus_of_node(1), std::vector<int>{2, 3});
+    }
+
+    fs::remove_all(root);
+}
+
+TEST_CASE("assign cpus automatically") {
+    auto topology = make_topology();
+
+    SUBCASE("whole cores on one node") {
+        auto assignment = assign_cpuset(topology, {lumper::k_cpuset_auto, 2, {}}, {});
+        CHECK(assignment.exclusive);
+        CHECK_EQ(assignment.cpus, std::vector<int>{0, 2});
+        CHECK_EQ(assignment.mems, std::vector<int>{0});
+    }
+
+    SUBCASE("best fit node") {
+        // Node 1 has the fewest free cpus that are enough.
+        auto assignment = assign_cpuset(topology, {lumper::k_cpuset_auto, 2, {}}, {0, 4, 6});
+        CHECK_EQ(assignment.cpus, std::vector<int>{5, 7});
+        CHECK_EQ(assignment.mems, std::vector<int>{1});
+    }
+
+    SUBCASE("free cpus of partial cores last") {
+        auto assignment = assign_cpuset(topology, {lumper::k_cpuset_auto, 3, {}}, {0});
+        CHECK_EQ(assignment.cpus, std::vector<int>{1, 2, 3});
+
+        assignment = assign_cpuset(topology, {lumper::k_cpuset_auto, 1, {}}, {0, 4, 5, 6});
+        CHECK_EQ(assignment.cpus, std::vector<int>{7});
+    }
+
+    SUBCASE("on the given node") {
+        auto assignment = assign_cpuset(topology, {lumper::k_cpuset_auto, 4, 1}, {});
+        CHECK_EQ(assignment.cpus, std::vector<int>{4, 5, 6, 7});
+        CHECK_EQ(assignment.mems, std::vector<int>{1});
+    }
+
+    SUBCASE("not enough free cpus") {
+        CHECK_THROWS_AS(assign_cpuset(topology, {lumper::k_cpuset_auto, 5, {}}, {}),
+                        std::runtime_error);
+        CHECK_THROWS_AS(assign_cpuset(topology, {lumper::k_cpuset_auto, 3, 0}, {1, 2}),
+                        std::runtime_error);
+        CHECK_THROWS_AS(assign_cpuset(topology, {lumper::k_cpuset_auto, 1, 2}, {}),
+                        std::invalid_argument);
+        CHECK_THROWS_AS(assign_cpuset(topology, {lumper::k_cpuset_auto, 0, {}}, {}),
+                        std::invalid_argument);
+    }
+}
+
+TEST_CASE("assign given cpus or node") {
+    auto topology = make_topology();
+
+    SUBCASE("cpu list") {
+        auto assignment = assign_cpuset(topology, {"3-4", 0, {}}, {0, 5});
+        CHECK_FALSE(assignment.exclusive);
+        CHECK_EQ(assignment.cpus, std::vector<int>{3, 4});
+        CHECK_EQ(assignment.mems, std::vector<int>{0, 1});
+
+        assignment = assign_cpuset(topology, {"3-4", 0, 1}, {});
+        CHECK_EQ(assignment.mems, std::vector<int>{1});
+
+        CHECK_THROWS_AS(assign_cpuset(topology, {"7-8", 0, {}}, {}), std::invalid_argument);
+    }
+
+    SUBCASE("cpu list overlapping exclusive cpus") {
+        CHECK_THROWS_AS(assign_cpuset(topology, {"3-4", 0, {}}, {4, 6}), std::runtime_error);
+        CHECK_THROWS_AS(assign_cpuset(topology, {"0", 0, 0}, {0}), std::runtime_error);
+    }
+
+    SUBCASE("node only") {
+        auto assignment = assign_cpuset(topology, {"", 0, 0}, {});
+        CHECK_FALSE(assignment.exclusive);
+        CHECK_EQ(assignment.cpus, std::vector<int>{0, 1, 2, 3});
+        CHECK_EQ(assignment.mems, std::vector<int>{0});
+
+        CHECK_THROWS_AS(assign_cpuset(topology, {"", 0, 3}, {}), std::invalid_argument);
+    }
+
+    SUBCASE("node only without exclusive cpus") {
+        auto assignment = assign_cpuset(topology, {"", 0, 1}, {1, 4, 6});
+        CHECK_FALSE(assignment.exclusive);
+        CHECK_EQ(assignment.cpus, std::vector<int>{5, 7});
+        CHECK_EQ(assignment.mems, std::vector<int>{1});
+
+        CHECK_THROWS_AS(assign_cpuset(topology, {"", 0, 0}, {0, 1, 2, 3}), std::runtime_error);
+    }
+}
+
+TEST_SUITE_END();
+
+} // namespace
@@ -0,0 +1,143 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "doctest/doctest.h"
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <thread>
+
+#include "fmt/format.h"
+
+#include "base/file_util.h"
+#include "lumper/event_journal.h"
+
+namespace {
+
+namespace fs = std::filesystem;
+
+using namespace std::chrono_literals;
+
+using lumper::container_event_type;
+using lumper::event_journal;
+
+fs::path make_temp_dir() {
+    auto ts = std::chrono::system_clock::now().time_since_epoch().count();
+    auto dir = fs::path(fmt::format("/tmp/test_event_journal_{}", ts));
+    fs::create_directories(dir);
+    return dir;
+}
+
+TEST_SUITE_BEGIN("event_journal");
+
+TEST_CASE("append and read events") {
+    auto dir = make_temp_dir();
+    auto path = dir / "events.journal";
+    event_journal journal(path, 8);
+    CHECK(fs::exists(path));
+    CHECK_EQ(journal.capacity(), 8);
+    CHECK_EQ(journal.next_seq(), 0);
+
+    SUBCASE("events are read in order with their fields") {
+        journal.append(container_event_type::started, "c1", 42);
+        journal.append(container_event_type::exited, "c1", 42, 3);
+        journal.append(container_event_type::oom, "c2", 43, -1, 9);
+
+        std::uint64_t cursor = 0;
+        auto result = journal.read(cursor);
+        CHECK_EQ(cursor, 3);
+        CHECK_EQ(result.lost, 0);
+        CHECK_FALSE(result.pending);
+        REQUIRE_EQ(result.events.size(), 3);
+        CHECK_EQ(result.events[0].seq, 0);
+        CHECK_EQ(result.events[0].type, container_event_type::started);
+        CHECK_EQ(result.events[0].container_id, "c1");
+        CHECK_EQ(result.events[0].pid, 42);
+        CHECK_EQ(result.events[0].exit_code, -1);
+        CHECK_EQ(result.events[1].exit_code, 3);
+        CHECK_EQ(result.events[2].type, container_event_type::oom);
+        CHECK_EQ(result.events[2].signal, 9);
+        CHECK_LT(std::chrono::system_clock::now() - result.events[2].time, 10s);
+
+        // Nothing new.
+        CHECK(journal.read(cursor).events.empty());
+    }
+
+    SUBCASE("overwritten events are reported as lost") {
+        for (int i = 0; i < 20; ++i) {
+            journal.append(container_event_type::created, fmt::format("c{}", i));
+        }
+        CHECK_EQ(journal.oldest_seq(), 12);
+
+        std::uint64_t cursor = 0;
+        auto result = journal.read(cursor);
+        CHECK_EQ(result.lost, 12);
+        REQUIRE_EQ(result.events.size(), 8);
+        CHECK_EQ(result.events.front().container_id, "c12");
+        CHECK_EQ(result.events.back().container_id, "c19");
+    }
+
+    SUBCASE("long ids are truncated") {
+        std::string long_id(200, 'x');
+        journal.append(container_event_type::removed, long_id);
+        std::uint64_t cursor = 0;
+        auto result = journal.read(cursor);
+        REQUIRE_EQ(result.events.size(), 1);
+        CHECK_EQ(result.events[0].container_id, std::string(96, 'x'));
+    }
+
+    SUBCASE("shared by another opener") {
+        event_journal other(path, 1024);
+        CHECK_EQ(other.capacity(), 8);
+        other.append(container_event_type::created, "c1");
+        std::uint64_t cursor = 0;
+        auto result = journal.read(cursor);
+        REQUIRE_EQ(result.events.size(), 1);
+        CHECK_EQ(result.events[0].container_id, "c1");
+    }
+
+    fs::remove_all(dir);
+}
+
+TEST_CASE("wait for events") {
+    auto dir = make_temp_dir();
+    event_journal journal(dir / "events.journal", 8);
+
+    SUBCASE("times out if nothing is appended") {
+        CHECK_FALSE(journal.wait(journal.wait_token(), 10ms));
+    }
+
+    SUBCASE("returns at once if appended since the token") {
+        auto token = journal.wait_token();
+        journal.append(container_event_type::created, "c1");
+        CHECK(journal.wait(token, 10s));
+    }
+
+    SUBCASE("woken by an append") {
+        auto token = journal.wait_token();
+        std::thread writer([&journal] {
+            std::this_thread::sleep_for(20ms);
+            journal.append(container_event_type::created, "c1");
+        });
+        auto start = std::chrono::steady_clock::now();
+        CHECK(journal.wait(token, 10s));
+        CHECK_LT(std::chrono::steady_clock::now() - start, 5s);
+        writer.join();
+    }
+
+    fs::remove_all(dir);
+}
+
+TEST_CASE("reject files not a journal") {
+    auto dir = make_temp_dir();
+    auto path = dir / "events.journal";
+    base::write_to_file(path, std::string(256, 'x'));
+    CHECK_THROWS_AS(event_journal{path}, fs::filesystem_error);
+    fs::remove_all(dir);
+}
+
+TEST_SUITE_END();
+
+} // namespace
@@ -0,0 +1,42 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "doctest/doctest.h"
+
+#include <chrono>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+
+#include "lumper/image_pin.h"
+#include "lumper/overlay_view.h"
+#include "lumper/path_constants.h"
+
+namespace {
+
+namespace fs = std::filesystem;
+
+TEST_SUITE_BEGIN("image_pin");
+
+TEST_CASE("rootfs of pins are usable as lowerdirs") {
+    lumper::image_pin pin{"repo:tag", lumper::make_pin_mountpoint(std::chrono::system_clock::now()),
+                          "fingerprint"};
+    CHECK_EQ(pin.mountpoint.parent_path(), fs::path(lumper::k_image_pins_dir));
+    CHECK_EQ(pin.mountpoint.native().find(':'), std::string::npos);
+
+    auto layer = fs::path(lumper::k_layers_dir) / "sha256_abc";
+    auto lowerdir = lumper::join_overlay_lowerdirs({pin.rootfs(), layer});
+    CHECK_EQ(lowerdir, pin.rootfs().native() + ":" + layer.native());
+}
+
+TEST_CASE("paths with separators are rejected as lowerdirs") {
+    CHECK_EQ(lumper::join_overlay_lowerdirs({"/a"}), "/a");
+    CHECK_THROWS_AS(lumper::join_overlay_lowerdirs({"/pins/repo:tag/rootfs", "/a"}),
+                    std::invalid_argument);
+    CHECK_THROWS_AS(lumper::join_overlay_lowerdirs({"/a,b"}), std::invalid_argument);
+}
+
+TEST_SUITE_END();
+
+} // namespace
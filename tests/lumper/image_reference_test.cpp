@@ -0,0 +1,71 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "doctest/doctest.h"
+
+#include <stdexcept>
+
+#include "lumper/image_reference.h"
+
+namespace {
+
+using lumper::image_reference;
+
+TEST_SUITE_BEGIN("image_reference");
+
+TEST_CASE("parse image reference") {
+    SUBCASE("repository only uses default registry and tag") {
+        auto ref = image_reference::parse("alpine");
+        CHECK_EQ(ref.registry, lumper::k_default_registry);
+        CHECK_EQ(ref.repository, "alpine");
+        CHECK_EQ(ref.tag, "latest");
+        CHECK(ref.digest.empty());
+    }
+
+    SUBCASE("nested repository with tag") {
+        auto ref = image_reference::parse("library/alpine:3.16");
+        CHECK_EQ(ref.registry, lumper::k_default_registry);
+        CHECK_EQ(ref.repository, "library/alpine");
+        CHECK_EQ(ref.tag, "3.16");
+    }
+
+    SUBCASE("registry with port") {
+        auto ref = image_reference::parse("registry.local:5000/library/alpine:3.16");
+        CHECK_EQ(ref.registry, "registry.local:5000");
+        CHECK_EQ(ref.repository, "library/alpine");
+        CHECK_EQ(ref.tag, "3.16");
+        CHECK_EQ(ref.to_string(), "registry.local:5000/library/alpine:3.16");
+    }
+
+    SUBCASE("pinned by digest") {
+        auto ref = image_reference::parse("localhost/alpine@sha256:0123456789abcdef");
+        CHECK_EQ(ref.registry, "localhost");
+        CHECK(ref.tag.empty());
+        CHECK_EQ(ref.digest, "sha256:0123456789abcdef");
+        CHECK_EQ(ref.manifest_ref(), ref.digest);
+    }
+
+    SUBCASE("malformed references") {
+        CHECK_THROWS_AS(image_reference::parse(""), std::invalid_argument);
+        CHECK_THROWS_AS(image_reference::parse("alpine:"), std::invalid_argument);
+        CHECK_THROWS_AS(image_reference::parse("Alpine"), std::invalid_argument);
+        CHECK_THROWS_AS(image_reference::parse("alpine@deadbeef"), std::invalid_argument);
+    }
+}
+
+TEST_CASE("local image name") {
+    SUBCASE("slashes are replaced") {
+        CHECK_EQ(image_reference::parse("library/alpine:3.16").local_name(),
+                 "library_alpine:3.16");
+    }
+
+    SUBCASE("short digest as tag when pinned by digest only") {
+        auto ref = image_reference::parse("alpine@sha256:0123456789abcdef0123");
+        CHECK_EQ(ref.local_name(), "alpine:0123456789ab");
+    }
+}
+
+TEST_SUITE_END();
+
+} // namespace
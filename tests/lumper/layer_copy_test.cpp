@@ -0,0 +1,182 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "doctest/doctest.h"
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/xattr.h>
+#include <unistd.h>
+
+#include "fmt/format.h"
+
+#include "base/file_util.h"
+#include "base/thread_pool.h"
+#include "lumper/layer_copy.h"
+
+namespace {
+
+namespace fs = std::filesystem;
+
+fs::path make_temp_dir() {
+    auto ts = std::chrono::system_clock::now().time_since_epoch().count();
+    auto dir = fs::path(fmt::format("/tmp/test_layer_copy_{}", ts));
+    fs::create_directories(dir);
+    return dir;
+}
+
+struct stat lstat_of(const fs::path& path) {
+    struct stat st {};
+    REQUIRE_EQ(::lstat(path.c_str(), &st), 0);
+    return st;
+}
+
+TEST_SUITE_BEGIN("layer_copy");
+
+TEST_CASE("copy layer tree") {
+    auto root = make_temp_dir();
+    auto src = root / "src";
+    auto dst = root / "dst";
+    fs::create_directories(src / "usr" / "bin");
+    base::write_to_file(src / "usr" / "bin" / "tool", "#!/bin/sh\necho hi\n");
+    ::chmod((src / "usr" / "bin" / "tool").c_str(), 0755);
+    base::write_to_file(src / "data", std::string(1024 * 1024, 'x'));
+    fs::create_hard_link(src / "data", src / "usr" / "data-link");
+    fs::create_symlink("usr/bin/tool", src / "tool-link");
+    ::chmod((src / "usr").c_str(), 0700);
+
+    auto stats = lumper::copy_layer_tree(src, dst, lumper::overlay_xattrs::to_layer);
+
+    CHECK_EQ(stats.files, 2);
+    CHECK_EQ(stats.file_bytes, 1024 * 1024 + 18);
+    CHECK_EQ(stats.whiteouts, 0);
+
+    SUBCASE("content and permission are preserved") {
+        CHECK_EQ(base::read_file_to_string(dst / "usr" / "bin" / "tool"), "#!/bin/sh\necho hi\n");
+        CHECK_EQ(lstat_of(dst / "usr" / "bin" / "tool").st_mode & 07777, 0755);
+        CHECK_EQ(lstat_of(dst / "usr").st_mode & 07777, 0700);
+        CHECK_EQ(base::read_file_to_string(dst / "data").size(), 1024 * 1024);
+    }
+
+    SUBCASE("hardlinks are kept") {
+        CHECK_EQ(lstat_of(dst / "data").st_ino, lstat_of(dst / "usr" / "data-link").st_ino);
+    }
+
+    SUBCASE("symlinks are copied as is") {
+        CHECK(fs::is_symlink(dst / "tool-link"));
+        CHECK_EQ(fs::read_symlink(dst / "tool-link"), "usr/bin/tool");
+    }
+
+    SUBCASE("timestamps are preserved") {
+        CHECK_EQ(lstat_of(dst / "usr").st_mtim.tv_sec, lstat_of(src / "usr").st_mtim.tv_sec);
+        CHECK_EQ(lstat_of(dst / "data").st_mtim.tv_nsec, lstat_of(src / "data").st_mtim.tv_nsec);
+    }
+
+    fs::remove_all(root);
+}
+
+TEST_CASE("throws when destination exists") {
+    auto root = make_temp_dir();
+    fs::create_directories(root / "src");
+    fs::create_directories(root / "dst");
+    CHECK_THROWS_AS(lumper::copy_layer_tree(root / "src", root / "dst",
+                                            lumper::overlay_xattrs::keep),
+                    fs::filesystem_error);
+    fs::remove_all(root);
+}
+
+TEST_CASE("copy layer tree on pool") {
+    auto root = make_temp_dir();
+    auto src = root / "src";
+    auto dst = root / "dst";
+    for (int i = 0; i < 64; ++i) {
+        auto dir = src / fmt::format("dir{}", i % 4);
+        fs::create_directories(dir);
+        base::write_to_file(dir / fmt::format("file{}", i), std::string(4096, 'a' + i % 26));
+    }
+    fs::create_hard_link(src / "dir1" / "file1", src / "dir2" / "file1-link");
+    REQUIRE_EQ(::mknod((src / "deleted").c_str(), S_IFCHR | 0600, ::makedev(0, 0)), 0);
+    REQUIRE_EQ(::lsetxattr((src / "dir3").c_str(), "trusted.overlay.opaque", "y", 1, 0), 0);
+
+    base::thread_pool pool(4);
+    auto stats = lumper::copy_layer_tree(src, dst, lumper::overlay_xattrs::keep, pool);
+
+    CHECK_EQ(stats.files, 64);
+    CHECK_EQ(stats.whiteouts, 1);
+    for (int i = 0; i < 64; ++i) {
+        auto file = fs::path(fmt::format("dir{}", i % 4)) / fmt::format("file{}", i);
+        CHECK_EQ(base::read_file_to_string(dst / file), std::string(4096, 'a' + i % 26));
+        CHECK_EQ(lstat_of(dst / file).st_mtim.tv_nsec, lstat_of(src / file).st_mtim.tv_nsec);
+    }
+    CHECK_EQ(lstat_of(dst / "dir1" / "file1").st_ino, lstat_of(dst / "dir2" / "file1-link").st_ino);
+    CHECK_EQ(lstat_of(dst / "deleted").st_rdev, ::makedev(0, 0));
+    char value = 0;
+    CHECK_EQ(::lgetxattr((dst / "dir3").c_str(), "trusted.overlay.opaque", &value, 1), 1);
+
+    fs::remove_all(root);
+}
+
+TEST_CASE("squash layer trees") {
+    auto root = make_temp_dir();
+    auto top = root / "top";
+    auto mid = root / "mid";
+    auto bottom = root / "bottom";
+    auto dst = root / "dst";
+
+    fs::create_directories(bottom / "etc");
+    fs::create_directories(bottom / "lib" / "old");
+    fs::create_directories(bottom / "cache");
+    base::write_to_file(bottom / "etc" / "os-release", "v1");
+    base::write_to_file(bottom / "etc" / "passwd", "root");
+    base::write_to_file(bottom / "lib" / "old" / "libfoo.so", "foo");
+    base::write_to_file(bottom / "cache" / "stale", "stale");
+
+    fs::create_directories(mid / "etc");
+    fs::create_directories(mid / "cache");
+    base::write_to_file(mid / "etc" / "os-release", "v2");
+    base::write_to_file(mid / "cache" / "fresh", "fresh");
+    // Contents of the directory in lower layers are hidden.
+    REQUIRE_EQ(::setxattr((mid / "cache").c_str(), "trusted.overlay.opaque", "y", 1, 0), 0);
+
+    fs::create_directories(top / "lib");
+    base::write_to_file(top / "app", "app");
+    // Whiteout of the directory hides its whole tree.
+    REQUIRE_EQ(::mknod((top / "lib" / "old").c_str(), S_IFCHR, ::makedev(0, 0)), 0);
+    // Whiteouts of nothing are dropped all the same.
+    REQUIRE_EQ(::mknod((top / "etc-gone").c_str(), S_IFCHR, ::makedev(0, 0)), 0);
+
+    auto stats = lumper::squash_layer_trees({top, mid, bottom}, dst, false);
+
+    CHECK_EQ(base::read_file_to_string(dst / "app"), "app");
+    CHECK_EQ(base::read_file_to_string(dst / "etc" / "os-release"), "v2");
+    CHECK_EQ(base::read_file_to_string(dst / "etc" / "passwd"), "root");
+    CHECK(fs::is_directory(dst / "lib"));
+    CHECK_FALSE(fs::exists(fs::symlink_status(dst / "lib" / "old")));
+    CHECK_FALSE(fs::exists(fs::symlink_status(dst / "etc-gone")));
+    CHECK(fs::exists(dst / "cache" / "fresh"));
+    CHECK_FALSE(fs::exists(dst / "cache" / "stale"));
+    CHECK_EQ(stats.files, 4);
+    CHECK_EQ(stats.whiteouts, 0);
+
+    // Files share inodes with layers, which are on the same filesystem here.
+    CHECK_EQ(stats.hardlinked_files, 4);
+    CHECK_EQ(lstat_of(dst / "etc" / "passwd").st_ino, lstat_of(bottom / "etc" / "passwd").st_ino);
+
+    SUBCASE("whiteouts are kept if stacked on other layers") {
+        auto stacked = root / "stacked";
+        auto stacked_stats = lumper::squash_layer_trees({top, mid}, stacked, true);
+        CHECK_EQ(stacked_stats.whiteouts, 2);
+        CHECK(S_ISCHR(lstat_of(stacked / "lib" / "old").st_mode));
+    }
+
+    fs::remove_all(root);
+}
+
+TEST_SUITE_END();
+
+} // namespace
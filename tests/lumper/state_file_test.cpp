@@ -0,0 +1,95 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "doctest/doctest.h"
+
+#include <chrono>
+#include <filesystem>
+#include <iterator>
+#include <stdexcept>
+
+#include <fcntl.h>
+
+#include "esl/unique_handle.h"
+#include "fmt/format.h"
+
+#include "base/file_util.h"
+#include "lumper/state_file.h"
+
+namespace {
+
+namespace fs = std::filesystem;
+
+fs::path make_temp_dir() {
+    auto ts = std::chrono::system_clock::now().time_since_epoch().count();
+    auto dir = fs::path(fmt::format("/tmp/test_state_file_{}", ts));
+    fs::create_directories(dir);
+    return dir;
+}
+
+TEST_SUITE_BEGIN("state_file");
+
+TEST_CASE("parse state durability") {
+    CHECK_EQ(lumper::parse_state_durability("none"), lumper::state_durability::none);
+    CHECK_EQ(lumper::parse_state_durability("sync"), lumper::state_durability::sync);
+    CHECK_EQ(lumper::parse_state_durability("batch"), lumper::state_durability::batch);
+    CHECK_THROWS_AS(lumper::parse_state_durability("fsync"), std::invalid_argument);
+}
+
+TEST_CASE("write state files") {
+    auto durability = lumper::state_durability::none;
+    SUBCASE("durability none") {}
+    SUBCASE("durability sync") {
+        durability = lumper::state_durability::sync;
+    }
+    CAPTURE(static_cast<int>(durability));
+
+    auto previous = lumper::get_state_durability();
+    lumper::set_state_durability(durability);
+    auto dir = make_temp_dir();
+
+    auto path = dir / "config.json";
+    base::write_to_file(path, "old content which is longer");
+    lumper::write_state_file(path, "new");
+    CHECK_EQ(base::read_file_to_string(path), "new");
+
+    lumper::write_state_files({{dir / "a", "1"}, {dir / "b", "2"}});
+    CHECK_EQ(base::read_file_to_string(dir / "a"), "1");
+    CHECK_EQ(base::read_file_to_string(dir / "b"), "2");
+    // No temp file is left.
+    CHECK_EQ(std::distance(fs::directory_iterator(dir), fs::directory_iterator()), 3);
+
+    CHECK_THROWS_AS(lumper::write_state_file(dir / "no" / "such", "x"), fs::filesystem_error);
+
+    lumper::set_state_durability(previous);
+    fs::remove_all(dir);
+}
+
+TEST_CASE("write state files relative to a directory") {
+    auto durability = lumper::state_durability::none;
+    SUBCASE("durability none") {}
+    SUBCASE("durability sync") {
+        durability = lumper::state_durability::sync;
+    }
+    CAPTURE(static_cast<int>(durability));
+
+    auto previous = lumper::get_state_durability();
+    lumper::set_state_durability(durability);
+    auto dir = make_temp_dir();
+    fs::create_directory(dir / "sub");
+    esl::unique_fd dirfd(::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    REQUIRE(static_cast<bool>(dirfd));
+
+    lumper::write_state_files({{"a", "1", dirfd.get()}, {"sub/b", "2", dirfd.get()}});
+    CHECK_EQ(base::read_file_to_string(dir / "a"), "1");
+    CHECK_EQ(base::read_file_to_string(dir / "sub" / "b"), "2");
+    CHECK_EQ(std::distance(fs::directory_iterator(dir / "sub"), fs::directory_iterator()), 1);
+
+    lumper::set_state_durability(previous);
+    fs::remove_all(dir);
+}
+
+TEST_SUITE_END;
+
+} // namespace
@@ -0,0 +1,106 @@
+//
+// Kingsley Chen <kingsamchen at gmail dot com>
+//
+
+#include "doctest/doctest.h"
+
+#include <chrono>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "fmt/format.h"
+
+#include "lumper/container_info.h"
+#include "lumper/state_file.h"
+#include "lumper/state_index.h"
+
+namespace {
+
+namespace fs = std::filesystem;
+
+fs::path make_temp_dir() {
+    auto ts = std::chrono::system_clock::now().time_since_epoch().count();
+    auto dir = fs::path(fmt::format("/tmp/test_state_index_{}", ts));
+    fs::create_directories(dir);
+    return dir;
+}
+
+lumper::container_info make_info(std::string_view id) {
+    lumper::container_info info{};
+    info.id = id;
+    info.image = "alpine";
+    info.command = "/bin/sh";
+    info.status = lumper::k_container_status_stopped;
+    return info;
+}
+
+std::vector<lumper::container_info> make_infos(const std::vector<std::string>& ids) {
+    std::vector<lumper::container_info> infos;
+    for (const auto& id : ids) {
+        infos.push_back(make_info(id));
+    }
+    return infos;
+}
+
+TEST_SUITE_BEGIN("state_index");
+
+TEST_CASE("resolve container-id prefixes") {
+    auto previous_durability = lumper::get_state_durability();
+    lumper::set_state_durability(lumper::state_durability::none);
+    auto dir = make_temp_dir();
+    auto previous_dir = lumper::relocate_state_index(dir);
+
+    SUBCASE("ids in appended records") {}
+    SUBCASE("ids in the snapshot") {
+        // Appending beyond 1024 records folds them into a snapshot, the next append included.
+        std::vector<std::string> fillers;
+        for (int i = 0; i < 1100; ++i) {
+            fillers.push_back(fmt::format("f{:04}", i));
+        }
+        lumper::index_container_infos(make_infos(fillers));
+    }
+
+    lumper::index_container_infos(make_infos({"3f5e", "3f6a", "3f6b", "3f6bc", "77d0"}));
+
+    SUBCASE("unique prefix") {
+        CHECK_EQ(lumper::resolve_container_id("3f5"), "3f5e");
+        CHECK_EQ(lumper::resolve_container_id("7"), "77d0");
+        CHECK_EQ(lumper::resolve_container_id("3f6a"), "3f6a");
+    }
+
+    SUBCASE("ambiguous prefix") {
+        CHECK_THROWS_AS(lumper::resolve_container_id("3f"), std::invalid_argument);
+        CHECK_THROWS_AS(lumper::resolve_container_id("3f6"), std::invalid_argument);
+    }
+
+    SUBCASE("exact match shadows longer ids") {
+        CHECK_EQ(lumper::resolve_container_id("3f6b"), "3f6b");
+        CHECK_EQ(lumper::resolve_container_id("3f6bc"), "3f6bc");
+        CHECK(lumper::is_container_indexed("3f6b"));
+        CHECK_FALSE(lumper::is_container_indexed("3f6"));
+    }
+
+    SUBCASE("no match") {
+        CHECK_THROWS_AS(lumper::resolve_container_id("9"), std::invalid_argument);
+        CHECK_THROWS_AS(lumper::resolve_container_id("3f5ee"), std::invalid_argument);
+        CHECK_THROWS_AS(lumper::resolve_container_id(""), std::invalid_argument);
+
+        // Removed ones no longer match.
+        lumper::unindex_container("77d0");
+        CHECK_THROWS_AS(lumper::resolve_container_id("7"), std::invalid_argument);
+        lumper::unindex_container("3f6bc");
+        CHECK_EQ(lumper::resolve_container_id("3f6b"), "3f6b");
+        CHECK_FALSE(lumper::is_container_indexed("3f6bc"));
+    }
+
+    lumper::relocate_state_index(previous_dir);
+    lumper::set_state_durability(previous_durability);
+    fs::remove_all(dir);
+}
+
+TEST_SUITE_END();
+
+} // namespace